@@ -5,6 +5,9 @@
 
 #define NTIMERS 25
 
+/** How much of a frame readnodes reads at a time. */
+#define READNODES_CHUNK 4096
+
 /* readn - read exactly n bytes */
 int readn(int fd, char *bp, size_t len)
 {
@@ -68,22 +71,50 @@ bstring readframe(int fd)
 
 Node *readnodes(int fd, Node **header)
 {
+  u_int16_t reclen = 0;
+  char chunk[READNODES_CHUNK];
+  size_t want = 0, used = 0;
+  int rc = 0;
   Node *body = NULL;
-  *header = NULL;
-  size_t from = 0;
-  
+  Node *doc = NULL;
+  StackishStream *stream = StackishStream_create(0);
+
   assert_mem(header);
   assert(fd >= 0 && "invalid socket");
+  *header = NULL;
 
-  bstring data = readframe(fd);
-  check(data, "failed to read framing record");
+  rc = readn(fd, (char *)&reclen, sizeof(reclen));
+  check(rc == sizeof(reclen), "failed to read record length");
+  reclen = ntohs(reclen);
+
+  // parse the frame as it comes in rather than reading it all first
+  while(reclen > 0) {
+    want = reclen < sizeof(chunk) ? reclen : sizeof(chunk);
+    rc = readn(fd, chunk, want);
+    check(rc == (int)want, "invalid record length from listener");
+    reclen -= want;
+
+    for(used = 0; used < want; ) {
+      used += StackishStream_feed(stream, chunk + used, want - used);
+      check(!StackishStream_has_error(stream), "invalid stackish in frame");
+
+      if((doc = StackishStream_take(stream)) != NULL) {
+        check_then(body == NULL, "too many nodes in frame", Node_destroy(doc));
+        if(*header == NULL) *header = doc; else body = doc;
+      }
+    }
+  }
+
+  // a last word right at the end of the frame is only done once we know it's the end
+  if(StackishStream_finish(stream) == 1) {
+    doc = StackishStream_take(stream);
+    check_then(body == NULL, "too many nodes in frame", Node_destroy(doc));
+    if(*header == NULL) *header = doc; else body = doc;
+  }
 
-  *header = Node_parse_seq(data, &from);
   check(*header, "failed to read header node");
 
-  body = Node_parse_seq(data, &from);
-  
-  ensure(bdestroy(data); return body);
+  ensure(StackishStream_destroy(stream); return body);
 }
 
 
@@ -22,6 +22,7 @@
 #include <sys/un.h>
 #include "../protocol/crypto.h"
 #include "../stackish/node.h"
+#include "../stackish/stream.h"
 #include <unistd.h>
 #include <sys/stat.h>
 #include <sys/time.h>
@@ -43,6 +44,9 @@ int readn(int fd, char *bp, size_t len);
 bstring readframe(int fd);
 
 /** 
+ * The frame is parsed with a StackishStream as it's read, so the whole
+ * frame is never in memory at once.
+ *
  * @brief Reads the header and body nodes from the fd as a frame.
  * @param fd : valid filedescriptor to read from.
  * @param header : OUT parameter that will have the header.
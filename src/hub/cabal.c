@@ -0,0 +1,200 @@
+/*
+ * Utu -- Saving The Internet With Hate
+ *
+ * Copyright (c) Zed A. Shaw 2005 (zedshaw@zedshaw.com)
+ *
+ * This file is modifiable/redistributable under the terms of the GNU
+ * General Public License.
+ *
+ * You should have recieved a copy of the GNU General Public License along
+ * with this program; see the file COPYING. If not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 0211-1307, USA.
+ */
+
+#include "hub/cabal.h"
+
+int Cabal_name_compare(Heap *heap, void *x, void *y)
+{
+  return bstrcmp(((Cabal *)x)->name, ((Cabal *)y)->name);
+}
+
+int Cabal_roster_compare(Heap *heap, void *x, void *y)
+{
+  return bstrcmp((bstring)x, (bstring)y);
+}
+
+Heap *Cabal_create_map()
+{
+  return Heap_create(Cabal_name_compare);
+}
+
+void Cabal_destroy_map(Heap *cabals)
+{
+  assert_not(cabals, NULL);
+
+  HEAP_ITERATE(cabals, i, Cabal *, cabal, Cabal_destroy(cabal));
+  Heap_destroy(cabals);
+}
+
+Cabal *Cabal_create(bstring name, bstring owner)
+{
+  assert_not(name, NULL);
+
+  Cabal *cabal = calloc(1, sizeof(Cabal));
+  assert_mem(cabal);
+
+  cabal->name = name;
+  cabal->owner = owner ? bstrcpy(owner) : NULL;
+  cabal->roster = Heap_create(Cabal_roster_compare);
+  cabal->invited = Heap_create(Cabal_roster_compare);
+  cabal->members = Heap_create(NULL);
+
+  return cabal;
+}
+
+void Cabal_destroy(Cabal *cabal)
+{
+  assert_not(cabal, NULL);
+
+  HEAP_ITERATE(cabal->members, i, Member *, member, Heap_delete(member->cabals, cabal));
+  HEAP_ITERATE(cabal->roster, i, bstring, fingerprint, bdestroy(fingerprint));
+  HEAP_ITERATE(cabal->invited, i, bstring, fingerprint, bdestroy(fingerprint));
+
+  Heap_destroy(cabal->members);
+  Heap_destroy(cabal->roster);
+  Heap_destroy(cabal->invited);
+  bdestroy(cabal->owner);
+  bdestroy(cabal->name);
+  free(cabal);
+}
+
+Cabal *Cabal_find(Heap *cabals, bstring name)
+{
+  Cabal temp = {.name = name};
+  size_t i = 0;
+
+  assert_not(cabals, NULL);
+  assert_not(name, NULL);
+
+  i = Heap_find(cabals, &temp);
+
+  return Heap_valid(cabals, i) ? Heap_elem(cabals, Cabal *, i) : NULL;
+}
+
+/** Removes the fingerprint from one of the fingerprint Heaps, returning 1 if it was there. */
+static int Cabal_remove_fingerprint(Heap *fingerprints, bstring fingerprint)
+{
+  size_t i = Heap_find(fingerprints, fingerprint);
+  bstring found = NULL;
+
+  if(Heap_valid(fingerprints, i)) {
+    found = Heap_elem(fingerprints, bstring, i);
+    Heap_delete(fingerprints, found);
+    bdestroy(found);
+    return 1;
+  } else {
+    return 0;
+  }
+}
+
+int Cabal_is_owner(Cabal *cabal, bstring fingerprint)
+{
+  assert_not(cabal, NULL);
+  assert_not(fingerprint, NULL);
+
+  return cabal->owner != NULL && biseq(cabal->owner, fingerprint) == 1;
+}
+
+int Cabal_is_enrolled(Cabal *cabal, bstring fingerprint)
+{
+  assert_not(cabal, NULL);
+  assert_not(fingerprint, NULL);
+
+  return Heap_valid(cabal->roster, Heap_find(cabal->roster, fingerprint));
+}
+
+int Cabal_invite(Cabal *cabal, bstring fingerprint)
+{
+  if(Cabal_may_join(cabal, fingerprint)) {
+    return 0;
+  }
+
+  Heap_add(cabal->invited, bstrcpy(fingerprint));
+  return 1;
+}
+
+int Cabal_may_join(Cabal *cabal, bstring fingerprint)
+{
+  return Cabal_is_owner(cabal, fingerprint) 
+    || Cabal_is_enrolled(cabal, fingerprint)
+    || Heap_valid(cabal->invited, Heap_find(cabal->invited, fingerprint));
+}
+
+int Cabal_enroll(Cabal *cabal, bstring fingerprint)
+{
+  if(Cabal_is_enrolled(cabal, fingerprint)) {
+    return 0;
+  }
+
+  Cabal_remove_fingerprint(cabal->invited, fingerprint);
+  Heap_add(cabal->roster, bstrcpy(fingerprint));
+  return 1;
+}
+
+int Cabal_expel(Cabal *cabal, bstring fingerprint)
+{
+  assert_not(cabal, NULL);
+  assert_not(fingerprint, NULL);
+
+  return Cabal_remove_fingerprint(cabal->roster, fingerprint);
+}
+
+void Cabal_bind(Cabal *cabal, Member *member)
+{
+  assert_not(cabal, NULL);
+  assert_not(member, NULL);
+
+  if(!Heap_valid(cabal->members, Heap_find(cabal->members, member))) {
+    Heap_add(cabal->members, member);
+    Heap_add(member->cabals, cabal);
+  }
+}
+
+void Cabal_unbind(Cabal *cabal, Member *member)
+{
+  assert_not(cabal, NULL);
+  assert_not(member, NULL);
+
+  Heap_delete(cabal->members, member);
+  Heap_delete(member->cabals, cabal);
+}
+
+void Cabal_bind_member(Heap *cabals, Member *member)
+{
+  assert_not(cabals, NULL);
+  assert_not(member, NULL);
+
+  HEAP_ITERATE(cabals, i, Cabal *, cabal,
+      if(Cabal_is_enrolled(cabal, member->fingerprint)) Cabal_bind(cabal, member));
+}
+
+void Cabal_unbind_all(Member *member)
+{
+  assert_not(member, NULL);
+
+  HEAP_ITERATE(member->cabals, i, Cabal *, cabal, Heap_delete(cabal->members, member));
+  Heap_clear(member->cabals);
+}
+
+size_t Cabal_deliver(Cabal *cabal, Message *msg)
+{
+  size_t count = 0;
+
+  assert_not(cabal, NULL);
+  assert_not(msg, NULL);
+
+  HEAP_ITERATE(cabal->members, i, Member *, member,
+      if(Member_send_msg(member, msg)) count++);
+
+  return count;
+}
@@ -0,0 +1,185 @@
+#ifndef utu_hub_cabal_h
+#define utu_hub_cabal_h
+
+/*
+ * Utu -- Saving The Internet With Hate
+ *
+ * Copyright (c) Zed A. Shaw 2005 (zedshaw@zedshaw.com)
+ *
+ * This file is modifiable/redistributable under the terms of the GNU
+ * General Public License.
+ *
+ * You should have recieved a copy of the GNU General Public License along
+ * with this program; see the file COPYING. If not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 0211-1307, USA.
+ */
+
+#include "hub/member.h"
+#include "hub/heap.h"
+
+/**
+ * A Cabal is a fixed group of members that all get the same messages.
+ * You could do this with a route that everyone registers for, but then
+ * every member needs a registration and every send walks the routing
+ * tree.  A Cabal instead keeps two things:
+ *
+ * - roster -- The key fingerprints of everyone in the cabal, whether
+ *   they are logged in or not.  This is what gets persisted.
+ * - members -- A dense Heap of the Members from the roster that are
+ *   currently logged in.  This is what a send walks.
+ *
+ * Members get bound into the members Heap when they login (see
+ * Cabal_bind_member) and unbound when they are logged out (see
+ * Cabal_unbind_all), so sending is a single lookup for the cabal and
+ * then a straight run down the array.  Detached members stay bound so
+ * their messages queue up for when they resume.
+ *
+ * Nobody gets on the roster without asking the owner, the member who
+ * made the cabal.  The owner can always join, and everyone else has to
+ * be put on the invited list first with Cabal_invite.  Invites aren't
+ * persisted, so they're gone if the hub restarts before they join.
+ */
+typedef struct Cabal {
+  bstring name;
+
+  /** Fingerprint of the member who made it, NULL if nobody owns it. */
+  bstring owner;
+
+  Heap *roster;
+  Heap *invited;
+  Heap *members;
+} Cabal;
+
+
+/**
+ * @brief Creates a Heap of Cabals sorted by name for Cabal_find.
+ * @return Heap * : The new empty cabal map.
+ */
+Heap *Cabal_create_map();
+
+/**
+ * @brief Destroys all the cabals and the map.
+ * @param cabals : Map from Cabal_create_map.
+ */
+void Cabal_destroy_map(Heap *cabals);
+
+/**
+ * @brief Creates a new empty cabal, not in any map.
+ * @param name : Cabal's name, which it now owns.
+ * @param owner : Fingerprint of the owner, copied, or NULL for none.
+ * @return Cabal * : The new cabal.
+ */
+Cabal *Cabal_create(bstring name, bstring owner);
+
+/**
+ * @brief Destroys the cabal, unbinding any members still in it.
+ * @param cabal : Cabal to destroy.
+ */
+void Cabal_destroy(Cabal *cabal);
+
+/**
+ * @brief Finds a cabal by name.
+ * @param cabals : Map to search.
+ * @param name : Name to look for.
+ * @return Cabal * : The cabal or NULL.
+ */
+Cabal *Cabal_find(Heap *cabals, bstring name);
+
+/**
+ * Puts the fingerprint on the cabal's roster, using up their invite
+ * if they had one.  This doesn't bind any Member, so if they are
+ * online you'll want Cabal_bind too.
+ *
+ * @brief Adds a fingerprint to the roster.
+ * @param cabal : Cabal to enroll in.
+ * @param fingerprint : Member's key fingerprint, copied.
+ * @return int : 1 if added, 0 if they were already on it.
+ */
+int Cabal_enroll(Cabal *cabal, bstring fingerprint);
+
+/**
+ * @brief Takes the fingerprint off the roster.
+ * @param cabal : Cabal to remove from.
+ * @param fingerprint : Member's key fingerprint.
+ * @return int : 1 if removed, 0 if they weren't on it.
+ */
+int Cabal_expel(Cabal *cabal, bstring fingerprint);
+
+/**
+ * @brief Tells you if the fingerprint is the cabal's owner.
+ * @param cabal : Cabal to check.
+ * @param fingerprint : Member's key fingerprint.
+ * @return int : 1 if they own it, 0 if not.
+ */
+int Cabal_is_owner(Cabal *cabal, bstring fingerprint);
+
+/**
+ * Lets the fingerprint join the cabal.  Only the owner should be
+ * doing this, so check with Cabal_is_owner first.
+ *
+ * @brief Puts the fingerprint on the invited list.
+ * @param cabal : Cabal to invite to.
+ * @param fingerprint : Member's key fingerprint, copied.
+ * @return int : 1 if invited, 0 if they already were or are enrolled.
+ */
+int Cabal_invite(Cabal *cabal, bstring fingerprint);
+
+/**
+ * @brief Tells you if the fingerprint is allowed to join.
+ * @param cabal : Cabal to check.
+ * @param fingerprint : Member's key fingerprint.
+ * @return int : 1 if they own it, are enrolled, or were invited.
+ */
+int Cabal_may_join(Cabal *cabal, bstring fingerprint);
+
+/**
+ * @brief Tells you if the fingerprint is on the roster.
+ * @param cabal : Cabal to check.
+ * @param fingerprint : Member's key fingerprint.
+ * @return int : 1 if they are, 0 if not.
+ */
+int Cabal_is_enrolled(Cabal *cabal, bstring fingerprint);
+
+/**
+ * @brief Adds a logged in member to the cabal's recipients.
+ * @param cabal : Cabal to bind into.
+ * @param member : Member to bind, it's fine if they already are.
+ */
+void Cabal_bind(Cabal *cabal, Member *member);
+
+/**
+ * @brief Removes the member from the cabal's recipients.
+ * @param cabal : Cabal to unbind from.
+ * @param member : Member to unbind.
+ */
+void Cabal_unbind(Cabal *cabal, Member *member);
+
+/**
+ * Called when a member logs in to bind them into every cabal that
+ * has them on the roster.  Logins are rare compared to sends, so this
+ * just does a search on each cabal's roster.
+ *
+ * @brief Binds the member into all their cabals.
+ * @param cabals : Map of all the cabals.
+ * @param member : Member who just logged in.
+ */
+void Cabal_bind_member(Heap *cabals, Member *member);
+
+/**
+ * @brief Unbinds the member from every cabal they are in, used at logout.
+ * @param member : Member being logged out.
+ */
+void Cabal_unbind_all(Member *member);
+
+/**
+ * Puts the message on the queue of everyone bound in the cabal.  Unlike
+ * Route_deliver one full queue doesn't stop the rest from getting it.
+ *
+ * @brief Delivers the message to the cabal.
+ * @param cabal : Cabal to deliver to.
+ * @param msg : Message to deliver.
+ * @return size_t : How many members it was queued for.
+ */
+size_t Cabal_deliver(Cabal *cabal, Message *msg);
+
+#endif
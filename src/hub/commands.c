@@ -1,5 +1,23 @@
 #include "commands.h"
 #include "info.h"
+#include "stackish/writer.h"
+#include "stackish/query.h"
+
+/** 
+ * @function send_msg
+ * @brief Puts a message the hub just made in the member's queue, or frees it if that fails.
+ * @param member : Who to deliver to.
+ * @param msg : New message nobody has a reference to yet.
+ */
+static inline void send_msg(Member *member, Message *msg)
+{
+  if(!Member_send_msg(member, msg)) {
+    // full, sampled out, or evicted, and no queue took a reference so it's still ours
+    log(WARN, "Response to member %s dropped.", bdata(Member_name(member)));
+    Message_ref_inc(msg);
+    Message_destroy(msg);
+  }
+}
 
 /** 
  * @function send_response
@@ -13,8 +31,47 @@ inline void send_response(Member *member, Node *response, const char *type)
   // deliver message to whoever this is from
   Node *hdr = NULL;
   Node *body = Message_cons(&hdr, 0, response, type);
-  Message *msg = Message_alloc(hdr, body);
-  Member_send_msg(member, msg);
+  send_msg(member, Message_alloc(hdr, body));
+}
+
+/** 
+ * @function response_start
+ * @brief Starts writing a response body straight to bytes, with the groups send_response would make open.
+ * @param out : The writer to start.
+ * @return bstring : The body the writer fills, give it to send_written.
+ */
+static inline bstring response_start(StackishWriter *out)
+{
+  bstring body = bfromcstralloc(256, "");
+  assert_mem(body);
+
+  StackishWriter_start(out, StackishSink_bstr(body));
+  StackishWriter_group(out);
+  StackishWriter_group(out);
+
+  return body;
+}
+
+/** 
+ * @function send_written
+ * @brief Closes a response started with response_start and puts it in the member's queue.
+ * @param member : Who to deliver to.
+ * @param out : The writer, with just the response's word left to write.
+ * @param word : The response's word (members, children, etc.)
+ * @param body : What response_start gave back, owned by the message after this.
+ * @param type : The final root type (rpy or err)
+ */
+static inline void send_written(Member *member, StackishWriter *out, const char *word, bstring body, const char *type)
+{
+  StackishWriter_word(out, word);
+  StackishWriter_word(out, type);
+  check(StackishWriter_finish(out), "Failed to write the response.");
+
+  dbg("Response: %s", bdata(body));
+  send_msg(member, Message_alloc_raw(Message_cons_header(0), body));
+  return;
+
+  on_fail(bdestroy(body));
 }
 
 /** 
@@ -25,9 +82,10 @@ inline void send_response(Member *member, Node *response, const char *type)
  */
 inline Node *extract_message(Message *message)
 {
-  Node *msg = message->data->child;
+  static NodeQuery *MESSAGE = NULL;
 
-  return msg ? msg->child : NULL;
+  // anchored, since the message is always the first child's first child and never a later one
+  return NodeQuery_anchored(NodeQuery_once(MESSAGE, "*/*/*"), message->data);
 }
 
 
@@ -46,19 +104,21 @@ static int Hub_route_members_cb(struct ConnectionState *conn, Member *from, Node
 {
   trace();
   Route *target = Route_find(conn->hub->routes, message);
-  Node *response = Node_cons("[b@w", Node_bstr(message, ' '), "@path", "members");
+  StackishWriter out;
+  bstring body = response_start(&out);
+
+  StackishWriter_node_blob(&out, message, ' ');
+  StackishWriter_attr(&out, "@path");
 
   if(target) {
-    // construct response nodes
+    // written straight out, the member names are never copied into nodes
     HEAP_ITERATE(target->members, indx, Member *, member, 
-        Node_new_string(response, bstrcpy(Member_name(member))));
+        StackishWriter_string(&out, (const char *)bdata(Member_name(member)), blength(Member_name(member))));
   } else {
-    Node_new_string(response, bfromcstr("Requested route does not exist."));
+    StackishWriter_cstr(&out, "Requested route does not exist.");
   }
-  
-  Node_dump(response, ' ', 1);
 
-  send_response(from, response, target ? "rpy" : "err");
+  send_written(from, &out, "members", body, target ? "rpy" : "err");
 
   return 1;
 }
@@ -67,15 +127,18 @@ static int Hub_route_children_cb(struct ConnectionState *conn, Member *from, Nod
 {
   trace();
   Route *target = Route_find(conn->hub->routes, message);
-  Node *response = Node_cons("[b@w", Node_bstr(message, ' '), "@path", "children");
+  StackishWriter out;
+  bstring body = response_start(&out);
+
+  StackishWriter_node_blob(&out, message, ' ');
+  StackishWriter_attr(&out, "@path");
 
   if(target) {
     HEAP_ITERATE(target->children, indx, Route *, route,
-        Node_new_string(response, bstrcpy(route->name)));
+        StackishWriter_string(&out, (const char *)bdata(route->name), blength(route->name)));
   }
 
-  Node_dump(response, ' ', 1);
-  send_response(from, response, "rpy");
+  send_written(from, &out, "children", body, "rpy");
 
   return 1;
 }
@@ -114,16 +177,227 @@ static int Hub_member_mendicate_cb(struct ConnectionState *conn, Member *from, N
   return 1;
 }
 
+/** 
+ * @function has_from
+ * @brief Tells you if the sender already put a "@from" in the group, which only the hub gets to add.
+ * @param group : Group the hub adds its "@from" to.
+ * @return int : 1 if there's one in there.
+ */
+static inline int has_from(Node *group)
+{
+  static NodeQuery *FROM = NULL;
+
+  return NodeQuery_first(NodeQuery_once(FROM, "*/@from"), group) != NULL;
+}
+
+/** 
+ * Direct member to member delivery that doesn't go through the routing
+ * tree.  The message names the recipient by key fingerprint and carries
+ * whatever payload node comes before it:
+ *
+ *   [ [ [ "hi" text "bf27-3806-..." @to send member msg
+ *
+ * The recipient is found in the hub's MemberIndex and gets the original
+ * message with the sender's fingerprint added as a "@from" string.  A
+ * message that already has a "@from" isn't sent, so nobody can claim
+ * to be someone else.
+ */
 static int Hub_member_send_cb(struct ConnectionState *conn,  Member *from, Node *message)
 {
   trace();
-  Node *response = Node_cons("[w", "sent");
+  bstring to = NULL;
+  Node *payload = NULL;
+  Member *recipient = NULL;
+  Node *response = NULL;
+  int sent = 0;
 
-  Node_dump(message, ' ', 1);
+  check(Node_decons(message, 0, "@sG", "@to", &to, &payload), "Invalid member send, needs a @to fingerprint and a payload.");
 
-  send_response(from, response, "rpy");
+  recipient = MemberIndex_find(conn->hub->index, to);
+
+  if(has_from(message->parent)) {
+    response = Node_cons("[s@s@w", bstrcpy(to), "@to", bfromcstr("Only the hub sets @from."), "@error", "unsent");
+  } else if(recipient) {
+    Message_changed(conn->recv.msg);
+    Node_name(Node_new_string(message->parent, bstrcpy(from->fingerprint)), bfromcstr("@from"));
+
+    sent = Member_send_msg(recipient, conn->recv.msg);
+
+    if(sent) {
+      response = Node_cons("[s@w", bstrcpy(to), "@to", "sent");
+    } else {
+      response = Node_cons("[s@s@w", bstrcpy(to), "@to", bfromcstr("Recipient's queue is full."), "@error", "unsent");
+    }
+  } else {
+    response = Node_cons("[s@s@w", bstrcpy(to), "@to", bfromcstr("No such member."), "@error", "unsent");
+  }
+
+  send_response(from, response, sent ? "rpy" : "err");
+
+  return 1;
+  on_fail(return 0);
+}
+
+/** 
+ * @function cabal_error
+ * @brief Replies with an err about the named cabal.
+ * @param member : Who to deliver to.
+ * @param name : Cabal name the request was for.
+ * @param error : Error message.
+ */
+inline void cabal_error(Member *member, bstring name, const char *error)
+{
+  send_response(member, Node_cons("[s@s@w", bstrcpy(name), "@name", 
+        bfromcstr(error), "@error", "cabal"), "err");
+}
+
+/** 
+ * Makes a new cabal owned by whoever asked for it.  The owner still
+ * has to join like anyone else, but they don't need an invite.
+ */
+static int Hub_cabal_create_cb(struct ConnectionState *conn, Member *from, Node *message)
+{
+  trace();
+  bstring name = NULL;
+  Cabal *cabal = NULL;
+
+  check(Node_decons(message, 0, "[sw", &name, "name"), "Invalid cabal create, needs a name.");
+  check(blength(name) > 0, "Zero length cabal name, killing client.");
+
+  if(Cabal_find(conn->hub->cabals, name)) {
+    cabal_error(from, name, "Cabal already exists.");
+    return 1;
+  }
+
+  cabal = Cabal_create(bstrcpy(name), from->fingerprint);
+  Heap_add(conn->hub->cabals, cabal);
+  if(conn->hub->store) Store_cabal_create(conn->hub->store, cabal);
+
+  send_response(from, Node_cons("[s@w", bstrcpy(name), "@name", "created"), "rpy");
 
   return 1;
+  on_fail(return 0);
+}
+
+/** 
+ * Lets the member named by fingerprint join a cabal, which only the
+ * cabal's owner can do:
+ *
+ *   [ "bf27-3806-..." @to [ "friends" name invite cabal msg
+ */
+static int Hub_cabal_invite_cb(struct ConnectionState *conn, Member *from, Node *message)
+{
+  trace();
+  bstring name = NULL;
+  bstring to = NULL;
+  Cabal *cabal = NULL;
+
+  check(Node_decons(message, 0, "[sw@s", &name, "name", "@to", &to), "Invalid cabal invite, needs a name and a @to fingerprint.");
+  cabal = Cabal_find(conn->hub->cabals, name);
+
+  if(cabal == NULL) {
+    cabal_error(from, name, "No such cabal.");
+  } else if(!Cabal_is_owner(cabal, from->fingerprint)) {
+    cabal_error(from, name, "Only the owner can invite to a cabal.");
+  } else {
+    Cabal_invite(cabal, to);
+    send_response(from, Node_cons("[s@s@w", bstrcpy(name), "@name", 
+          bstrcpy(to), "@to", "invited"), "rpy");
+  }
+
+  return 1;
+  on_fail(return 0);
+}
+
+static int Hub_cabal_join_cb(struct ConnectionState *conn, Member *from, Node *message)
+{
+  trace();
+  bstring name = NULL;
+  Cabal *cabal = NULL;
+
+  check(Node_decons(message, 0, "[sw", &name, "name"), "Invalid cabal join, needs a name.");
+  cabal = Cabal_find(conn->hub->cabals, name);
+
+  if(cabal == NULL) {
+    cabal_error(from, name, "No such cabal.");
+  } else if(!Cabal_may_join(cabal, from->fingerprint)) {
+    cabal_error(from, name, "You need an invite from the owner.");
+  } else {
+    if(Cabal_enroll(cabal, from->fingerprint) && conn->hub->store) {
+      Store_cabal_join(conn->hub->store, cabal, from);
+    }
+
+    Cabal_bind(cabal, from);
+    send_response(from, Node_cons("[s@n@w", bstrcpy(name), "@name", 
+          (uint64_t)Heap_count(cabal->roster), "@count", "joined"), "rpy");
+  }
+
+  return 1;
+  on_fail(return 0);
+}
+
+static int Hub_cabal_leave_cb(struct ConnectionState *conn, Member *from, Node *message)
+{
+  trace();
+  bstring name = NULL;
+  Cabal *cabal = NULL;
+
+  check(Node_decons(message, 0, "[sw", &name, "name"), "Invalid cabal leave, needs a name.");
+  cabal = Cabal_find(conn->hub->cabals, name);
+
+  if(cabal == NULL) {
+    cabal_error(from, name, "No such cabal.");
+  } else {
+    if(Cabal_expel(cabal, from->fingerprint) && conn->hub->store) {
+      Store_cabal_leave(conn->hub->store, cabal, from);
+    }
+
+    Cabal_unbind(cabal, from);
+    send_response(from, Node_cons("[s@w", bstrcpy(name), "@name", "left"), "rpy");
+  }
+
+  return 1;
+  on_fail(return 0);
+}
+
+/** 
+ * Multicast to everyone in a cabal.  The payload comes before the
+ * cabal's name and everyone bound in the cabal gets the original
+ * message with a "@from" fingerprint added:
+ *
+ *   [ [ [ "hi" text [ "friends" name send cabal msg
+ *
+ * Like member send, one that already has a "@from" is refused.
+ */
+static int Hub_cabal_send_cb(struct ConnectionState *conn, Member *from, Node *message)
+{
+  trace();
+  bstring name = NULL;
+  Node *payload = NULL;
+  Cabal *cabal = NULL;
+  size_t count = 0;
+
+  check(Node_decons(message, 0, "[swG", &name, "name", &payload), "Invalid cabal send, needs a name and a payload.");
+
+  cabal = Cabal_find(conn->hub->cabals, name);
+
+  if(cabal == NULL) {
+    cabal_error(from, name, "No such cabal.");
+  } else if(!Cabal_is_enrolled(cabal, from->fingerprint)) {
+    cabal_error(from, name, "Only members of a cabal can send to it.");
+  } else if(has_from(message->parent)) {
+    cabal_error(from, name, "Only the hub sets @from.");
+  } else {
+    Message_changed(conn->recv.msg);
+    Node_name(Node_new_string(message->parent, bstrcpy(from->fingerprint)), bfromcstr("@from"));
+    count = Cabal_deliver(cabal, conn->recv.msg);
+
+    send_response(from, Node_cons("[s@n@w", bstrcpy(name), "@name", 
+          (uint64_t)count, "@count", "sent"), "rpy");
+  }
+
+  return 1;
+  on_fail(return 0);
 }
 
 static int Hub_system_ping_cb(struct ConnectionState *conn, Member *from, Node *message)
@@ -139,6 +413,92 @@ static int Hub_system_ping_cb(struct ConnectionState *conn, Member *from, Node *
   on_fail(return 0);
 }
 
+/** 
+ * Replies with the counts of what's happened to slow members, and
+ * then a class group for each member class with how many times its
+ * members were throttled and how long they were paused.  Like ping it
+ * needs something in it, so send '[ [ 1 lag system'.
+ */
+static int Hub_system_lag_cb(struct ConnectionState *conn, Member *from, Node *message)
+{
+  trace();
+  Node *group = NULL;
+  Node *response = Node_cons("[n@n@n@n@n@w", 
+      Member_lag_counts.warned, "@warned",
+      Member_lag_counts.degraded, "@degraded",
+      Member_lag_counts.recovered, "@recovered",
+      Member_lag_counts.sampled_out, "@sampled_out",
+      Member_lag_counts.evicted, "@evicted",
+      "lag");
+
+  HEAP_ITERATE(conn->hub->classes, i, MemberClass *, mclass,
+      group = Node_new_group(response);
+      Node_new_string(group, bstrcpy(mclass->name));
+      Node_name(Node_new_number(group, mclass->throttled), bfromcstr("@throttled"));
+      Node_name(Node_new_number(group, mclass->paused_ms), bfromcstr("@paused_ms"));
+      Node_name(group, bfromcstr("class")));
+
+  send_response(from, response, "rpy");
+
+  return 1;
+}
+
+/** 
+ * Replies with the Message slab counts, send '[ [ 1 slab system'.
+ */
+static int Hub_system_slab_cb(struct ConnectionState *conn, Member *from, Node *message)
+{
+  trace();
+  SlabStats stats = Slab_stats();
+  Node *response = Node_cons("[n@n@n@n@n@w", 
+      stats.allocs, "@allocs",
+      stats.frees, "@frees",
+      stats.hits, "@hits",
+      stats.trimmed, "@trimmed",
+      stats.free_blocks, "@free_blocks",
+      "slab");
+
+  send_response(from, response, "rpy");
+
+  return 1;
+}
+
+/** 
+ * Replies with the latency of each message stage in nanoseconds, see
+ * trace.h.  Send '[ [ 1 trace system', or a 0 instead of 1 to also reset
+ * the histograms after reporting.
+ */
+static int Hub_system_trace_cb(struct ConnectionState *conn, Member *from, Node *message)
+{
+  trace();
+  TraceStage stage = 0;
+  const TraceHistogram *hist = NULL;
+  Node *response = Node_new_group(NULL);
+  Node *group = NULL;
+
+  for(stage = 0; stage < TRACE_STAGES; stage++) {
+    hist = Trace_histogram(stage);
+    group = Node_new_group(response);
+    Node_name(Node_new_number(group, hist->count), bfromcstr("@count"));
+    Node_name(Node_new_number(group, hist->count ? hist->total_ns / hist->count : 0), bfromcstr("@avg"));
+    Node_name(Node_new_number(group, TraceHistogram_percentile(hist, 50)), bfromcstr("@p50"));
+    Node_name(Node_new_number(group, TraceHistogram_percentile(hist, 99)), bfromcstr("@p99"));
+    Node_name(Node_new_number(group, hist->max_ns), bfromcstr("@max"));
+    Node_name(group, bfromcstr(Trace_stage_name(stage)));
+  }
+
+  Node_name(Node_new_number(response, Trace_sample_rate), bfromcstr("@sample_rate"));
+  Node_name(response, bfromcstr("trace"));
+
+  if(message->type == TYPE_NUMBER && message->value.number == 0) {
+    Trace_reset();
+  }
+
+  send_response(from, response, "rpy");
+
+  return 1;
+}
+
 static int Hub_info_generic(struct ConnectionState *conn, Node *message, Member *from, const char *operation, bstring (*info_op)(bstring path, bstring *error))
 {
   bstring info_name = NULL;
@@ -208,6 +568,13 @@ Registration registrations[] = {
   // member to member messaging
   {"send","member", Hub_member_send_cb },
 
+  // cabal multicast groups
+  {"create","cabal", Hub_cabal_create_cb },
+  {"invite","cabal", Hub_cabal_invite_cb },
+  {"join","cabal", Hub_cabal_join_cb },
+  {"leave","cabal", Hub_cabal_leave_cb },
+  {"send","cabal", Hub_cabal_send_cb },
+
   // generic information operations
   {"get","info", Hub_info_get_cb },
   {"list","info", Hub_info_list_cb },
@@ -215,6 +582,9 @@ Registration registrations[] = {
 
   // system level commands
   {"ping","system", Hub_system_ping_cb },
+  {"lag","system", Hub_system_lag_cb },
+  {"slab","system", Hub_system_slab_cb },
+  {"trace","system", Hub_system_trace_cb },
   { NULL, NULL, NULL}
 };
 
@@ -250,6 +620,8 @@ int Hub_service_message(struct ConnectionState *state)
     // this is a callback that only targets the Hub, call it
     Node *message = extract_message(state->recv.msg);
     check(message, "Invalid service message format, must have at least one internal node.");
+    // it's only the hub's until the callback sends it anywhere, so it can be filled in now
+    check(Node_expand(message), "Invalid service message, failed to parse it.");
     check(target->callback(state, state->recv.msg->from, message), "Callback returned false so aborting connection.");
   } else {
     // looks like a regular delivery, send it on
@@ -257,6 +629,10 @@ int Hub_service_message(struct ConnectionState *state)
     dbg("Routed to %s with %d deliveries", bdata(target->name), count);
   }
 
+  if(state->recv.msg->trace.decrypt_ns) {
+    Trace_record(TRACE_ROUTE, state->recv.msg->trace.decrypt_ns, Trace_now_ns());
+  }
+
   return 1;
 
   on_fail(Message_ref_inc(state->recv.msg); return 0);
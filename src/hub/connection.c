@@ -253,17 +253,22 @@ _match:
       log(ERROR, "member failed to login");
       { state->cs = 11; goto _again;}
     }
+    // coming back before they were reaped, so they're not detached anymore
+    MemberDetachList_remove(&state->hub->detached, state->member);
+    MemberIndex_add(state->hub->index, state->member);
+    Cabal_bind_member(state->hub->cabals, state->member);
+    Member_set_class(state->member, MemberClass_for(state->hub->classes, state->member->fingerprint));
   }
 	break;
 	case 5:
-#line 47 "hub/connection.rl"
+#line 49 "hub/connection.rl"
 	{
     trc(established,(_ps),( state->cs));
     taskcreate(ConnectionState_outgoing, state, HUB_DEFAULT_STACK);
   }
 	break;
 	case 6:
-#line 52 "hub/connection.rl"
+#line 54 "hub/connection.rl"
 	{
     trc(recv,(_ps),( state->cs));
     if(!state->recv.hdr || !state->recv.body) {
@@ -277,10 +282,14 @@ _match:
       { state->cs = 11; goto _again;}
     }
     state->recv.msg->from = state->member;
+    state->recv.msg->size = state->peer->recv_size;
+    *(state->peer->recv_codec == NODE_CODEC_BINARY ? &state->recv.msg->bin : &state->recv.msg->raw) = state->peer->recv_raw;
+    state->peer->recv_raw = NULL;
+    state->recv.msg->trace = state->peer->recv_trace;
   }
 	break;
 	case 7:
-#line 67 "hub/connection.rl"
+#line 69 "hub/connection.rl"
 	{
     trc(clear_recv,(_ps),( state->cs));
     state->recv.msg = NULL;
@@ -289,14 +298,14 @@ _match:
   }
 	break;
 	case 8:
-#line 74 "hub/connection.rl"
+#line 76 "hub/connection.rl"
 	{
     trc(clear_send,(_ps),( state->cs));
     state->send.msg = NULL;
   }
 	break;
 	case 9:
-#line 79 "hub/connection.rl"
+#line 81 "hub/connection.rl"
 	{
     trc(service,(_ps),( state->cs));
     if(!Hub_service_message(state)) {
@@ -305,13 +314,13 @@ _match:
   }
 	break;
 	case 10:
-#line 86 "hub/connection.rl"
+#line 88 "hub/connection.rl"
 	{
     trc(msg_ready,(_ps),( state->cs));
   }
 	break;
 	case 11:
-#line 90 "hub/connection.rl"
+#line 92 "hub/connection.rl"
 	{
     trc(msgid_check,(_ps),( state->cs));
     if(state->recv.msg->msgid != state->recv_count) {
@@ -323,50 +332,51 @@ _match:
   }
 	break;
 	case 12:
-#line 100 "hub/connection.rl"
+#line 102 "hub/connection.rl"
 	{
     trc(aborted,(_ps),( state->cs));
   }
 	break;
 	case 13:
-#line 104 "hub/connection.rl"
+#line 106 "hub/connection.rl"
 	{
     trc(sent,(_ps),( state->cs));
-    Member_delete_msg(state->member);
+    // if they detached mid-send it stays queued for when they resume
+    if(state->member) Member_delete_msg(state->member);
   }
 	break;
 	case 14:
-#line 109 "hub/connection.rl"
+#line 111 "hub/connection.rl"
 	{
     trc(hate_apply,(_ps),( state->cs));
   }
 	break;
 	case 15:
-#line 113 "hub/connection.rl"
+#line 115 "hub/connection.rl"
 	{
     trc(hate_challenge,(_ps),( state->cs));
   }
 	break;
 	case 16:
-#line 117 "hub/connection.rl"
+#line 119 "hub/connection.rl"
 	{
     trc(hate_paid,(_ps),( state->cs));
   }
 	break;
 	case 17:
-#line 121 "hub/connection.rl"
+#line 123 "hub/connection.rl"
 	{
     trc(hate_valid,(_ps),( state->cs));
   }
 	break;
 	case 18:
-#line 125 "hub/connection.rl"
+#line 127 "hub/connection.rl"
 	{
     trc(hate_invalid,(_ps),( state->cs));
   }
 	break;
 	case 19:
-#line 129 "hub/connection.rl"
+#line 131 "hub/connection.rl"
 	{
     trc(error,(_ps),( state->cs)); 
 
@@ -380,7 +390,7 @@ _match:
   }
 	break;
 	case 20:
-#line 141 "hub/connection.rl"
+#line 143 "hub/connection.rl"
 	{
     trc(half_close,(_ps),( state->cs));
     if(!ConnectionState_half_close(state)) {
@@ -389,7 +399,7 @@ _match:
   }
 	break;
 	case 21:
-#line 148 "hub/connection.rl"
+#line 150 "hub/connection.rl"
 	{
     trc(rest_close,(_ps),( state->cs));
     if(!ConnectionState_rest_close(state)) {
@@ -397,7 +407,7 @@ _match:
     }
   }
 	break;
-#line 401 "hub/connection.c"
+#line 403 "hub/connection.c"
 		}
 	}
 
@@ -418,7 +428,7 @@ int ConnectionState_finish(ConnectionState *state)
   assert_mem(state);
 
   
-#line 422 "hub/connection.c"
+#line 424 "hub/connection.c"
 #line 136 "hub/connection.rl"
 
   int rc = ConnectionState_invariant(state, 0);
@@ -431,10 +441,8 @@ int ConnectionState_finish(ConnectionState *state)
     if(state->recv.hdr) Node_destroy(state->recv.hdr);
   }
 
-  if(state->send.msg) {
-    Message_destroy(state->send.msg);
-  }
-
+  // send.msg is still owned by the member's queue, which outlives
+  // this connection when the member is detached, so don't touch it
   // clear out the messages
   state->recv.msg = NULL;
   state->recv.hdr = NULL;
@@ -144,10 +144,8 @@ int ConnectionState_finish(ConnectionState *state)
     if(state->recv.hdr) Node_destroy(state->recv.hdr);
   }
 
-  if(state->send.msg) {
-    Message_destroy(state->send.msg);
-  }
-
+  // send.msg is still owned by the member's queue, which outlives
+  // this connection when the member is detached, so don't touch it
   // clear out the messages
   state->recv.msg = NULL;
   state->recv.hdr = NULL;
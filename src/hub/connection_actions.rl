@@ -42,6 +42,11 @@
       log(ERROR, "member failed to login");
       fgoto Aborting;
     }
+    // coming back before they were reaped, so they're not detached anymore
+    MemberDetachList_remove(&state->hub->detached, state->member);
+    MemberIndex_add(state->hub->index, state->member);
+    Cabal_bind_member(state->hub->cabals, state->member);
+    Member_set_class(state->member, MemberClass_for(state->hub->classes, state->member->fingerprint));
   }
 
   action established {
@@ -62,6 +67,10 @@
       fgoto Aborting;
     }
     state->recv.msg->from = state->member;
+    state->recv.msg->size = state->peer->recv_size;
+    *(state->peer->recv_codec == NODE_CODEC_BINARY ? &state->recv.msg->bin : &state->recv.msg->raw) = state->peer->recv_raw;
+    state->peer->recv_raw = NULL;
+    state->recv.msg->trace = state->peer->recv_trace;
   }
 
   action clear_recv {
@@ -103,7 +112,8 @@
 
   action sent {
     trc(sent,fcurs,ftargs);
-    Member_delete_msg(state->member);
+    // if they detached mid-send it stays queued for when they resume
+    if(state->member) Member_delete_msg(state->member);
   }
 
   action hate_apply {
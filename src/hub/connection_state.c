@@ -26,6 +26,18 @@ int ConnectionState_dequeue_msg(ConnectionState *state)
 
   state->send.msg = Member_first_msg(state->member);
 
+  // we could have been detached while waiting on the queue
+  if(state->member == NULL) {
+    state->send.msg = NULL;
+  }
+
+  state->send.dequeued_ns = 0;
+
+  if(state->send.msg && MsgQueue_first_stamp(state->member->queue)) {
+    state->send.dequeued_ns = Trace_now_ns();
+    Trace_record(TRACE_QUEUE, MsgQueue_first_stamp(state->member->queue), state->send.dequeued_ns);
+  }
+
   return state->send.msg != NULL;
 }
 
@@ -33,13 +45,24 @@ int ConnectionState_send_msg(ConnectionState *state)
 {
   int rc = 0;
   Message *msg = state->send.msg;
+  bstring bytes = NULL;
 
-  if(ConnectionState_done(state)) {
+  if(ConnectionState_done(state) || state->member == NULL) {
     rc = 0;
   } else {
     // make a new header with the msgid the connected client expects
     Node *hdr = Message_cons_header(state->send_count++);
-    rc = Peer_send(state->member->peer, hdr, msg->body);
+
+    // only the header and encryption are per recipient, the body is serialized once per codec
+    bytes = Message_bytes_as(msg, state->member->peer->codec);
+    rc = bytes ? Peer_send_raw(state->member->peer, hdr, bytes) : 0;
+
+    if(rc && state->send.dequeued_ns) {
+      uint64_t now = Trace_now_ns();
+      Trace_record(TRACE_WRITE, state->send.dequeued_ns, now);
+      Trace_record(TRACE_TOTAL, msg->trace.read_ns, now);
+    }
+
     Node_destroy(hdr);
   }
 
@@ -83,6 +106,20 @@ int ConnectionState_read_msg(ConnectionState *state)
   return state->recv.body != NULL;
 }
 
+int ConnectionState_throttle(ConnectionState *state)
+{
+  uint64_t wait = 0;
+
+  // pause reading rather than disconnect, the socket buffer pushes back on them
+  while(state->member && (wait = Member_throttle(state->member, state->peer->recv_size))) {
+    state->member->mclass->throttled++;
+    state->member->mclass->paused_ms += wait;
+    taskdelay(wait);
+  }
+
+  return state->member != NULL && !ConnectionState_done(state);
+}
+
 void ConnectionState_incoming(void *data)
 {
   ConnectionState *state = (ConnectionState *)data;
@@ -91,7 +128,10 @@ void ConnectionState_incoming(void *data)
   ConnectionState_exec(state, UEv_PASS);
   ConnectionState_exec(state, UEv_PASS);
 
-  while(ConnectionState_read_msg(state)) {
+  // routing only looks at the top of a message, the payload stays unparsed
+  if(state->peer) state->peer->parse_depth = HUB_PARSE_DEPTH;
+
+  while(ConnectionState_read_msg(state) && ConnectionState_throttle(state)) {
     ConnectionState_lock(state);
 
     if(ConnectionState_exec(state, UEv_MSG_RECV) == 0 && state->recv.msg) {
@@ -112,11 +152,20 @@ int ConnectionState_half_close(ConnectionState *state)
     state->client = NULL;
 
     if(state->member) {
-      Route_unregister_all(state->hub->routes, state->member);
-      Member_logout(&state->hub->members, state->member);
+      // keep their routes and queue around so they can resume, 
+      // Hub_reap_members logs them out if they don't come back
+      Member *member = state->member;
+      state->member = NULL;
+      Member_detach(member);
+
+      // evicted members don't get to resume, and they could have come back while Member_detach yielded
+      if(Member_is_evicted(member)) {
+        Hub_logout_member(state->hub, member);
+      } else if(Member_is_detached(member)) {
+        MemberDetachList_push(&state->hub->detached, member);
+      }
     }
 
-    state->member = NULL;
     return 1;
   } else {
     return 0;
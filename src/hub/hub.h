@@ -16,9 +16,29 @@
 
 
 #include "hub/routing.h"
+#include "hub/cabal.h"
+#include "hub/store.h"
+#include "protocol/slab.h"
 
+/** 
+ * Serializing and destroying Nodes doesn't recurse (see NodeWalk), so
+ * how big a message is doesn't change how much stack a task needs.  The
+ * outgoing task still encrypts and signs on its stack though, and that
+ * hasn't been measured, so this stays at 32k.
+ */
 #define HUB_DEFAULT_STACK (32*1024)
 
+/** 
+ * Levels of a received message the hub builds.  Routing only reads the
+ * body, its data, and the route groups in that, and internal messages
+ * one level under those are expanded when a callback gets them, so any
+ * payload below is never parsed by the hub at all.
+ */
+#define HUB_PARSE_DEPTH 3
+
+/** Milliseconds between runs of Hub_sweep_task. */
+#define HUB_SWEEP_INTERVAL 1000
+
 struct Hub;
 
 /**
@@ -99,6 +119,8 @@ typedef struct ConnectionState {
   /** Passes information about a message being sent to the machine. */
   struct {
     Message *msg;
+    /** When a traced msg came off the queue, 0 if it isn't traced. */
+    uint64_t dequeued_ns;
   } send;
 
 } ConnectionState;
@@ -193,6 +215,18 @@ void ConnectionState_outgoing(void *data);
  */
 int ConnectionState_read_msg(ConnectionState *conn);
 
+/** 
+ * Holds off processing the message just read until the member's
+ * MemberClass rate limits say they can send it.  The reader just
+ * sleeps, so a member sending too fast fills up their socket and
+ * slows down instead of being disconnected.
+ *
+ * @brief Rate limits a connection's incoming messages.
+ * @param conn : state that just read a message.
+ * @return int : 1 to process the message, 0 if the connection went away.
+ */
+int ConnectionState_throttle(ConnectionState *conn);
+
 /** 
  * @brief MyriadClient handler that reads incoming messages and data.
  * @param data : myriad data (ConnectionState)
@@ -237,8 +271,17 @@ typedef struct Hub
   bstring key;
   MyriadServer *server;
   Member *members;
+  MemberIndex *index;
+
+  /** Detached members oldest first, for Hub_reap_members. */
+  MemberDetachList detached;
   ConnectionState *closed;
   Route *routes;
+  Heap *cabals;
+  Store *store;
+
+  /** MemberClasses by name, always has the default class. */
+  Heap *classes;
 } Hub;
 
 
@@ -269,9 +312,35 @@ int Hub_init(char *argv_0);
  */
 Hub *Hub_create(bstring host, bstring port, bstring name, bstring key);
 
+/**
+ * Gives the hub a Store to persist into, and loads what was saved
+ * there before (currently the cabals).  Without this the hub still
+ * works but forgets everything when it exits.  Call it after
+ * Hub_create and before Hub_listen.
+ *
+ * @brief Opens the hub's database and loads it.
+ * @param hub : Hub to give the store.
+ * @param path : sqlite3 file made with schema.sql.
+ * @return int : 1 for success, 0 for fail.
+ */
+int Hub_open_store(Hub *hub, const char *path);
+
+/**
+ * Loads the member classes from the file (see MemberClass_load) so
+ * members get the rate and lag limits for their class when they
+ * login.  Without this everyone is in the default class.  Call it
+ * after Hub_create and before Hub_listen.
+ *
+ * @brief Loads the hub's member classes.
+ * @param hub : Hub to configure.
+ * @param path : Member class file.
+ * @return int : 1 for success, 0 for fail.
+ */
+int Hub_load_classes(Hub *hub, const char *path);
+
 /**
  * Starts a created hub so that it begins listening on the port
- * and processing clients.
+ * and processing clients, and starts the Hub_sweep_task.
  *
  * @brief Start listening on the socket.
  * @param hub A hub created.
@@ -316,6 +385,52 @@ int Hub_destroy(Hub *hub);
  */
 void Hub_queue_conn(Hub *hub, MyriadClient *client);
 
+/** 
+ * Members whose connection dropped are kept detached for
+ * MEMBER_DETACH_GRACE seconds so they can resume.  This logs out the
+ * ones that have been gone longer than that, removing their routes as
+ * well.  They're taken off the front of hub->detached, so it stops at
+ * the first one that still has time left and never walks the members.
+ *
+ * @brief Logs out detached members that didn't come back in time.
+ * @param hub : Hub to reap.
+ */
+void Hub_reap_members(Hub *hub);
+
+/** 
+ * Runs Member_lag_check on every member.  This is the only place lag
+ * gets updated, Member_send_msg just goes by the state it leaves them
+ * in so routing doesn't pay for it once per recipient.
+ * Detached members who are evicted have no connection to close, so
+ * they're logged out right here instead.
+ *
+ * @brief Checks how far behind every member is.
+ * @param hub : Hub to check.
+ */
+void Hub_check_lag(Hub *hub);
+
+/** 
+ * Runs for as long as the hub listens, doing the periodic work every
+ * HUB_SWEEP_INTERVAL milliseconds instead of on each new connection,
+ * so nothing waits on a connect or a send to happen.  Right now that's
+ * Hub_check_lag, Hub_reap_members, a Store_flush of the pending cabal
+ * writes, and a Slab_trim of spare Messages.
+ *
+ * @brief The hub's periodic housekeeping task.
+ * @param data : The Hub, from taskcreate.
+ */
+void Hub_sweep_task(void *data);
+
+/** 
+ * Takes the member out of everything in the hub (routes, the member
+ * index, cabals) and then logs them out.  The member is gone after this.
+ *
+ * @brief Fully logs out a member.
+ * @param hub : Hub they're in.
+ * @param member : Member to log out.
+ */
+void Hub_logout_member(Hub *hub, Member *member);
+
 /** 
  * Sets up the proper client and calls Hub_queue_conn to do
  * the work.  This task function doesn't return until the ConnectionState
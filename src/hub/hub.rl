@@ -72,6 +72,9 @@ Hub *Hub_create(bstring host, bstring port, bstring name, bstring key)
   state->name = name;
   state->routes = Route_create_root("root");
   assert_mem(state->routes);
+  state->index = MemberIndex_create();
+  state->cabals = Cabal_create_map();
+  state->classes = MemberClass_create_map();
 
   Hub_commands_register(state);
 
@@ -128,6 +131,10 @@ int Hub_destroy(Hub *state)
 
   // TODO: make this work better with the pool rather than destroy the whole world
   Route_destroy(state->routes);
+  MemberIndex_destroy(state->index);
+  Cabal_destroy_map(state->cabals);
+  MemberClass_destroy_map(state->classes);
+  if(state->store) Store_close(state->store);
 
   free(state);
 
@@ -30,6 +30,74 @@ inline ConnectionState *Hub_new_or_reuse_conn(Hub *hub)
   return state;
 }
 
+void Hub_logout_member(Hub *hub, Member *member)
+{
+  assert_not(hub, NULL);
+  assert_not(member, NULL);
+
+  Route_unregister_all(hub->routes, member);
+  MemberIndex_remove(hub->index, member);
+  MemberDetachList_remove(&hub->detached, member);
+  Cabal_unbind_all(member);
+  Member_logout(&hub->members, member);
+}
+
+void Hub_reap_members(Hub *hub)
+{
+  Member *expired = NULL;
+  time_t now = time(NULL);
+  assert_not(hub, NULL);
+
+  // oldest first, so the first one with time left means everyone after it has too
+  while((expired = hub->detached.first) != NULL && Member_is_expired(expired, now)) {
+    log(INFO, "Member %s did not come back, logging them out.", bdata(Member_name(expired)));
+    Hub_logout_member(hub, expired);
+  }
+}
+
+void Hub_check_lag(Hub *hub)
+{
+  Member *te = NULL;
+  struct sglib_Member_iterator it;
+  time_t now = time(NULL);
+  assert_not(hub, NULL);
+
+  // evicting only shuts down their socket, so the tree doesn't change under this
+  for(te=sglib_Member_it_init(&it,hub->members); te!=NULL; te=sglib_Member_it_next(&it)) {
+    Member_lag_check(te, now);
+  } 
+
+  // logging out yields, so start over each time rather than trust the next pointer
+  te = hub->detached.first;
+  while(te != NULL) {
+    if(Member_is_evicted(te)) {
+      log(INFO, "Member %s was evicted while detached, logging them out.", bdata(Member_name(te)));
+      Hub_logout_member(hub, te);
+      te = hub->detached.first;
+    } else {
+      te = te->detached_next;
+    }
+  }
+}
+
+void Hub_sweep_task(void *data)
+{
+  Hub *hub = (Hub *)data;
+  assert_not(hub, NULL);
+
+  for(;;) {
+    taskdelay(HUB_SWEEP_INTERVAL);
+    Hub_check_lag(hub);
+    Hub_reap_members(hub);
+
+    // the only place the commands' writes hit the database
+    if(hub->store) Store_flush(hub->store);
+
+    // give back spare Messages a bit at a time, so the next burst still finds some
+    Slab_trim(SLAB_MAX_FREE / 4);
+  }
+}
+
 void Hub_queue_conn(Hub *hub, MyriadClient *client)
 {
   ConnectionState *state = Hub_new_or_reuse_conn(hub);
@@ -65,9 +133,35 @@ int Hub_init(char *argv_0)
   on_fail(return 0);
 }
 
+int Hub_open_store(Hub *hub, const char *path)
+{
+  assert_not(hub, NULL);
+  assert_not(path, NULL);
+  assert(hub->store == NULL && "Hub already has a store.");
+
+  hub->store = Store_open(path, hub->name);
+  check(hub->store, "Failed to open the hub's store.");
+
+  check(Store_load_cabals(hub->store, hub->cabals), "Failed to load cabals.");
+
+  return 1;
+  on_fail(return 0);
+}
+
+int Hub_load_classes(Hub *hub, const char *path)
+{
+  assert_not(hub, NULL);
+  assert_not(path, NULL);
+
+  check(MemberClass_load(hub->classes, path), "Failed to load member classes.");
+
+  return 1;
+  on_fail(return 0);
+}
 
 void Hub_listen(Hub *hub)
 {
+  taskcreate(Hub_sweep_task, hub, HUB_DEFAULT_STACK);
   Hub_exec(hub, UEv_LISTEN);
 }
 
@@ -13,10 +13,13 @@
 
 
 #include "member.h"
+#include <sys/socket.h>
 
 
 SGLIB_DEFINE_RBTREE_FUNCTIONS(Member, left, right, color, MEMBER_COMPARATOR);
 
+MemberLagCounts Member_lag_counts;
+
 
 Member *Member_find(Member *map, bstring pubkey)
 {
@@ -39,27 +42,191 @@ Message *Member_first_msg(Member *member)
 
 int Member_delete_msg(Member *member)
 {
+  Message *first = NULL;
   assert_not(member, NULL);
 
+  if(!MsgQueue_is_empty(member->queue)) {
+    first = MsgQueue_get_first(member->queue);
+    member->lag.bytes_pending -= MIN(first->size, member->lag.bytes_pending);
+  }
+
   return MsgQueue_delete(member->queue);
 }
 
+MemberLagState Member_lag_update(Member *member, time_t now)
+{
+  MemberLag *lag = NULL;
+  const MemberLagLimits *limits = NULL;
+  MemberLagState state = MEMBER_LAG_OK;
+  time_t age = 0;
+  time_t since = 0;
+
+  assert_not(member, NULL);
+  assert_not(member->lag_limits, NULL);
+
+  lag = &member->lag;
+  limits = member->lag_limits;
+
+  // once they're evicted there's no coming back
+  if(Member_is_evicted(member)) return MEMBER_LAG_EVICTED;
+
+  // nobody can read a detached member's queue, so it's not their fault it's backing up
+  if(Member_is_detached(member)) return lag->state;
+
+  lag->depth_avg += ((double)MsgQueue_count(member->queue) - lag->depth_avg) * MEMBER_LAG_ALPHA;
+
+  if(!MsgQueue_is_empty(member->queue)) {
+    since = MsgQueue_get_first(member->queue)->received_at;
+    age = now - (since > member->attached_at ? since : member->attached_at);
+  }
+
+  if((limits->evict_age && age >= limits->evict_age) || 
+      (limits->evict_bytes && lag->bytes_pending >= limits->evict_bytes)) {
+    state = MEMBER_LAG_EVICTED;
+  } else if((limits->degrade_age && age >= limits->degrade_age) || 
+      (limits->degrade_bytes && lag->bytes_pending >= limits->degrade_bytes)) {
+    state = MEMBER_LAG_DEGRADED;
+  } else if(lag->depth_avg >= limits->warn_depth) {
+    state = MEMBER_LAG_WARNED;
+  }
+
+  if(state != lag->state) {
+    switch(state) {
+      case MEMBER_LAG_EVICTED:
+        log(WARN, "Member %s is %jd seconds and %zu bytes behind, evicting.", 
+            bdata(Member_name(member)), (intmax_t)age, lag->bytes_pending);
+        Member_lag_counts.evicted++;
+        break;
+      case MEMBER_LAG_DEGRADED:
+        log(WARN, "Member %s is %jd seconds and %zu bytes behind, sampling 1 in %u messages.", 
+            bdata(Member_name(member)), (intmax_t)age, lag->bytes_pending, limits->degrade_sample);
+        Member_lag_counts.degraded++;
+        break;
+      case MEMBER_LAG_WARNED:
+        if(lag->state == MEMBER_LAG_OK) {
+          log(WARN, "Member %s has an average of %.1f messages queued.", 
+              bdata(Member_name(member)), lag->depth_avg);
+          Member_lag_counts.warned++;
+        }
+        break;
+      default:
+        break;
+    }
+
+    if(lag->state == MEMBER_LAG_DEGRADED && state < MEMBER_LAG_DEGRADED) {
+      log(INFO, "Member %s caught up, back to full delivery.", bdata(Member_name(member)));
+      Member_lag_counts.recovered++;
+    }
+
+    lag->state = state;
+  }
+
+  return state;
+}
+
+void Member_evict(Member *member)
+{
+  assert_not(member, NULL);
+
+  if(!Member_is_evicted(member)) {
+    member->lag.state = MEMBER_LAG_EVICTED;
+    Member_lag_counts.evicted++;
+  }
+
+  if(member->peer) {
+    // the connection's reader and writer both fail out and log them out
+    if(shutdown(member->peer->source.fd, SHUT_RDWR) == -1) {
+      log(WARN, "Failed to shutdown evicted member %s's socket.", bdata(Member_name(member)));
+      errno = 0;
+    }
+  }
+}
+
+MemberLagState Member_lag_check(Member *member, time_t now)
+{
+  MemberLagState was = MEMBER_LAG_OK;
+  MemberLagState state = MEMBER_LAG_OK;
+
+  assert_not(member, NULL);
+
+  was = member->lag.state;
+  state = Member_lag_update(member, now);
+
+  if(state == MEMBER_LAG_EVICTED && was != MEMBER_LAG_EVICTED) Member_evict(member);
+
+  return state;
+}
+
 int Member_send_msg(Member *member, Message *msg)
 {
   int rc = 0;
+  unsigned int sample = 0;
+
   assert_not(member, NULL);
   assert_not(msg, NULL);
 
+  // Hub_check_lag keeps this current, working it out here would cost every recipient of every message
+  switch(member->lag.state) {
+    case MEMBER_LAG_EVICTED:
+      return 0;
+
+    case MEMBER_LAG_DEGRADED:
+      sample = member->lag_limits->degrade_sample;
+      if(sample > 1 && member->lag.sample_count++ % sample != 0) {
+        Member_lag_counts.sampled_out++;
+        return 0;
+      }
+      break;
+
+    default:
+      break;
+  }
+
   check(!MsgQueue_is_full(member->queue), "member's queue is full");
   rc = MsgQueue_add(member->queue, msg);
   check(rc, "failed to add to member's queue");
 
+  member->lag.bytes_pending += msg->size;
+
   MsgQueue_wake_all(member->queue);
 
   return 1;
   on_fail(return 0);
 }
 
+void Member_set_class(Member *member, MemberClass *mclass)
+{
+  uint64_t now = MemberClass_now_ms();
+
+  assert_not(member, NULL);
+  assert_not(mclass, NULL);
+
+  member->mclass = mclass;
+  member->lag_limits = &mclass->lag;
+  TokenBucket_init(&member->msgs_bucket, mclass->msgs_rate, mclass->msgs_burst, now);
+  TokenBucket_init(&member->bytes_bucket, mclass->bytes_rate, mclass->bytes_burst, now);
+}
+
+uint64_t Member_throttle(Member *member, size_t size)
+{
+  uint64_t now = MemberClass_now_ms();
+  uint64_t msgs_wait = 0;
+  uint64_t bytes_wait = 0;
+
+  assert_not(member, NULL);
+
+  msgs_wait = TokenBucket_wait(&member->msgs_bucket, now);
+  bytes_wait = TokenBucket_wait(&member->bytes_bucket, now);
+
+  if(msgs_wait || bytes_wait) {
+    return msgs_wait > bytes_wait ? msgs_wait : bytes_wait;
+  }
+
+  TokenBucket_take(&member->msgs_bucket, 1);
+  TokenBucket_take(&member->bytes_bucket, size);
+  return 0;
+}
+
 Member *Member_create(Peer *peer)
 {
   assert_not(peer, NULL);
@@ -70,19 +237,40 @@ Member *Member_create(Peer *peer)
   assert_mem(e);
   e->peer = peer;
   e->key = CryptState_export_key(peer->state, CRYPT_THEIR_KEY, PK_PUBLIC);
+  e->name = bstrcpy(peer->state->them.name);
+  e->fingerprint = CryptState_fingerprint_bstr(bstrcpy(e->key));
+  assert_mem(e->fingerprint);
   e->queue = MsgQueue_create(MEMBER_MSG_QUEUE_LENGTH);
   e->routes = Heap_create(NULL);
+  e->cabals = Heap_create(NULL);
+  e->lag_limits = &MEMBER_LAG_DEFAULTS;
+  e->attached_at = time(NULL);
 
   return e;
 }
 
 Member *Member_login(Member **map, Peer *peer)
 {
-  Member *e = NULL;
+  Member *e = NULL, *existing = NULL;
 
   e = Member_create(peer);
   check(e, "Failed to create new member from peer.");
 
+  existing = sglib_Member_find_member(*map, e);
+
+  if(existing) {
+    check(Member_is_detached(existing), "Member is already logged in.");
+    // their queue is dead to Member_send_msg, so resuming them would get them nothing
+    check(!Member_is_evicted(existing), "Member was evicted and isn't logged out yet.");
+
+    // same key came back before the grace period ran out, resume them
+    log(INFO, "Member %s reattached with %zu pending messages.", bdata(existing->name), 
+        MsgQueue_count(existing->queue));
+    Member_attach(existing, peer);
+    Member_destroy(e);
+    return existing;
+  }
+
   // all good, log them in
   sglib_Member_add(map, e);
 
@@ -90,6 +278,29 @@ Member *Member_login(Member **map, Peer *peer)
   on_fail(if(e) Member_destroy(e); return NULL);
 }
 
+void Member_detach(Member *member)
+{
+  assert_not(member, NULL);
+
+  member->peer = NULL;
+  member->detached_at = time(NULL);
+
+  // the old connection's writer is waiting on this, let it go
+  MsgQueue_wake_all(member->queue);
+  taskyield();
+}
+
+void Member_attach(Member *member, Peer *peer)
+{
+  assert_not(member, NULL);
+  assert_not(peer, NULL);
+  assert(Member_is_detached(member) && "attaching a member that's still attached");
+
+  member->peer = peer;
+  member->detached_at = 0;
+  member->attached_at = time(NULL);
+}
+
 
 void Member_logout(Member **map, Member *member)
 {
@@ -116,8 +327,11 @@ void Member_logout(Member **map, Member *member)
 void Member_destroy(Member *mb)
 {
   if(mb->key) bdestroy(mb->key); mb->key = NULL;
+  if(mb->name) bdestroy(mb->name); mb->name = NULL;
+  if(mb->fingerprint) bdestroy(mb->fingerprint); mb->fingerprint = NULL;
   if(mb->queue) MsgQueue_destroy(mb->queue);
   if(mb->routes) Heap_destroy(mb->routes);
+  if(mb->cabals) Heap_destroy(mb->cabals);
   free(mb);
 }
 
@@ -138,3 +352,158 @@ void Member_destroy_map(Member **map)
     *map = NULL;
   }
 }
+
+
+/** FNV-1a over the fingerprint, the index folds it into its bucket range. */
+static inline uint32_t MemberIndex_hash(bstring fingerprint)
+{
+  uint32_t hash = 2166136261U;
+  int i = 0;
+
+  for(i = 0; i < blength(fingerprint); i++) {
+    hash ^= (unsigned char)fingerprint->data[i];
+    hash *= 16777619U;
+  }
+
+  return hash;
+}
+
+#define MemberIndex_bucket(I, F) (MemberIndex_hash(F) & ((I)->size - 1))
+
+/** Doubles the buckets and moves everyone over to their new one. */
+static void MemberIndex_grow(MemberIndex *index)
+{
+  size_t size = index->size * 2;
+  Member **buckets = calloc(size, sizeof(Member *));
+  Member *member = NULL, *next = NULL;
+  size_t i = 0, bucket = 0;
+
+  // it still works when it can't grow, just with longer chains
+  if(buckets == NULL) return;
+
+  for(i = 0; i < index->size; i++) {
+    for(member = index->buckets[i]; member != NULL; member = next) {
+      next = member->index_next;
+      bucket = MemberIndex_hash(member->fingerprint) & (size - 1);
+      member->index_next = buckets[bucket];
+      buckets[bucket] = member;
+    }
+  }
+
+  free(index->buckets);
+  index->buckets = buckets;
+  index->size = size;
+}
+
+MemberIndex *MemberIndex_create()
+{
+  MemberIndex *index = calloc(1, sizeof(MemberIndex));
+  assert_mem(index);
+
+  index->size = MEMBER_INDEX_BUCKETS;
+  index->buckets = calloc(index->size, sizeof(Member *));
+  assert_mem(index->buckets);
+
+  return index;
+}
+
+void MemberIndex_destroy(MemberIndex *index)
+{
+  assert_not(index, NULL);
+  free(index->buckets);
+  free(index);
+}
+
+void MemberIndex_add(MemberIndex *index, Member *member)
+{
+  Member *found = NULL;
+  size_t bucket = 0;
+  assert_not(index, NULL);
+  assert_not(member, NULL);
+  assert_not(member->fingerprint, NULL);
+
+  bucket = MemberIndex_bucket(index, member->fingerprint);
+
+  SGLIB_LIST_FIND_MEMBER(Member, index->buckets[bucket], member, MEMBER_FP_COMPARATOR, index_next, found);
+
+  if(found == NULL) {
+    SGLIB_LIST_ADD(Member, index->buckets[bucket], member, index_next);
+    index->count++;
+
+    if(index->count > index->size * MEMBER_INDEX_LOAD) MemberIndex_grow(index);
+  } else {
+    assert(found == member && "two members with the same fingerprint in the index");
+  }
+}
+
+void MemberIndex_remove(MemberIndex *index, Member *member)
+{
+  Member *found = NULL;
+  size_t bucket = 0;
+  assert_not(index, NULL);
+  assert_not(member, NULL);
+
+  bucket = MemberIndex_bucket(index, member->fingerprint);
+
+  SGLIB_LIST_DELETE_IF_MEMBER(Member, index->buckets[bucket], member, MEMBER_FP_COMPARATOR, index_next, found);
+
+  if(found) {
+    found->index_next = NULL;
+    index->count--;
+  }
+}
+
+Member *MemberIndex_find(MemberIndex *index, bstring fingerprint)
+{
+  Member *e = NULL, temp = {.fingerprint = fingerprint};
+  size_t bucket = 0;
+  assert_not(index, NULL);
+  assert_not(fingerprint, NULL);
+
+  bucket = MemberIndex_bucket(index, fingerprint);
+
+  SGLIB_LIST_FIND_MEMBER(Member, index->buckets[bucket], &temp, MEMBER_FP_COMPARATOR, index_next, e);
+
+  return e;
+}
+
+void MemberDetachList_push(MemberDetachList *list, Member *member)
+{
+  assert_not(list, NULL);
+  assert_not(member, NULL);
+  if(MemberDetachList_has(list, member)) return;
+
+  member->detached_prev = list->last;
+  member->detached_next = NULL;
+
+  if(list->last) {
+    list->last->detached_next = member;
+  } else {
+    list->first = member;
+  }
+
+  list->last = member;
+}
+
+void MemberDetachList_remove(MemberDetachList *list, Member *member)
+{
+  assert_not(list, NULL);
+  assert_not(member, NULL);
+
+  if(!MemberDetachList_has(list, member)) return;
+
+  if(member->detached_prev) {
+    member->detached_prev->detached_next = member->detached_next;
+  } else {
+    list->first = member->detached_next;
+  }
+
+  if(member->detached_next) {
+    member->detached_next->detached_prev = member->detached_prev;
+  } else {
+    list->last = member->detached_prev;
+  }
+
+  member->detached_prev = NULL;
+  member->detached_next = NULL;
+}
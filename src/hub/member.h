@@ -17,8 +17,45 @@
 #include "protocol/peer.h"
 #include "hub/queue.h"
 #include "hub/heap.h"
+#include "hub/member_class.h"
 
 
+/**
+ * How far behind a member is in reading their messages.  Members who
+ * fall behind move from ok to warned, then degraded where they only get
+ * a sample of what's sent to them, and finally evicted where they are
+ * disconnected and logged out.  See Member_lag_update.
+ */
+typedef enum MemberLagState {
+  MEMBER_LAG_OK = 0,
+  MEMBER_LAG_WARNED,
+  MEMBER_LAG_DEGRADED,
+  MEMBER_LAG_EVICTED
+} MemberLagState;
+
+/** Counts of what happened to slow members across the whole process. */
+typedef struct MemberLagCounts {
+  uint64_t warned;
+  uint64_t degraded;
+  uint64_t recovered;
+  uint64_t sampled_out;
+  uint64_t evicted;
+} MemberLagCounts;
+
+extern MemberLagCounts Member_lag_counts;
+
+/** Per member lag tracking, updated by Hub_check_lag on every sweep. */
+typedef struct MemberLag {
+  /** Moving average of the queue depth. */
+  double depth_avg;
+  size_t bytes_pending;
+  MemberLagState state;
+  unsigned int sample_count;
+} MemberLag;
+
+/** How much of the new depth goes into MemberLag.depth_avg each update. */
+#define MEMBER_LAG_ALPHA 0.25
+
 /**
  * The data structure used internally by the Hub to keep track of everyone.
  * It is implemented as an SGLIB red-black tree that keeps track of the
@@ -27,6 +64,8 @@
  */
 typedef struct Member {
   bstring key;
+  bstring name;
+  bstring fingerprint;
   Peer *peer;
   MsgQueue *queue;
   void *data;
@@ -35,7 +74,29 @@ typedef struct Member {
   struct Member *right;
   int color;
 
+  /** Chains members in the same MemberIndex bucket. */
+  struct Member *index_next;
+
   Heap *routes;
+  Heap *cabals;
+
+  /** When the member lost its connection, 0 while attached. */
+  time_t detached_at;
+
+  /** When the member last got a connection, lag is only counted from then. */
+  time_t attached_at;
+
+  /** Neighbors in the MemberDetachList while detached. */
+  struct Member *detached_prev;
+  struct Member *detached_next;
+
+  MemberLag lag;
+  const MemberLagLimits *lag_limits;
+
+  /** Their MemberClass and the buckets limiting what they can send. */
+  MemberClass *mclass;
+  TokenBucket msgs_bucket;
+  TokenBucket bytes_bucket;
 } Member;
 
 
@@ -44,11 +105,39 @@ typedef struct Member {
  */
 #define MEMBER_MSG_QUEUE_LENGTH 30
 
+/** How many seconds a detached member keeps its routes and queue
+ * waiting for the same key to come back before it is logged out.
+ */
+#define MEMBER_DETACH_GRACE 30
+
 /** Used by SGLIB to compare red-black tree members. */
 #define MEMBER_COMPARATOR(x, y) (memcmp((x)->key->data, (y)->key->data, MIN(blength((x)->key), blength((y)->key))) + (blength((x)->key) - blength((y)->key)))
 
 SGLIB_DEFINE_RBTREE_PROTOTYPES(Member, left, right, color, MEMBER_COMPARATOR);
 
+/** Buckets a MemberIndex starts with, must be a power of 2. */
+#define MEMBER_INDEX_BUCKETS 64
+
+/** Most members per bucket on average before a MemberIndex doubles its buckets. */
+#define MEMBER_INDEX_LOAD 2
+
+/**
+ * A hash index of Members by their key fingerprint so that direct
+ * member to member messages can find the recipient without walking
+ * the red-black tree or the routing tree.  The index doesn't own the
+ * members, it just chains them through Member.index_next, so take a
+ * member out before you Member_logout them.
+ */
+typedef struct MemberIndex {
+  size_t count;
+  /** How many buckets there are, always a power of 2. */
+  size_t size;
+  Member **buckets;
+} MemberIndex;
+
+/** Used by SGLIB to compare members in a MemberIndex bucket. */
+#define MEMBER_FP_COMPARATOR(x, y) (bstrcmp((x)->fingerprint, (y)->fingerprint))
+
 /** 
  * Finds the Member in the map who has the given pubkey. 
  *
@@ -59,11 +148,15 @@ SGLIB_DEFINE_RBTREE_PROTOTYPES(Member, left, right, color, MEMBER_COMPARATOR);
 Member *Member_find(Member *map, bstring pubkey);
 
 /** 
- * Send a message to the member, putting it on their queue. 
+ * Send a message to the member, putting it on their queue.  If the
+ * member is degraded only a sample of messages make it through, and if
+ * they have been evicted nothing does.  This only looks at the lag state
+ * the last sweep left them in, since it runs once per recipient for
+ * every message routed.
  *
  * @param member Who to send it to.
  * @param msg The message to send.
- * @return 1 for good, 0 for bad.
+ * @return 1 for queued, 0 for not queued.
  */
 int Member_send_msg(Member *member, Message *msg);
 
@@ -97,7 +190,11 @@ Member *Member_create(Peer *peer);
 
 /** 
  * Add a member to the map based on their established Utu key, but don't
- * let them login more than once.
+ * let them login more than once.  If the key belongs to a member that
+ * is detached (see Member_detach) then that member is reattached to the
+ * new peer and returned with its routes and pending messages intact.
+ * An evicted member can't be resumed, so their key is refused until the
+ * hub logs the old member out.
  *
  * @param map The member map to add this new member to.
  * @param peer The peer layer they are riding on.
@@ -105,6 +202,99 @@ Member *Member_create(Peer *peer);
  */
 Member *Member_login(Member **map, Peer *peer);
 
+/** 
+ * Called when a member's connection goes away.  Rather than logging
+ * them out right away the member stays in the map with its routes
+ * and queue so that a reconnect with the same key can pick up where
+ * it left off.  Anyone waiting on the queue is woken up so the old
+ * connection's writer can exit.
+ *
+ * @brief Detaches the member from its dead peer.
+ * @param member : Member to detach.
+ */
+void Member_detach(Member *member);
+
+/** 
+ * @brief Reattaches a detached member to a new peer.
+ * @param member : Detached member.
+ * @param peer : The new connection's peer.
+ */
+void Member_attach(Member *member, Peer *peer);
+
+/** 
+ * Works out how far behind the member is at time now from their queue
+ * depth, the age of the oldest pending message, and the bytes pending,
+ * then moves them to the right MemberLagState for their lag_limits.  It
+ * logs and counts each change.  Use Member_lag_check, which also
+ * evicts them when they get there.
+ *
+ * Nothing drains a detached member's queue, so their lag is frozen
+ * until they come back, and the age of what's pending only counts from
+ * when they reattached.  Otherwise they'd be degraded and evicted inside
+ * their MEMBER_DETACH_GRACE for a backlog they had no way to read.
+ *
+ * @brief Updates the member's lag state.
+ * @param member : Member to check.
+ * @param now : Current time.
+ * @return MemberLagState : The state they're in now.
+ */
+MemberLagState Member_lag_update(Member *member, time_t now);
+
+/** 
+ * Member_lag_update, then Member_evict if that just made them evicted.
+ * Hub_check_lag calls this for everyone on a timer, which also catches
+ * someone nobody is sending to while what's already queued gets older.
+ *
+ * @brief Updates the member's lag state and evicts them if it's time.
+ * @param member : Member to check.
+ * @param now : Current time.
+ * @return MemberLagState : The state they're in now.
+ */
+MemberLagState Member_lag_check(Member *member, time_t now);
+
+/** 
+ * Disconnects a member that has fallen too far behind by shutting down
+ * their socket.  That breaks the writer out of a stuck send and the
+ * reader out of its read, and since they're marked evicted the
+ * connection logs them out rather than detaching them.
+ *
+ * @brief Kicks a slow member off.
+ * @param member : Member to evict.
+ */
+void Member_evict(Member *member);
+
+/** 
+ * Puts the member in the class, which sets their lag_limits and
+ * refills their ingress buckets with the class's rates.
+ *
+ * @brief Sets the member's MemberClass.
+ * @param member : Member to change.
+ * @param mclass : Class they're in now.
+ */
+void Member_set_class(Member *member, MemberClass *mclass);
+
+/** 
+ * Checks the member's message and byte buckets for a message of size
+ * bytes they just sent.  If both have room then the message is taken
+ * out of them and this returns 0.  Otherwise it returns how long the
+ * member has to wait before asking again, and nothing is taken.
+ *
+ * @brief Rate limits what a member sends to the hub.
+ * @param member : Member who sent it.
+ * @param size : Size of what they sent.
+ * @return uint64_t : Milliseconds to pause their reads, 0 for go ahead.
+ */
+uint64_t Member_throttle(Member *member, size_t size);
+
+/** Tells you if the member has been evicted for lagging. */
+#define Member_is_evicted(M) ((M)->lag.state == MEMBER_LAG_EVICTED)
+
+/** Tells you if the member currently has no connection. */
+#define Member_is_detached(M) ((M)->peer == NULL)
+
+/** Tells you if a detached member has outlived the grace period at time N, or was evicted. */
+#define Member_is_expired(M, N) (Member_is_detached(M) && (Member_is_evicted(M) || (N) - (M)->detached_at > MEMBER_DETACH_GRACE))
+
 
 /** 
  * Removes the given member from the map, letting the GC clean 
@@ -136,5 +326,79 @@ void Member_destroy(Member *mb);
 void Member_destroy_map(Member **map);
 
 
-#define Member_name(M) ((M)->peer->state->them.name)
+/** 
+ * @brief Creates an empty MemberIndex.
+ * @return MemberIndex * : The new index.
+ */
+MemberIndex *MemberIndex_create();
+
+/** 
+ * @brief Destroys the index but not the members in it.
+ * @param index : Index to destroy.
+ */
+void MemberIndex_destroy(MemberIndex *index);
+
+/** 
+ * Adds the member to the index under its fingerprint.  Adding a
+ * member that is already in there is allowed and does nothing, which
+ * is what happens when a detached member logs back in.  Once there are
+ * more than MEMBER_INDEX_LOAD members a bucket the buckets double, so
+ * finds stay short however many members there are.
+ *
+ * @brief Adds a member to the index.
+ * @param index : Index to add to.
+ * @param member : Member to add.
+ */
+void MemberIndex_add(MemberIndex *index, Member *member);
+
+/** 
+ * @brief Takes the member out of the index.
+ * @param index : Index to remove from.
+ * @param member : Member to remove.
+ */
+void MemberIndex_remove(MemberIndex *index, Member *member);
+
+/** 
+ * @brief Finds the member with this key fingerprint.
+ * @param index : Index to search.
+ * @param fingerprint : Fingerprint as given by CryptState_fingerprint_key.
+ * @return Member * : The member or NULL if nobody has it.
+ */
+Member *MemberIndex_find(MemberIndex *index, bstring fingerprint);
+
+/**
+ * The detached members in the order they detached.  Everyone gets the
+ * same grace period so the first one is always the next to expire, and
+ * reaping only has to look at the front.
+ */
+typedef struct MemberDetachList {
+  Member *first;
+  Member *last;
+} MemberDetachList;
+
+/** Tells you if the member is in the list, only the first one has no prev. */
+#define MemberDetachList_has(L, M) ((M)->detached_prev != NULL || (L)->first == (M))
+
+/** 
+ * Pushing a member that's already in the list does nothing, which
+ * happens when they reattach and detach again while the first detach
+ * is still yielding in Member_detach.
+ *
+ * @brief Puts a member that just detached on the end of the list.
+ * @param list : List to add to.
+ * @param member : Member to add.
+ */
+void MemberDetachList_push(MemberDetachList *list, Member *member);
+
+/** 
+ * Taking out a member that isn't in the list does nothing, so it's
+ * safe to call for anyone that logs in or out.
+ *
+ * @brief Takes the member out of the list.
+ * @param list : List to remove from.
+ * @param member : Member to remove.
+ */
+void MemberDetachList_remove(MemberDetachList *list, Member *member);
+
+#define Member_name(M) ((M)->name)
 #endif
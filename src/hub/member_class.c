@@ -0,0 +1,207 @@
+/*
+ * Utu -- Saving The Internet With Hate
+ *
+ * Copyright (c) Zed A. Shaw 2005 (zedshaw@zedshaw.com)
+ *
+ * This file is modifiable/redistributable under the terms of the GNU
+ * General Public License.
+ *
+ * You should have recieved a copy of the GNU General Public License along
+ * with this program; see the file COPYING. If not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 0211-1307, USA.
+ */
+
+#include <stdio.h>
+#include "hub/member.h"
+
+const MemberLagLimits MEMBER_LAG_DEFAULTS = {
+  .warn_depth = MEMBER_MSG_QUEUE_LENGTH / 2,
+  .degrade_age = 5,
+  .degrade_bytes = 256 * 1024,
+  .degrade_sample = 4,
+  .evict_age = 30,
+  .evict_bytes = 1024 * 1024
+};
+
+uint64_t MemberClass_now_ms()
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+void TokenBucket_init(TokenBucket *bucket, double rate, double burst, uint64_t now)
+{
+  assert_not(bucket, NULL);
+
+  bucket->rate = rate;
+  bucket->burst = burst < 1 ? 1 : burst;
+  bucket->tokens = bucket->burst;
+  bucket->last_ms = now;
+}
+
+uint64_t TokenBucket_wait(TokenBucket *bucket, uint64_t now)
+{
+  assert_not(bucket, NULL);
+
+  if(bucket->rate <= 0) return 0;
+
+  if(now > bucket->last_ms) {
+    bucket->tokens += (now - bucket->last_ms) * bucket->rate / 1000.0;
+    if(bucket->tokens > bucket->burst) bucket->tokens = bucket->burst;
+    bucket->last_ms = now;
+  }
+
+  // in debt, wait until it's paid back plus one millisecond to round up
+  return bucket->tokens >= 0 ? 0 : (uint64_t)(-bucket->tokens * 1000.0 / bucket->rate) + 1;
+}
+
+int MemberClass_name_compare(Heap *heap, void *x, void *y)
+{
+  return bstrcmp(((MemberClass *)x)->name, ((MemberClass *)y)->name);
+}
+
+int MemberClass_roster_compare(Heap *heap, void *x, void *y)
+{
+  return bstrcmp((bstring)x, (bstring)y);
+}
+
+Heap *MemberClass_create_map()
+{
+  Heap *classes = Heap_create(MemberClass_name_compare);
+  Heap_add(classes, MemberClass_create(bfromcstr(MEMBER_CLASS_DEFAULT)));
+  return classes;
+}
+
+void MemberClass_destroy_map(Heap *classes)
+{
+  assert_not(classes, NULL);
+
+  HEAP_ITERATE(classes, i, MemberClass *, mclass, MemberClass_destroy(mclass));
+  Heap_destroy(classes);
+}
+
+MemberClass *MemberClass_create(bstring name)
+{
+  assert_not(name, NULL);
+
+  MemberClass *mclass = calloc(1, sizeof(MemberClass));
+  assert_mem(mclass);
+
+  mclass->name = name;
+  mclass->msgs_rate = MEMBER_CLASS_MSGS_RATE;
+  mclass->msgs_burst = MEMBER_CLASS_MSGS_BURST;
+  mclass->bytes_rate = MEMBER_CLASS_BYTES_RATE;
+  mclass->bytes_burst = MEMBER_CLASS_BYTES_BURST;
+  mclass->lag = MEMBER_LAG_DEFAULTS;
+  mclass->roster = Heap_create(MemberClass_roster_compare);
+
+  return mclass;
+}
+
+void MemberClass_destroy(MemberClass *mclass)
+{
+  assert_not(mclass, NULL);
+
+  HEAP_ITERATE(mclass->roster, i, bstring, fingerprint, bdestroy(fingerprint));
+  Heap_destroy(mclass->roster);
+  bdestroy(mclass->name);
+  free(mclass);
+}
+
+MemberClass *MemberClass_find(Heap *classes, bstring name)
+{
+  MemberClass temp = {.name = name};
+  size_t i = 0;
+
+  assert_not(classes, NULL);
+  assert_not(name, NULL);
+
+  i = Heap_find(classes, &temp);
+
+  return Heap_valid(classes, i) ? Heap_elem(classes, MemberClass *, i) : NULL;
+}
+
+MemberClass *MemberClass_for(Heap *classes, bstring fingerprint)
+{
+  struct tagbstring default_name = bsStatic(MEMBER_CLASS_DEFAULT);
+
+  assert_not(classes, NULL);
+
+  if(fingerprint) {
+    HEAP_ITERATE(classes, i, MemberClass *, mclass,
+        if(Heap_valid(mclass->roster, Heap_find(mclass->roster, fingerprint))) return mclass);
+  }
+
+  return MemberClass_find(classes, &default_name);
+}
+
+int MemberClass_load(Heap *classes, const char *file)
+{
+  FILE *in = NULL;
+  char line[512];
+  char kind[32], name[64], fingerprint[256];
+  struct tagbstring class_name;
+  double rates[4];
+  MemberLagLimits lag;
+  long ages[2];
+  MemberClass *mclass = NULL;
+  int lineno = 0;
+
+  assert_not(classes, NULL);
+  assert_not(file, NULL);
+
+  in = fopen(file, "r");
+  check(in, "Failed to open member class file.");
+
+  while(fgets(line, sizeof(line), in)) {
+    lineno++;
+
+    if(sscanf(line, "%31s", kind) != 1 || kind[0] == '#') continue;
+
+    check(sscanf(line, "%*s %63s", name) == 1, "Member class line is missing the class name.");
+    btfromcstr(class_name, name);
+    mclass = MemberClass_find(classes, &class_name);
+
+    if(strcmp(kind, "class") == 0) {
+      check(sscanf(line, "%*s %*s %lf %lf %lf %lf",
+            &rates[0], &rates[1], &rates[2], &rates[3]) == 4,
+          "Class line needs NAME MSGS/SEC MSGS-BURST BYTES/SEC BYTES-BURST.");
+
+      if(!mclass) {
+        mclass = MemberClass_create(bfromcstr(name));
+        Heap_add(classes, mclass);
+      }
+
+      mclass->msgs_rate = rates[0];
+      mclass->msgs_burst = rates[1];
+      mclass->bytes_rate = rates[2];
+      mclass->bytes_burst = rates[3];
+    } else if(strcmp(kind, "lag") == 0) {
+      check(mclass, "Lag line for a class that isn't defined yet.");
+      check(sscanf(line, "%*s %*s %lf %ld %zu %u %ld %zu", &lag.warn_depth,
+            &ages[0], &lag.degrade_bytes, &lag.degrade_sample,
+            &ages[1], &lag.evict_bytes) == 6,
+          "Lag line needs NAME WARN-DEPTH DEGRADE-SECS DEGRADE-BYTES SAMPLE EVICT-SECS EVICT-BYTES.");
+
+      lag.degrade_age = ages[0];
+      lag.evict_age = ages[1];
+      mclass->lag = lag;
+    } else if(strcmp(kind, "member") == 0) {
+      check(mclass, "Member line for a class that isn't defined yet.");
+      check(sscanf(line, "%*s %*s %255s", fingerprint) == 1, "Member line needs NAME FINGERPRINT.");
+
+      Heap_add(mclass->roster, bfromcstr(fingerprint));
+    } else {
+      fail("Unknown line in member class file.");
+    }
+  }
+
+  fclose(in);
+  errno = 0;
+  log(INFO, "Loaded %zu member classes from %s.", Heap_count(classes), file);
+  return 1;
+
+  on_fail(log(ERROR, "Member class file %s line %d is bad.", file, lineno); if(in) fclose(in); return 0);
+}
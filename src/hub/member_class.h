@@ -0,0 +1,190 @@
+#ifndef utu_hub_member_class_h
+#define utu_hub_member_class_h
+
+/*
+ * Utu -- Saving The Internet With Hate
+ *
+ * Copyright (c) Zed A. Shaw 2005 (zedshaw@zedshaw.com)
+ *
+ * This file is modifiable/redistributable under the terms of the GNU
+ * General Public License.
+ *
+ * You should have recieved a copy of the GNU General Public License along
+ * with this program; see the file COPYING. If not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 0211-1307, USA.
+ */
+
+#include <myriad/myriad.h>
+#include <time.h>
+#include "hub/heap.h"
+
+/**
+ * Thresholds for the MemberLagState changes.  Each MemberClass has one
+ * of these that its members point at, so changing it changes them all.
+ * An age or bytes of 0 turns that check off.
+ */
+typedef struct MemberLagLimits {
+  /** Average queue depth that gets a warning logged. */
+  double warn_depth;
+
+  /** Oldest pending message age in seconds or bytes pending to be degraded. */
+  time_t degrade_age;
+  size_t degrade_bytes;
+
+  /** While degraded only 1 out of this many messages are queued. */
+  unsigned int degrade_sample;
+
+  /** Oldest pending message age in seconds or bytes pending to be evicted. */
+  time_t evict_age;
+  size_t evict_bytes;
+} MemberLagLimits;
+
+/** The lag limits a MemberClass gets unless it's configured otherwise. */
+extern const MemberLagLimits MEMBER_LAG_DEFAULTS;
+
+/**
+ * A simple token bucket that fills at rate tokens a second up to burst.
+ * Takes are allowed to go into debt so that a single large message
+ * doesn't get stuck forever, it just makes the next ones wait longer.
+ * A rate of 0 means there's no limit.
+ */
+typedef struct TokenBucket {
+  double rate;
+  double burst;
+  double tokens;
+  uint64_t last_ms;
+} TokenBucket;
+
+/**
+ * Members are put in a class by their key fingerprint and get that
+ * class's ingress rate limits and lag limits.  Anyone not listed in
+ * a class gets the Hub's "default" class, which has no rate limits
+ * unless the class file gives it some.
+ */
+typedef struct MemberClass {
+  bstring name;
+
+  /** Messages and bytes a second members can send, and how far they can burst. */
+  double msgs_rate;
+  double msgs_burst;
+  double bytes_rate;
+  double bytes_burst;
+
+  MemberLagLimits lag;
+
+  /** Key fingerprints of the members in this class. */
+  Heap *roster;
+
+  /** How many times members in this class got paused, and for how long, see lag system. */
+  uint64_t throttled;
+  uint64_t paused_ms;
+} MemberClass;
+
+/** Name of the class everyone starts in. */
+#define MEMBER_CLASS_DEFAULT "default"
+
+/**
+ * Ingress limits a new class starts with.  The rates are 0 so nobody is
+ * limited until a class file (-c) says so, and the bursts only matter
+ * once a rate is set.
+ */
+#define MEMBER_CLASS_MSGS_RATE 0
+#define MEMBER_CLASS_MSGS_BURST 0
+#define MEMBER_CLASS_BYTES_RATE 0
+#define MEMBER_CLASS_BYTES_BURST 0
+
+/**
+ * @brief Current time in milliseconds from the monotonic clock.
+ * @return uint64_t : Milliseconds since some point that never goes backwards.
+ */
+uint64_t MemberClass_now_ms();
+
+/**
+ * @brief Sets up the bucket full.
+ * @param bucket : Bucket to set up.
+ * @param rate : Tokens a second, 0 for no limit.
+ * @param burst : Most tokens it can hold.
+ * @param now : From MemberClass_now_ms.
+ */
+void TokenBucket_init(TokenBucket *bucket, double rate, double burst, uint64_t now);
+
+/**
+ * @brief Refills the bucket and tells you how long until it's out of debt.
+ * @param bucket : Bucket to check.
+ * @param now : From MemberClass_now_ms.
+ * @return uint64_t : Milliseconds to wait, 0 if you can take now.
+ */
+uint64_t TokenBucket_wait(TokenBucket *bucket, uint64_t now);
+
+/** Takes amount tokens out of the bucket, call after TokenBucket_wait says 0. */
+#define TokenBucket_take(B, A) ((B)->tokens -= (A))
+
+/**
+ * @brief Creates a Heap of MemberClasses sorted by name.
+ * @return Heap * : The new map.
+ */
+Heap *MemberClass_create_map();
+
+/**
+ * @brief Destroys every class and the map.
+ * @param classes : Map to destroy.
+ */
+void MemberClass_destroy_map(Heap *classes);
+
+/**
+ * @brief Creates a class with the default limits.
+ * @param name : Name of the class, which it now owns.
+ * @return MemberClass * : The new class.
+ */
+MemberClass *MemberClass_create(bstring name);
+
+/**
+ * @brief Destroys the class.  Don't do this while members point at it.
+ * @param mclass : Class to destroy.
+ */
+void MemberClass_destroy(MemberClass *mclass);
+
+/**
+ * @brief Finds a class by name.
+ * @param classes : Map to search.
+ * @param name : Name of the class.
+ * @return MemberClass * : The class or NULL.
+ */
+MemberClass *MemberClass_find(Heap *classes, bstring name);
+
+/**
+ * Looks through the classes for one that has the fingerprint on its
+ * roster, otherwise gives back the default class.
+ *
+ * @brief Finds which class a member is in.
+ * @param classes : Map to search.
+ * @param fingerprint : Member's key fingerprint.
+ * @return MemberClass * : Their class or the default one.
+ */
+MemberClass *MemberClass_for(Heap *classes, bstring fingerprint);
+
+/**
+ * Loads classes from a plain text file, one setting per line with
+ * blank lines and # comments ignored:
+ *
+ * <pre>
+ *   # class NAME MSGS/SEC MSGS-BURST BYTES/SEC BYTES-BURST
+ *   class default 100 200 524288 1048576
+ *   class bulk 1000 2000 4194304 8388608
+ *   # lag NAME WARN-DEPTH DEGRADE-SECS DEGRADE-BYTES SAMPLE EVICT-SECS EVICT-BYTES
+ *   lag bulk 20 10 1048576 2 60 4194304
+ *   # member NAME FINGERPRINT
+ *   member bulk bf27-3806-2dc6-19a0-894d-a3ff-875b-9685-4fba-a2b2-0635-cb94-3494-e1e2-b04b-1f45
+ * </pre>
+ *
+ * A class line for an existing class (like default) just changes its
+ * limits.  Lines for lag and member have to come after their class.
+ *
+ * @brief Loads a class file into the map.
+ * @param classes : Map to add to.
+ * @param file : Path to the class file.
+ * @return int : 1 for success, 0 for fail.
+ */
+int MemberClass_load(Heap *classes, const char *file);
+
+#endif
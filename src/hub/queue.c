@@ -25,6 +25,8 @@ MsgQueue *MsgQueue_create(size_t dim)
 
   queue->messages = malloc(dim * sizeof(Message *));
   assert_mem(queue->messages);
+  queue->stamps = calloc(dim, sizeof(uint64_t));
+  assert_mem(queue->stamps);
   return queue;
 }
 
@@ -37,6 +39,7 @@ int MsgQueue_add(MsgQueue *q, Message *message)
   } else {
     Message_ref_inc(message);
     q->messages[q->j] = message;
+    q->stamps[q->j] = message->trace.read_ns ? Trace_now_ns() : 0;
     q->j = (q->j + 1) % q->dim;
     return 1;
   }
@@ -70,6 +73,11 @@ void MsgQueue_destroy(MsgQueue *q)
     q->messages = NULL;
   }
 
+  if(q->stamps) {
+    free(q->stamps);
+    q->stamps = NULL;
+  }
+
   free(q);
 }
 
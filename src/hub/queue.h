@@ -45,6 +45,8 @@
 
 typedef struct MsgQueue {
   Message **messages;
+  /** When each traced message was added, 0 for ones not traced. */
+  uint64_t *stamps;
   Rendez read_wait;
   int dead;
 
@@ -72,9 +74,15 @@ MsgQueue *MsgQueue_create(size_t length);
 /** Tells you if the MsgQueue is full. */
 #define MsgQueue_is_full(Q) (((Q)->i)==(((Q)->j)+1)%((Q)->dim))
 
+/** How many messages are waiting in the MsgQueue. */
+#define MsgQueue_count(Q) (((Q)->j + (Q)->dim - (Q)->i) % (Q)->dim)
+
 /** Returns a pointer to the first message ready in the queue.  Does not remove it.*/
 #define MsgQueue_get_first(Q) ((Q)->messages[(Q)->i])
 
+/** When the first message was added if it's being traced, otherwise 0. */
+#define MsgQueue_first_stamp(Q) ((Q)->stamps[(Q)->i])
+
 /** Blocks until a message is available or the queue is marked dead. */
 Message *MsgQueue_first(MsgQueue *queue);
 
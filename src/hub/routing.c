@@ -4,6 +4,10 @@
 
 int Route_children_compare(Heap *heap, void *x, void *y)
 {
+  // the same interned name is a quick match, but not every name is interned
+  // and the children are kept sorted by name, so the rest compare as strings
+  if(((Route *)x)->name == ((Route *)y)->name) return 0;
+
   return bstrcmp(((Route *)x)->name, ((Route *)y)->name);
 }
 
@@ -12,7 +16,9 @@ Route *Route_alloc(Route *parent, const char *name)
   Route *r = h_calloc(1, sizeof(Route));
   assert_mem(r);
 
-  r->name = bfromcstr(name);
+  // common route words share the parser's interned names
+  r->name = Node_intern(name, strlen(name));
+  if(r->name == NULL) r->name = bfromcstr(name);
   assert_mem(r->name);
 
   r->members = Heap_create(NULL);
@@ -118,7 +124,7 @@ Route *Route_extend_and_find(Route *routes, Node *according_to)
 
   SGLIB_LIST_MAP_ON_ELEMENTS(Node, according_to->child, n, sibling,
       check(path_i < ROUTE_MAX_PATH, "path too long");
-      if(n->type == TYPE_GROUP && n->name && bchar(n->name,0) != '@') path[path_i++] = n);
+      if(Node_is_group(n) && n->name && bchar(n->name,0) != '@') path[path_i++] = n);
 
   Route *point = Route_add(routes, path, path_i);
 
@@ -185,7 +191,7 @@ Route *Route_find(Route *parent, Node *according_to)
   // go through the root node's children
   SGLIB_LIST_MAP_ON_ELEMENTS(Node, according_to->child, n, sibling,
       check(i++ < ROUTE_MAX_PATH, "Routing path too long.");
-      if(n->type == TYPE_GROUP && n->name && bchar(n->name,0) != '@') r = Route_find_child(r, n);
+      if(Node_is_group(n) && n->name && bchar(n->name,0) != '@') r = Route_find_child(r, n);
       if(r == NULL) return NULL);
 
   return r;
@@ -221,10 +227,10 @@ ssize_t Route_deliver(Route *route, Message *msg)
   assert_not(route, NULL);
   assert_not(msg, NULL);
 
+  // one slow member shouldn't stop everyone else getting it
   HEAP_ITERATE(route->members, i, Member *, m, 
-      check(Member_send_msg(m, msg), "delivery failed"); count += 1);
+      if(Member_send_msg(m, msg)) count += 1);
 
   return count;
-  on_fail(return -1);
 }
 
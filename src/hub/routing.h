@@ -171,10 +171,13 @@ Route *Route_find_child(Route *parent, Node *element);
 #define Route_add_child(parent, element) Route_alloc((parent), (const char *)bdata((element)->name))
 
 /** 
+ * Members that can't take the message (full queue, lagging) are skipped
+ * so that one of them doesn't stop the rest getting it.
+ *
  * @brief Given a found route, send it to all the registered members.
  * @param route : Where to send it.
  * @param msg : Message to send.
- * @return ssize_t : -1 if there's a failure, otherwise the number of deliveries.
+ * @return ssize_t : The number of deliveries.
  */
 ssize_t Route_deliver(Route *route, Message *msg);
 
@@ -19,7 +19,7 @@ CREATE TABLE circuit (from_member_id INTEGER, to_member_id INTEGER);
 
 CREATE TABLE member (hub_id INTEGER, name TEXT, key BLOB, last_active DATETIME, mean_hate REAL, last_conn_state INTEGER);
 
-CREATE TABLE cabal (hub_id INTEGER, name TEXT);
+CREATE TABLE cabal (hub_id INTEGER, name TEXT, owner TEXT);
 CREATE TABLE cabal_member (cabal_id INTEGER, member_id INTEGER);
 
 CREATE TABLE service (name TEXT, read_queue INTEGER);
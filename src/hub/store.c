@@ -0,0 +1,359 @@
+/*
+ * Utu -- Saving The Internet With Hate
+ *
+ * Copyright (c) Zed A. Shaw 2005 (zedshaw@zedshaw.com)
+ *
+ * This file is modifiable/redistributable under the terms of the GNU
+ * General Public License.
+ *
+ * You should have recieved a copy of the GNU General Public License along
+ * with this program; see the file COPYING. If not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 0211-1307, USA.
+ */
+
+#include "hub/store.h"
+#include "protocol/crypto.h"
+
+/** 
+ * sqlite3 leaves errno set even when it works, which check() would take as
+ * a failure, so this looks at the sqlite3 result code and clears errno if
+ * it is good.
+ */
+#define sql_ok(D, R, M) if((R) == SQLITE_OK || (R) == SQLITE_ROW || (R) == SQLITE_DONE) { errno = 0; }\
+  else { log(ERROR, "sqlite3: %s", sqlite3_errmsg(D)); fail(M); }
+
+/** Steps the statement, clearing errno if it went through. */
+static inline int Store_step(sqlite3_stmt *stmt)
+{
+  int rc = sqlite3_step(stmt);
+  if(rc == SQLITE_ROW || rc == SQLITE_DONE) errno = 0;
+  return rc;
+}
+
+/** Prepares the query, binding each '?' with the format chars 'i' int64, 't' text, 'b' blob bstrings. */
+static sqlite3_stmt *Store_query(Store *store, const char *sql, const char *format, ...)
+{
+  sqlite3_stmt *stmt = NULL;
+  int rc = 0;
+  int col = 1;
+  va_list args;
+  bstring data = NULL;
+
+  va_start(args, format);
+
+  rc = sqlite3_prepare_v2(store->db, sql, -1, &stmt, NULL);
+  sql_ok(store->db, rc, "Failed to prepare query, was the database made with schema.sql?");
+
+  for(; *format != '\0'; format++, col++) {
+    switch(*format) {
+      case 'i':
+        rc = sqlite3_bind_int64(stmt, col, va_arg(args, sqlite3_int64));
+        break;
+      case 't':
+        data = va_arg(args, bstring);
+        rc = sqlite3_bind_text(stmt, col, (const char *)bdata(data), blength(data), SQLITE_TRANSIENT);
+        break;
+      case 'b':
+        data = va_arg(args, bstring);
+        rc = sqlite3_bind_blob(stmt, col, bdata(data), blength(data), SQLITE_TRANSIENT);
+        break;
+      default:
+        fail("invalid char in query format");
+    }
+
+    sql_ok(store->db, rc, "Failed to bind query parameter.");
+  }
+
+  va_end(args);
+  return stmt;
+
+  on_fail(va_end(args); if(stmt) sqlite3_finalize(stmt); return NULL);
+}
+
+/** Runs a query that returns nothing, or just one int64 in the first column. */
+static int Store_exec(sqlite3_stmt *stmt, sqlite3_int64 *result)
+{
+  int rc = 0;
+  check(stmt, "Can't run a failed query.");
+
+  rc = Store_step(stmt);
+  sql_ok(sqlite3_db_handle(stmt), rc, "Failed to run query.");
+
+  if(result) {
+    *result = rc == SQLITE_ROW ? sqlite3_column_int64(stmt, 0) : 0;
+  }
+
+  sqlite3_finalize(stmt);
+  return 1;
+
+  on_fail(if(stmt) sqlite3_finalize(stmt); return 0);
+}
+
+/** Finds the member's row id by key, adding them if they aren't there. */
+static sqlite3_int64 Store_member_id(Store *store, bstring key, bstring name)
+{
+  sqlite3_int64 id = 0;
+
+  check(Store_exec(Store_query(store, "SELECT rowid FROM member WHERE hub_id = ? AND key = ?",
+          "ib", store->hub_id, key), &id), "Failed to find member.");
+
+  if(id == 0) {
+    check(Store_exec(Store_query(store, "INSERT INTO member (hub_id, name, key) VALUES (?, ?, ?)",
+            "itb", store->hub_id, name, key), NULL), "Failed to add member.");
+    id = sqlite3_last_insert_rowid(store->db);
+  }
+
+  return id;
+  on_fail(return 0);
+}
+
+/** Makes a StoreWrite for the cabal and puts it on the end of the pending list. */
+static StoreWrite *Store_pend(Store *store, StoreWriteType type, Cabal *cabal)
+{
+  StoreWrite *write = NULL;
+
+  assert_not(store, NULL);
+  assert_not(cabal, NULL);
+
+  write = calloc(1, sizeof(StoreWrite));
+  assert_mem(write);
+
+  write->type = type;
+  write->cabal = bstrcpy(cabal->name);
+
+  if(store->pending_last) {
+    store->pending_last->next = write;
+  } else {
+    store->pending = write;
+  }
+
+  store->pending_last = write;
+  store->pending_count++;
+
+  return write;
+}
+
+static void StoreWrite_destroy(StoreWrite *write)
+{
+  bdestroy(write->cabal);
+  bdestroy(write->owner);
+  bdestroy(write->key);
+  bdestroy(write->name);
+  free(write);
+}
+
+/** Runs one pending write against the database. */
+static int Store_run_write(Store *store, StoreWrite *write)
+{
+  sqlite3_int64 member_id = 0;
+
+  switch(write->type) {
+    case STORE_CABAL_CREATE:
+      check(Store_exec(Store_query(store, "INSERT INTO cabal (hub_id, name, owner) VALUES (?, ?, ?)",
+              write->owner ? "itt" : "it", store->hub_id, write->cabal, write->owner), NULL),
+          "Failed to save cabal.");
+      break;
+
+    case STORE_CABAL_JOIN:
+      member_id = Store_member_id(store, write->key, write->name);
+      check(member_id, "Failed to get member for cabal join.");
+
+      check(Store_exec(Store_query(store, "INSERT INTO cabal_member (cabal_id, member_id)"
+              " SELECT rowid, ? FROM cabal WHERE hub_id = ? AND name = ?",
+              "iit", member_id, store->hub_id, write->cabal), NULL), "Failed to save cabal join.");
+      break;
+
+    case STORE_CABAL_LEAVE:
+      member_id = Store_member_id(store, write->key, write->name);
+      check(member_id, "Failed to get member for cabal leave.");
+
+      check(Store_exec(Store_query(store, "DELETE FROM cabal_member WHERE member_id = ?"
+              " AND cabal_id IN (SELECT rowid FROM cabal WHERE hub_id = ? AND name = ?)",
+              "iit", member_id, store->hub_id, write->cabal), NULL), "Failed to save cabal leave.");
+      break;
+
+    default:
+      fail("Invalid StoreWrite type.");
+  }
+
+  return 1;
+  on_fail(return 0);
+}
+
+Store *Store_open(const char *path, bstring hub_name)
+{
+  Store *store = NULL;
+  int rc = 0;
+
+  assert_not(path, NULL);
+  assert_not(hub_name, NULL);
+
+  store = calloc(1, sizeof(Store));
+  assert_mem(store);
+
+  rc = sqlite3_open(path, &store->db);
+  sql_ok(store->db, rc, "Failed to open hub database.");
+
+  check(Store_exec(Store_query(store, "SELECT rowid FROM hub WHERE name = ?",
+          "t", hub_name), &store->hub_id), "Failed to find the hub.");
+
+  if(store->hub_id == 0) {
+    check(Store_exec(Store_query(store, "INSERT INTO hub (name) VALUES (?)",
+            "t", hub_name), NULL), "Failed to add the hub.");
+    store->hub_id = sqlite3_last_insert_rowid(store->db);
+  }
+
+  return store;
+  on_fail(Store_close(store); return NULL);
+}
+
+void Store_close(Store *store)
+{
+  assert_not(store, NULL);
+
+  if(store->db) {
+    Store_flush(store);
+    sqlite3_close(store->db);
+  }
+
+  free(store);
+}
+
+int Store_load_cabals(Store *store, Heap *cabals)
+{
+  sqlite3_stmt *stmt = NULL;
+  Cabal *cabal = NULL;
+  bstring key = NULL;
+  int rc = 0;
+
+  assert_not(store, NULL);
+  assert_not(cabals, NULL);
+
+  stmt = Store_query(store, "SELECT name, owner FROM cabal WHERE hub_id = ?", "i", store->hub_id);
+  check(stmt, "Failed to query cabals.");
+
+  while((rc = Store_step(stmt)) == SQLITE_ROW) {
+    struct tagbstring name;
+    struct tagbstring owner;
+
+    if(sqlite3_column_type(stmt, 0) != SQLITE_TEXT || sqlite3_column_bytes(stmt, 0) == 0) {
+      log(WARN, "Skipping stored cabal with no name.");
+      continue;
+    }
+
+    blk2tbstr(name, sqlite3_column_text(stmt, 0), sqlite3_column_bytes(stmt, 0));
+    blk2tbstr(owner, sqlite3_column_text(stmt, 1), sqlite3_column_bytes(stmt, 1));
+
+    if(Cabal_find(cabals, &name)) {
+      log(WARN, "Skipping second stored cabal named %s.", bdata(&name));
+      continue;
+    }
+
+    cabal = Cabal_create(bstrcpy(&name), sqlite3_column_type(stmt, 1) == SQLITE_TEXT ? &owner : NULL);
+    Heap_add(cabals, cabal);
+  }
+  sql_ok(store->db, rc, "Failed loading cabals.");
+  sqlite3_finalize(stmt);
+
+  stmt = Store_query(store, "SELECT cabal.name, member.key FROM cabal_member"
+      " JOIN cabal ON cabal.rowid = cabal_member.cabal_id"
+      " JOIN member ON member.rowid = cabal_member.member_id"
+      " WHERE cabal.hub_id = ?", "i", store->hub_id);
+  check(stmt, "Failed to query cabal members.");
+
+  while((rc = Store_step(stmt)) == SQLITE_ROW) {
+    struct tagbstring name;
+
+    if(sqlite3_column_type(stmt, 0) != SQLITE_TEXT) {
+      log(WARN, "Skipping stored member of a cabal with no name.");
+      continue;
+    }
+
+    blk2tbstr(name, sqlite3_column_text(stmt, 0), sqlite3_column_bytes(stmt, 0));
+
+    cabal = Cabal_find(cabals, &name);
+    if(cabal == NULL) {
+      log(WARN, "Skipping stored member of missing cabal %s.", bdata(&name));
+      continue;
+    }
+
+    key = blk2bstr(sqlite3_column_blob(stmt, 1), sqlite3_column_bytes(stmt, 1));
+    // fingerprint_bstr takes the key
+    key = CryptState_fingerprint_bstr(key);
+    if(key == NULL) {
+      log(WARN, "Skipping stored member of %s whose key won't fingerprint.", bdata(&name));
+      errno = 0;
+      continue;
+    }
+
+    Cabal_enroll(cabal, key);
+    bdestroy(key);
+  }
+  sql_ok(store->db, rc, "Failed loading cabal members.");
+  sqlite3_finalize(stmt);
+
+  log(INFO, "Loaded %zu cabals from the store.", Heap_count(cabals));
+  return 1;
+
+  on_fail(if(stmt) sqlite3_finalize(stmt); return 0);
+}
+
+int Store_flush(Store *store)
+{
+  StoreWrite *write = NULL;
+  size_t failed = 0;
+  size_t count = 0;
+  int rc = 0;
+
+  assert_not(store, NULL);
+
+  if(store->pending == NULL) return 1;
+
+  count = store->pending_count;
+  // if this fails the writes stay pending for the next flush
+  rc = sqlite3_exec(store->db, "BEGIN", NULL, NULL, NULL);
+  sql_ok(store->db, rc, "Failed to start the write transaction.");
+
+  while((write = store->pending) != NULL) {
+    store->pending = write->next;
+    if(!Store_run_write(store, write)) failed++;
+    StoreWrite_destroy(write);
+  }
+
+  store->pending_last = NULL;
+  store->pending_count = 0;
+
+  rc = sqlite3_exec(store->db, "COMMIT", NULL, NULL, NULL);
+  sql_ok(store->db, rc, "Failed to commit the writes.");
+
+  if(failed) {
+    log(ERROR, "%zu of %zu pending writes didn't make it to the store.", failed, count);
+  }
+
+  return failed == 0;
+  on_fail(if(!sqlite3_get_autocommit(store->db)) sqlite3_exec(store->db, "ROLLBACK", NULL, NULL, NULL); return 0);
+}
+
+void Store_cabal_create(Store *store, Cabal *cabal)
+{
+  StoreWrite *write = Store_pend(store, STORE_CABAL_CREATE, cabal);
+  write->owner = cabal->owner ? bstrcpy(cabal->owner) : NULL;
+}
+
+void Store_cabal_join(Store *store, Cabal *cabal, Member *member)
+{
+  assert_not(member, NULL);
+
+  StoreWrite *write = Store_pend(store, STORE_CABAL_JOIN, cabal);
+  write->key = bstrcpy(member->key);
+  write->name = bstrcpy(member->name);
+}
+
+void Store_cabal_leave(Store *store, Cabal *cabal, Member *member)
+{
+  assert_not(member, NULL);
+
+  StoreWrite *write = Store_pend(store, STORE_CABAL_LEAVE, cabal);
+  write->key = bstrcpy(member->key);
+  write->name = bstrcpy(member->name);
+}
@@ -0,0 +1,128 @@
+#ifndef utu_hub_store_h
+#define utu_hub_store_h
+
+/*
+ * Utu -- Saving The Internet With Hate
+ *
+ * Copyright (c) Zed A. Shaw 2005 (zedshaw@zedshaw.com)
+ *
+ * This file is modifiable/redistributable under the terms of the GNU
+ * General Public License.
+ *
+ * You should have recieved a copy of the GNU General Public License along
+ * with this program; see the file COPYING. If not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 0211-1307, USA.
+ */
+
+#include <sqlite3.h>
+#include "hub/cabal.h"
+
+/**
+ * The Store keeps the parts of the Hub that need to survive a restart
+ * in a sqlite3 database made with hub/schema.sql:
+ *
+ * <pre>
+ *   sqlite3 hub.db < schema.sql
+ * </pre>
+ *
+ * Right now that is just the cabals and who is in them, using the
+ * hub, cabal, cabal_member, and member tables.  Members are stored by
+ * their public key, and the fingerprint is worked out again on load.
+ *
+ * sqlite3 blocks, and every connection is a task in the one thread, so
+ * the commands never write the database themselves.  Store_cabal_create
+ * and friends copy what they need into a StoreWrite on the pending list,
+ * and Store_flush runs the whole list in one transaction.  The hub does
+ * that from Hub_sweep_task, and Store_close does it one last time.
+ * Cabals are found by name when the writes run, so nothing has to wait
+ * for a row id.
+ */
+typedef enum StoreWriteType {
+  STORE_CABAL_CREATE, STORE_CABAL_JOIN, STORE_CABAL_LEAVE
+} StoreWriteType;
+
+typedef struct StoreWrite {
+  struct StoreWrite *next;
+  StoreWriteType type;
+  bstring cabal;
+
+  /** The owner's fingerprint for a create, NULL if it has none. */
+  bstring owner;
+
+  /** The member's key and name for a join or leave. */
+  bstring key;
+  bstring name;
+} StoreWrite;
+
+typedef struct Store {
+  sqlite3 *db;
+  sqlite3_int64 hub_id;
+
+  StoreWrite *pending;
+  StoreWrite *pending_last;
+  size_t pending_count;
+} Store;
+
+/**
+ * Opens the database and finds (or adds) the row for this hub.
+ *
+ * @brief Opens a Store.
+ * @param path : sqlite3 database file, already loaded with schema.sql.
+ * @param hub_name : The hub's name to keep this hub's data apart.
+ * @return Store * : The store or NULL if it couldn't open.
+ */
+Store *Store_open(const char *path, bstring hub_name);
+
+/**
+ * @brief Flushes anything still pending and closes the database.
+ * @param store : Store to close.
+ */
+void Store_close(Store *store);
+
+/**
+ * Loads all of this hub's cabals and their rosters.  A row that doesn't
+ * make sense (no name, a second cabal with the same name, a member of a
+ * cabal that isn't there, a key that won't fingerprint) is logged and
+ * skipped so one bad row doesn't keep the hub from starting.
+ *
+ * @brief Loads all of this hub's cabals and their rosters.
+ * @param store : Store to load from.
+ * @param cabals : Cabal map to add them to.
+ * @return int : 1 for success, 0 if the queries themselves failed.
+ */
+int Store_load_cabals(Store *store, Heap *cabals);
+
+/**
+ * Runs every pending write inside one transaction and empties the
+ * list.  A write that fails is logged and the rest still go in.
+ *
+ * @brief Writes out everything pending.
+ * @param store : Store to flush.
+ * @return int : 1 if everything was written, 0 if anything failed.
+ */
+int Store_flush(Store *store);
+
+/**
+ * @brief Queues saving a new cabal and its owner.
+ * @param store : Store to save in.
+ * @param cabal : The new cabal.
+ */
+void Store_cabal_create(Store *store, Cabal *cabal);
+
+/**
+ * @brief Queues recording that the member is in the cabal.
+ * @param store : Store to save in.
+ * @param cabal : A cabal already given to Store_cabal_create.
+ * @param member : Member joining.
+ */
+void Store_cabal_join(Store *store, Cabal *cabal, Member *member);
+
+/**
+ * @brief Queues recording that the member left the cabal.
+ * @param store : Store to save in.
+ * @param cabal : A cabal already given to Store_cabal_create.
+ * @param member : Member leaving.
+ */
+void Store_cabal_leave(Store *store, Cabal *cabal, Member *member);
+
+#endif
@@ -12,6 +12,7 @@
  */
 
 #include "crypto.h"
+#include "stackish/template.h"
 
 /* This needs to be here because APPLE is fucking retarded. */
 ltc_math_descriptor ltc_mp;
@@ -37,6 +38,10 @@ static int global_cipher_idx;
 
 static int CryptState_initialized = 0;
 
+/** The envelope every message is sent in, read once. */
+static NodeTemplate *CRYPT_ENV_CONS = NULL;
+static NodeTemplate *CRYPT_ENV_DECONS = NULL;
+
 int CryptState_init()
 {
   assert(!errno && "bad errno before CryptState_init");
@@ -329,7 +334,7 @@ Node *CryptState_receiver_send_final(CryptState *state, bstring *hbuf)
   assert_not(hbuf, NULL);
 
   // base empty header since it's always required
-  *hbuf = bfromcstr("[ header \n");
+  *hbuf = state->final_header ? bstrcpy(state->final_header) : bfromcstr("[ header \n");
   check(*hbuf, "failed to allocate header");
 
   // generate our random nonce to be used from now on
@@ -475,7 +480,7 @@ Node *CryptState_initiator_send_final(CryptState *state, bstring *hbuf)
   assert_not(state, NULL);
   assert_not(hbuf, NULL);
   
-  *hbuf = bfromcstr("[ header \n");
+  *hbuf = state->final_header ? bstrcpy(state->final_header) : bfromcstr("[ header \n");
 
   payload = Node_cons("[nnw",
       state->them.nonce.num.right, state->them.nonce.num.left, CRYPT_INIT_MSG);
@@ -541,7 +546,7 @@ Node *CryptState_encrypt_packet(CryptState *state, symmetric_key *key, bstring h
   bsetsize(tag,taglen);
   CryptState_nonce_inc(&state->them.nonce);
 
-  Node *msg = Node_cons("[bbw", payload, tag, CRYPT_ENV_MSG);
+  Node *msg = NodeTemplate_cons(NodeTemplate_once(CRYPT_ENV_CONS, "[bbw", CRYPT_ENV_MSG), payload, tag);
 
   return msg;
   // TODO: wipe the results from memory on failure
@@ -581,7 +586,7 @@ bstring CryptState_decrypt_packet(CryptState *state, symmetric_key *key, bstring
   assert_not(header, NULL);
   assert_not(packet, NULL);
 
-  rc = Node_decons(packet, 0, "[bbw", &rectag, &payload, CRYPT_ENV_MSG);
+  rc = NodeTemplate_decons(NodeTemplate_once(CRYPT_ENV_DECONS, "[bbw", CRYPT_ENV_MSG), packet, 0, &rectag, &payload);
   check(rc, "failed to deconstruct msg");
 
   rc = ccm_memory(global_cipher_idx, NULL, 0, key,
@@ -711,19 +716,63 @@ bstring CryptState_hash(const unsigned char *data, size_t length)
 
 
 
+static int CryptState_hash_write(void *data, const void *bytes, size_t length)
+{
+  return hash_descriptor[global_hash_idx].process((hash_state *)data, bytes, length) == CRYPT_OK;
+}
+
+StackishSink CryptState_hash_sink(hash_state *md)
+{
+  StackishSink sink = { CryptState_hash_write, NULL };
+  int rc = 0;
+
+  assert_not(md, NULL);
+
+  rc = hash_descriptor[global_hash_idx].init(md);
+  assert(rc == CRYPT_OK && "failed to start a hash");
+  sink.data = md;
+
+  return sink;
+}
+
+bstring CryptState_hash_done(hash_state *md)
+{
+  bstring hash = bfromcstralloc(MAXBLOCKSIZE, "");
+  int rc = 0;
+
+  assert_not(md, NULL);
+  assert_mem(hash);
+
+  rc = hash_descriptor[global_hash_idx].done(md, bdata(hash));
+  ltc_ok(rc, "Failed to finish the hash.");
+  bsetsize(hash, hash_descriptor[global_hash_idx].hashsize);
+
+  return hash;
+  on_fail(bdestroy(hash); return NULL);
+}
+
+
 Node *CryptState_sign_node(ecc_key *private_key, bstring name, Node *input)
 {
   bstring hash = NULL, signature = NULL, payload = NULL, public_key = NULL;
   unsigned long out_len = MAXBLOCKSIZE;
   Node *result = NULL;
   int rc = 0;
+  hash_state md;
+  StackishTee tee;
+  StackishWriter out;
+
+  // write the node out as the payload and hash it in the same pass
+  payload = bfromcstralloc(256, "");
+  assert_mem(payload);
+  tee.first = StackishSink_bstr(payload);
+  tee.second = CryptState_hash_sink(&md);
 
-  // convert the node to a bstring to hash
-  payload = Node_bstr(input, ' ');
-  check(payload, "Failed to convert Node to BLOB to sign.");
+  StackishWriter_start(&out, StackishSink_tee(&tee));
+  StackishWriter_node(&out, input, ' ');
+  check(StackishWriter_finish(&out), "Failed to convert Node to BLOB to sign.");
 
-  // hash the node to get the resulting value to sign
-  hash = CryptState_hash_bstr(payload);
+  hash = CryptState_hash_done(&md);
   check(hash, "Failed to hash the payload to sign.");
 
   // sign the hash
@@ -81,6 +81,7 @@
 #include <myriad/bstring/bstrlib.h>
 #include <tomcrypt.h>
 #include "stackish/stackish.h"
+#include "stackish/writer.h"
 
 /** Hate challenge node root. */
 #define CRYPT_CHALLENGE_MSG "challenge"
@@ -136,6 +137,12 @@ typedef struct CryptState {
   CryptPeer them;
   void *data;
 
+  /** 
+   * The authenticated header to send with our final handshake message,
+   * or NULL for the plain "[ header \n".  Not owned, it's copied.
+   */
+  bstring final_header;
+
   symmetric_key shared;
 } CryptState;
 
@@ -277,7 +284,8 @@ int CryptState_receiver_process_response(CryptState *state, bstring hbuf, Node *
  * and verify it's validity.
  *
  * hbuf is an out parameter that contains the header to send to the
- * initiator exactly as-is.
+ * initiator exactly as-is.  It's a copy of state->final_header if
+ * that's set.
  */
 Node *CryptState_receiver_send_final(CryptState *state, bstring *hbuf);
 
@@ -324,6 +332,7 @@ int CryptState_initiator_process_response(CryptState *state, bstring header, Nod
  *
  * Just like CryptState_receiver_done() this method clears the shared key and
  * finalizes the two session keys for further encrypted communication.
+ * The header in hbuf is a copy of state->final_header if that's set.
  */
 Node *CryptState_initiator_send_final(CryptState *state, bstring *hbuf);
 
@@ -404,6 +413,26 @@ bstring CryptState_fingerprint_bstr(bstring key);
  */
 bstring CryptState_hash(const unsigned char *data, size_t length);
 
+/** 
+ * Starts md on the same hash CryptState_hash uses, and gives back a
+ * sink that feeds it, so whatever a StackishWriter writes is hashed as
+ * it goes.  Get the hash with CryptState_hash_done.
+ *
+ * @function CryptState_hash_sink
+ * @brief Makes a sink that hashes what's written to it.
+ * @param md : Hash state that has to live as long as the writer.
+ * @return StackishSink : The sink for StackishWriter_start.
+ */
+StackishSink CryptState_hash_sink(hash_state *md);
+
+/** 
+ * @function CryptState_hash_done
+ * @brief Finishes a hash started with CryptState_hash_sink.
+ * @param md : The hash state.
+ * @return bstring : The resulting hash, same as CryptState_hash of the bytes.
+ */
+bstring CryptState_hash_done(hash_state *md);
+
 
 /** 
  * Used when a peer needs to sign a message to prove that they actually
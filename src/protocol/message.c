@@ -13,16 +13,27 @@
 
 
 #include "message.h"
+#include "slab.h"
+#include "stackish/template.h"
 #include <time.h>
 
-void *message_test_calloc()
+/** The formats used on every message, read once. */
+static NodeTemplate *MESSAGE_HEADER_CONS = NULL;
+static NodeTemplate *MESSAGE_HEADER_DECONS = NULL;
+static NodeTemplate *MESSAGE_BODY_DECONS = NULL;
+
+static const MessageAllocator MESSAGE_SLAB_ALLOCATOR = { Slab_calloc, Slab_free };
+
+static MessageAllocator message_allocator = { Slab_calloc, Slab_free };
+
+void Message_set_allocator(const MessageAllocator *allocator)
 {
-  return calloc(1, sizeof(Message));
+  message_allocator = allocator ? *allocator : MESSAGE_SLAB_ALLOCATOR;
 }
 
 Message* Message_alloc(Node *hdr, Node *body) 
 {
-  Message *msg = message_test_calloc();
+  Message *msg = message_allocator.alloc(sizeof(Message));
   assert_mem(msg);
 
   msg->hdr = hdr;
@@ -38,6 +49,18 @@ Message* Message_alloc(Node *hdr, Node *body)
   return msg;
 }
 
+Message *Message_alloc_raw(Node *hdr, bstring raw)
+{
+  Message *msg = NULL;
+
+  assert_not(raw, NULL);
+
+  msg = Message_alloc(hdr, NULL);
+  msg->raw = raw;
+
+  return msg;
+}
+
 Message* Message_decons(Node *hdr, Node *body)
 {
   Message *msg = NULL;
@@ -51,11 +74,11 @@ Message* Message_decons(Node *hdr, Node *body)
 
   check_then(msg->type, "body's type was NULL", Node_dump(body, ' ', 1));
 
-  rc = Node_decons(hdr, 0, "[nw", &msg->msgid, "header");
+  rc = NodeTemplate_decons(NodeTemplate_once(MESSAGE_HEADER_DECONS, "[nw", "header"), hdr, 0, &msg->msgid);
   check(rc, "failed to deconstruct node");
 
   // don't process the word name but instead take it directly off the root
-  rc = Node_decons(body, 0, "[G.", &msg->data);
+  rc = NodeTemplate_decons(NodeTemplate_once(MESSAGE_BODY_DECONS, "[G."), body, 0, &msg->data);
   check_then(rc, "failed to deconstruct body", Node_dump(body, ' ', 1));
 
   Message_ref_dec(msg);  // don't need it anymore, it's the caller's problem
@@ -66,7 +89,7 @@ Message* Message_decons(Node *hdr, Node *body)
 
 inline Node *Message_cons_header(uint64_t msgid)
 {
-  return Node_cons("[nw", msgid,  "header");
+  return NodeTemplate_cons(NodeTemplate_once(MESSAGE_HEADER_CONS, "[nw", "header"), msgid);
 }
 
 Node *Message_cons(Node **hdr, uint64_t msgid, Node *data, const char *type)
@@ -86,16 +109,71 @@ void Message_destroy(Message *msg)
 {
   assert_not(msg, NULL);
 
-  Message_ref_dec(msg);
-  assert(msg->ref_count >= 0 && "reference count decremented too far");
+  assert(msg->ref_count > 0 && "reference count decremented too far");
 
-  if(msg->ref_count == 0) {
+  // only the one who drops the last reference sees 0, so only one frees it
+  if(Message_ref_dec(msg) == 0) {
+    // raw and bin can be views in the body's arena, so they have to go first
+    if(msg->raw) bdestroy(msg->raw);
+    if(msg->bin) bdestroy(msg->bin);
     if(msg->hdr) Node_destroy(msg->hdr);
     if(msg->body) Node_destroy(msg->body);
-    free(msg);
+    message_allocator.release(msg, sizeof(Message));
   }
 }
 
+bstring Message_bytes(Message *msg)
+{
+  return Message_bytes_as(msg, NODE_CODEC_TEXT);
+}
+
+bstring Message_bytes_as(Message *msg, NodeCodec codec)
+{
+  bstring bytes = NULL;
+  bstring *cached = NULL;
+  Node *body = NULL;
+
+  assert_not(msg, NULL);
+
+  cached = codec == NODE_CODEC_BINARY ? &msg->bin : &msg->raw;
+
+  if(*cached == NULL && (msg->body != NULL || msg->raw != NULL)) {
+    if(msg->body != NULL) {
+      bytes = Node_encode(msg->body, codec);
+    } else {
+      // written straight to bytes (see Message_alloc_raw), so the other form comes from those
+      body = Node_parse(msg->raw);
+      check(body, "failed to parse message bytes");
+      bytes = Node_encode(body, codec);
+      Node_destroy(body);
+    }
+
+    check(bytes, "failed to serialize message body");
+
+    // whoever gets there first wins, everyone else uses theirs
+    if(!__sync_bool_compare_and_swap(cached, NULL, bytes)) {
+      bdestroy(bytes);
+    }
+  }
+
+  return *cached;
+  on_fail(return NULL);
+}
+
+void Message_changed(Message *msg)
+{
+  assert_not(msg, NULL);
+
+  if(msg->raw) {
+    bdestroy(msg->raw);
+    msg->raw = NULL;
+  }
+
+  if(msg->bin) {
+    bdestroy(msg->bin);
+    msg->bin = NULL;
+  }
+}
 
 void Message_dump(Message *msg)
 {
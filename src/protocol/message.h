@@ -16,6 +16,8 @@
 
 #include <myriad/myriad.h>
 #include "stackish/node.h"
+#include "stackish/binary.h"
+#include "protocol/trace.h"
 
 struct Member;
 
@@ -30,6 +32,14 @@ struct Member;
  * No element is optional (but can be empty).
  *
  * ORDER IS REQUIRED to keep the message format canonical.
+ *
+ * A Message is immutable once it's been put on a MsgQueue.  Anything that
+ * needs to change it (like adding \@from) has to happen before the first
+ * Member_send_msg, and after that the hdr, body, and data are only read.
+ * That's what lets one Message be fanned out to any number of queues,
+ * even ones served by other threads, without copying it.  The ref_count
+ * is the only thing that changes, and it's only touched with
+ * Message_ref_inc and Message_ref_dec which are atomic.
  */
 typedef struct Message {
   uint64_t msgid;
@@ -42,9 +52,47 @@ typedef struct Message {
   Node *hdr;
   Node *body;
 
-  short ref_count;
+  /** Decrypted size in bytes when it came off the wire, 0 for ones the Hub makes. */
+  size_t size;
+
+  /** 
+   * The serialized body that gets encrypted for each recipient.  It's
+   * the bytes that came off the wire, or made by Message_bytes the first
+   * time the message is sent.  Dropped by Message_changed.  Use
+   * Message_bytes rather than reading this directly.
+   */
+  bstring raw;
+
+  /** Same as raw but in the binary form, for members that talk it. */
+  bstring bin;
+
+  /** Set when the message was picked to be traced, see trace.h. */
+  TraceStamps trace;
+
+  /** Only change with Message_ref_inc and Message_ref_dec. */
+  uint32_t ref_count;
 } Message;
 
+/**
+ * Where Messages get their memory.  By default they come from the
+ * per thread slab (see slab.h), but tests can swap in their own to
+ * count or fail allocations.  The release gets the same size that
+ * alloc was given, and alloc has to return zeroed memory.
+ */
+typedef struct MessageAllocator {
+  void *(*alloc)(size_t size);
+  void (*release)(void *ptr, size_t size);
+} MessageAllocator;
+
+/**
+ * Only change this when there aren't any Messages alive, since they
+ * have to be released by the allocator that made them.
+ *
+ * @brief Sets the allocator for new Messages.
+ * @param allocator : The allocator to copy in, or NULL for the slab.
+ */
+void Message_set_allocator(const MessageAllocator *allocator);
+
 /**
  * Used mostly internally and in testing, but it creates
  * the initial raw memory for a Message, sets ref count = 0,
@@ -61,6 +109,22 @@ typedef struct Message {
  */
 Message *Message_alloc(Node *hdr, Node *body);
 
+/**
+ * Same as Message_alloc() but for a body that was written straight to
+ * canonical bytes with a StackishWriter (see writer.h) and never built
+ * as Nodes, like the hub's responses.  The message owns raw, and it's
+ * sent as is.  There's no body or data to read, and the binary form is
+ * only made (from raw) if a member that talks it gets the message.
+ *
+ * You must call Message_ref_inc on what's returned.
+ *
+ * @brief Allocates a message for bytes that are already written.
+ * @param hdr The header to be used later, can be NULL.
+ * @param raw The canonical body bytes, ending in \n.
+ * @return Initial message.
+ */
+Message *Message_alloc_raw(Node *hdr, bstring raw);
+
 /** 
  * Deconstructs Nodes into an Message suitable for delivery to a Member.
  * It's still collectable by the caller until you put it on a MsgQueue
@@ -95,6 +159,40 @@ Message* Message_decons(Node *hdr, Node *body);
  */
 Node *Message_cons(Node **hdr, uint64_t msgid, Node *data, const char *type);
 
+/**
+ * Gives the serialized body of the message, serializing it only the
+ * first time so a message delivered to 1000 members is serialized once.
+ * The buffer belongs to the message and lives as long as it does, so
+ * don't change or destroy it.  Safe to call from any thread sharing
+ * the message, if two race one of them just throws its copy away.
+ *
+ * @param msg The message to serialize.
+ * @return The body bytes, or NULL if the message has no body.
+ */
+bstring Message_bytes(Message *msg);
+
+/**
+ * Same as Message_bytes() but in the encoding a member's peer talks
+ * (see binary.h).  Each form is made at most once and kept, so the hub
+ * only transcodes when the sender and a recipient talk different ones.
+ * The canonical text from Message_bytes is still the one to sign.
+ *
+ * @param msg The message to serialize.
+ * @param codec Which encoding.
+ * @return The body bytes, or NULL if the message has no body.
+ */
+bstring Message_bytes_as(Message *msg, NodeCodec codec);
+
+/**
+ * Call this before changing a message that came off the wire (like
+ * adding \@from) so its raw and bin bytes are dropped and
+ * recipients get the changed body instead.  Like any change, only do it
+ * before the message is enqueued.
+ *
+ * @param msg The message about to be changed.
+ */
+void Message_changed(Message *msg);
+
 /**
  * Does a simplistic dump of the message for debugging.
  *
@@ -119,6 +217,9 @@ void Message_destroy(Message *msg);
  */
 Node *Message_cons_header(uint64_t msgid);
 
-#define Message_ref_inc(M) ((M)->ref_count++)
-#define Message_ref_dec(M) ((M)->ref_count--)
+/** Atomically adds a reference, giving back the new count. */
+#define Message_ref_inc(M) (__sync_add_and_fetch(&(M)->ref_count, 1))
+
+/** Atomically drops a reference, giving back the new count. */
+#define Message_ref_dec(M) (__sync_sub_and_fetch(&(M)->ref_count, 1))
 #endif
@@ -13,6 +13,11 @@
 
 
 #include "peer.h"
+#include "stackish/arena.h"
+#include "stackish/query.h"
+
+/** Offered by the receiver and sent back by the initiator to agree on binary. */
+static struct tagbstring PEER_CODEC_OFFER = bsStatic("[ \"" NODE_BINARY_CODEC "\" @codec header \n");
 
 
 Peer *Peer_create(CryptState *state, int fd, CryptState_key_confirm_cb key_confirm)
@@ -32,10 +37,30 @@ Peer *Peer_create(CryptState *state, int fd, CryptState_key_confirm_cb key_confi
   peer->source.in =  sbuf_create(pool, PEER_DEFAULT_IO_BUF_SIZE);
   assert_mem(peer->source.in);
   peer->key_confirm = key_confirm;
+  peer->binary_ok = 1;
+  peer->codec = NODE_CODEC_TEXT;
 
   return peer;
 }
 
+/** Looks for the binary offer in a handshake header. */
+static NodeCodec Peer_codec_in(Node *hdr)
+{
+  static NodeQuery *CODEC = NULL;
+  NodeQueryCursor cursor;
+  Node *codec = NULL;
+
+  NodeQuery_start(&cursor, NodeQuery_once(CODEC, "*/@codec"), hdr);
+
+  while((codec = NodeQuery_next(&cursor)) != NULL) {
+    if(codec->type == TYPE_STRING && biseqcstr(codec->value.string, NODE_BINARY_CODEC)) {
+      return NODE_CODEC_BINARY;
+    }
+  }
+
+  return NODE_CODEC_TEXT;
+}
+
 void Peer_destroy(Peer *peer, int crypt_too)
 {
   if(peer) {
@@ -71,7 +96,10 @@ int Peer_establish_receiver(Peer *peer)
   Node_destroy(ihdr); ihdr = NULL;
   bdestroy(header);
 
+  // offer binary in our final header, they take it by sending it back in theirs
+  state->final_header = peer->binary_ok ? &PEER_CODEC_OFFER : NULL;
   rmsg = CryptState_receiver_send_final(state, &header); 
+  state->final_header = NULL;
   check(rmsg, "failed to build receiver final message");
 
   rc = FrameSource_send(peer->source, header, rmsg, 1);
@@ -85,6 +113,8 @@ int Peer_establish_receiver(Peer *peer)
   rc = CryptState_receiver_done(state, header, imsg);
   check(rc, "failed to process final message");
 
+  peer->codec = peer->binary_ok ? Peer_codec_in(ihdr) : NODE_CODEC_TEXT;
+
   ensure(bdestroy(header); 
       if(rmsg) Node_destroy(rmsg);
       if(imsg) Node_destroy(imsg);
@@ -124,7 +154,11 @@ int Peer_establish_initiator(Peer *peer)
   check(rc, "failed to process receiver response");
   Node_destroy(rmsg); bdestroy(header); rmsg = NULL;
 
+  // take binary if they offered it, and tell them by sending the offer back
+  peer->codec = peer->binary_ok ? Peer_codec_in(rhdr) : NODE_CODEC_TEXT;
+  state->final_header = peer->codec == NODE_CODEC_BINARY ? &PEER_CODEC_OFFER : NULL;
   imsg = CryptState_initiator_send_final(state, &header);
+  state->final_header = NULL;
   check(imsg, "failed to generate final message");
 
   rc = FrameSource_send(peer->source, header, imsg, 1);
@@ -147,12 +181,38 @@ Node *Peer_recv(Peer *peer, Node **rhdr)
   Node *packet = NULL;
   Node *msg = NULL;
   bstring header = NULL;
+  bstring pbuf = NULL;
+
+  // it's a view owned by the last body's arena, which could be gone already
+  peer->recv_size = 0;
+  peer->recv_raw = NULL;
 
   packet = FrameSource_recv(peer->source, &header, rhdr);
   if(!packet) return NULL; // socket probably closed
 
-  msg = CryptState_decrypt_node(state, &state->me.skey, header, packet);
-  check(msg, "failed to decrypt message");
+  peer->recv_trace.read_ns = Trace_sample() ? Trace_now_ns() : 0;
+  peer->recv_trace.decrypt_ns = 0;
+
+  // same as CryptState_decrypt_node but we want the size on the way
+  pbuf = CryptState_decrypt_packet(state, &state->me.skey, header, packet);
+  check(pbuf && blength(pbuf) > 0, "failed to decrypt message");
+
+  peer->recv_size = blength(pbuf);
+  peer->recv_codec = Node_is_binary(pbuf) ? NODE_CODEC_BINARY : NODE_CODEC_TEXT;
+  check_then(peer->recv_codec == peer->codec || peer->recv_codec == NODE_CODEC_TEXT,
+      "binary message from a peer that didn't agree to it", bdestroy(pbuf));
+
+  // the message goes in one arena that owns pbuf, and its blobs point into pbuf
+  msg = Node_parse_lazy(pbuf, peer->parse_depth);
+  check(msg, "failed to parse decrypted message");
+
+  // keep the bytes so they can be sent on without serializing the Node again
+  peer->recv_raw = NodeArena_view(msg->arena, (const char *)bdata(pbuf), blength(pbuf));
+
+  if(peer->recv_trace.read_ns) {
+    peer->recv_trace.decrypt_ns = Trace_now_ns();
+    Trace_record(TRACE_DECRYPT, peer->recv_trace.read_ns, peer->recv_trace.decrypt_ns);
+  }
 
   ensure(Node_destroy(packet); 
       bdestroy(header);
@@ -169,11 +229,42 @@ int Peer_send(Peer *peer, Node *header, Node *payload)
   CryptState *state = peer->state;
   Node *msg = NULL;
   int rc = 0;
+  bstring pbuf = NULL;
+  bstring hbuf = Node_bstr(header, 1);
+  check(hbuf, "failed to convert header to bstring");
+
+  // encryption is done in place and the packet owns the result
+  pbuf = Node_encode(payload, peer->codec);
+  check_then(pbuf, "failed to encode payload", bdestroy(hbuf); rc = 0);
+
+  msg = CryptState_encrypt_packet(state, &state->them.skey, hbuf, pbuf);
+  check_then(msg, "failed to encrypt payload", bdestroy(pbuf); rc = 0);
+
+  rc = FrameSource_send(peer->source, hbuf, msg, 1);
+  Node_destroy(msg); bdestroy(hbuf);
+  check(rc, "failed to send");
+
+  ensure(return rc);
+}
+
+
+int Peer_send_raw(Peer *peer, Node *header, bstring payload)
+{
+  assert_not(peer, NULL);
+  assert_not(header, NULL);
+  assert_not(payload, NULL);
+
+  CryptState *state = peer->state;
+  Node *msg = NULL;
+  int rc = 0;
+  bstring pbuf = NULL;
   bstring hbuf = Node_bstr(header, 1);
   check(hbuf, "failed to convert header to bstring");
 
-  msg = CryptState_encrypt_node(state, &state->them.skey, hbuf, payload);
-  check_then(msg, "failed to encrypt payload", rc = 0);
+  // encryption is done in place and the packet owns the result
+  pbuf = bstrcpy(payload);
+  msg = CryptState_encrypt_packet(state, &state->them.skey, hbuf, pbuf);
+  check_then(msg, "failed to encrypt payload", bdestroy(pbuf); rc = 0);
 
   rc = FrameSource_send(peer->source, hbuf, msg, 1);
   Node_destroy(msg); bdestroy(hbuf);
@@ -18,6 +18,8 @@
 
 #include "crypto.h"
 #include "frame.h"
+#include "trace.h"
+#include "stackish/binary.h"
 
 #define PEER_DEFAULT_IO_BUF_SIZE (32 * 1024)
 
@@ -34,6 +36,38 @@ typedef struct Peer {
   pool_t *pool;
   FrameSource source;
   CryptState_key_confirm_cb key_confirm;
+
+  /** 
+   * Whether to offer (or take) the binary stackish form while
+   * establishing, on by default.  Change it before Peer_establish_*.
+   */
+  int binary_ok;
+
+  /** What both sides agreed to talk, text unless they both wanted binary. */
+  NodeCodec codec;
+
+  /** 
+   * How many levels of a received text message Peer_recv builds, the
+   * groups under that are deferred (see Node_parse_lazy).  0, the
+   * default, builds all of it.
+   */
+  size_t parse_depth;
+
+  /** Which form the last message from Peer_recv came in. */
+  NodeCodec recv_codec;
+
+  /** Decrypted size of the last message from Peer_recv. */
+  size_t recv_size;
+
+  /** 
+   * Decrypted bytes of the last message from Peer_recv.  It's a view
+   * owned by the body's arena (see Node_parse_view), so it's only good
+   * as long as the body is.  bdestroy on it does nothing.
+   */
+  bstring recv_raw;
+
+  /** Trace stamps for the last message from Peer_recv, 0 if it wasn't sampled. */
+  TraceStamps recv_trace;
 } Peer;
 
 
@@ -67,7 +101,12 @@ void Peer_destroy(Peer *peer, int crypt_too);
  * messages of the most basic type using crypto and frame
  * APIs.  What is does is call Framing_recv to get a 
  * message, then it decrypts it to create the rhdr out
- * parameter and returned Node body.
+ * parameter and returned Node body.  The decrypted size
+ * of the body is left in peer->recv_size and the decrypted bytes
+ * in peer->recv_raw.  The body is parsed with Node_parse_view, so
+ * its blobs point into those bytes instead of being copies.  The
+ * bytes are text or binary, peer->recv_codec says which, and binary is
+ * only accepted if it was agreed to.
  *
  * @param peer The peer to recv from.
  * @param rhdr OUT parameter that will have the header to send.
@@ -81,7 +120,7 @@ Node *Peer_recv(Peer *peer, Node **rhdr);
 /**
  * The inverse of Peer_recv() this takes a header
  * and payload and sends it.  The header is *not* encrypted
- * but the payload is.  The header is included in the AAD
+ * but the payload is, and it's serialized in peer->codec.  The header is included in the AAD
  * so if it is tampered with then the receiver will know.
  *
  * @param peer The peer to send to.
@@ -91,6 +130,19 @@ Node *Peer_recv(Peer *peer, Node **rhdr);
  */
 int Peer_send(Peer *peer, Node *header, Node *payload);
 
+/**
+ * Same as Peer_send() but the payload is already serialized in
+ * peer->codec, like from Message_bytes_as().  The payload is
+ * copied before it's encrypted so the caller's bytes aren't touched,
+ * which means many peers can send the same payload.
+ *
+ * @param peer The peer to send to.
+ * @param header The header node to send.
+ * @param payload The unencrypted serialized payload, not changed.
+ * @return 0 on failure and 1 on success.
+ */
+int Peer_send_raw(Peer *peer, Node *header, bstring payload);
+
 
 /**
  * Establishes the communications for an initiator.
@@ -98,6 +150,11 @@ int Peer_send(Peer *peer, Node *header, Node *payload);
  * uses the Myriad Task functions so you can have
  * other stuff happen at the same time.
  *
+ * If the receiver offers the binary form in its final header and
+ * peer->binary_ok is set, the initiator takes it by sending the same
+ * "@codec" string back in its own final header.  Both headers are
+ * authenticated so nobody in the middle can change what's picked.
+ *
  * TODO: Gotta allow for a callback to let them confirm the
  * key.
  *
@@ -110,7 +167,8 @@ int Peer_establish_initiator(Peer *peer);
 /**
  * The analog to the Peer_establish_initiator() function,
  * this is used by the receiver to setup the communication
- * and confirms their communication.
+ * and confirms their communication.  It offers the binary form
+ * when peer->binary_ok is set, and older initiators just ignore it.
  *
  * TODO: Also needs a confirm key callback.
  *
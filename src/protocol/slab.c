@@ -0,0 +1,133 @@
+/*
+ * Utu -- Saving The Internet With Hate
+ *
+ * Copyright (c) Zed A. Shaw 2005 (zedshaw@zedshaw.com)
+ *
+ * This file is modifiable/redistributable under the terms of the GNU
+ * General Public License.
+ *
+ * You should have recieved a copy of the GNU General Public License along
+ * with this program; see the file COPYING. If not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 0211-1307, USA.
+ */
+
+#include "slab.h"
+
+typedef struct SlabBlock {
+  struct SlabBlock *next;
+} SlabBlock;
+
+typedef struct SlabClass {
+  SlabBlock *free;
+  size_t free_count;
+} SlabClass;
+
+typedef struct Slab {
+  SlabClass classes[SLAB_CLASSES];
+  SlabStats stats;
+} Slab;
+
+static __thread Slab slab_local;
+
+/** Finds the smallest class that fits size, or -1 if it's too big. */
+static inline int Slab_class_for(size_t size)
+{
+  int i = 0;
+  size_t class_size = SLAB_MIN_SIZE;
+
+  for(i = 0; i < SLAB_CLASSES; i++, class_size <<= 1) {
+    if(size <= class_size) return i;
+  }
+
+  return -1;
+}
+
+/** Frees blocks off the class's freelist until only keep are left. */
+static size_t SlabClass_trim(SlabClass *sc, size_t keep)
+{
+  SlabBlock *block = NULL;
+  size_t count = 0;
+
+  while(sc->free_count > keep) {
+    block = sc->free;
+    sc->free = block->next;
+    sc->free_count--;
+    free(block);
+    count++;
+  }
+
+  slab_local.stats.trimmed += count;
+  slab_local.stats.free_blocks -= count;
+  return count;
+}
+
+void *Slab_calloc(size_t size)
+{
+  int cls = Slab_class_for(size);
+  SlabClass *sc = NULL;
+  SlabBlock *block = NULL;
+
+  slab_local.stats.allocs++;
+
+  if(cls < 0) {
+    return calloc(1, size);
+  }
+
+  sc = &slab_local.classes[cls];
+
+  if(sc->free) {
+    block = sc->free;
+    sc->free = block->next;
+    sc->free_count--;
+    slab_local.stats.hits++;
+    slab_local.stats.free_blocks--;
+    memset(block, 0, size);
+    return block;
+  } else {
+    // always allocate the full class size so it can be reused for anything in the class
+    return calloc(1, SLAB_MIN_SIZE << cls);
+  }
+}
+
+void Slab_free(void *ptr, size_t size)
+{
+  int cls = Slab_class_for(size);
+  SlabClass *sc = NULL;
+  SlabBlock *block = (SlabBlock *)ptr;
+
+  if(ptr == NULL) return;
+
+  slab_local.stats.frees++;
+
+  if(cls < 0) {
+    free(ptr);
+    return;
+  }
+
+  sc = &slab_local.classes[cls];
+  block->next = sc->free;
+  sc->free = block;
+  sc->free_count++;
+  slab_local.stats.free_blocks++;
+
+  if(sc->free_count > SLAB_MAX_FREE) {
+    SlabClass_trim(sc, SLAB_MAX_FREE / 2);
+  }
+}
+
+size_t Slab_trim(size_t keep)
+{
+  int i = 0;
+  size_t count = 0;
+
+  for(i = 0; i < SLAB_CLASSES; i++) {
+    count += SlabClass_trim(&slab_local.classes[i], keep);
+  }
+
+  return count;
+}
+
+SlabStats Slab_stats()
+{
+  return slab_local.stats;
+}
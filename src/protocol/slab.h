@@ -0,0 +1,88 @@
+#ifndef utu_slab_h
+#define utu_slab_h
+
+/*
+ * Utu -- Saving The Internet With Hate
+ *
+ * Copyright (c) Zed A. Shaw 2005 (zedshaw@zedshaw.com)
+ *
+ * This file is modifiable/redistributable under the terms of the GNU
+ * General Public License.
+ *
+ * You should have recieved a copy of the GNU General Public License along
+ * with this program; see the file COPYING. If not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 0211-1307, USA.
+ */
+
+#include <myriad/myriad.h>
+
+/**
+ * A small per thread slab allocator for the little objects the Hub
+ * makes and throws away for every message (mostly Messages).  Blocks
+ * are kept on freelists by size class instead of going back to malloc,
+ * so the next allocation of that size is just a pop.  Anything bigger
+ * than the largest class goes straight to malloc.
+ *
+ * Each block is its own malloc, so a block allocated by one thread
+ * and freed by another just lands on the second thread's freelist,
+ * which means Messages can be freed by whatever thread drops the last
+ * reference.  Freelists are trimmed back when they grow past
+ * SLAB_MAX_FREE, and Slab_trim lets you cut them down further when
+ * things are quiet.
+ */
+
+/** Number of size classes, sizes are SLAB_MIN_SIZE doubled each class. */
+#define SLAB_CLASSES 6
+
+/** Smallest size class, must be at least sizeof(void *). */
+#define SLAB_MIN_SIZE 32
+
+/** Biggest size the slab handles, more than this is just malloc. */
+#define SLAB_MAX_SIZE (SLAB_MIN_SIZE << (SLAB_CLASSES - 1))
+
+/** Most blocks a size class keeps free before trimming back to half. */
+#define SLAB_MAX_FREE 1024
+
+/** Counts for one thread's slab. */
+typedef struct SlabStats {
+  uint64_t allocs;
+  uint64_t frees;
+  /** Allocations that came off a freelist rather than malloc. */
+  uint64_t hits;
+  /** Blocks given back to malloc by trimming. */
+  uint64_t trimmed;
+  /** Blocks sitting on the freelists right now. */
+  uint64_t free_blocks;
+} SlabStats;
+
+/**
+ * @brief Gets zeroed memory of size bytes.
+ * @param size : Bytes needed.
+ * @return void * : The memory or NULL if out of memory.
+ */
+void *Slab_calloc(size_t size);
+
+/**
+ * You have to give the same size you gave Slab_calloc, since that's
+ * how it knows which freelist the block goes on.
+ *
+ * @brief Gives back memory from Slab_calloc.
+ * @param ptr : Memory to free, can be NULL.
+ * @param size : The size it was allocated with.
+ */
+void Slab_free(void *ptr, size_t size);
+
+/**
+ * @brief Frees this thread's spare blocks back down to keep per size class.
+ * @param keep : How many free blocks each class can keep, 0 for none.
+ * @return size_t : How many blocks were freed.
+ */
+size_t Slab_trim(size_t keep);
+
+/**
+ * @brief Copies out this thread's slab counts.
+ * @return SlabStats : The counts.
+ */
+SlabStats Slab_stats();
+
+#endif
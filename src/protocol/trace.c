@@ -0,0 +1,106 @@
+/*
+ * Utu -- Saving The Internet With Hate
+ *
+ * Copyright (c) Zed A. Shaw 2005 (zedshaw@zedshaw.com)
+ *
+ * This file is modifiable/redistributable under the terms of the GNU
+ * General Public License.
+ *
+ * You should have recieved a copy of the GNU General Public License along
+ * with this program; see the file COPYING. If not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 0211-1307, USA.
+ */
+
+#include "trace.h"
+#include <time.h>
+
+unsigned int Trace_sample_rate = TRACE_DEFAULT_SAMPLE_RATE;
+
+static TraceHistogram trace_histograms[TRACE_STAGES];
+
+static unsigned int trace_counter = 0;
+
+static const char *trace_stage_names[TRACE_STAGES] = {
+  "decrypt", "route", "queue", "write", "total"
+};
+
+uint64_t Trace_now_ns()
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+int Trace_sample()
+{
+  unsigned int rate = Trace_sample_rate;
+
+  return rate && __sync_fetch_and_add(&trace_counter, 1) % rate == 0;
+}
+
+void Trace_record(TraceStage stage, uint64_t from_ns, uint64_t to_ns)
+{
+  TraceHistogram *hist = NULL;
+  uint64_t elapsed = 0;
+  int bucket = 0;
+
+  assert(stage < TRACE_STAGES && "invalid trace stage");
+
+  if(from_ns == 0 || to_ns < from_ns) return;
+
+  hist = &trace_histograms[stage];
+  elapsed = to_ns - from_ns;
+
+  // bucket is the number of bits needed for elapsed
+  for(bucket = 0; bucket < TRACE_BUCKETS - 1 && (elapsed >> bucket) > 0; bucket++);
+
+  __sync_fetch_and_add(&hist->buckets[bucket], 1);
+  __sync_fetch_and_add(&hist->count, 1);
+  __sync_fetch_and_add(&hist->total_ns, elapsed);
+
+  // a racing bigger max can get lost, it's only a report
+  if(elapsed > hist->max_ns) hist->max_ns = elapsed;
+}
+
+const TraceHistogram *Trace_histogram(TraceStage stage)
+{
+  assert(stage < TRACE_STAGES && "invalid trace stage");
+
+  return &trace_histograms[stage];
+}
+
+uint64_t TraceHistogram_percentile(const TraceHistogram *hist, double percent)
+{
+  uint64_t wanted = 0;
+  uint64_t seen = 0;
+  int i = 0;
+
+  assert_not(hist, NULL);
+
+  if(hist->count == 0) return 0;
+
+  wanted = (uint64_t)(hist->count * percent / 100.0);
+  if(wanted == 0) wanted = 1;
+
+  for(i = 0; i < TRACE_BUCKETS; i++) {
+    seen += hist->buckets[i];
+    if(seen >= wanted) {
+      return i == 0 ? 0 : ((uint64_t)1 << i) < hist->max_ns ? (uint64_t)1 << i : hist->max_ns;
+    }
+  }
+
+  return hist->max_ns;
+}
+
+const char *Trace_stage_name(TraceStage stage)
+{
+  assert(stage < TRACE_STAGES && "invalid trace stage");
+
+  return trace_stage_names[stage];
+}
+
+void Trace_reset()
+{
+  memset(trace_histograms, 0, sizeof(trace_histograms));
+}
@@ -0,0 +1,124 @@
+#ifndef utu_trace_h
+#define utu_trace_h
+
+/*
+ * Utu -- Saving The Internet With Hate
+ *
+ * Copyright (c) Zed A. Shaw 2005 (zedshaw@zedshaw.com)
+ *
+ * This file is modifiable/redistributable under the terms of the GNU
+ * General Public License.
+ *
+ * You should have recieved a copy of the GNU General Public License along
+ * with this program; see the file COPYING. If not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 0211-1307, USA.
+ */
+
+#include <myriad/myriad.h>
+
+/**
+ * Latency tracing for messages going through the Hub.  A sample of the
+ * messages read get monotonic nanosecond stamps as they go through each
+ * stage, and the time between stages goes into a histogram for that
+ * stage.  That tells you whether the time goes to crypto, routing,
+ * sitting in member queues, or writing to sockets:
+ *
+ * <pre>
+ *   read -> decrypt -> route -> (enqueue) -> queue -> (dequeue) -> write
+ *   \---------------------------- total ------------------------------/
+ * </pre>
+ *
+ * Only 1 out of Trace_sample_rate messages is traced, so the clock
+ * reads cost almost nothing.  Set it to 0 to turn tracing off.
+ */
+
+typedef enum TraceStage {
+  /** Frame read to decrypted and parsed. */
+  TRACE_DECRYPT = 0,
+  /** Decrypted to routed and put on every member's queue. */
+  TRACE_ROUTE,
+  /** Put on a member's queue to taken off by their writer. */
+  TRACE_QUEUE,
+  /** Taken off the queue to encrypted and written to the socket. */
+  TRACE_WRITE,
+  /** Frame read to written, for each member it went to. */
+  TRACE_TOTAL,
+  TRACE_STAGES
+} TraceStage;
+
+/** Buckets are powers of 2 nanoseconds, so 40 goes out past 9 minutes. */
+#define TRACE_BUCKETS 40
+
+/** Default for Trace_sample_rate. */
+#define TRACE_DEFAULT_SAMPLE_RATE 100
+
+typedef struct TraceHistogram {
+  uint64_t count;
+  uint64_t total_ns;
+  uint64_t max_ns;
+  /** Bucket i counts times from 2^(i-1) up to 2^i nanoseconds. */
+  uint64_t buckets[TRACE_BUCKETS];
+} TraceHistogram;
+
+/** 
+ * Stamps a traced Message carries from when it was read, 0 if it isn't
+ * traced.  The later stages are per recipient so they are kept by the
+ * queue and the writer instead.
+ */
+typedef struct TraceStamps {
+  uint64_t read_ns;
+  uint64_t decrypt_ns;
+} TraceStamps;
+
+/** Trace 1 out of this many messages, 0 for none. */
+extern unsigned int Trace_sample_rate;
+
+/**
+ * @brief Current monotonic time in nanoseconds.
+ * @return uint64_t : Nanoseconds since some point that never goes backwards.
+ */
+uint64_t Trace_now_ns();
+
+/**
+ * @brief Decides if the next message should be traced.
+ * @return int : 1 if it should be, 0 if not.
+ */
+int Trace_sample();
+
+/**
+ * Times of 0 are ignored since they mean a stamp was missing, like a
+ * message that was only partly traced.
+ *
+ * @brief Adds a time to a stage's histogram.
+ * @param stage : Which stage it was.
+ * @param from_ns : Stamp when the stage started.
+ * @param to_ns : Stamp when the stage ended.
+ */
+void Trace_record(TraceStage stage, uint64_t from_ns, uint64_t to_ns);
+
+/**
+ * @brief Gets the histogram for a stage.
+ * @param stage : Which stage.
+ * @return const TraceHistogram * : The stage's histogram.
+ */
+const TraceHistogram *Trace_histogram(TraceStage stage);
+
+/**
+ * @brief Works out a percentile from a histogram.
+ * @param hist : Histogram to look at.
+ * @param percent : Like 50 or 99.
+ * @return uint64_t : Upper bound in nanoseconds of the bucket it falls in.
+ */
+uint64_t TraceHistogram_percentile(const TraceHistogram *hist, double percent);
+
+/**
+ * @brief Name of the stage for reports.
+ * @param stage : Which stage.
+ * @return const char * : Name like "decrypt".
+ */
+const char *Trace_stage_name(TraceStage stage);
+
+/** Clears all the histograms. */
+void Trace_reset();
+
+#endif
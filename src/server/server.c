@@ -76,7 +76,7 @@ void usage(const char *message)
     printf("ERROR: %s\n", message);
   }
 
-  printf("USAGE: utuserver -a addr -p port -n name [-d chroot] [-k keyfile] [-m] [-u uid -g gid] [-l server.log]\n");
+  printf("USAGE: utuserver -a addr -p port -n name [-d chroot] [-k keyfile] [-m] [-u uid -g gid] [-l server.log] [-s hub.db] [-c classes.conf] [-t trace-1-in-N]\n");
 }
 
 void remove_pid_atexit()
@@ -109,12 +109,14 @@ int main (int argc, char *argv[])
   int make_new_key = 0;
   const char *key_file = "utuserver.key";
   const char *chroot = "/var/run/utu";
+  const char *store_file = NULL;
+  const char *class_file = NULL;
   int rc = 0;
 
   uid = geteuid();
   gid = getegid();
 
-  while((rc = getopt(argc, argv, "ha:p:n:k:d:g:u:m:l:")) != -1) {
+  while((rc = getopt(argc, argv, "ha:p:n:k:d:g:u:m:l:s:c:t:")) != -1) {
     switch(rc) {
       case 'h':
         usage(NULL);
@@ -152,6 +154,15 @@ int main (int argc, char *argv[])
       case 'l':
         check(redirect_out_logs(optarg), "Failed to create log file.");
         break;
+      case 's':
+        store_file = optarg;
+        break;
+      case 'c':
+        class_file = optarg;
+        break;
+      case 't':
+        Trace_sample_rate = atoi(optarg);
+        break;
       default:
         usage("invalid arguments");
         return 1;
@@ -179,6 +190,14 @@ int main (int argc, char *argv[])
     check(create_key_file(key_file, hub->key), "Failed to create key file");
   }
 
+  if(class_file) {
+    check(Hub_load_classes(hub, class_file), "Failed to load member classes.");
+  }
+
+  if(store_file) {
+    check(Hub_open_store(hub, store_file), "Failed to open hub database (make it with schema.sql).");
+  }
+
   Hub_listen(hub);
 
   Hub_destroy(hub);
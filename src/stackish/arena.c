@@ -0,0 +1,198 @@
+/*
+ * Utu -- Saving The Internet With Hate
+ *
+ * Copyright (c) Zed A. Shaw 2005 (zedshaw@zedshaw.com)
+ *
+ * This file is modifiable/redistributable under the terms of the GNU
+ * General Public License.
+ *
+ * You should have recieved a copy of the GNU General Public License along
+ * with this program; see the file COPYING. If not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 0211-1307, USA.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <myriad/defend.h>
+#include "stackish/arena.h"
+
+typedef struct NodeArenaChunk {
+  struct NodeArenaChunk *next;
+  size_t size;
+  size_t used;
+} NodeArenaChunk;
+
+typedef struct NodeArenaOwned {
+  struct NodeArenaOwned *next;
+  bstring str;
+  Node *node;
+} NodeArenaOwned;
+
+/** Everything handed out is aligned for a uint64_t or a double. */
+#define NODE_ARENA_ALIGN(S) (((S) + 7) & ~((size_t)7))
+
+#define NODE_ARENA_HEADER NODE_ARENA_ALIGN(sizeof(NodeArenaChunk))
+
+static NodeArenaChunk *NodeArenaChunk_create(size_t size)
+{
+  NodeArenaChunk *chunk = malloc(NODE_ARENA_HEADER + size);
+  assert_mem(chunk);
+
+  chunk->next = NULL;
+  chunk->size = size;
+  chunk->used = 0;
+
+  return chunk;
+}
+
+static inline void *NodeArenaChunk_take(NodeArenaChunk *chunk, size_t size)
+{
+  void *mem = NULL;
+
+  if(chunk->size - chunk->used < size) return NULL;
+
+  mem = (char *)chunk + NODE_ARENA_HEADER + chunk->used;
+  chunk->used += size;
+
+  return mem;
+}
+
+NodeArena *NodeArena_create(size_t size_hint)
+{
+  size_t size = NODE_ARENA_ALIGN(size_hint) + NODE_ARENA_ALIGN(sizeof(NodeArena));
+  NodeArenaChunk *chunk = NULL;
+  NodeArena *arena = NULL;
+
+  if(size < NODE_ARENA_CHUNK) size = NODE_ARENA_CHUNK;
+
+  chunk = NodeArenaChunk_create(size);
+  arena = NodeArenaChunk_take(chunk, NODE_ARENA_ALIGN(sizeof(NodeArena)));
+  memset(arena, 0, sizeof(NodeArena));
+
+  arena->chunks = chunk;
+  arena->size = size;
+
+  return arena;
+}
+
+void NodeArena_destroy(NodeArena *arena)
+{
+  NodeArenaOwned *owned = NULL;
+  NodeArenaChunk *chunk = NULL, *next = NULL;
+
+  assert_not(arena, NULL);
+
+  for(owned = arena->owned; owned != NULL; owned = owned->next) {
+    if(owned->str) bdestroy(owned->str);
+
+    if(owned->node) {
+      // its siblings are arena nodes or other adopted ones, just do this one
+      owned->node->sibling = NULL;
+      Node_destroy(owned->node);
+    }
+  }
+
+  if(arena->input) bdestroy(arena->input);
+
+  // the arena is in the last chunk, so it can't be touched inside here
+  for(chunk = arena->chunks; chunk != NULL; chunk = next) {
+    next = chunk->next;
+    free(chunk);
+  }
+}
+
+void *NodeArena_alloc(NodeArena *arena, size_t size)
+{
+  void *mem = NULL;
+  NodeArenaChunk *chunk = NULL;
+  size_t chunk_size = 0;
+
+  assert_not(arena, NULL);
+
+  size = NODE_ARENA_ALIGN(size);
+  mem = NodeArenaChunk_take(arena->chunks, size);
+
+  if(mem == NULL) {
+    // double each time so big trees don't make lots of chunks
+    chunk_size = arena->chunks->size * 2;
+    if(chunk_size < size) chunk_size = size;
+
+    chunk = NodeArenaChunk_create(chunk_size);
+    chunk->next = arena->chunks;
+    arena->chunks = chunk;
+    arena->size += chunk_size;
+
+    mem = NodeArenaChunk_take(chunk, size);
+  }
+
+  memset(mem, 0, size);
+  return mem;
+}
+
+bstring NodeArena_bstr(NodeArena *arena, const char *start, size_t length)
+{
+  bstring str = NodeArena_alloc(arena, sizeof(struct tagbstring) + length + 1);
+
+  str->data = (unsigned char *)(str + 1);
+  str->slen = length;
+  // write protected, same as bsStatic
+  str->mlen = -1;
+  memcpy(str->data, start, length);
+  str->data[length] = '\0';
+
+  return str;
+}
+
+bstring NodeArena_view(NodeArena *arena, const char *start, size_t length)
+{
+  bstring str = NodeArena_alloc(arena, sizeof(struct tagbstring));
+
+  str->data = (unsigned char *)start;
+  str->slen = length;
+  str->mlen = -1;
+
+  return str;
+}
+
+void NodeArena_adopt_bstr(NodeArena *arena, bstring str)
+{
+  NodeArenaOwned *owned = NULL;
+
+  assert_not(arena, NULL);
+
+  // only heap strings need freeing, bdestroy won't touch the rest
+  if(str == NULL || str->mlen <= 0) return;
+
+  owned = NodeArena_alloc(arena, sizeof(NodeArenaOwned));
+  owned->str = str;
+  owned->next = arena->owned;
+  arena->owned = owned;
+}
+
+void NodeArena_adopt_node(NodeArena *arena, Node *node)
+{
+  NodeArenaOwned *owned = NULL;
+
+  assert_not(arena, NULL);
+
+  if(node == NULL || node->arena != NULL) return;
+
+  owned = NodeArena_alloc(arena, sizeof(NodeArenaOwned));
+  owned->node = node;
+  owned->next = arena->owned;
+  arena->owned = owned;
+}
+
+Node *Node_new_root(NodeArena *arena)
+{
+  Node *root = NULL;
+
+  if(arena == NULL) return Node_new_group(NULL);
+
+  root = NodeArena_alloc(arena, sizeof(Node));
+  root->type = TYPE_GROUP;
+  root->arena = arena;
+  arena->root = root;
+
+  return root;
+}
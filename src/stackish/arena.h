@@ -0,0 +1,179 @@
+#ifndef utu_stackish_arena_h
+#define utu_stackish_arena_h
+
+/*
+ * Utu -- Saving The Internet With Hate
+ *
+ * Copyright (c) Zed A. Shaw 2005 (zedshaw@zedshaw.com)
+ *
+ * This file is modifiable/redistributable under the terms of the GNU
+ * General Public License.
+ *
+ * You should have recieved a copy of the GNU General Public License along
+ * with this program; see the file COPYING. If not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 0211-1307, USA.
+ */
+
+#include "stackish/node.h"
+
+/**
+ * A bump allocator that a whole Node tree lives in, so parsing a
+ * message is a handful of mallocs instead of a few for every node, and
+ * destroying it is freeing a few chunks instead of walking the tree.
+ * Node_parse_arena makes one and the root Node owns it, so you just
+ * call Node_destroy on the root like any other tree.
+ *
+ * Strings in the arena are write protected bstrings (like bsStatic
+ * makes) so bdestroy won't free them, and you have to bstrcpy them if
+ * you want to change them or keep them longer than the tree.
+ *
+ * Anything you add to an arena tree later with the regular Node
+ * functions still works.  New nodes under an arena node come from the
+ * arena, and bstrings or heap subtrees handed to them are adopted by
+ * the arena and destroyed with it.  Node_destroy on anything but the
+ * root of an arena tree does nothing, since it can't be freed alone.
+ */
+
+/** Smallest chunk an arena gets from malloc. */
+#define NODE_ARENA_CHUNK 4096
+
+struct NodeArenaChunk;
+struct NodeArenaOwned;
+
+typedef struct NodeArena {
+  /** The root node, destroying it destroys the arena. */
+  Node *root;
+  struct NodeArenaChunk *chunks;
+  /** Heap things given to the tree that go when the arena does. */
+  struct NodeArenaOwned *owned;
+  /** Total bytes malloced for chunks. */
+  size_t size;
+
+  /** The buffer Node_parse_view parsed, blobs point into it. */
+  bstring input;
+} NodeArena;
+
+/**
+ * The arena lives inside its own first chunk, so it's just one malloc
+ * until it fills up.
+ *
+ * @brief Creates an arena.
+ * @param size_hint : About how many bytes the tree will need.
+ * @return NodeArena * : The new arena.
+ */
+NodeArena *NodeArena_create(size_t size_hint);
+
+/**
+ * @brief Frees every chunk and everything the arena adopted.
+ * @param arena : Arena to destroy, every node in it is gone after this.
+ */
+void NodeArena_destroy(NodeArena *arena);
+
+/**
+ * @brief Gets size bytes of zeroed memory from the arena.
+ * @param arena : Arena to allocate from.
+ * @param size : Bytes needed.
+ * @return void * : The memory, it's freed with the arena.
+ */
+void *NodeArena_alloc(NodeArena *arena, size_t size);
+
+/**
+ * @brief Copies the bytes into a write protected bstring in the arena.
+ * @param arena : Arena to allocate from.
+ * @param start : Bytes to copy.
+ * @param length : How many.
+ * @return bstring : The new string, it's freed with the arena.
+ */
+bstring NodeArena_bstr(NodeArena *arena, const char *start, size_t length);
+
+/**
+ * Makes a write protected bstring that points at the bytes rather than
+ * copying them, so they have to live as long as the arena does.  It
+ * isn't \0 terminated unless the bytes after it happen to be.
+ *
+ * @brief Makes a bstring view of some bytes.
+ * @param arena : Arena to put the bstring in.
+ * @param start : Bytes it points at.
+ * @param length : How many.
+ * @return bstring : The view, it's freed with the arena.
+ */
+bstring NodeArena_view(NodeArena *arena, const char *start, size_t length);
+
+/**
+ * Heap bstrings (ones bdestroy would free) are destroyed with the
+ * arena, and write protected ones like arena strings are ignored.
+ *
+ * @brief Makes the arena own a bstring.
+ * @param arena : Arena that owns it now.
+ * @param str : The string, can be NULL.
+ */
+void NodeArena_adopt_bstr(NodeArena *arena, bstring str);
+
+/**
+ * @brief Makes the arena own a heap Node tree grafted into it.
+ * @param arena : Arena that owns it now.
+ * @param node : Heap node (and its children) to Node_destroy with the arena.
+ */
+void NodeArena_adopt_node(NodeArena *arena, Node *node);
+
+/**
+ * @brief Makes a root group node that owns the arena.
+ * @param arena : Arena to make the root in, or NULL for a normal heap group.
+ * @return Node * : The new root.
+ */
+Node *Node_new_root(NodeArena *arena);
+
+/**
+ * Same as Node_parse() but the tree is built in a new arena owned by
+ * the root.  Use it for trees you're going to read and then throw away
+ * whole, like received messages.
+ *
+ * @param buf A stackish string sitting in the buffer that needs to be parsed.
+ * @return A fully formed Node in its own arena, NULL if there was an error.
+ */
+Node *Node_parse_arena(bstring buf);
+
+/**
+ * Same as Node_parse_seq() but with the tree built in its own arena.
+ *
+ * @param buf A stackish structure that has some stackish in it.
+ * @param from IN/OUT parameter that says where to start, and where the parsing ended inside buf.
+ * @return A fully formed Node in its own arena, NULL if there was a failure.
+ */
+Node *Node_parse_seq_arena(bstring buf, size_t *from);
+
+/**
+ * Same as Node_parse_arena() but the arena takes buf and every blob is
+ * a NodeArena_view into it instead of a copy, so a big payload is never
+ * copied between decrypting and sending it on.  Node_decons with copy=0
+ * hands out these views directly.  Strings are still copied since
+ * they get used as C strings, and a view can't be \0 terminated.
+ *
+ * The arena owns buf even if the parse fails, so don't destroy it or
+ * change it after this.  It's destroyed along with the tree.
+ *
+ * It takes the binary form too (see binary.h), and tells them apart by
+ * the first byte.
+ *
+ * @param buf A stackish string that the tree will own.
+ * @return A fully formed Node in its own arena, NULL if there was an error.
+ */
+Node *Node_parse_view(bstring buf);
+
+/**
+ * Same as Node_parse_view() but groups nested depth or more levels below
+ * the root aren't built.  They're checked against the same rules and
+ * NODE_LIMITS, then kept as a TYPE_DEFERRED node holding a view of their
+ * bytes and named with their closing word, so a hub that only reads the
+ * top of a message never pays for the payload under it.  Use
+ * Node_expand when you need what's inside.
+ *
+ * The binary form is always parsed whole.
+ *
+ * @param buf A stackish string that the tree will own.
+ * @param depth How many levels to build, 0 builds everything.
+ * @return The tree in its own arena, NULL if there was an error.
+ */
+Node *Node_parse_lazy(bstring buf, size_t depth);
+
+#endif
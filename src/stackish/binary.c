@@ -0,0 +1,361 @@
+/*
+ * Utu -- Saving The Internet With Hate
+ *
+ * Copyright (c) Zed A. Shaw 2005 (zedshaw@zedshaw.com)
+ *
+ * This file is modifiable/redistributable under the terms of the GNU
+ * General Public License.
+ *
+ * You should have recieved a copy of the GNU General Public License along
+ * with this program; see the file COPYING. If not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 0211-1307, USA.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <myriad/defend.h>
+#include "stackish/binary.h"
+#include "stackish/scan.h"
+
+/** Names added to the dictionary so far in this document. */
+typedef struct NodeBinaryWords {
+  const unsigned char *start[NODE_BINARY_MAX_WORDS];
+  size_t length[NODE_BINARY_MAX_WORDS];
+  size_t count;
+} NodeBinaryWords;
+
+static inline size_t varint_length(uint64_t number)
+{
+  size_t length = 1;
+
+  for(; number >= 0x80; number >>= 7) length++;
+
+  return length;
+}
+
+/** Writes number if out isn't NULL, and always gives back how long it is. */
+static inline size_t varint_put(unsigned char *out, uint64_t number)
+{
+  size_t length = 0;
+
+  if(out == NULL) return varint_length(number);
+
+  for(; number >= 0x80; number >>= 7) out[length++] = (number & 0x7F) | 0x80;
+  out[length++] = (unsigned char)number;
+
+  return length;
+}
+
+/** Reads a varint, giving back where it ended or NULL if it's cut off or too big. */
+static inline const unsigned char *varint_get(const unsigned char *p, const unsigned char *pe, uint64_t *number)
+{
+  int shift = 0;
+
+  for(*number = 0; p < pe && shift < 64; shift += 7, p++) {
+    *number |= (uint64_t)(*p & 0x7F) << shift;
+    if((*p & 0x80) == 0) return p + 1;
+  }
+
+  return NULL;
+}
+
+/** A tag and varint length followed by the bytes, like STRING and NAME. */
+static inline size_t Node_binary_put_bytes(unsigned char *out, NodeBinaryTag tag, const void *data, size_t length)
+{
+  size_t at = 1 + varint_put(out ? out + 1 : NULL, length);
+
+  if(out) {
+    out[0] = tag;
+    if(length > 0) memcpy(out + at, data, length);
+  }
+
+  return at + length;
+}
+
+static size_t Node_binary_put_name(unsigned char *out, bstring name, NodeBinaryWords *words)
+{
+  bstring interned = Node_is_interned(name) ? name : Node_intern((const char *)name->data, blength(name));
+  size_t i = 0, length = blength(name);
+
+  if(interned) {
+    if(out) out[0] = NODE_BIN_NAME_REF;
+    return 1 + varint_put(out ? out + 1 : NULL, interned - NODE_INTERNED);
+  }
+
+  for(i = 0; i < words->count; i++) {
+    if(words->length[i] == length && memcmp(words->start[i], name->data, length) == 0) {
+      if(out) out[0] = NODE_BIN_NAME_REF;
+      return 1 + varint_put(out ? out + 1 : NULL, NODE_INTERNED_COUNT + i);
+    }
+  }
+
+  if(words->count < NODE_BINARY_MAX_WORDS) {
+    words->start[words->count] = name->data;
+    words->length[words->count++] = length;
+  }
+
+  return Node_binary_put_bytes(out, NODE_BIN_NAME, name->data, length);
+}
+
+/**
+ * Writes (or just measures when out is NULL) the node in the same
+ * order as Node_write, so both passes build the same dictionary.
+ * Gives back 0 if a deferred group in it doesn't parse.
+ */
+static size_t Node_binary_write(unsigned char *out, Node *d, int follow_sibs, NodeBinaryWords *words)
+{
+  size_t length = 0;
+  uint64_t bits = 0;
+  int i = 0;
+  int leaving = 0;
+  NodeWalk walk;
+
+  Node_walk_start(&walk, d, follow_sibs);
+
+  while((d = Node_walk_next(&walk, &leaving)) != NULL) {
+    if(!leaving) {
+      if(d->type == TYPE_GROUP) {
+        if(out) out[length] = NODE_BIN_START;
+        length++;
+      }
+      continue;
+    }
+
+    switch(d->type) {
+      case TYPE_BLOB:
+        length += Node_binary_put_bytes(out ? out + length : NULL, NODE_BIN_BLOB, 
+            d->value.string ? d->value.string->data : NULL, blength(d->value.string));
+        break;
+      case TYPE_STRING:
+        length += Node_binary_put_bytes(out ? out + length : NULL, NODE_BIN_STRING, 
+            d->value.string ? d->value.string->data : NULL, Node_cstr_length(d->value.string));
+        break;
+      case TYPE_NUMBER:
+        if(out) out[length] = NODE_BIN_NUMBER;
+        length += 1 + varint_put(out ? out + length + 1 : NULL, d->value.number);
+        break;
+      case TYPE_FLOAT:
+        if(out) {
+          memcpy(&bits, &d->value.floating, sizeof(bits));
+          out[length] = NODE_BIN_FLOAT;
+          for(i = 0; i < 8; i++) out[length + 1 + i] = (unsigned char)(bits >> (i * 8));
+        }
+        length += 9;
+        break;
+      case TYPE_GROUP: 
+        if(!d->name || bchar(d->name, 0) == '@') {
+          if(out) out[length] = NODE_BIN_END;
+          length++;
+        }
+        break;
+      case TYPE_INVALID: // fallthrough
+      default:
+        assert(!"invalid type for node");
+        break;
+    }
+
+    if(d->name != NULL) {
+      length += Node_binary_put_name(out ? out + length : NULL, d->name, words);
+    }
+  }
+
+  Node_walk_end(&walk);
+
+  return walk.failed ? 0 : length;
+}
+
+size_t Node_binary_length(Node *d, int follow_sibs)
+{
+  NodeBinaryWords words;
+  size_t length = 0;
+
+  assert_not(d, NULL);
+
+  words.count = 0;
+  length = Node_binary_write(NULL, d, follow_sibs, &words);
+
+  return length > 0 ? 1 + length : 0;
+}
+
+bstring Node_binary(Node *d, int follow_sibs)
+{
+  NodeBinaryWords words;
+  bstring out = NULL;
+  size_t length = 0;
+
+  assert_not(d, NULL);
+
+  length = Node_binary_length(d, follow_sibs);
+  if(length == 0) return NULL;
+
+  out = bfromcstralloc(length + 1, "");
+  assert_mem(out);
+
+  words.count = 0;
+  out->data[0] = NODE_BINARY_MAGIC;
+  length = Node_binary_write(out->data + 1, d, follow_sibs, &words);
+  if(length == 0) {
+    bdestroy(out);
+    return NULL;
+  }
+
+  length++;
+  assert(length == Node_binary_length(d, follow_sibs) && "binary length was wrong");
+
+  out->slen = length;
+  out->data[length] = '\0';
+
+  return out;
+}
+
+bstring Node_encode(Node *d, NodeCodec codec)
+{
+  return codec == NODE_CODEC_BINARY ? Node_binary(d, 1) : Node_bstr(d, 1);
+}
+
+/** Only real words and \@attributes, so the text form still parses. */
+static int Node_binary_is_word(const unsigned char *start, size_t length)
+{
+  StackishToken token = Stackish_scan_token((const char *)start, length);
+
+  return token == STACKISH_TOKEN_WORD || token == STACKISH_TOKEN_ATTR;
+}
+
+/** Names the last child for an attribute, otherwise names current and ends it. */
+static int Node_binary_name(Node **current, Node *root, size_t *depth, bstring interned, const unsigned char *start, size_t length)
+{
+  Node *target = start[0] == '@' ? (*current)->child : *current;
+
+  check(target, "parsing failure, attribute with nothing to name");
+  Node_name(target, interned ? interned : Node_name_str(target, (const char *)start, length));
+
+  if(target == *current) {
+    Node_limit_close(target);
+    (*depth)--;
+    *current = *current == root ? NULL : (*current)->parent;
+  }
+
+  return 1;
+  on_fail(return 0);
+}
+
+Node *Node_parse_binary_into(bstring buf, NodeArena *arena)
+{
+  const unsigned char *p = NULL, *pe = NULL;
+  Node *root = NULL, *current = NULL;
+  NodeBinaryWords words;
+  bstring interned = NULL;
+  uint64_t number = 0;
+  double floating = 0;
+  size_t depth = 0;
+  int i = 0;
+
+  assert_not(buf, NULL);
+  check(Node_is_binary(buf), "not a binary stackish document");
+
+  words.count = 0;
+  p = buf->data + 1;
+  pe = buf->data + blength(buf);
+
+  while(p < pe) {
+    NodeBinaryTag tag = *p++;
+
+    // only a START can come before the root, and nothing after it's done
+    check(current || (tag == NODE_BIN_START && root == NULL), "parsing failure, token outside the document");
+
+    // everything but the names and END is another child of current
+    if(current && tag != NODE_BIN_END && tag != NODE_BIN_NAME && tag != NODE_BIN_NAME_REF) {
+      check(Node_limit_width(current), "parsing failure, too many children in a group");
+    }
+
+    switch(tag) {
+      case NODE_BIN_START:
+        check(depth++ < NODE_LIMITS.depth, "parsing failure, groups nested too deep");
+
+        if(current) {
+          current = Node_new_group(current);
+        } else {
+          root = current = Node_new_root(arena);
+        }
+        break;
+
+      case NODE_BIN_END:
+        Node_limit_close(current);
+        depth--;
+        current = current == root ? NULL : current->parent;
+        break;
+
+      case NODE_BIN_NUMBER:
+        p = varint_get(p, pe, &number);
+        check(p, "parsing failure, bad number");
+        Node_new_number(current, number);
+        break;
+
+      case NODE_BIN_FLOAT:
+        check(pe - p >= 8, "parsing failure, float cut off");
+        for(number = 0, i = 0; i < 8; i++) number |= (uint64_t)p[i] << (i * 8);
+        memcpy(&floating, &number, sizeof(floating));
+        Node_new_float(current, floating);
+        p += 8;
+        break;
+
+      case NODE_BIN_STRING:  // fallthrough
+      case NODE_BIN_BLOB:
+        p = varint_get(p, pe, &number);
+        check(p && number <= (uint64_t)(pe - p), "parsing failure, string or blob cut off");
+
+        if(tag == NODE_BIN_STRING) {
+          check(!memchr(p, '"', number) && !memchr(p, '\0', number), "parsing failure, string can't be text");
+        }
+
+        check(Node_from_str(current, tag == NODE_BIN_STRING ? TYPE_STRING : TYPE_BLOB, 
+              (const char *)p, number), "parsing failure, invalid value");
+        p += number;
+        break;
+
+      case NODE_BIN_NAME:
+        p = varint_get(p, pe, &number);
+        check(p && number > 0 && number <= (uint64_t)(pe - p), "parsing failure, name cut off");
+        check(Node_binary_is_word(p, number), "parsing failure, name isn't a word");
+
+        if(words.count < NODE_BINARY_MAX_WORDS) {
+          words.start[words.count] = p;
+          words.length[words.count++] = number;
+        }
+
+        check(Node_binary_name(&current, root, &depth, NULL, p, number), "parsing failure, bad name");
+        p += number;
+        break;
+
+      case NODE_BIN_NAME_REF:
+        p = varint_get(p, pe, &number);
+        check(p, "parsing failure, bad name reference");
+
+        if(number < NODE_INTERNED_COUNT) {
+          interned = &NODE_INTERNED[number];
+          check(Node_binary_name(&current, root, &depth, interned, interned->data, blength(interned)), "parsing failure, bad name");
+        } else {
+          number -= NODE_INTERNED_COUNT;
+          check(number < words.count, "parsing failure, name reference that isn't in the dictionary");
+          check(Node_binary_name(&current, root, &depth, NULL, words.start[number], words.length[number]), "parsing failure, bad name");
+        }
+        break;
+
+      default:
+        fail("parsing failure, unknown binary tag");
+    }
+  }
+
+  check(root && current == NULL, "parsing failure, document cut off");
+
+  return root;
+
+  on_fail(if(root) Node_destroy(root);
+      else if(arena) NodeArena_destroy(arena);
+      return NULL);
+}
+
+Node *Node_parse_binary(bstring buf)
+{
+  return Node_parse_binary_into(buf, NULL);
+}
@@ -0,0 +1,117 @@
+#ifndef utu_stackish_binary_h
+#define utu_stackish_binary_h
+
+/*
+ * Utu -- Saving The Internet With Hate
+ *
+ * Copyright (c) Zed A. Shaw 2005 (zedshaw@zedshaw.com)
+ *
+ * This file is modifiable/redistributable under the terms of the GNU
+ * General Public License.
+ *
+ * You should have recieved a copy of the GNU General Public License along
+ * with this program; see the file COPYING. If not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 0211-1307, USA.
+ */
+
+#include "stackish/node.h"
+#include "stackish/arena.h"
+
+/**
+ * A compact binary form of stackish for peers that agree to it (see
+ * Peer_establish_receiver).  It's the same tokens in the same order as
+ * the canonical text, so it turns into exactly the same tree, but each
+ * one is a tag byte instead of punctuation and whitespace:
+ *
+ * <pre>
+ *   0xB5                   first byte of every document
+ *   START                  [
+ *   END                    ]
+ *   NUMBER varint          1234
+ *   FLOAT 8 bytes          1.500000 (IEEE double, little endian)
+ *   STRING varint bytes    "hello"
+ *   BLOB varint bytes      '5:hello'
+ *   NAME varint bytes      a word or \@attribute
+ *   NAME_REF varint        a word or \@attribute from the dictionary
+ * </pre>
+ *
+ * Varints are unsigned LEB128.  The dictionary starts as NODE_INTERNED,
+ * which both ends have, and the first NODE_BINARY_MAX_WORDS names sent
+ * with NAME get added after it, so a word is only spelled out once per
+ * document.  It starts over with every document, which is what lets the
+ * hub encode a message once and send it to every member that wants it.
+ *
+ * Anything that can't be written as canonical text (strings with a "
+ * or \\0, names that aren't words) is rejected, since the canonical
+ * text is still what gets signed and what text peers get.
+ */
+
+/** First byte of a binary document.  Text always starts with [ or whitespace. */
+#define NODE_BINARY_MAGIC 0xB5
+
+/** What peers call this encoding when they negotiate it. */
+#define NODE_BINARY_CODEC "stackish.bin.1"
+
+/** Most names a document adds to the dictionary. */
+#define NODE_BINARY_MAX_WORDS 64
+
+/** Which encoding a peer talks. */
+typedef enum NodeCodec {
+  NODE_CODEC_TEXT, NODE_CODEC_BINARY
+} NodeCodec;
+
+/** The tag bytes, see above. */
+typedef enum NodeBinaryTag {
+  NODE_BIN_START = 1, NODE_BIN_END, NODE_BIN_NUMBER, NODE_BIN_FLOAT,
+  NODE_BIN_STRING, NODE_BIN_BLOB, NODE_BIN_NAME, NODE_BIN_NAME_REF
+} NodeBinaryTag;
+
+/** True if the bstring B holds a binary document rather than text. */
+#define Node_is_binary(B) ((B) && blength(B) > 0 && (unsigned char)bchar(B, 0) == NODE_BINARY_MAGIC)
+
+/**
+ * @brief Tells you exactly how many bytes Node_binary will make.
+ * @param d : The node to measure.
+ * @param follow_sibs : Whether to follow siblings of this node.
+ * @return size_t : Bytes in the binary form, including the magic byte, 0 if a deferred group in it doesn't parse.
+ */
+size_t Node_binary_length(Node *d, int follow_sibs);
+
+/**
+ * The binary twin of Node_bstr, sized once and written straight in.
+ *
+ * @brief Encodes a node in the binary form.
+ * @param d : The node to encode.
+ * @param follow_sibs : Whether to follow siblings of this node.
+ * @return bstring : The encoded document, NULL if a deferred group in it doesn't parse.
+ */
+bstring Node_binary(Node *d, int follow_sibs);
+
+/**
+ * @brief Makes a bstring in the codec asked for, Node_bstr or Node_binary.
+ * @param d : The node to encode.
+ * @param codec : Which one.
+ * @return bstring : The encoded document, NULL if a deferred group in it doesn't parse.
+ */
+bstring Node_encode(Node *d, NodeCodec codec);
+
+/**
+ * @brief Parses a binary document into regular heap Nodes.
+ * @param buf : The document, which has to be the whole buffer.
+ * @return Node * : The tree, or NULL if it's invalid.
+ */
+Node *Node_parse_binary(bstring buf);
+
+/**
+ * This is how Node_parse_view handles binary documents.  Just like it,
+ * the arena owns buf (if it's the arena's input) and is destroyed if the
+ * parse fails, and blobs are views into buf when it's the arena's input.
+ *
+ * @brief Parses a binary document into an arena.
+ * @param buf : The document, which has to be the whole buffer.
+ * @param arena : Arena to build in, or NULL for heap Nodes.
+ * @return Node * : The tree, or NULL if it's invalid.
+ */
+Node *Node_parse_binary_into(bstring buf, NodeArena *arena);
+
+#endif
@@ -16,7 +16,10 @@
 #include <myriad/defend.h>
 #include <stdlib.h>
 #include "stackish/stackish.h"
+#include "stackish/binary.h"
+#include "stackish/number.h"
 #include <ctype.h>
+#include <string.h>
 #include "node_algo.h"
 
 void Node_dump(Node *d, char sep, int follow_sibs) 
@@ -26,6 +29,11 @@ void Node_dump(Node *d, char sep, int follow_sibs)
 
   assert_not(d, NULL);
 
+  if(str == NULL) {
+    fprintf(stderr, "<deferred group that doesn't parse>\n");
+    return;
+  }
+
   // go through and convert non-printables to printable, but not the last \n
   for(i = 0; i < blength(str)-1; i++) {
     if(!isprint(str->data[i])) {
@@ -45,77 +53,372 @@ void Node_dump(Node *d, char sep, int follow_sibs)
 bstring Node_bstr(Node *d, int follow_sibs)
 {
   int rc = 0;
-  bstring temp = bfromcstr("");
-  assert_mem(temp);
+  size_t length = 0;
+  bstring temp = NULL;
 
   assert_not(d, NULL);
 
-  Node_catbstr(temp, d, ' ', follow_sibs);
-  
+  length = Node_serialized_length(d, ' ', follow_sibs);
+  if(length == 0) return NULL;
+
+  // the +2 is for the final \n and the \0 so nothing ever reallocs
+  temp = bfromcstralloc(length + 2, "");
+  assert_mem(temp);
+
+  if(!Node_catbstr(temp, d, ' ', follow_sibs)) {
+    bdestroy(temp);
+    return NULL;
+  }
+
   rc = bconchar(temp, '\n');
   assert(rc == BSTR_OK && "failed to append separator char");
 
   return temp;
 }
 
-void Node_catbstr(bstring str, Node *d, char sep, int follow_sibs) 
+/** Digits in a number as %llu would print it. */
+static inline size_t Node_number_length(uint64_t number)
 {
-  int rc = 0;
+  size_t length = 1;
 
-  assert_not(str, NULL);
+  while(number >= 10) {
+    number /= 10;
+    length++;
+  }
+
+  return length;
+}
+
+static inline char *Node_write_number(char *out, uint64_t number)
+{
+  size_t length = Node_number_length(number);
+  char *end = out + length;
 
-  if(d == NULL) return;
+  do {
+    *--end = '0' + (number % 10);
+    number /= 10;
+  } while(number > 0);
 
-  if(d->sibling != NULL && follow_sibs) {
-    Node_catbstr(str, d->sibling, sep, follow_sibs);
+  return out + length;
+}
+
+/** Chars a float takes, see Stackish_float_format. */
+static inline size_t Node_float_length(double floating)
+{
+  char buf[STACKISH_FLOAT_MAX];
+
+  return Stackish_float_format(buf, floating);
+}
+
+NodeLimits NODE_LIMITS = { NODE_MAX_DEPTH, NODE_MAX_WIDTH };
+
+/** A step that only frees the parsed copy of a deferred node once it's been walked. */
+#define NODE_WALK_TEMP 2
+
+static inline void Node_walk_push(NodeWalk *walk, Node *d, int leaving)
+{
+  NodeWalkStep *steps = NULL;
+
+  if(walk->count == walk->size) {
+    if(walk->steps == walk->inline_steps) {
+      steps = malloc(walk->size * 2 * sizeof(NodeWalkStep));
+      assert_mem(steps);
+      memcpy(steps, walk->steps, walk->size * sizeof(NodeWalkStep));
+    } else {
+      steps = realloc(walk->steps, walk->size * 2 * sizeof(NodeWalkStep));
+      assert_mem(steps);
+    }
+
+    walk->steps = steps;
+    walk->size *= 2;
   }
 
-  if(d->type == TYPE_GROUP) {
-    rc = bformata(str, "[%c", sep);
-    assert(rc == BSTR_OK);
+  walk->steps[walk->count].node = d;
+  walk->steps[walk->count].leaving = leaving;
+  walk->count++;
+}
+
+static Node *Node_parse_into(bstring buf, size_t *from, NodeArena *arena, size_t lazy, Node *into);
+
+/**
+ * Finds where a deferred node's bytes start in the buffer its arena
+ * parsed, when they're a view of it.  Those can be parsed right where
+ * they are since the input always has a delimiter after the closing
+ * word, which is all the parser needs after it.
+ */
+static int Node_deferred_offset(Node *d, size_t *from)
+{
+  bstring input = d->arena ? d->arena->input : NULL;
+  bstring raw = d->value.string;
+
+  if(input == NULL || raw->mlen != -1) return 0;
+  if(raw->data < input->data || raw->data + blength(raw) >= input->data + blength(input)) return 0;
+
+  *from = raw->data - input->data;
+  return 1;
+}
+
+/** Parses a deferred node into a heap tree named the same, for walks, NULL if it won't parse. */
+static Node *Node_deferred_tree(Node *d)
+{
+  bstring buf = NULL;
+  Node *tree = NULL;
+  size_t from = 0;
+
+  if(Node_deferred_offset(d, &from)) {
+    tree = Node_parse_into(d->arena->input, &from, NULL, 0, NULL);
+  } else {
+    buf = bstrcpy(d->value.string);
+    assert_mem(buf);
+
+    // the parser needs the whitespace after the closing word
+    bconchar(buf, ' ');
+    tree = Node_parse(buf);
+    bdestroy(buf);
+  }
+
+  if(tree == NULL) return NULL;
+
+  // an attribute could have renamed it after the bytes were taken
+  if(d->name != NULL) Node_name(tree, bstrcpy(d->name));
+
+  return tree;
+}
+
+void Node_walk_start(NodeWalk *walk, Node *d, int follow_sibs)
+{
+  assert_not(walk, NULL);
+
+  walk->steps = walk->inline_steps;
+  walk->count = 0;
+  walk->size = NODE_WALK_INLINE;
+  walk->entered = NULL;
+  walk->expand = 1;
+  walk->failed = 0;
+
+  // siblings are written last first, so the last one ends up on top
+  for(; d != NULL; d = follow_sibs ? d->sibling : NULL) {
+    Node_walk_push(walk, d, 0);
   }
+}
+
+Node *Node_walk_next(NodeWalk *walk, int *leaving)
+{
+  Node *d = walk->entered;
+  NodeWalkStep *step = NULL;
 
-  if(d->child != NULL) {
-    // we always follow siblings on the children
-    Node_catbstr(str, d->child, sep, 1);
+  // children go on only now so Node_walk_skip can keep them off
+  if(d != NULL) {
+    walk->entered = NULL;
+    for(d = d->child; d != NULL; d = d->sibling) Node_walk_push(walk, d, 0);
   }
 
-  switch(d->type) {
-    case TYPE_BLOB:
-      bformata(str, "'%zu:" , blength(d->value.string));
-      bconcat(str, d->value.string);
-      bformata(str, "\'%c", sep);
-      break;
-    case TYPE_STRING:
-      bformata(str, "\"%s\"%c" , bdata(d->value.string), sep);
-      break;
-    case TYPE_NUMBER:
-      bformata(str, "%llu%c", d->value.number, sep);
-      break;
-    case TYPE_FLOAT:
-      bformata(str, "%f%c", d->value.floating, sep);
-      break;
-    case TYPE_GROUP: 
-      if(!d->name || bchar(d->name, 0) == '@') {
-        rc = bformata(str, "]%c", sep);
-        assert(rc == BSTR_OK);
+  while(walk->count > 0) {
+    step = &walk->steps[walk->count - 1];
+
+    if(step->leaving == NODE_WALK_TEMP) {
+      walk->count--;
+      Node_destroy(step->node);
+      continue;
+    }
+
+    if(!step->leaving && walk->expand && step->node->type == TYPE_DEFERRED) {
+      // walk a parsed copy in its place, and throw it away once it's done
+      d = Node_deferred_tree(step->node);
+      if(d == NULL) {
+        walk->failed = 1;
+        return NULL;
       }
-      break;
-    case TYPE_INVALID: // fallthrough
-    default:
-      assert(!"invalid type for node");
-      break;
+
+      step->node = d;
+      step->leaving = NODE_WALK_TEMP;
+      Node_walk_push(walk, d, 0);
+      continue;
+    }
+
+    *leaving = step->leaving;
+
+    if(step->leaving) {
+      walk->count--;
+    } else {
+      // leave it where it is, the children go on top of it
+      step->leaving = 1;
+      walk->entered = step->node;
+    }
+
+    return step->node;
   }
 
-  if(d->name != NULL) {
-    rc = bformata(str, "%s%c", bdata(d->name), sep); 
-    assert(rc == BSTR_OK);
+  return NULL;
+}
+
+void Node_walk_end(NodeWalk *walk)
+{
+  size_t i = 0;
+
+  // a walk that stopped early still has to free the copies it made
+  for(i = 0; i < walk->count; i++) {
+    if(walk->steps[i].leaving == NODE_WALK_TEMP) Node_destroy(walk->steps[i].node);
   }
+
+  if(walk->steps != walk->inline_steps) free(walk->steps);
+
+  walk->steps = walk->inline_steps;
+  walk->count = 0;
+  walk->entered = NULL;
+}
+
+size_t Node_serialized_length(Node *d, char sep, int follow_sibs)
+{
+  size_t length = 0;
+  int leaving = 0;
+  NodeWalk walk;
+
+  Node_walk_start(&walk, d, follow_sibs);
+
+  while((d = Node_walk_next(&walk, &leaving)) != NULL) {
+    // everything is counted on the way out, the order doesn't matter
+    if(!leaving) continue;
+
+    switch(d->type) {
+      case TYPE_BLOB:
+        // '5:hello' plus the sep
+        length += Node_number_length(blength(d->value.string)) + blength(d->value.string) + 4;
+        break;
+      case TYPE_STRING:
+        length += Node_cstr_length(d->value.string) + 3;
+        break;
+      case TYPE_NUMBER:
+        length += Node_number_length(d->value.number) + 1;
+        break;
+      case TYPE_FLOAT:
+        length += Node_float_length(d->value.floating) + 1;
+        break;
+      case TYPE_GROUP: 
+        length += 2;
+        if(!d->name || bchar(d->name, 0) == '@') length += 2;
+        break;
+      case TYPE_INVALID: // fallthrough
+      default:
+        assert(!"invalid type for node");
+        break;
+    }
+
+    if(d->name != NULL) length += Node_cstr_length(d->name) + 1;
+  }
+
+  Node_walk_end(&walk);
+
+  // nothing real is ever 0 bytes, so that says a deferred group didn't parse
+  return walk.failed ? 0 : length;
+}
+
+/**
+ * Writes the node the same as Node_catbstr always has, into out which
+ * has to have Node_serialized_length bytes, and gives back the end
+ * (NULL if a deferred group in it doesn't parse).
+ */
+static char *Node_write(char *out, Node *d, char sep, int follow_sibs)
+{
+  size_t length = 0;
+  int leaving = 0;
+  NodeWalk walk;
+
+  Node_walk_start(&walk, d, follow_sibs);
+
+  while((d = Node_walk_next(&walk, &leaving)) != NULL) {
+    if(!leaving) {
+      if(d->type == TYPE_GROUP) {
+        *out++ = '[';
+        *out++ = sep;
+      }
+      continue;
+    }
+
+    switch(d->type) {
+      case TYPE_BLOB:
+        *out++ = '\'';
+        out = Node_write_number(out, blength(d->value.string));
+        *out++ = ':';
+        if(blength(d->value.string) > 0) {
+          memcpy(out, d->value.string->data, blength(d->value.string));
+          out += blength(d->value.string);
+        }
+        *out++ = '\'';
+        *out++ = sep;
+        break;
+      case TYPE_STRING:
+        length = Node_cstr_length(d->value.string);
+        *out++ = '"';
+        if(length > 0) memcpy(out, d->value.string->data, length);
+        out += length;
+        *out++ = '"';
+        *out++ = sep;
+        break;
+      case TYPE_NUMBER:
+        out = Node_write_number(out, d->value.number);
+        *out++ = sep;
+        break;
+      case TYPE_FLOAT:
+        out += Stackish_float_format(out, d->value.floating);
+        *out++ = sep;
+        break;
+      case TYPE_GROUP: 
+        if(!d->name || bchar(d->name, 0) == '@') {
+          *out++ = ']';
+          *out++ = sep;
+        }
+        break;
+      case TYPE_INVALID: // fallthrough
+      default:
+        assert(!"invalid type for node");
+        break;
+    }
+
+    if(d->name != NULL) {
+      length = Node_cstr_length(d->name);
+      if(length > 0) memcpy(out, d->name->data, length);
+      out += length;
+      *out++ = sep;
+    }
+  }
+
+  Node_walk_end(&walk);
+
+  return walk.failed ? NULL : out;
+}
+
+int Node_catbstr(bstring str, Node *d, char sep, int follow_sibs) 
+{
+  int rc = 0;
+  size_t length = 0;
+  char *end = NULL;
+
+  assert_not(str, NULL);
+
+  if(d == NULL) return 1;
+
+  // size it once and write it straight in, no reallocs or printf
+  length = Node_serialized_length(d, sep, follow_sibs);
+  if(length == 0) return 0;
+
+  rc = balloc(str, blength(str) + length + 1);
+  assert(rc == BSTR_OK && "failed to grow string for node");
+
+  end = Node_write((char *)str->data + blength(str), d, sep, follow_sibs);
+  if(end == NULL) return 0;
+
+  assert((size_t)(end - (char *)str->data - blength(str)) == length && "serialized length was wrong");
+
+  str->slen += length;
+  str->data[str->slen] = '\0';
+
+  return 1;
 }
 
 inline void Node_intern_destroy(Node *d)
 {
-  if(d->type == TYPE_BLOB || d->type == TYPE_STRING) {
+  if(d->type == TYPE_BLOB || d->type == TYPE_STRING || d->type == TYPE_DEFERRED) {
     bdestroy(d->value.string);
   }
 
@@ -128,8 +431,32 @@ inline void Node_intern_destroy(Node *d)
 
 void Node_destroy(Node *root) 
 {
-  BIN_TREE_MAP_ON_ELEMENTS_POSTORDER(Node, root, d, sibling, child, 
-       Node_intern_destroy(d)); 
+  NodeWalk walk;
+  Node *d = NULL;
+  int leaving = 0;
+
+  if(root && root->arena) {
+    // nothing in an arena can be freed alone, but the root frees all of it
+    if(root->arena->root == root) NodeArena_destroy(root->arena);
+    return;
+  }
+
+  // can't use BIN_TREE_MAP since it has to skip over arena trees grafted in here
+  Node_walk_start(&walk, root, 1);
+  walk.expand = 0;
+
+  while((d = Node_walk_next(&walk, &leaving)) != NULL) {
+    if(d->arena) {
+      // everything under it belongs to its arena, which goes if this is its root
+      if(!leaving) Node_walk_skip(&walk);
+      else if(d->arena->root == d) NodeArena_destroy(d->arena);
+    } else if(leaving) {
+      // the children are already gone by the time we leave
+      Node_intern_destroy(d);
+    }
+  }
+
+  Node_walk_end(&walk);
 }
 
 void *node_test_calloc()
@@ -139,8 +466,15 @@ void *node_test_calloc()
 
 inline Node *Node_create(Node *parent, enum NodeType type) 
 {
-  Node *node = node_test_calloc();
-  assert_mem(node);
+  Node *node = NULL;
+
+  if(parent && parent->arena) {
+    node = NodeArena_alloc(parent->arena, sizeof(Node));
+    node->arena = parent->arena;
+  } else {
+    node = node_test_calloc();
+    assert_mem(node);
+  }
 
   node->type = type;
 
@@ -161,8 +495,17 @@ inline Node *Node_create(Node *parent, enum NodeType type)
   return node;\
 }
 
-DEFINE_NEW_NODE_FUNC(string, string, TYPE_STRING, bstring);
-DEFINE_NEW_NODE_FUNC(blob, string, TYPE_BLOB, bstring);
+#define DEFINE_NEW_BSTR_NODE_FUNC(name,node_type) Node *Node_new_##name(Node *parent, bstring data)\
+{\
+  Node *node = Node_create(parent, node_type);\
+  node->value.string = data;\
+  if(node->arena) NodeArena_adopt_bstr(node->arena, data);\
+  return node;\
+}
+
+DEFINE_NEW_BSTR_NODE_FUNC(string, TYPE_STRING);
+DEFINE_NEW_BSTR_NODE_FUNC(blob, TYPE_BLOB);
+DEFINE_NEW_BSTR_NODE_FUNC(deferred, TYPE_DEFERRED);
 DEFINE_NEW_NODE_FUNC(number, number, TYPE_NUMBER, uint64_t);
 DEFINE_NEW_NODE_FUNC(float, floating, TYPE_FLOAT, double);
 
@@ -177,13 +520,82 @@ void Node_name(Node *node, bstring name)
   assert_not(node, NULL);
   assert_not(name, NULL);
 
-  if(node->name) {
+  if(node->arena) {
+    // the old name goes with the arena, the new one has to as well
+    NodeArena_adopt_bstr(node->arena, name);
+  } else if(node->name) {
     bdestroy(node->name);
   }
 
   node->name = name;
 }
 
+/** 
+ * Words that show up in nearly every message.  Keep it sorted (as bytes)
+ * since Node_intern does a binary search on it.  The binary form refers
+ * to these by position, so changing the list means changing
+ * NODE_BINARY_CODEC too or peers will read each other's words wrong.
+ */
+struct tagbstring NODE_INTERNED[] = {
+  bsStatic("@error"), bsStatic("@from"), bsStatic("@name"),
+  bsStatic("@path"), bsStatic("@to"), bsStatic("answer"), bsStatic("cabal"),
+  bsStatic("challenge"), bsStatic("children"), bsStatic("create"),
+  bsStatic("created"), bsStatic("env"), bsStatic("err"), bsStatic("error"),
+  bsStatic("get"), bsStatic("header"), bsStatic("identity"),
+  bsStatic("info"), bsStatic("init"), bsStatic("invite"),
+  bsStatic("invited"), bsStatic("join"), bsStatic("joined"), bsStatic("lag"),
+  bsStatic("leave"), bsStatic("left"), bsStatic("list"), bsStatic("member"),
+  bsStatic("members"), bsStatic("mendicate"), bsStatic("mendicated"),
+  bsStatic("message"), bsStatic("msg"), bsStatic("name"), bsStatic("ping"),
+  bsStatic("pong"), bsStatic("recv"), bsStatic("register"),
+  bsStatic("registered"), bsStatic("route"), bsStatic("rpy"),
+  bsStatic("send"), bsStatic("sent"), bsStatic("signed"), bsStatic("slab"),
+  bsStatic("system"), bsStatic("tag"), bsStatic("trace"),
+  bsStatic("unregister"), bsStatic("unsent")
+};
+
+const size_t NODE_INTERNED_COUNT = sizeof(NODE_INTERNED) / sizeof(struct tagbstring);
+
+bstring Node_intern(const char *start, size_t length)
+{
+  size_t low = 0, high = NODE_INTERNED_COUNT, mid = 0;
+  int rc = 0;
+
+  while(low < high) {
+    mid = (low + high) / 2;
+    rc = memcmp(start, NODE_INTERNED[mid].data, 
+        length < (size_t)NODE_INTERNED[mid].slen ? length : (size_t)NODE_INTERNED[mid].slen);
+
+    if(rc == 0) rc = (length > (size_t)NODE_INTERNED[mid].slen) - (length < (size_t)NODE_INTERNED[mid].slen);
+
+    if(rc == 0) {
+      return &NODE_INTERNED[mid];
+    } else if(rc < 0) {
+      high = mid;
+    } else {
+      low = mid + 1;
+    }
+  }
+
+  return NULL;
+}
+
+bstring Node_name_str(Node *node, const char *start, size_t length)
+{
+  bstring name = Node_intern(start, length);
+
+  return name ? name : Node_str(node, start, length);
+}
+
+bstring Node_str(Node *node, const char *start, size_t length)
+{
+  if(node && node->arena) {
+    return NodeArena_bstr(node->arena, start, length);
+  } else {
+    return blk2bstr(start, length);
+  }
+}
+
 
 
 Node *Node_cons(const char *format, ...) {
@@ -238,13 +650,13 @@ Node *Node_cons(const char *format, ...) {
       case '@': {
                   const char *attr = va_arg(args, const char *);
                   check(attr != NULL, "NULL given for attr");
-                  Node_name(cur_node->child, bfromcstr(attr));
+                  Node_name(cur_node->child, Node_name_str(cur_node->child, attr, strlen(attr)));
                   break;
                 }
       case 'w': {
                   const char *word = va_arg(args, const char *);
                   check(word != NULL, "NULL given for word name");
-                  Node_name(cur_node, bfromcstr(word));
+                  Node_name(cur_node, Node_name_str(cur_node, word, strlen(word)));
                   UP();
                   break;
                 }
@@ -394,6 +806,8 @@ void Node_add_child(Node *parent, Node *child)
 
   LIST_ADD(Node, parent->child, child, sibling);
   child->parent = parent;
+
+  if(parent->arena) NodeArena_adopt_node(parent->arena, child);
 }
 
 void Node_add_sib(Node *sib1, Node *sib2)
@@ -403,6 +817,8 @@ void Node_add_sib(Node *sib1, Node *sib2)
 
   LIST_ADD(Node, sib1, sib2, sibling);
   sib2->parent = sib1->parent;
+
+  if(sib1->arena) NodeArena_adopt_node(sib1->arena, sib2);
 }
 
 Node *Node_parse(bstring buf)
@@ -414,64 +830,210 @@ Node *Node_parse(bstring buf)
   return Node_parse_seq(buf, &from);
 }
 
-Node *Node_parse_seq(bstring buf, size_t *from)
+/** 
+ * Runs the parser over buf from nread until the document's done, going
+ * back in after each blob.  Gives back 0 if buf can't be parsed, and
+ * nread is left where the parser stopped.
+ */
+static int Node_parse_run(stackish_parser *parser, bstring buf, size_t *nread)
 {
-  size_t nread = *from;
-  stackish_parser parser;
-  stackish_parser_init(&parser);
   char last = bchar(buf, blength(buf) - 1);
 
-  assert_not(buf, NULL);
-  assert_not(from, NULL);
-
   // make sure that the string ends in at least one space of some kind for the parser
   check(last == ' ' || last == '\n' || last == '\t', "buffer doesn't end in either ' \\n\\t'");
 
-  nread = stackish_parser_execute(&parser, (const char *)bdata(buf), blength(buf), nread);
-  check(!stackish_parser_has_error(&parser), "parsing error on stackish string");
+  *nread = stackish_parser_execute(parser, (const char *)bdata(buf), blength(buf), *nread);
 
-  while(stackish_more(&parser) && !stackish_parser_is_finished(&parser) && nread < (size_t)blength(buf)) {
-    assert(nread+stackish_more(&parser)+1 < (size_t)blength(buf) && "buffer overflow");
+  while(!stackish_parser_has_error(parser) && stackish_more(parser) 
+      && !stackish_parser_is_finished(parser) && *nread < (size_t)blength(buf)) 
+  {
+    assert(*nread+stackish_more(parser)+1 < (size_t)blength(buf) && "buffer overflow");
     // there is a blob that we have to pull out in order to continue
-    nread = stackish_parser_execute(&parser, (const char *)bdata(buf), blength(buf), 
-        nread+stackish_more(&parser)+1);
-    check(!stackish_parser_has_error(&parser), "parsing error after BLOB");
+    *nread = stackish_parser_execute(parser, (const char *)bdata(buf), blength(buf), 
+        *nread+stackish_more(parser)+1);
   }
 
+  return !stackish_parser_has_error(parser);
+  on_fail(return 0);
+}
+
+/**
+ * Does the parsing for all the text Node_parse functions.  Groups lazy
+ * levels down are deferred unless lazy is 0, and with into set the
+ * document's root group is built in into instead of a new node.
+ */
+static Node *Node_parse_into(bstring buf, size_t *from, NodeArena *arena, size_t lazy, Node *into)
+{
+  size_t nread = *from;
+  stackish_parser parser;
+  stackish_parser_init(&parser);
+  parser.arena = arena;
+  parser.lazy_depth = lazy;
+  parser.into = into;
+
+  assert_not(buf, NULL);
+  assert_not(from, NULL);
+
+  check(Node_parse_run(&parser, buf, &nread), "parsing error on stackish string");
+
   *from = nread + 1;
 
   // skip over a last trailing newline
   while(bchar(buf, *from) == '\n') (*from)++;
 
+  // once there's a root it owns the arena, before that it's ours
+  if(arena && parser.root == NULL) NodeArena_destroy(arena);
+
   return parser.root;
 
   on_fail(dbg("failed parsing after %zu bytes", nread);
+      if(arena && parser.root == NULL) NodeArena_destroy(arena);
+      // into isn't ours to destroy, only what was put in it
+      if(into && parser.root == into) {
+        if(into->child) Node_destroy(into->child);
+        into->child = NULL;
+        parser.root = NULL;
+      }
       stackish_node_clear(&parser); 
       *from = nread + 1;
       return NULL);
 }
 
+Node *Node_parse_seq(bstring buf, size_t *from)
+{
+  return Node_parse_into(buf, from, NULL, 0, NULL);
+}
+
+Node *Node_parse_arena(bstring buf)
+{
+  size_t from = 0;
+
+  assert_not(buf, NULL);
+
+  return Node_parse_seq_arena(buf, &from);
+}
+
+Node *Node_parse_view(bstring buf)
+{
+  return Node_parse_lazy(buf, 0);
+}
+
+Node *Node_parse_lazy(bstring buf, size_t depth)
+{
+  size_t from = 0;
+  NodeArena *arena = NULL;
+
+  assert_not(buf, NULL);
+
+  // blobs aren't copied so it needs less room than Node_parse_arena
+  arena = NodeArena_create(blength(buf) * 2);
+  arena->input = buf;
+
+  if(Node_is_binary(buf)) {
+    return Node_parse_binary_into(buf, arena);
+  } else {
+    return Node_parse_into(buf, &from, arena, depth, NULL);
+  }
+}
+
+Node *Node_parse_seq_arena(bstring buf, size_t *from)
+{
+  assert_not(buf, NULL);
+  assert_not(from, NULL);
+
+  size_t length = *from < (size_t)blength(buf) ? blength(buf) - *from : 0;
+
+  // nodes take a lot more room than their text, so this is usually one chunk
+  return Node_parse_into(buf, from, NodeArena_create(length * 4), 0, NULL);
+}
+
+/** Parses a deferred node into itself, see Node_expand. */
+static int Node_expand_one(Node *d)
+{
+  bstring raw = d->value.string;
+  bstring name = d->name;
+  bstring buf = NULL;
+  size_t from = 0;
+
+  // in an arena's input it's parsed right there, so blobs stay views of the input
+  if(!Node_deferred_offset(d, &from)) {
+    buf = bstrcpy(raw);
+    assert_mem(buf);
+    bconchar(buf, ' ');
+  }
+
+  // it's parsed as a plain group, then gets back the name it had
+  d->type = TYPE_GROUP;
+  d->value.number = 0;
+  d->name = NULL;
+
+  check(Node_parse_into(buf ? buf : d->arena->input, &from, NULL, 0, d) == d, "deferred group failed to parse");
+
+  if(d->name != NULL && !d->arena) bdestroy(d->name);
+  d->name = name;
+
+  if(buf && d->arena) {
+    // blobs in a view arena point into buf now, so it goes with the arena
+    NodeArena_adopt_bstr(d->arena, buf);
+  } else if(buf) {
+    bdestroy(raw);
+    bdestroy(buf);
+  }
+
+  return 1;
+
+  on_fail(if(d->name != NULL && !d->arena) bdestroy(d->name);
+      d->type = TYPE_DEFERRED;
+      d->value.string = raw;
+      d->name = name;
+      if(buf) bdestroy(buf);
+      return 0);
+}
+
+int Node_expand(Node *d)
+{
+  NodeWalk walk;
+  int leaving = 0;
+  int rc = 1;
+
+  assert_not(d, NULL);
+
+  Node_walk_start(&walk, d, 0);
+  walk.expand = 0;
+
+  while((d = Node_walk_next(&walk, &leaving)) != NULL) {
+    // the walk goes on into its children once it's expanded
+    if(!leaving && d->type == TYPE_DEFERRED && !Node_expand_one(d)) rc = 0;
+  }
+
+  Node_walk_end(&walk);
+
+  return rc;
+}
+
 Node *Node_from_str(Node *parent, enum NodeType type, const char *start, size_t length) 
 {
-  char *end = NULL;
+  uint64_t number = 0;
+  double floating = 0;
 
   switch(type) {
     case TYPE_BLOB:
-      return Node_new_blob(parent, blk2bstr(start, length));
+      if(parent && parent->arena && parent->arena->input) {
+        // Node_parse_view keeps the buffer so blobs can just point into it
+        return Node_new_blob(parent, NodeArena_view(parent->arena, start, length));
+      } else {
+        return Node_new_blob(parent, Node_str(parent, start, length));
+      }
       break;
     case TYPE_STRING:
-      return Node_new_string(parent, blk2bstr(start, length));
+      return Node_new_string(parent, Node_str(parent, start, length));
       break;
     case TYPE_NUMBER:
-      end = NULL;
-      uint64_t number = strtoull(start, &end, 10);
-      check(end == start + length, "malformed number on input");
+      check(Stackish_number_parse(start, length, &number), "malformed number on input");
       return Node_new_number(parent, number);
       break;
     case TYPE_FLOAT:
-      end = NULL;
-      double floating = strtod(start, &end);
-      check(end == start + length, "malformed float on input");
+      check(Stackish_float_parse(start, length, &floating), "malformed float on input");
       return Node_new_float(parent, floating);
       break;
     default:
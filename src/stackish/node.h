@@ -17,11 +17,16 @@
 #include <myriad/bstring/bstrlib.h>
 #include <stdint.h>
 
-/** Determines what is contained in the Node.value union. */
+/** 
+ * Determines what is contained in the Node.value union.  A
+ * TYPE_DEFERRED is a group Node_parse_lazy didn't build yet, see
+ * Node_expand.
+ */
 typedef enum NodeType { 
-  TYPE_NUMBER, TYPE_STRING, TYPE_BLOB, TYPE_FLOAT, TYPE_INVALID, TYPE_GROUP
+  TYPE_NUMBER, TYPE_STRING, TYPE_BLOB, TYPE_FLOAT, TYPE_INVALID, TYPE_GROUP, TYPE_DEFERRED
 } NodeType;
 
+struct NodeArena;
 
 /** 
  * A Node contains the data for this element of the Stackish tree,
@@ -43,7 +48,8 @@ typedef struct Node {
   NodeType type;
 
   /** Holds the actual data depending on the type.  node.string 
-   * holds both TYPE_STRING and TYPE_BLOB.*/
+   * holds TYPE_STRING, TYPE_BLOB, and the unparsed bytes of a
+   * TYPE_DEFERRED.*/
   union {
     uint64_t number;
     bstring string;
@@ -58,6 +64,9 @@ typedef struct Node {
 
   /** The first child of this Node. */
   struct Node *child;
+
+  /** The arena this Node was allocated in, NULL for ones on the heap.  See arena.h. */
+  struct NodeArena *arena;
 } Node;
 
 /**
@@ -81,8 +90,23 @@ void Node_dump(Node *d, char sep, int follow_sibs);
  * @param d The node to dump.
  * @param sep Separator char between nodes (canonical requires ' ' ASCII 32).
  * @param follow_sibs Whether to follow siblings of this node.
+ * @return 1 if it was added, 0 if a deferred group in it doesn't parse and str is left alone.
  */
-void Node_catbstr(bstring str, Node *d, char sep, int follow_sibs);
+int Node_catbstr(bstring str, Node *d, char sep, int follow_sibs);
+
+/**
+ * Tells you exactly how many bytes Node_catbstr will add for this node,
+ * so you can allocate once and never grow the buffer.
+ *
+ * @param d The node to measure.
+ * @param sep Separator char between nodes.
+ * @param follow_sibs Whether to follow siblings of this node.
+ * @return Bytes the serialized node takes, without a final \n, or 0 if a deferred group in it doesn't parse.
+ */
+size_t Node_serialized_length(Node *d, char sep, int follow_sibs);
+
+/** Bytes of a string or name up to the first \0, same as %s would print. */
+#define Node_cstr_length(S) ((S) && (S)->data ? strlen((const char *)(S)->data) : 0)
 
 /**
  * The most common way to make a bstring out of a stackish struct.
@@ -96,12 +120,112 @@ void Node_catbstr(bstring str, Node *d, char sep, int follow_sibs);
  *
  * @param d The node to dump.
  * @param follow_sibs Whether to follow siblings of this node.
- * @return Fully formed bstring with the node in serialized form.
+ * @return Fully formed bstring with the node in serialized form, NULL if a deferred group in it doesn't parse.
  */
 bstring Node_bstr(Node *d, int follow_sibs);
 
+/** Steps a NodeWalk holds in itself before it moves them to the heap. */
+#define NODE_WALK_INLINE 32
+
+typedef struct NodeWalkStep {
+  Node *node;
+  int leaving;
+} NodeWalkStep;
+
+/**
+ * Walks a tree in the order Node_bstr writes it without recursing, so
+ * how deep or wide a tree is never changes how much of the task's stack
+ * it takes.  Every node comes out of Node_walk_next twice, entering
+ * (before its children) and leaving (after them):
+ *
+ * <pre>
+ *   Node_walk_start(&walk, root, 1);
+ *   while((d = Node_walk_next(&walk, &leaving)) != NULL) {
+ *     if(!leaving) ... else ...
+ *   }
+ *   Node_walk_end(&walk);
+ * </pre>
+ *
+ * The pending steps stay in the NodeWalk until there's more than
+ * NODE_WALK_INLINE of them, then they go to the heap, so you always
+ * have to call Node_walk_end.
+ *
+ * A TYPE_DEFERRED node is parsed into a throw away tree that's walked
+ * in its place, so anything written on a walk comes out the same as if
+ * the whole document had been parsed, and the tree itself is never
+ * changed.  Set expand to 0 after Node_walk_start to get the deferred
+ * nodes themselves instead.
+ */
+typedef struct NodeWalk {
+  NodeWalkStep *steps;
+  size_t count;
+  size_t size;
+
+  /** Last node entered, its children go on at the next step unless it's skipped. */
+  Node *entered;
+
+  /** Whether to walk deferred nodes as the groups they stand for, 1 by default. */
+  int expand;
+
+  /** Set when a deferred node didn't parse, which ends the walk early. */
+  int failed;
+
+  NodeWalkStep inline_steps[NODE_WALK_INLINE];
+} NodeWalk;
+
+/**
+ * @brief Gets a walk ready to start at d.
+ * @param walk : The walk, usually on the stack.
+ * @param d : Node to start with, can be NULL.
+ * @param follow_sibs : Whether to walk the siblings of d too.
+ */
+void Node_walk_start(NodeWalk *walk, Node *d, int follow_sibs);
+
+/**
+ * @brief Moves to the next step of the walk.
+ * @param walk : The walk.
+ * @param leaving : OUT 0 when entering the node, 1 when leaving it.
+ * @return Node * : The node or NULL when the walk is done, or failed is set.
+ */
+Node *Node_walk_next(NodeWalk *walk, int *leaving);
+
+/** Don't go into the children of the node that was just entered. */
+#define Node_walk_skip(W) ((W)->entered = NULL)
+
+/** @brief Frees whatever the walk put on the heap. */
+void Node_walk_end(NodeWalk *walk);
+
 /**
- * Destroys a node and all things under it.
+ * Caps on what the parsers (Node_parse, StackishStream, and
+ * Node_parse_binary) will build, since their input comes off the wire.
+ * A document that nests groups deeper than depth or puts more than
+ * width children in one group fails to parse.
+ */
+typedef struct NodeLimits {
+  size_t depth;
+  size_t width;
+} NodeLimits;
+
+#define NODE_MAX_DEPTH 128
+#define NODE_MAX_WIDTH (64 * 1024)
+
+/** The limits all the parsers use, change them before any parsing starts. */
+extern NodeLimits NODE_LIMITS;
+
+/**
+ * For the parsers, counts another child going into the open group G and
+ * is false once there's too many.  The count is kept in the group's
+ * value, which groups don't use, and Node_limit_close clears it.
+ */
+#define Node_limit_width(G) (++(G)->value.number <= NODE_LIMITS.width)
+
+/** For the parsers, G is done so its child count goes away. */
+#define Node_limit_close(G) ((G)->value.number = 0)
+
+/**
+ * Destroys a node and all things under it.  For a tree made in a
+ * NodeArena only destroying the root does anything, and it frees the
+ * whole arena at once.
  *
  * @param root Node to start with, includes siblings.
  */
@@ -119,6 +243,12 @@ Node *Node_new_string(Node *parent, bstring data);
 /** Constructs a new node that represents a blob, attaching to parent if not NULL. */
 Node *Node_new_blob(Node *parent, bstring data);
 
+/** Constructs a deferred group out of its unparsed bytes, from the [ to the closing word or ]. */
+Node *Node_new_deferred(Node *parent, bstring data);
+
+/** Whether N is a group, even one that hasn't been parsed yet. */
+#define Node_is_group(N) ((N)->type == TYPE_GROUP || (N)->type == TYPE_DEFERRED)
+
 /** Constructs a new node that represents a number, attaching to parent if not NULL. */
 Node *Node_new_number(Node *parent, uint64_t data);
 
@@ -128,6 +258,42 @@ Node *Node_new_float(Node *parent, double data);
 /** Constructs a new node that represents a group, attaching to parent if not NULL. */
 Node *Node_new_group(Node *parent);
 
+/**
+ * Copies the bytes into a bstring that lives as long as the node does,
+ * so in the node's arena if it has one.  Use it to make names and
+ * values for nodes you're about to attach to node.
+ */
+bstring Node_str(Node *node, const char *start, size_t length);
+
+/**
+ * The shared names Node_intern gives out.  They're write protected
+ * (bsStatic) so bdestroy and Node_destroy leave them alone, and you
+ * can never change one.
+ */
+extern struct tagbstring NODE_INTERNED[];
+extern const size_t NODE_INTERNED_COUNT;
+
+/**
+ * Looks up one of the common words (header, msg, rpy, \@to, and so on)
+ * and gives back the one shared bstring for it.  Two interned names are
+ * the same word only if they are the same pointer.
+ *
+ * @param start Bytes of the word.
+ * @param length How many.
+ * @return The interned name, or NULL if it isn't a common word.
+ */
+bstring Node_intern(const char *start, size_t length);
+
+/** True if S is one of the interned names. */
+#define Node_is_interned(S) ((S) >= NODE_INTERNED && (S) < NODE_INTERNED + NODE_INTERNED_COUNT)
+
+/**
+ * Makes a name for a node, the interned one if it's a common word,
+ * otherwise a copy just like Node_str.  The parser and Node_cons name
+ * nodes with this.
+ */
+bstring Node_name_str(Node *node, const char *start, size_t length);
+
 /** 
  * Names a node.  Named groups are normal, naming anything else makes an attribute, but
  * attributes should start with a '@'.  So calling Node_name(blob_node, "stuff") is 
@@ -175,7 +341,8 @@ Node *Node_cons(const char *format, ...);
  * and don't want to extract it.
  *
  * @param node The node to start deconstructing from.
- * @param copy Whether to copy the data or not.
+ * @param copy Whether to copy the data or not.  Without copying you get the Node's own
+ *   bstrings, which for a Node_parse_view tree are views into the parsed buffer.
  * @param format The deconstruct format.  Remember it's got to be reversed from the cons format used.
  * @return 0 for failure, 1 for success.  On failure the results are not to be trusted.
  */
@@ -229,6 +396,19 @@ Node *Node_parse(bstring buf);
  */
 Node *Node_parse_seq(bstring buf, size_t *from);
 
+/**
+ * Parses every TYPE_DEFERRED group under d (and d itself) into the
+ * real thing, in place, so code that goes through the children can see
+ * them.  Names and attributes on the deferred nodes are kept.  This
+ * changes the tree, so do it before it's shared with other threads (a
+ * Message has to be expanded before it's enqueued).  Walks and
+ * Node_bstr don't need it, they expand as they go.
+ *
+ * @param d The node to expand, along with everything under it.
+ * @return 1 if it all parsed, 0 if not, and then whatever failed is left deferred.
+ */
+int Node_expand(Node *d);
+
 /**
  * Given a type and a string this will do the proper conversion to create the
  * right node.  It returns NULL if there's an error of any kind.
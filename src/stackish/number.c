@@ -0,0 +1,391 @@
+/*
+ * Utu -- Saving The Internet With Hate
+ *
+ * Copyright (c) Zed A. Shaw 2005 (zedshaw@zedshaw.com)
+ *
+ * This file is modifiable/redistributable under the terms of the GNU
+ * General Public License.
+ *
+ * You should have recieved a copy of the GNU General Public License along
+ * with this program; see the file COPYING. If not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 0211-1307, USA.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <float.h>
+#include <math.h>
+#include "stackish/number.h"
+
+/**
+ * Grisu2 from Florian Loitsch's "Printing Floating-Point Numbers Quickly
+ * and Accurately with Integers".  A double is turned into a 64 bit
+ * significand and binary exponent (a NumberFp), scaled by a cached power
+ * of ten so the exponent is small, and the digits are cut off as soon
+ * as they land between the float's neighbours.
+ */
+typedef struct NumberFp {
+  uint64_t f;
+  int e;
+} NumberFp;
+
+#define NUMBER_HIDDEN_BIT 0x0010000000000000ULL
+#define NUMBER_SIGNIFICAND_MASK 0x000FFFFFFFFFFFFFULL
+#define NUMBER_EXPONENT_BIAS (0x3FF + 52)
+
+/** 10^k for k = -348, -340, ... 340 as a 64 bit significand and binary exponent. */
+static const uint64_t number_powers_f[] = {
+  0xfa8fd5a0081c0288ULL, 0xbaaee17fa23ebf76ULL, 0x8b16fb203055ac76ULL, 0xcf42894a5dce35eaULL,
+  0x9a6bb0aa55653b2dULL, 0xe61acf033d1a45dfULL, 0xab70fe17c79ac6caULL, 0xff77b1fcbebcdc4fULL,
+  0xbe5691ef416bd60cULL, 0x8dd01fad907ffc3cULL, 0xd3515c2831559a83ULL, 0x9d71ac8fada6c9b5ULL,
+  0xea9c227723ee8bcbULL, 0xaecc49914078536dULL, 0x823c12795db6ce57ULL, 0xc21094364dfb5637ULL,
+  0x9096ea6f3848984fULL, 0xd77485cb25823ac7ULL, 0xa086cfcd97bf97f4ULL, 0xef340a98172aace5ULL,
+  0xb23867fb2a35b28eULL, 0x84c8d4dfd2c63f3bULL, 0xc5dd44271ad3cdbaULL, 0x936b9fcebb25c996ULL,
+  0xdbac6c247d62a584ULL, 0xa3ab66580d5fdaf6ULL, 0xf3e2f893dec3f126ULL, 0xb5b5ada8aaff80b8ULL,
+  0x87625f056c7c4a8bULL, 0xc9bcff6034c13053ULL, 0x964e858c91ba2655ULL, 0xdff9772470297ebdULL,
+  0xa6dfbd9fb8e5b88fULL, 0xf8a95fcf88747d94ULL, 0xb94470938fa89bcfULL, 0x8a08f0f8bf0f156bULL,
+  0xcdb02555653131b6ULL, 0x993fe2c6d07b7facULL, 0xe45c10c42a2b3b06ULL, 0xaa242499697392d3ULL,
+  0xfd87b5f28300ca0eULL, 0xbce5086492111aebULL, 0x8cbccc096f5088ccULL, 0xd1b71758e219652cULL,
+  0x9c40000000000000ULL, 0xe8d4a51000000000ULL, 0xad78ebc5ac620000ULL, 0x813f3978f8940984ULL,
+  0xc097ce7bc90715b3ULL, 0x8f7e32ce7bea5c70ULL, 0xd5d238a4abe98068ULL, 0x9f4f2726179a2245ULL,
+  0xed63a231d4c4fb27ULL, 0xb0de65388cc8ada8ULL, 0x83c7088e1aab65dbULL, 0xc45d1df942711d9aULL,
+  0x924d692ca61be758ULL, 0xda01ee641a708deaULL, 0xa26da3999aef774aULL, 0xf209787bb47d6b85ULL,
+  0xb454e4a179dd1877ULL, 0x865b86925b9bc5c2ULL, 0xc83553c5c8965d3dULL, 0x952ab45cfa97a0b3ULL,
+  0xde469fbd99a05fe3ULL, 0xa59bc234db398c25ULL, 0xf6c69a72a3989f5cULL, 0xb7dcbf5354e9beceULL,
+  0x88fcf317f22241e2ULL, 0xcc20ce9bd35c78a5ULL, 0x98165af37b2153dfULL, 0xe2a0b5dc971f303aULL,
+  0xa8d9d1535ce3b396ULL, 0xfb9b7cd9a4a7443cULL, 0xbb764c4ca7a44410ULL, 0x8bab8eefb6409c1aULL,
+  0xd01fef10a657842cULL, 0x9b10a4e5e9913129ULL, 0xe7109bfba19c0c9dULL, 0xac2820d9623bf429ULL,
+  0x80444b5e7aa7cf85ULL, 0xbf21e44003acdd2dULL, 0x8e679c2f5e44ff8fULL, 0xd433179d9c8cb841ULL,
+  0x9e19db92b4e31ba9ULL, 0xeb96bf6ebadf77d9ULL, 0xaf87023b9bf0ee6bULL
+};
+
+static const int16_t number_powers_e[] = {
+  -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980, -954, -927,
+  -901, -874, -847, -821, -794, -768, -741, -715, -688, -661, -635, -608,
+  -582, -555, -529, -502, -475, -449, -422, -396, -369, -343, -316, -289,
+  -263, -236, -210, -183, -157, -130, -103, -77, -50, -24, 3, 30,
+  56, 83, 109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+  375, 402, 428, 455, 481, 508, 534, 561, 588, 614, 641, 667,
+  694, 720, 747, 774, 800, 827, 853, 880, 907, 933, 960, 986,
+  1013, 1039, 1066
+};
+
+static const uint64_t number_pow10[] = {
+  1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL,
+  1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+  100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL, 100000000000000000ULL,
+  1000000000000000000ULL, 10000000000000000000ULL
+};
+
+static inline NumberFp NumberFp_make(uint64_t f, int e)
+{
+  NumberFp fp;
+
+  fp.f = f;
+  fp.e = e;
+
+  return fp;
+}
+
+/** The top 64 bits of the 128 bit product, rounded. */
+static inline NumberFp NumberFp_multiply(NumberFp x, NumberFp y)
+{
+  const uint64_t M32 = 0xFFFFFFFFULL;
+  uint64_t a = x.f >> 32, b = x.f & M32, c = y.f >> 32, d = y.f & M32;
+  uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+  uint64_t tmp = (bd >> 32) + (ad & M32) + (bc & M32);
+
+  tmp += 1ULL << 31;
+
+  return NumberFp_make(ac + (ad >> 32) + (bc >> 32) + (tmp >> 32), x.e + y.e + 64);
+}
+
+static inline NumberFp NumberFp_normalize(NumberFp fp)
+{
+  while(!(fp.f & (1ULL << 63))) {
+    fp.f <<= 1;
+    fp.e--;
+  }
+
+  return fp;
+}
+
+/** The float v, and the points half way to its neighbours below and above. */
+static inline void NumberFp_boundaries(double floating, NumberFp *v, NumberFp *minus, NumberFp *plus)
+{
+  uint64_t bits = 0;
+  int biased = 0;
+
+  memcpy(&bits, &floating, sizeof(bits));
+  biased = (int)((bits >> 52) & 0x7FF);
+
+  if(biased != 0) {
+    *v = NumberFp_make((bits & NUMBER_SIGNIFICAND_MASK) + NUMBER_HIDDEN_BIT, biased - NUMBER_EXPONENT_BIAS);
+  } else {
+    // subnormal
+    *v = NumberFp_make(bits & NUMBER_SIGNIFICAND_MASK, 1 - NUMBER_EXPONENT_BIAS);
+  }
+
+  *plus = NumberFp_normalize(NumberFp_make((v->f << 1) + 1, v->e - 1));
+
+  // a power of two is closer to the one below it
+  if(v->f == NUMBER_HIDDEN_BIT) {
+    *minus = NumberFp_make((v->f << 2) - 1, v->e - 2);
+  } else {
+    *minus = NumberFp_make((v->f << 1) - 1, v->e - 1);
+  }
+
+  minus->f <<= minus->e - plus->e;
+  minus->e = plus->e;
+}
+
+/** Picks the cached 10^-K that brings e into the range the digits need. */
+static inline NumberFp Number_cached_power(int e, int *K)
+{
+  double dk = (-61 - e) * 0.30102999566398114 + 347;
+  int k = (int)dk;
+  unsigned int index = 0;
+
+  if(dk - k > 0.0) k++;
+
+  index = (unsigned int)((k >> 3) + 1);
+  *K = -(-348 + (int)(index << 3));
+
+  return NumberFp_make(number_powers_f[index], number_powers_e[index]);
+}
+
+/** Moves the last digit down while that's still inside the range and closer to the real value. */
+static inline void Number_round(char *digits, int length, uint64_t delta, uint64_t rest, uint64_t ten_kappa, uint64_t wp_w)
+{
+  while(rest < wp_w && delta - rest >= ten_kappa &&
+      (rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w)) 
+  {
+    digits[length - 1]--;
+    rest += ten_kappa;
+  }
+}
+
+static inline int Number_digit_count(uint32_t n)
+{
+  int count = 1;
+
+  while(count < 10 && n >= number_pow10[count]) count++;
+
+  return count;
+}
+
+/** Gives the digits of a positive finite float, which is digits * 10^K. */
+static int Number_grisu2(double floating, char *digits, int *K)
+{
+  NumberFp v, minus, plus, c_mk, W, Wp, Wm, one;
+  uint64_t wp_w = 0, delta = 0, p2 = 0, tmp = 0;
+  uint32_t p1 = 0, d = 0;
+  int kappa = 0, length = 0;
+
+  NumberFp_boundaries(floating, &v, &minus, &plus);
+  c_mk = Number_cached_power(plus.e, K);
+
+  W = NumberFp_multiply(NumberFp_normalize(v), c_mk);
+  Wp = NumberFp_multiply(plus, c_mk);
+  Wm = NumberFp_multiply(minus, c_mk);
+  // stay strictly inside, since the products can be off by one
+  Wm.f++;
+  Wp.f--;
+
+  delta = Wp.f - Wm.f;
+  one = NumberFp_make(1ULL << -Wp.e, Wp.e);
+  wp_w = Wp.f - W.f;
+  p1 = (uint32_t)(Wp.f >> -one.e);
+  p2 = Wp.f & (one.f - 1);
+  kappa = Number_digit_count(p1);
+
+  // the integer part first
+  while(kappa > 0) {
+    d = p1 / (uint32_t)number_pow10[kappa - 1];
+    p1 %= (uint32_t)number_pow10[kappa - 1];
+    if(d || length) digits[length++] = '0' + d;
+    kappa--;
+
+    tmp = ((uint64_t)p1 << -one.e) + p2;
+    if(tmp <= delta) {
+      *K += kappa;
+      Number_round(digits, length, delta, tmp, number_pow10[kappa] << -one.e, wp_w);
+      return length;
+    }
+  }
+
+  // then the fraction until it's inside the range
+  for(;;) {
+    p2 *= 10;
+    delta *= 10;
+    d = (uint32_t)(p2 >> -one.e);
+    if(d || length) digits[length++] = '0' + d;
+    p2 &= one.f - 1;
+    kappa--;
+
+    if(p2 < delta) {
+      *K += kappa;
+      Number_round(digits, length, delta, p2, one.f, wp_w * (-kappa < 20 ? number_pow10[-kappa] : 0));
+      return length;
+    }
+  }
+}
+
+size_t Stackish_float_format(char *out, double floating)
+{
+  char digits[20];
+  char *p = out;
+  int length = 0, K = 0, point = 0, i = 0;
+
+  if(signbit(floating)) {
+    *p++ = '-';
+    floating = -floating;
+  }
+
+  if(isnan(floating) || isinf(floating)) {
+    // there's no way to write these in stackish, so it's what %f did
+    memcpy(p, isnan(floating) ? "nan" : "inf", 3);
+    return p + 3 - out;
+  }
+
+  if(floating == 0.0) {
+    memcpy(p, "0.0", 3);
+    return p + 3 - out;
+  }
+
+  length = Number_grisu2(floating, digits, &K);
+  // where the . goes counting from the first digit
+  point = length + K;
+
+  if(point <= 0) {
+    // 0.000ddd
+    *p++ = '0';
+    *p++ = '.';
+    for(i = point; i < 0; i++) *p++ = '0';
+    memcpy(p, digits, length);
+    p += length;
+  } else if(point < length) {
+    // dd.ddd
+    memcpy(p, digits, point);
+    p += point;
+    *p++ = '.';
+    memcpy(p, digits + point, length - point);
+    p += length - point;
+  } else {
+    // ddd000.0
+    memcpy(p, digits, length);
+    p += length;
+    for(i = length; i < point; i++) *p++ = '0';
+    *p++ = '.';
+    *p++ = '0';
+  }
+
+  return p - out;
+}
+
+int Stackish_number_parse(const char *start, size_t length, uint64_t *number)
+{
+  const char *end = start + length;
+  uint64_t n = 0;
+  unsigned int d = 0;
+
+  if(length == 0) return 0;
+
+  for(; start < end; start++) {
+    d = (unsigned char)*start - '0';
+    if(d > 9) return 0;
+    // 18446744073709551615 is the biggest, anything over would wrap
+    if(n > (UINT64_MAX - d) / 10) return 0;
+    n = n * 10 + d;
+  }
+
+  *number = n;
+  return 1;
+}
+
+/** Powers of ten a double holds exactly, for the fast float path. */
+static const double number_exact_pow10[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/** Copies the token so strtod has its \0, for the few the fast path can't do. */
+static int Number_float_slow(const char *start, size_t length, double *floating)
+{
+  char buf[64];
+  char *copy = length < sizeof(buf) ? buf : malloc(length + 1);
+  char *end = NULL;
+  int rc = 0, saved = errno;
+
+  if(copy == NULL) return 0;
+
+  memcpy(copy, start, length);
+  copy[length] = '\0';
+  *floating = strtod(copy, &end);
+  // too big for a double, but tiny ones are fine even though they set ERANGE
+  rc = end == copy + length && !isinf(*floating);
+  // check() fails on any errno, so the ERANGE can't be left behind
+  errno = saved;
+
+  if(copy != buf) free(copy);
+
+  return rc;
+}
+
+int Stackish_float_parse(const char *start, size_t length, double *floating)
+{
+  const char *p = start, *end = start + length, *dot = NULL, *first = NULL;
+  uint64_t mantissa = 0;
+  int negative = 0, digits = 0, exponent = 0, trailing = 0;
+  unsigned int d = 0;
+
+  if(p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+  first = p;
+
+  // has to be digits.digits
+  for(; p < end; p++) {
+    d = (unsigned char)*p - '0';
+
+    if(*p == '.' && dot == NULL) {
+      if(p == first) return 0;
+      dot = p;
+      continue;
+    } else if(d > 9) {
+      return 0;
+    }
+
+    if(dot) exponent--;
+
+    if(d == 0 && digits > 0) {
+      // zeros only count once there's a digit after them
+      trailing++;
+    } else if(d != 0) {
+      if(digits + trailing + 1 > 19) return Number_float_slow(start, length, floating);
+      mantissa = mantissa * number_pow10[trailing + 1] + d;
+      digits += trailing + 1;
+      trailing = 0;
+    }
+  }
+
+  if(dot == NULL || dot == end - 1) return 0;
+
+  // the zeros at the end of the mantissa go in the exponent instead
+  exponent += trailing;
+
+#if defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD != 0
+  // with extended precision the multiply below rounds twice
+  return Number_float_slow(start, length, floating);
+#endif
+
+  // exact when the mantissa and the power of ten are both exact doubles
+  if(mantissa > (1ULL << 53) || exponent < -22 || exponent > 22) {
+    return Number_float_slow(start, length, floating);
+  }
+
+  *floating = exponent < 0 ? (double)mantissa / number_exact_pow10[-exponent]
+    : (double)mantissa * number_exact_pow10[exponent];
+  if(negative) *floating = -*floating;
+
+  return 1;
+}
@@ -0,0 +1,69 @@
+#ifndef utu_stackish_number_h
+#define utu_stackish_number_h
+
+/*
+ * Utu -- Saving The Internet With Hate
+ *
+ * Copyright (c) Zed A. Shaw 2005 (zedshaw@zedshaw.com)
+ *
+ * This file is modifiable/redistributable under the terms of the GNU
+ * General Public License.
+ *
+ * You should have recieved a copy of the GNU General Public License along
+ * with this program; see the file COPYING. If not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 0211-1307, USA.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Converting numbers and floats to and from the text in a stackish
+ * document, without snprintf, strtoull, or a NUL terminated copy.
+ *
+ * Floats are written with just the digits it takes to read back as the
+ * exact same double (Grisu2), so 1e-9 is 0.000000001 and not 0.000000,
+ * and whatever's parsed comes back out unchanged.  It's the shortest
+ * for all but a rare few (1e23 comes out 99999999999999990000000.0),
+ * and those still read back exactly.  The
+ * stackish float has no exponent, so they're always written out in
+ * full with a . and at least one digit on each side of it.
+ */
+
+/** Most chars Stackish_float_format writes (-0. and the 341 digits the tiniest floats need), plus a \0. */
+#define STACKISH_FLOAT_MAX 345
+
+/**
+ * Infinity and NaN can't be written as a stackish float, so they come
+ * out as inf and nan like they used to and won't parse back.
+ *
+ * @brief Writes a float in the shortest form that reads back exactly.
+ * @param out : Where to write, needs STACKISH_FLOAT_MAX chars.  No \0 is put on.
+ * @param floating : The float.
+ * @return size_t : How many chars were written.
+ */
+size_t Stackish_float_format(char *out, double floating);
+
+/**
+ * @brief Parses a number token (just digits) in place.
+ * @param start : First digit.
+ * @param length : How many there are.
+ * @param number : OUT the number.
+ * @return int : 1 if it's all digits and fits in 64 bits, 0 if not.
+ */
+int Stackish_number_parse(const char *start, size_t length, uint64_t *number);
+
+/**
+ * Gives the correctly rounded double, the same as strtod does.  Most
+ * floats (up to 19 digits, and not too big or small) are worked out
+ * exactly right there, the rest are copied and handed to strtod.
+ *
+ * @brief Parses a float token ([+-]digits.digits) in place.
+ * @param start : First char.
+ * @param length : How many there are.
+ * @param floating : OUT the float.
+ * @return int : 1 if it's a valid float, 0 if not.
+ */
+int Stackish_float_parse(const char *start, size_t length, double *floating);
+
+#endif
@@ -0,0 +1,225 @@
+/*
+ * Utu -- Saving The Internet With Hate
+ *
+ * Copyright (c) Zed A. Shaw 2005 (zedshaw@zedshaw.com)
+ *
+ * This file is modifiable/redistributable under the terms of the GNU
+ * General Public License.
+ *
+ * You should have recieved a copy of the GNU General Public License along
+ * with this program; see the file COPYING. If not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 0211-1307, USA.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <myriad/defend.h>
+#include "stackish/query.h"
+#include "stackish/scan.h"
+
+/** Same as NodeTemplate_word_is, interned names only need the pointer compare. */
+#define NodeQuery_word_is(N, W) ((N) == (W) || ((N) != NULL && blength(N) == blength(W) \
+      && memcmp((N)->data, (W)->data, blength(W)) == 0))
+
+#define NodeQuery_matches(S, N) ((S)->word == NULL || NodeQuery_word_is((N)->name, (S)->word))
+
+/** Checks one step of the path is * or a word or \@attr that could be in a document. */
+static int NodeQuery_is_step(const char *start, size_t length)
+{
+  StackishToken token = Stackish_scan_token(start, length);
+
+  if(length == 1 && start[0] == '*') return 1;
+
+  return token == STACKISH_TOKEN_WORD || token == STACKISH_TOKEN_ATTR;
+}
+
+NodeQuery *NodeQuery_compile(const char *path)
+{
+  NodeQuery *query = NULL;
+  NodeQueryStep *step = NULL;
+  const char *cur = NULL, *end = NULL;
+  size_t count = 1;
+
+  assert_not(path, NULL);
+
+  for(cur = path; *cur != '\0'; cur++) {
+    if(*cur == '/') count++;
+  }
+
+  check(count <= NODE_QUERY_MAX_STEPS, "query path has too many steps");
+
+  // the steps go right after the query so it's one malloc
+  query = calloc(1, sizeof(NodeQuery) + count * sizeof(NodeQueryStep));
+  assert_mem(query);
+  query->steps = (NodeQueryStep *)(query + 1);
+
+  for(cur = path, step = query->steps; step < query->steps + count; cur = end + 1, step++) {
+    end = strchr(cur, '/');
+    if(end == NULL) end = cur + strlen(cur);
+
+    if(*cur == '$') {
+      step->capture = 1;
+      query->captures++;
+      cur++;
+    }
+
+    // counted before the check so destroy only looks at steps that were filled in
+    query->count++;
+    check(end > cur && NodeQuery_is_step(cur, end - cur), "invalid step in query path");
+
+    if(*cur != '*') {
+      step->word = Node_intern(cur, end - cur);
+      if(step->word == NULL) step->word = blk2bstr(cur, end - cur);
+      assert_mem(step->word);
+    }
+  }
+
+  return query;
+  on_fail(if(query) NodeQuery_destroy(query); return NULL);
+}
+
+void NodeQuery_destroy(NodeQuery *query)
+{
+  size_t i = 0;
+
+  assert_not(query, NULL);
+
+  // the interned ones are write protected so bdestroy leaves them alone
+  for(i = 0; i < query->count; i++) {
+    if(query->steps[i].word) bdestroy(query->steps[i].word);
+  }
+
+  free(query);
+}
+
+void NodeQuery_start(NodeQueryCursor *cursor, NodeQuery *query, Node *root)
+{
+  assert_not(cursor, NULL);
+  assert_not(query, NULL);
+
+  cursor->query = query;
+  cursor->root = root;
+  cursor->level = -1;
+  cursor->done = root == NULL || query->count == 0;
+}
+
+/** First node from n on down the sibling chain that step matches. */
+static inline Node *NodeQuery_scan(NodeQueryStep *step, Node *n)
+{
+  while(n != NULL && !NodeQuery_matches(step, n)) n = n->sibling;
+  return n;
+}
+
+Node *NodeQuery_next(NodeQueryCursor *cursor)
+{
+  NodeQueryStep *steps = cursor->query->steps;
+  int last = (int)cursor->query->count - 1;
+  int level = cursor->level;
+  Node **at = cursor->at;
+
+  if(cursor->done) return NULL;
+
+  if(level < 0) {
+    // the root is the only thing the first step can match
+    level = 0;
+    at[0] = NodeQuery_matches(&steps[0], cursor->root) ? cursor->root : NULL;
+  } else if(level > 0) {
+    // pick up after the last match
+    at[level] = NodeQuery_scan(&steps[level], at[level]->sibling);
+  } else {
+    // a one step query only had the root to match
+    at[0] = NULL;
+  }
+
+  while(level >= 0) {
+    if(at[level] == NULL) {
+      // nothing more at this step, go back to the one before and try its next
+      if(--level <= 0) break;
+      at[level] = NodeQuery_scan(&steps[level], at[level]->sibling);
+    } else if(level == last) {
+      cursor->level = level;
+      return at[level];
+    } else {
+      level++;
+      at[level] = NodeQuery_scan(&steps[level], at[level - 1]->child);
+    }
+  }
+
+  cursor->done = 1;
+  return NULL;
+}
+
+Node *NodeQuery_first(NodeQuery *query, Node *root)
+{
+  NodeQueryCursor cursor;
+
+  NodeQuery_start(&cursor, query, root);
+
+  return NodeQuery_next(&cursor);
+}
+
+Node *NodeQuery_anchored(NodeQuery *query, Node *root)
+{
+  Node *n = root;
+  size_t i = 0;
+
+  assert_not(query, NULL);
+
+  if(n == NULL || query->count == 0 || !NodeQuery_matches(&query->steps[0], n)) return NULL;
+
+  for(i = 1; i < query->count && n != NULL; i++) {
+    n = NodeQuery_scan(&query->steps[i], n->child);
+  }
+
+  return n;
+}
+
+size_t NodeQuery_all(NodeQuery *query, Node *root, Node **out, size_t max)
+{
+  NodeQueryCursor cursor;
+  size_t count = 0;
+  Node *n = NULL;
+
+  assert_not(out, NULL);
+
+  NodeQuery_start(&cursor, query, root);
+
+  while(count < max && (n = NodeQuery_next(&cursor)) != NULL) {
+    out[count++] = n;
+  }
+
+  return count;
+}
+
+int NodeQuery_bind(NodeQuery *query, Node *root, ...)
+{
+  NodeQueryCursor cursor;
+  size_t i = 0;
+  va_list args;
+
+  NodeQuery_start(&cursor, query, root);
+
+  if(NodeQuery_next(&cursor) == NULL) return 0;
+
+  va_start(args, root);
+
+  for(i = 0; i < query->count; i++) {
+    if(query->steps[i].capture) *(va_arg(args, Node **)) = cursor.at[i];
+  }
+
+  va_end(args);
+
+  return 1;
+}
+
+NodeQuery *NodeQuery_install(NodeQuery **slot, NodeQuery *query)
+{
+  assert_not(slot, NULL);
+  assert_not(query, NULL);
+
+  if(!__sync_bool_compare_and_swap(slot, NULL, query)) {
+    NodeQuery_destroy(query);
+  }
+
+  return *slot;
+}
@@ -0,0 +1,164 @@
+#ifndef stackish_query_h
+#define stackish_query_h
+
+/*
+ * Utu -- Saving The Internet With Hate
+ *
+ * Copyright (c) Zed A. Shaw 2005 (zedshaw@zedshaw.com)
+ *
+ * This file is modifiable/redistributable under the terms of the GNU
+ * General Public License.
+ *
+ * You should have recieved a copy of the GNU General Public License along
+ * with this program; see the file COPYING. If not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 0211-1307, USA.
+ */
+
+#include <stdarg.h>
+#include "stackish/node.h"
+
+/** Most steps a query path can have. */
+#define NODE_QUERY_MAX_STEPS 16
+
+/**
+ * A path through a Node tree like "msg/route/register" that's read
+ * once and then matched against as many trees as you want without
+ * allocating anything.  Each step is one of:
+ *
+ * - word : A node named word, which is a group closed with that word.
+ * - \@attr : A node given that attribute.
+ * - * : Any node at all.
+ *
+ * The first step matches the root itself, and each one after that
+ * matches the children of what the step before it matched.  Put a $ in
+ * front of a step to capture it for NodeQuery_bind:
+ *
+ * <pre>
+ *   static NodeQuery *TO = NULL;
+ *   Node *to = NULL, *member = NULL;
+ *
+ *   if(NodeQuery_bind(NodeQuery_once(TO, "msg/$member/send/$@to"), body, &member, &to)) ...
+ * </pre>
+ *
+ * Children are matched in the order they're linked, which is the last
+ * one pushed (closest to its parent's word) first, the same way
+ * Node_decons sees them.  Like templates, a query never changes once
+ * it's made, so any number of threads can share one.
+ */
+typedef struct NodeQueryStep {
+  /** The name to match, NULL for *. */
+  bstring word;
+  int capture;
+} NodeQueryStep;
+
+typedef struct NodeQuery {
+  size_t count;
+  size_t captures;
+  NodeQueryStep *steps;
+} NodeQuery;
+
+/**
+ * Where a match is up to, so you can go through all of them one at a
+ * time.  It's meant to live on the stack:
+ *
+ * <pre>
+ *   NodeQuery_start(&cursor, query, root);
+ *   while((n = NodeQuery_next(&cursor)) != NULL) ...
+ * </pre>
+ */
+typedef struct NodeQueryCursor {
+  NodeQuery *query;
+  Node *root;
+  /** Step the cursor is on, -1 before the first match. */
+  int level;
+  int done;
+  Node *at[NODE_QUERY_MAX_STEPS];
+} NodeQueryCursor;
+
+/**
+ * @brief Reads a path into a query.
+ * @param path : The path, see NodeQuery.
+ * @return NodeQuery * : The query, NULL if the path is invalid.
+ */
+NodeQuery *NodeQuery_compile(const char *path);
+
+/**
+ * @brief Destroys a query.
+ * @param query : Query to destroy.
+ */
+void NodeQuery_destroy(NodeQuery *query);
+
+/**
+ * @brief Gets a cursor ready to go through the matches in root.
+ * @param cursor : The cursor, usually on the stack.
+ * @param query : Query to match.
+ * @param root : Tree to match it against, can be NULL.
+ */
+void NodeQuery_start(NodeQueryCursor *cursor, NodeQuery *query, Node *root);
+
+/**
+ * @brief Finds the next match.
+ * @param cursor : Cursor from NodeQuery_start.
+ * @return Node * : What the last step matched, NULL when there's no more.
+ */
+Node *NodeQuery_next(NodeQueryCursor *cursor);
+
+/**
+ * @brief Finds the first match.
+ * @param query : Query to match.
+ * @param root : Tree to look in.
+ * @return Node * : What the last step matched, NULL if nothing did.
+ */
+Node *NodeQuery_first(NodeQuery *query, Node *root);
+
+/**
+ * Takes only the first node each step matches and never backs up to
+ * try a later sibling, so a path of three * steps is exactly the
+ * first child's first child.  That's for paths with one right answer,
+ * like where a message keeps its body, where a later sibling matching
+ * would be wrong and not just slower.
+ *
+ * @brief Finds the match down the first matching node at each step.
+ * @param query : Query to match.
+ * @param root : Tree to look in.
+ * @return Node * : What the last step matched, NULL if the first try at any step failed.
+ */
+Node *NodeQuery_anchored(NodeQuery *query, Node *root);
+
+/**
+ * @brief Finds all the matches, up to max of them.
+ * @param query : Query to match.
+ * @param root : Tree to look in.
+ * @param out : Where the matches go.
+ * @param max : How many out has room for.
+ * @return size_t : How many were put in out.
+ */
+size_t NodeQuery_all(NodeQuery *query, Node *root, Node **out, size_t max);
+
+/**
+ * Finds the first match and sets a Node ** for each $ step in the
+ * order they're in the path.  Nothing is set if there isn't a match.
+ *
+ * @brief Binds the captures of the first match.
+ * @param query : Query to match.
+ * @param root : Tree to look in.
+ * @param ... : A Node ** for every capture.
+ * @return int : 1 if it matched, 0 if not.
+ */
+int NodeQuery_bind(NodeQuery *query, Node *root, ...);
+
+/**
+ * Puts query in *slot if it's still NULL, otherwise destroys it since
+ * some other thread got there first.
+ *
+ * @brief Installs a shared query.
+ * @param slot : Where the shared query goes.
+ * @param query : The new query.
+ * @return NodeQuery * : Whatever is in the slot now.
+ */
+NodeQuery *NodeQuery_install(NodeQuery **slot, NodeQuery *query);
+
+/** Gives the query in Q, compiling it from the path the first time. */
+#define NodeQuery_once(Q, P) ((Q) ? (Q) : NodeQuery_install(&(Q), NodeQuery_compile(P)))
+
+#endif
@@ -0,0 +1,358 @@
+/*
+ * Utu -- Saving The Internet With Hate
+ *
+ * Copyright (c) Zed A. Shaw 2005 (zedshaw@zedshaw.com)
+ *
+ * This file is modifiable/redistributable under the terms of the GNU
+ * General Public License.
+ *
+ * You should have recieved a copy of the GNU General Public License along
+ * with this program; see the file COPYING. If not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 0211-1307, USA.
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "stackish/scan.h"
+#include "stackish/number.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define STACKISH_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+/** Same as ragel's space, \t \n \v \f \r are 9 through 13. */
+#define is_space(C) ((C) == ' ' || (unsigned char)((C) - 9) < 5)
+
+#define is_delimiter(C) (is_space(C) || (C) == '[' || (C) == ']' || (C) == '"' || (C) == '\'')
+
+#define is_word_char(C) (isalnum(C) || (C) == '-' || (C) == '_' || (C) == '.' || (C) == ':')
+
+typedef const char *(*StackishScanner)(const char *p, const char *pe);
+
+static const char *scalar_delimiter(const char *p, const char *pe)
+{
+  while(p < pe && !is_delimiter(*p)) p++;
+  return p;
+}
+
+static const char *scalar_quote(const char *p, const char *pe)
+{
+  while(p < pe && *p != '"') p++;
+  return p;
+}
+
+static const char *scalar_space(const char *p, const char *pe)
+{
+  while(p < pe && is_space(*p)) p++;
+  return p;
+}
+
+#ifdef STACKISH_SCAN_X86
+
+/*
+ * Each one makes a mask with a bit set for every byte that matches, and
+ * the first set bit is where the run ends.  Whitespace is ' ' or any
+ * byte that's 0 to 4 after subtracting 9, which min_epu8 can check
+ * without an unsigned compare.
+ */
+
+static inline __m128i sse2_spaces(__m128i bytes)
+{
+  __m128i shifted = _mm_sub_epi8(bytes, _mm_set1_epi8(9));
+  __m128i controls = _mm_cmpeq_epi8(_mm_min_epu8(shifted, _mm_set1_epi8(4)), shifted);
+
+  return _mm_or_si128(controls, _mm_cmpeq_epi8(bytes, _mm_set1_epi8(' ')));
+}
+
+static const char *sse2_delimiter(const char *p, const char *pe)
+{
+  __m128i bytes, hits;
+  int mask = 0;
+
+  for(; pe - p >= 16; p += 16) {
+    bytes = _mm_loadu_si128((const __m128i *)p);
+    hits = _mm_or_si128(sse2_spaces(bytes),
+        _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('[')), _mm_cmpeq_epi8(bytes, _mm_set1_epi8(']'))),
+          _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('"')), _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\'')))));
+
+    if((mask = _mm_movemask_epi8(hits)) != 0) return p + __builtin_ctz(mask);
+  }
+
+  return scalar_delimiter(p, pe);
+}
+
+static const char *sse2_quote(const char *p, const char *pe)
+{
+  int mask = 0;
+
+  for(; pe - p >= 16; p += 16) {
+    mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)p), _mm_set1_epi8('"')));
+    if(mask != 0) return p + __builtin_ctz(mask);
+  }
+
+  return scalar_quote(p, pe);
+}
+
+static const char *sse2_space(const char *p, const char *pe)
+{
+  int mask = 0;
+
+  for(; pe - p >= 16; p += 16) {
+    mask = ~_mm_movemask_epi8(sse2_spaces(_mm_loadu_si128((const __m128i *)p))) & 0xFFFF;
+    if(mask != 0) return p + __builtin_ctz(mask);
+  }
+
+  return scalar_space(p, pe);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i avx2_spaces(__m256i bytes)
+{
+  __m256i shifted = _mm256_sub_epi8(bytes, _mm256_set1_epi8(9));
+  __m256i controls = _mm256_cmpeq_epi8(_mm256_min_epu8(shifted, _mm256_set1_epi8(4)), shifted);
+
+  return _mm256_or_si256(controls, _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(' ')));
+}
+
+__attribute__((target("avx2")))
+static const char *avx2_delimiter(const char *p, const char *pe)
+{
+  __m256i bytes, hits;
+  unsigned int mask = 0;
+
+  for(; pe - p >= 32; p += 32) {
+    bytes = _mm256_loadu_si256((const __m256i *)p);
+    hits = _mm256_or_si256(avx2_spaces(bytes),
+        _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('[')), _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(']'))),
+          _mm256_or_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('"')), _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\'')))));
+
+    if((mask = _mm256_movemask_epi8(hits)) != 0) return p + __builtin_ctz(mask);
+  }
+
+  return sse2_delimiter(p, pe);
+}
+
+__attribute__((target("avx2")))
+static const char *avx2_quote(const char *p, const char *pe)
+{
+  unsigned int mask = 0;
+
+  for(; pe - p >= 32; p += 32) {
+    mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)p), _mm256_set1_epi8('"')));
+    if(mask != 0) return p + __builtin_ctz(mask);
+  }
+
+  return sse2_quote(p, pe);
+}
+
+__attribute__((target("avx2")))
+static const char *avx2_space(const char *p, const char *pe)
+{
+  unsigned int mask = 0;
+
+  for(; pe - p >= 32; p += 32) {
+    mask = ~(unsigned int)_mm256_movemask_epi8(avx2_spaces(_mm256_loadu_si256((const __m256i *)p)));
+    if(mask != 0) return p + __builtin_ctz(mask);
+  }
+
+  return sse2_space(p, pe);
+}
+
+#endif
+
+static struct {
+  StackishScanKind kind;
+  StackishScanner delimiter;
+  StackishScanner quote;
+  StackishScanner space;
+} scanners = { STACKISH_SCAN_SCALAR, NULL, NULL, NULL };
+
+StackishScanKind Stackish_scan_use(StackishScanKind kind)
+{
+#ifdef STACKISH_SCAN_X86
+  __builtin_cpu_init();
+
+  if(kind == STACKISH_SCAN_AVX2 && !__builtin_cpu_supports("avx2")) kind = STACKISH_SCAN_SSE2;
+#else
+  kind = STACKISH_SCAN_SCALAR;
+#endif
+
+  switch(kind) {
+#ifdef STACKISH_SCAN_X86
+    case STACKISH_SCAN_AVX2:
+      scanners.delimiter = avx2_delimiter;
+      scanners.quote = avx2_quote;
+      scanners.space = avx2_space;
+      break;
+    case STACKISH_SCAN_SSE2:
+      scanners.delimiter = sse2_delimiter;
+      scanners.quote = sse2_quote;
+      scanners.space = sse2_space;
+      break;
+#endif
+    default:
+      kind = STACKISH_SCAN_SCALAR;
+      scanners.delimiter = scalar_delimiter;
+      scanners.quote = scalar_quote;
+      scanners.space = scalar_space;
+      break;
+  }
+
+  scanners.kind = kind;
+  return kind;
+}
+
+StackishScanKind Stackish_scan_kind()
+{
+  if(scanners.delimiter == NULL) Stackish_scan_use(STACKISH_SCAN_AVX2);
+
+  return scanners.kind;
+}
+
+const char *Stackish_scan_delimiter(const char *p, const char *pe)
+{
+  if(scanners.delimiter == NULL) Stackish_scan_use(STACKISH_SCAN_AVX2);
+
+  return scanners.delimiter(p, pe);
+}
+
+const char *Stackish_scan_quote(const char *p, const char *pe)
+{
+  if(scanners.quote == NULL) Stackish_scan_use(STACKISH_SCAN_AVX2);
+
+  return scanners.quote(p, pe);
+}
+
+const char *Stackish_scan_space(const char *p, const char *pe)
+{
+  if(scanners.space == NULL) Stackish_scan_use(STACKISH_SCAN_AVX2);
+
+  return scanners.space(p, pe);
+}
+
+StackishToken Stackish_scan_token(const char *start, size_t length)
+{
+  // the ctype macros want unsigned bytes
+  const unsigned char *s = (const unsigned char *)start;
+  size_t i = 0;
+  size_t digits = 0;
+
+  if(length == 0) return STACKISH_TOKEN_INVALID;
+
+  if(s[0] == '@' || isalpha(s[0])) {
+    i = s[0] == '@';
+    if(i >= length || !isalpha(s[i])) return STACKISH_TOKEN_INVALID;
+
+    for(i++; i < length; i++) {
+      if(!is_word_char(s[i])) return STACKISH_TOKEN_INVALID;
+    }
+
+    return s[0] == '@' ? STACKISH_TOKEN_ATTR : STACKISH_TOKEN_WORD;
+  }
+
+  if(s[0] == '-' || s[0] == '+') i++;
+  for(; i < length && isdigit(s[i]); i++) digits++;
+
+  if(i == length && i == digits) return STACKISH_TOKEN_NUMBER;
+  if(digits == 0 || i == length || s[i] != '.') return STACKISH_TOKEN_INVALID;
+
+  for(i++, digits = 0; i < length && isdigit(s[i]); i++) digits++;
+
+  return digits > 0 && i == length ? STACKISH_TOKEN_FLOAT : STACKISH_TOKEN_INVALID;
+}
+
+const char *Stackish_scan_group(const char *p, const char *pe, size_t depth, size_t width,
+    const char **word, size_t *length)
+{
+  // children so far in each open group, the innermost is counts[level - 1]
+  size_t inline_counts[STACKISH_SCAN_INLINE];
+  size_t *counts = inline_counts;
+  size_t level = 0, blob = 0;
+  uint64_t number = 0;
+  double floating = 0.0;
+  const char *mark = NULL, *end = NULL;
+
+  *word = NULL;
+  *length = 0;
+
+  while(p < pe) {
+    if(is_space(*p)) {
+      p = Stackish_scan_space(p, pe);
+      continue;
+    }
+
+    if(*p == '[') {
+      if(level >= depth) break;
+      if(level > 0 && ++counts[level - 1] > width) break;
+
+      if(level == STACKISH_SCAN_INLINE && counts == inline_counts) {
+        // deeper than most documents ever go, but depth caps how far
+        counts = malloc(depth * sizeof(size_t));
+        if(counts == NULL) break;
+        memcpy(counts, inline_counts, sizeof(inline_counts));
+      }
+
+      counts[level++] = 0;
+      p++;
+      continue;
+    }
+
+    // everything else needs a group to go in
+    if(level == 0) break;
+
+    if(*p == ']') {
+      p++;
+      if(--level == 0) { end = p; break; }
+    } else if(*p == '"') {
+      p = Stackish_scan_quote(p + 1, pe);
+      if(p == pe || ++counts[level - 1] > width) break;
+      p++;
+    } else if(*p == '\'') {
+      // '5:hello' with at most 9 digits of length like the stream takes
+      for(p++, mark = p, blob = 0; p < pe && isdigit(*p) && p - mark < 9; p++) {
+        blob = blob * 10 + (*p - '0');
+      }
+
+      if(p == mark || p >= pe || *p != ':') break;
+      if((size_t)(pe - p) < blob + 2 || p[blob + 1] != '\'') break;
+      if(++counts[level - 1] > width) break;
+      p += blob + 2;
+    } else {
+      mark = p;
+      p = Stackish_scan_delimiter(p, pe);
+
+      switch(Stackish_scan_token(mark, p - mark)) {
+        case STACKISH_TOKEN_NUMBER:
+          // has to fit the same as when it's parsed, or the group fails to expand later
+          if(!Stackish_number_parse(mark, p - mark, &number)) goto done;
+          if(++counts[level - 1] > width) goto done;
+          break;
+        case STACKISH_TOKEN_FLOAT:
+          if(!Stackish_float_parse(mark, p - mark, &floating)) goto done;
+          if(++counts[level - 1] > width) goto done;
+          break;
+        case STACKISH_TOKEN_ATTR:
+          if(counts[level - 1] == 0) goto done;
+          break;
+        case STACKISH_TOKEN_WORD:
+          if(--level == 0) {
+            *word = mark;
+            *length = p - mark;
+            end = p;
+            goto done;
+          }
+          break;
+        default:
+          goto done;
+      }
+    }
+  }
+
+done:
+  if(counts != inline_counts) free(counts);
+
+  return end;
+}
@@ -0,0 +1,114 @@
+#ifndef utu_stackish_scan_h
+#define utu_stackish_scan_h
+
+/*
+ * Utu -- Saving The Internet With Hate
+ *
+ * Copyright (c) Zed A. Shaw 2005 (zedshaw@zedshaw.com)
+ *
+ * This file is modifiable/redistributable under the terms of the GNU
+ * General Public License.
+ *
+ * You should have recieved a copy of the GNU General Public License along
+ * with this program; see the file COPYING. If not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 0211-1307, USA.
+ */
+
+/**
+ * Scanners that find where a run of stackish bytes ends 16 or 32 bytes
+ * at a time, so the parser only has to look at the bytes that change
+ * the structure (brackets, quotes, the ends of words) and not every byte
+ * of the long strings and whitespace in between.
+ *
+ * The first call picks AVX2 if the CPU has it, then SSE2, then plain C,
+ * and they all give the same answers.
+ */
+typedef enum StackishScanKind {
+  STACKISH_SCAN_SCALAR, STACKISH_SCAN_SSE2, STACKISH_SCAN_AVX2
+} StackishScanKind;
+
+/**
+ * @brief Finds the end of a bare token (number, float, word, attribute).
+ * @param p : Where to start.
+ * @param pe : End of the bytes.
+ * @return const char * : First whitespace, [, ], ", or ' byte, or pe if there isn't one.
+ */
+const char *Stackish_scan_delimiter(const char *p, const char *pe);
+
+/**
+ * @brief Finds the end of a string.
+ * @param p : Where to start, just after the opening quote.
+ * @param pe : End of the bytes.
+ * @return const char * : The closing ", or pe if there isn't one.
+ */
+const char *Stackish_scan_quote(const char *p, const char *pe);
+
+/**
+ * @brief Skips whitespace.
+ * @param p : Where to start.
+ * @param pe : End of the bytes.
+ * @return const char * : The first byte that isn't whitespace, or pe.
+ */
+const char *Stackish_scan_space(const char *p, const char *pe);
+
+/** What a bare token (anything up to a delimiter) turns out to be. */
+typedef enum StackishToken {
+  STACKISH_TOKEN_INVALID, STACKISH_TOKEN_NUMBER, STACKISH_TOKEN_FLOAT,
+  STACKISH_TOKEN_WORD, STACKISH_TOKEN_ATTR
+} StackishToken;
+
+/**
+ * Sorts a token by the grammar's rules only: word is alpha followed by
+ * alnum, -, _, . or :, an attribute is \@word, number is digit+ and
+ * float is an optionally signed digit+ . digit+.  It doesn't check that
+ * a number or float fits, number.h does that.  Everything that takes
+ * stackish apart by hand uses this so they all agree with the ragel
+ * parser.
+ *
+ * @brief Sorts a bare token.
+ * @param start : First byte of the token.
+ * @param length : How long it is.
+ * @return StackishToken : What it is, STACKISH_TOKEN_INVALID if it's nothing (or empty).
+ */
+StackishToken Stackish_scan_token(const char *start, size_t length);
+
+/** Open groups Stackish_scan_group keeps counts for before it needs the heap. */
+#define STACKISH_SCAN_INLINE 32
+
+/**
+ * Skips a whole group without building anything, checking it the same
+ * way the parsers would: every token is valid, numbers and floats fit
+ * (checked with number.h, same as Node_from_str), attributes have
+ * something to name, nothing nests more than depth groups (counting
+ * this one), and no group has more than width children.  The lazy
+ * parse uses it to step over the parts of a document it defers.
+ *
+ * @brief Finds the end of a group.
+ * @param p : Where to start, on the group's [.
+ * @param pe : End of the bytes.
+ * @param depth : How many groups deep it can go.
+ * @param width : Most children any group can have.
+ * @param word : OUT the word that closed the group, NULL if it was a ].
+ * @param length : OUT how long the word is.
+ * @return const char * : Just past the closing word or ], NULL if the group is invalid or doesn't end.
+ */
+const char *Stackish_scan_group(const char *p, const char *pe, size_t depth, size_t width,
+    const char **word, size_t *length);
+
+/**
+ * @brief Which scanners are being used.
+ * @return StackishScanKind : The one picked for this CPU, or set with Stackish_scan_use.
+ */
+StackishScanKind Stackish_scan_kind();
+
+/**
+ * Mostly for tests and benchmarks.  Asking for one the CPU doesn't have
+ * gets you the best one it does have.
+ *
+ * @brief Switches the scanners.
+ * @param kind : Scanners to use.
+ * @return StackishScanKind : What's actually being used now.
+ */
+StackishScanKind Stackish_scan_use(StackishScanKind kind);
+
+#endif
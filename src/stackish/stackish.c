@@ -14,6 +14,7 @@
 
 #include "stackish/ragel.h"
 #include "stackish/stackish.h"
+#include "stackish/scan.h"
 #include <myriad/defend.h>
 
 #define push(T,M,F) handle_push(parser, TYPE_##T, PTR_TO(M), LEN(M, F)) 
@@ -28,6 +29,7 @@ inline int handle_push(stackish_parser *parser, enum NodeType type, const char *
   check(current, "parsing failure, no current node");
   check(parser->root, "parsing failure, no root node");
   check(current->type == TYPE_GROUP, "parsing failure, pushing onto a node that's not a group");
+  check(Node_limit_width(current), "parsing failure, too many children in a group");
 
   Node *node = Node_from_str(current, type, start, length);
 
@@ -47,12 +49,15 @@ inline int handle_word(stackish_parser *parser, const char *start, size_t length
   check(parser->current, "parsing error, parser doesn't have an active current node");
 
   if(start == NULL) {
-    if(current->name != NULL) bdestroy(current->name);
+    if(current->name != NULL && !current->arena) bdestroy(current->name);
     current->name = NULL;
   } else {
-    Node_name(current, blk2bstr(start, length));
+    Node_name(current, Node_name_str(current, start, length));
   }
 
+  Node_limit_close(current);
+  parser->depth--;
+
   // either quit if we're at the root or move up to the parent
   if(current == parser->root) {
     return 1;
@@ -80,19 +85,23 @@ inline int handle_attr(stackish_parser *parser, const char *start, size_t length
   Node *current = parser->current->child;
   check(current, "parsing failure, attempting to set an attribute of a node with no children");
 
-  Node_name(current, blk2bstr(start, length));
+  Node_name(current, Node_name_str(current, start, length));
 
   return 1;
   on_fail(return 0);
 }
 
 
-inline void handle_start(stackish_parser *parser)
+inline int handle_start(stackish_parser *parser)
 {
   assert_not(parser, NULL);
 
-  // new group will ignore root if it is NULL, and attach it otherwise
-  Node *mark = Node_new_group(parser->current);
+  check(parser->depth < NODE_LIMITS.depth, "parsing failure, groups nested too deep");
+  check(!parser->current || Node_limit_width(parser->current), "parsing failure, too many children in a group");
+
+  // the root owns the parser's arena if it has one (or is the one to parse into), the rest attach to current
+  Node *mark = parser->current ? Node_new_group(parser->current) 
+    : parser->into ? parser->into : Node_new_root(parser->arena);
 
   // first node, so set the root and current to it
   if(parser->root == NULL) {
@@ -101,16 +110,49 @@ inline void handle_start(stackish_parser *parser)
 
   // now we set the current to the emark
   parser->current = mark;
+  parser->depth++;
+
+  return 1;
+  on_fail(return 0);
+}
+
+
+/** Puts a deferred node for the group at start on current, and gives back where the group ends. */
+inline const char *handle_defer(stackish_parser *parser, const char *start, const char *pe)
+{
+  assert_not(parser, NULL);
+
+  const char *word = NULL;
+  size_t length = 0;
+  Node *current = parser->current;
+
+  check(current, "parsing failure, no current node");
+  check(parser->depth < NODE_LIMITS.depth, "parsing failure, groups nested too deep");
+  check(Node_limit_width(current), "parsing failure, too many children in a group");
+
+  // checked the same as if it were parsed, so expanding it later can't fail
+  const char *end = Stackish_scan_group(start, pe, NODE_LIMITS.depth - parser->depth, 
+      NODE_LIMITS.width, &word, &length);
+  check(end, "parsing failure in a deferred group");
+
+  bstring raw = current->arena && current->arena->input ? NodeArena_view(current->arena, start, end - start)
+    : Node_str(current, start, end - start);
+  Node *node = Node_new_deferred(current, raw);
+
+  if(word != NULL) Node_name(node, Node_name_str(node, word, length));
+
+  return end;
+  on_fail(return NULL);
 }
 
 
 /** machine **/
-#line 160 "stackish/stackish.rl"
+#line 212 "stackish/stackish.rl"
 
 
 /** Data **/
 
-#line 114 "stackish/stackish.c"
+#line 156 "stackish/stackish.c"
 static const char _stackish_parser_actions[] = {
 	0, 1, 0, 1, 1, 1, 2, 1, 
 	3, 1, 4, 1, 5, 1, 6, 1, 
@@ -119,7 +161,7 @@ static const char _stackish_parser_actions[] = {
 	7, 2, 2, 0, 2, 2, 4, 2, 
 	2, 7, 2, 6, 0, 2, 6, 4, 
 	2, 6, 7, 2, 9, 0, 2, 9, 
-	4, 2, 9, 7
+	4, 2, 9, 7, 2, 0, 10
 };
 
 static const char _stackish_parser_key_offsets[] = {
@@ -175,7 +217,7 @@ static const char _stackish_parser_trans_targs_wi[] = {
 };
 
 static const char _stackish_parser_trans_actions_wi[] = {
-	21, 1, 7, 0, 1, 0, 17, 0, 
+	21, 60, 7, 0, 1, 0, 17, 0, 
 	0, 11, 0, 0, 0, 0, 0, 0, 
 	0, 0, 0, 0, 0, 0, 0, 0, 
 	1, 1, 1, 9, 15, 0, 1, 1, 
@@ -195,20 +237,20 @@ static const int stackish_parser_error = 0;
 
 static const int stackish_parser_en_main = 10;
 
-#line 164 "stackish/stackish.rl"
+#line 216 "stackish/stackish.rl"
 
 RAGEL_INIT(stackish_parser, {
     
-#line 203 "stackish/stackish.c"
+#line 245 "stackish/stackish.c"
 	{
 	cs = stackish_parser_start;
 	}
-#line 167 "stackish/stackish.rl"
+#line 219 "stackish/stackish.rl"
 })
 
 RAGEL_DEFINE_FUNCTIONS(stackish_parser, {
     
-#line 212 "stackish/stackish.c"
+#line 254 "stackish/stackish.c"
 	{
 	int _klen;
 	unsigned int _trans;
@@ -282,49 +324,58 @@ _match:
 		switch ( *_acts++ )
 		{
 	case 0:
-#line 110 "stackish/stackish.rl"
+#line 152 "stackish/stackish.rl"
 	{ MARK(mark, p); }
 	break;
 	case 1:
-#line 111 "stackish/stackish.rl"
-	{ if(!push(NUMBER, mark, p)) goto _out; }
+#line 153 "stackish/stackish.rl"
+	{ if(!push(NUMBER, mark, p)) {cs = (stackish_parser_error); goto _again;} }
 	break;
 	case 2:
-#line 112 "stackish/stackish.rl"
-	{ if(!push(FLOAT, mark, p)) goto _out; }
+#line 154 "stackish/stackish.rl"
+	{ if(!push(FLOAT, mark, p)) {cs = (stackish_parser_error); goto _again;} }
 	break;
 	case 3:
-#line 113 "stackish/stackish.rl"
-	{ if(!push(STRING, mark, p)) goto _out; }
+#line 155 "stackish/stackish.rl"
+	{ if(!push(STRING, mark, p)) {cs = (stackish_parser_error); goto _again;} }
 	break;
 	case 4:
-#line 114 "stackish/stackish.rl"
-	{ handle_start(parser); }
+#line 156 "stackish/stackish.rl"
+	{
+    if(parser->lazy_depth && parser->depth >= parser->lazy_depth) {
+      // too deep to build now, so step over it and carry on after its closing word
+      const char *end = handle_defer(parser, p, pe);
+      if(end == NULL) {cs = (stackish_parser_error); goto _again;}
+      {p = ((end))-1;}
+    } else if(!handle_start(parser)) {
+      {cs = (stackish_parser_error); goto _again;}
+    }
+  }
 	break;
 	case 5:
-#line 115 "stackish/stackish.rl"
-	{ if(!push(BLOB, mark, p)) goto _out; else parser->more = 0;}
+#line 166 "stackish/stackish.rl"
+	{ if(!push(BLOB, mark, p)) {cs = (stackish_parser_error); goto _again;} else parser->more = 0;}
 	break;
 	case 6:
-#line 116 "stackish/stackish.rl"
+#line 167 "stackish/stackish.rl"
 	{
-    if(handle_word(parser, PTR_TO(mark), LEN(mark, p))) {
-      // all done, stop processing
-      goto _out;
-    }
+    int done = handle_word(parser, PTR_TO(mark), LEN(mark, p));
+    if(done < 0) {cs = (stackish_parser_error); goto _again;}
+    // all done, stop processing
+    if(done) goto _out;
   }
 	break;
 	case 7:
-#line 122 "stackish/stackish.rl"
+#line 173 "stackish/stackish.rl"
 	{
-    if(handle_group(parser)) {
-      // all done, stop processing
-      goto _out;
-    }
+    int done = handle_group(parser);
+    if(done < 0) {cs = (stackish_parser_error); goto _again;}
+    // all done, stop processing
+    if(done) goto _out;
   }
 	break;
 	case 8:
-#line 128 "stackish/stackish.rl"
+#line 179 "stackish/stackish.rl"
 	{ 
     char *end = NULL; 
     parser->more = strtoul(PTR_TO(mark), &end, 10); 
@@ -337,10 +388,14 @@ _match:
   }
 	break;
 	case 9:
-#line 138 "stackish/stackish.rl"
-	{ if(!handle_attr(parser, PTR_TO(mark), LEN(mark, p))) goto _out; }
+#line 189 "stackish/stackish.rl"
+	{ if(!handle_attr(parser, PTR_TO(mark), LEN(mark, p))) {cs = (stackish_parser_error); goto _again;} }
+	break;
+	case 10:
+#line 190 "stackish/stackish.rl"
+	{ {p = ((Stackish_scan_quote(p, pe)))-1;} }
 	break;
-#line 344 "stackish/stackish.c"
+#line 399 "stackish/stackish.c"
 		}
 	}
 
@@ -351,12 +406,12 @@ _again:
 		goto _resume;
 	_out: {}
 	}
-#line 171 "stackish/stackish.rl"
+#line 223 "stackish/stackish.rl"
     }, 
     {
     
-#line 359 "stackish/stackish.c"
-#line 174 "stackish/stackish.rl"
+#line 414 "stackish/stackish.c"
+#line 226 "stackish/stackish.rl"
     });
 
 
@@ -16,6 +16,7 @@
 
 
 #include "stackish/node.h"
+#include "stackish/arena.h"
 #include "stackish/ragel_declare.h"
 
 /**
@@ -115,6 +116,14 @@ typedef struct stackish_parser {
   size_t mark;
   Node *root;
   Node *current;
+  /** Set after stackish_parser_init to build the tree in an arena. */
+  NodeArena *arena;
+  /** How many groups are open, checked against NODE_LIMITS. */
+  size_t depth;
+  /** Groups opened this deep or deeper are deferred, 0 to build them all. */
+  size_t lazy_depth;
+  /** Set to parse into this group rather than making a new root, see Node_expand. */
+  Node *into;
 } stackish_parser;
 
 RAGEL_DECLARE_FUNCTIONS(stackish_parser);
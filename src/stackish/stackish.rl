@@ -13,6 +13,7 @@
 
 #include "stackish/ragel.h"
 #include "stackish/stackish.h"
+#include "stackish/scan.h"
 #include <myriad/defend.h>
 
 #define push(T,M,F) handle_push(parser, TYPE_##T, PTR_TO(M), LEN(M, F)) 
@@ -27,6 +28,7 @@ inline int handle_push(stackish_parser *parser, enum NodeType type, const char *
   check(current, "parsing failure, no current node");
   check(parser->root, "parsing failure, no root node");
   check(current->type == TYPE_GROUP, "parsing failure, pushing onto a node that's not a group");
+  check(Node_limit_width(current), "parsing failure, too many children in a group");
 
   Node *node = Node_from_str(current, type, start, length);
 
@@ -46,12 +48,15 @@ inline int handle_word(stackish_parser *parser, const char *start, size_t length
   check(parser->current, "parsing error, parser doesn't have an active current node");
 
   if(start == NULL) {
-    if(current->name != NULL) bdestroy(current->name);
+    if(current->name != NULL && !current->arena) bdestroy(current->name);
     current->name = NULL;
   } else {
-    Node_name(current, blk2bstr(start, length));
+    Node_name(current, Node_name_str(current, start, length));
   }
 
+  Node_limit_close(current);
+  parser->depth--;
+
   // either quit if we're at the root or move up to the parent
   if(current == parser->root) {
     return 1;
@@ -79,19 +84,23 @@ inline int handle_attr(stackish_parser *parser, const char *start, size_t length
   Node *current = parser->current->child;
   check(current, "parsing failure, attempting to set an attribute of a node with no children");
 
-  Node_name(current, blk2bstr(start, length));
+  Node_name(current, Node_name_str(current, start, length));
 
   return 1;
   on_fail(return 0);
 }
 
 
-inline void handle_start(stackish_parser *parser)
+inline int handle_start(stackish_parser *parser)
 {
   assert_not(parser, NULL);
 
-  // new group will ignore root if it is NULL, and attach it otherwise
-  Node *mark = Node_new_group(parser->current);
+  check(parser->depth < NODE_LIMITS.depth, "parsing failure, groups nested too deep");
+  check(!parser->current || Node_limit_width(parser->current), "parsing failure, too many children in a group");
+
+  // the root owns the parser's arena if it has one (or is the one to parse into), the rest attach to current
+  Node *mark = parser->current ? Node_new_group(parser->current) 
+    : parser->into ? parser->into : Node_new_root(parser->arena);
 
   // first node, so set the root and current to it
   if(parser->root == NULL) {
@@ -100,6 +109,39 @@ inline void handle_start(stackish_parser *parser)
 
   // now we set the current to the emark
   parser->current = mark;
+  parser->depth++;
+
+  return 1;
+  on_fail(return 0);
+}
+
+
+/** Puts a deferred node for the group at start on current, and gives back where the group ends. */
+inline const char *handle_defer(stackish_parser *parser, const char *start, const char *pe)
+{
+  assert_not(parser, NULL);
+
+  const char *word = NULL;
+  size_t length = 0;
+  Node *current = parser->current;
+
+  check(current, "parsing failure, no current node");
+  check(parser->depth < NODE_LIMITS.depth, "parsing failure, groups nested too deep");
+  check(Node_limit_width(current), "parsing failure, too many children in a group");
+
+  // checked the same as if it were parsed, so expanding it later can't fail
+  const char *end = Stackish_scan_group(start, pe, NODE_LIMITS.depth - parser->depth, 
+      NODE_LIMITS.width, &word, &length);
+  check(end, "parsing failure in a deferred group");
+
+  bstring raw = current->arena && current->arena->input ? NodeArena_view(current->arena, start, end - start)
+    : Node_str(current, start, end - start);
+  Node *node = Node_new_deferred(current, raw);
+
+  if(word != NULL) Node_name(node, Node_name_str(node, word, length));
+
+  return end;
+  on_fail(return NULL);
 }
 
 
@@ -108,22 +150,31 @@ inline void handle_start(stackish_parser *parser)
   machine stackish_parser;
 
   action mark { MARK(mark, fpc); }
-  action number { if(!push(NUMBER, mark, fpc)) fbreak; }
-  action float { if(!push(FLOAT, mark, fpc)) fbreak; }
-  action string { if(!push(STRING, mark, fpc)) fbreak; }
-  action start { handle_start(parser); }
-  action blob { if(!push(BLOB, mark, fpc)) fbreak; else parser->more = 0;}
-  action word {
-    if(handle_word(parser, PTR_TO(mark), LEN(mark, fpc))) {
-      // all done, stop processing
-      fbreak;
+  action number { if(!push(NUMBER, mark, fpc)) fgoto *stackish_parser_error; }
+  action float { if(!push(FLOAT, mark, fpc)) fgoto *stackish_parser_error; }
+  action string { if(!push(STRING, mark, fpc)) fgoto *stackish_parser_error; }
+  action start {
+    if(parser->lazy_depth && parser->depth >= parser->lazy_depth) {
+      // too deep to build now, so step over it and carry on after its closing word
+      const char *end = handle_defer(parser, fpc, pe);
+      if(end == NULL) fgoto *stackish_parser_error;
+      fexec end;
+    } else if(!handle_start(parser)) {
+      fgoto *stackish_parser_error;
     }
   }
+  action blob { if(!push(BLOB, mark, fpc)) fgoto *stackish_parser_error; else parser->more = 0;}
+  action word {
+    int done = handle_word(parser, PTR_TO(mark), LEN(mark, fpc));
+    if(done < 0) fgoto *stackish_parser_error;
+    // all done, stop processing
+    if(done) fbreak;
+  }
   action group {
-    if(handle_group(parser)) {
-      // all done, stop processing
-      fbreak;
-    }
+    int done = handle_group(parser);
+    if(done < 0) fgoto *stackish_parser_error;
+    // all done, stop processing
+    if(done) fbreak;
   }
   action more { 
     char *end = NULL; 
@@ -135,11 +186,12 @@ inline void handle_start(stackish_parser *parser)
       fbreak;
     }
   }
-  action attrib { if(!handle_attr(parser, PTR_TO(mark), LEN(mark, fpc))) fbreak; }
+  action attrib { if(!handle_attr(parser, PTR_TO(mark), LEN(mark, fpc))) fgoto *stackish_parser_error; }
+  action quote { fexec Stackish_scan_quote(fpc, pe); }
 
   number =  digit+;
   float  =  ('-' | '+')? digit+ "." digit+;
-  string =  '"' %mark (any -- '"')* '"' @string;
+  string =  '"' %mark ((any -- '"') >quote (any -- '"')*)? '"' @string;
   start  = "[";
   word   =  alpha+ (alnum | '-' | '_' | '.' | ':')*;
   blob   =  "'" digit+ >mark ":" @more "'" @blob;
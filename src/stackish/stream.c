@@ -0,0 +1,285 @@
+/*
+ * Utu -- Saving The Internet With Hate
+ *
+ * Copyright (c) Zed A. Shaw 2005 (zedshaw@zedshaw.com)
+ *
+ * This file is modifiable/redistributable under the terms of the GNU
+ * General Public License.
+ *
+ * You should have recieved a copy of the GNU General Public License along
+ * with this program; see the file COPYING. If not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 0211-1307, USA.
+ */
+
+#include <stdlib.h>
+#include <ctype.h>
+#include <myriad/defend.h>
+#include "stackish/stream.h"
+#include "stackish/scan.h"
+
+/** Same as ragel's space. */
+#define is_space(C) ((C) == ' ' || (C) == '\t' || (C) == '\n' || (C) == '\r' || (C) == '\v' || (C) == '\f')
+
+StackishStream *StackishStream_create(int use_arena)
+{
+  StackishStream *stream = calloc(1, sizeof(StackishStream));
+  assert_mem(stream);
+
+  stream->state = STACKISH_SPACE;
+  stream->use_arena = use_arena;
+  stream->token = bfromcstr("");
+  assert_mem(stream->token);
+
+  return stream;
+}
+
+void StackishStream_destroy(StackishStream *stream)
+{
+  assert_not(stream, NULL);
+
+  if(stream->root) Node_destroy(stream->root);
+  if(stream->blob) bdestroy(stream->blob);
+  bdestroy(stream->token);
+  free(stream);
+}
+
+static int StackishStream_start(StackishStream *stream)
+{
+  check(stream->depth < NODE_LIMITS.depth, "parsing failure, groups nested too deep");
+
+  if(stream->current) {
+    check(Node_limit_width(stream->current), "parsing failure, too many children in a group");
+    stream->current = Node_new_group(stream->current);
+  } else {
+    stream->root = Node_new_root(stream->use_arena ? NodeArena_create(0) : NULL);
+    stream->current = stream->root;
+  }
+
+  stream->depth++;
+
+  return 1;
+  on_fail(return 0);
+}
+
+/** Ends the current group with a word or a ] (NULL word). */
+static int StackishStream_end(StackishStream *stream, const char *word, size_t length)
+{
+  Node *current = stream->current;
+
+  check(current, "parsing error, ending a group that was never started");
+
+  if(word) Node_name(current, Node_name_str(current, word, length));
+  Node_limit_close(current);
+  stream->depth--;
+
+  // either the document is done or we move up to the parent
+  if(current == stream->root) {
+    stream->state = STACKISH_DONE;
+  } else {
+    stream->current = current->parent;
+  }
+
+  return 1;
+  on_fail(return 0);
+}
+
+static int StackishStream_push(StackishStream *stream, NodeType type, const char *start, size_t length)
+{
+  check(stream->current, "parsing failure, no group to push onto");
+  check(Node_limit_width(stream->current), "parsing failure, too many children in a group");
+  check(Node_from_str(stream->current, type, start, length), "parsing failure, invalid value");
+
+  return 1;
+  on_fail(return 0);
+}
+
+/** Works out what a bare token is and does it. */
+static int StackishStream_token(StackishStream *stream, const char *start, size_t length)
+{
+  switch(Stackish_scan_token(start, length)) {
+    case STACKISH_TOKEN_ATTR:
+      check(stream->current && stream->current->child, "parsing failure, attribute with nothing to name");
+      Node_name(stream->current->child, Node_name_str(stream->current->child, start, length));
+      return 1;
+    case STACKISH_TOKEN_WORD:
+      return StackishStream_end(stream, start, length);
+    case STACKISH_TOKEN_NUMBER:
+      return StackishStream_push(stream, TYPE_NUMBER, start, length);
+    case STACKISH_TOKEN_FLOAT:
+      return StackishStream_push(stream, TYPE_FLOAT, start, length);
+    default:
+      fail("parsing failure, invalid word, attribute, number or float");
+  }
+
+  on_fail(return 0);
+}
+
+size_t StackishStream_feed(StackishStream *stream, const char *buf, size_t len)
+{
+  const char *p = buf;
+  const char *pe = buf + len;
+  const char *mark = NULL;
+  size_t avail = 0;
+  int rc = 1;
+
+  assert_not(stream, NULL);
+  assert_not(buf, NULL);
+
+  while(p < pe && stream->state != STACKISH_DONE && stream->state != STACKISH_ERROR) {
+    switch(stream->state) {
+      case STACKISH_SPACE:
+        if(is_space(*p)) {
+          p = Stackish_scan_space(p, pe);
+        } else if(*p == '[') {
+          p++;
+          rc = StackishStream_start(stream);
+        } else if(*p == ']') {
+          p++;
+          rc = StackishStream_end(stream, NULL, 0);
+        } else if(*p == '"') {
+          p++;
+          stream->state = STACKISH_STRING;
+        } else if(*p == '\'') {
+          // no point reading a big blob that can't go anywhere
+          check(stream->current, "parsing failure, blob with no group to push onto");
+          check(Node_limit_width(stream->current), "parsing failure, too many children in a group");
+          p++;
+          stream->state = STACKISH_BLOB_LENGTH;
+        } else {
+          stream->state = STACKISH_TOKEN;
+        }
+        break;
+
+      case STACKISH_TOKEN:
+        mark = p;
+        p = Stackish_scan_delimiter(p, pe);
+
+        if(p == pe) {
+          // it might keep going in the next chunk
+          bcatblk(stream->token, (const unsigned char *)mark, p - mark);
+        } else {
+          stream->state = STACKISH_SPACE;
+
+          if(blength(stream->token) == 0) {
+            rc = StackishStream_token(stream, mark, p - mark);
+          } else {
+            bcatblk(stream->token, (const unsigned char *)mark, p - mark);
+            rc = StackishStream_token(stream, (const char *)stream->token->data, blength(stream->token));
+            btrunc(stream->token, 0);
+          }
+
+          // the space after the last word is part of the document
+          if(stream->state == STACKISH_DONE && is_space(*p)) p++;
+        }
+        break;
+
+      case STACKISH_STRING:
+        mark = p;
+        p = Stackish_scan_quote(p, pe);
+
+        if(blength(stream->token) > 0 || p == pe) {
+          bcatblk(stream->token, (const unsigned char *)mark, p - mark);
+        }
+
+        if(p < pe) {
+          if(blength(stream->token) == 0) {
+            rc = StackishStream_push(stream, TYPE_STRING, mark, p - mark);
+          } else {
+            rc = StackishStream_push(stream, TYPE_STRING, (const char *)stream->token->data, blength(stream->token));
+            btrunc(stream->token, 0);
+          }
+
+          p++;
+          stream->state = STACKISH_SPACE;
+        }
+        break;
+
+      case STACKISH_BLOB_LENGTH:
+        if(isdigit(*p)) {
+          check(blength(stream->token) < 9, "parsing failure, blob length too long");
+          bconchar(stream->token, *p);
+        } else {
+          check(*p == ':' && blength(stream->token) > 0, "parsing failure, invalid blob length");
+
+          stream->blob_left = strtoul((const char *)stream->token->data, NULL, 10);
+          btrunc(stream->token, 0);
+          check(stream->blob_left <= STACKISH_STREAM_MAX_BLOB, "parsing failure, blob is too big");
+
+          // sized up front so the data is read straight in with no reallocs
+          stream->blob = bfromcstralloc(stream->blob_left + 1, "");
+          assert_mem(stream->blob);
+          stream->state = STACKISH_BLOB;
+        }
+        p++;
+        break;
+
+      case STACKISH_BLOB:
+        avail = pe - p;
+        if(avail > stream->blob_left) avail = stream->blob_left;
+
+        bcatblk(stream->blob, (const unsigned char *)p, avail);
+        p += avail;
+        stream->blob_left -= avail;
+
+        if(stream->blob_left == 0) stream->state = STACKISH_BLOB_END;
+        break;
+
+      case STACKISH_BLOB_END:
+        check(*p == '\'', "parsing failure, blob doesn't end with a '");
+        p++;
+
+        Node_new_blob(stream->current, stream->blob);
+        stream->blob = NULL;
+        stream->state = STACKISH_SPACE;
+        break;
+
+      default:
+        fail("parsing failure, stream in an invalid state");
+    }
+
+    check(rc, "parsing failure in stackish stream");
+  }
+
+  stream->nread += p - buf;
+  return p - buf;
+
+  on_fail(stream->state = STACKISH_ERROR;
+      stream->nread += p - buf;
+      return p - buf);
+}
+
+int StackishStream_finish(StackishStream *stream)
+{
+  int rc = 1;
+
+  assert_not(stream, NULL);
+
+  if(stream->state == STACKISH_TOKEN) {
+    stream->state = STACKISH_SPACE;
+    rc = StackishStream_token(stream, (const char *)stream->token->data, blength(stream->token));
+    btrunc(stream->token, 0);
+    if(!rc) stream->state = STACKISH_ERROR;
+  }
+
+  switch(stream->state) {
+    case STACKISH_DONE: return 1;
+    case STACKISH_ERROR: return -1;
+    default: return 0;
+  }
+}
+
+Node *StackishStream_take(StackishStream *stream)
+{
+  Node *root = NULL;
+
+  assert_not(stream, NULL);
+
+  if(stream->state != STACKISH_DONE) return NULL;
+
+  root = stream->root;
+  stream->root = NULL;
+  stream->current = NULL;
+  stream->state = STACKISH_SPACE;
+
+  return root;
+}
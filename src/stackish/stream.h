@@ -0,0 +1,127 @@
+#ifndef utu_stackish_stream_h
+#define utu_stackish_stream_h
+
+/*
+ * Utu -- Saving The Internet With Hate
+ *
+ * Copyright (c) Zed A. Shaw 2005 (zedshaw@zedshaw.com)
+ *
+ * This file is modifiable/redistributable under the terms of the GNU
+ * General Public License.
+ *
+ * You should have recieved a copy of the GNU General Public License along
+ * with this program; see the file COPYING. If not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 0211-1307, USA.
+ */
+
+#include "stackish/node.h"
+#include "stackish/arena.h"
+
+/**
+ * Where a StackishStream is in the input, kept between feeds so a chunk
+ * can end anywhere, even in the middle of a word, string, or blob.
+ */
+typedef enum StackishStreamState {
+  STACKISH_SPACE, STACKISH_TOKEN, STACKISH_STRING,
+  STACKISH_BLOB_LENGTH, STACKISH_BLOB, STACKISH_BLOB_END,
+  STACKISH_DONE, STACKISH_ERROR
+} StackishStreamState;
+
+/**
+ * A stackish parser that you feed the input as it shows up rather than
+ * needing the whole document in one buffer ending in a space like
+ * Node_parse_seq does.  It builds the same Node trees as Node_parse, and
+ * you can keep feeding it to get one document after another:
+ *
+ * <pre>
+ *   while((n = read(fd, buf, sizeof(buf))) > 0) {
+ *     for(used = 0; used < n; used += StackishStream_feed(stream, buf + used, n - used)) {
+ *       if(StackishStream_done(stream)) process(StackishStream_take(stream));
+ *       check(!StackishStream_has_error(stream), "bad stackish");
+ *     }
+ *   }
+ * </pre>
+ *
+ * Only a word or string that crosses into the next chunk gets copied to
+ * the side, and blobs are read straight into their bstring, so it never
+ * holds more than the tree being built.
+ *
+ * The bare tokens (numbers, floats, words, attributes) have to be split
+ * up by whitespace, [, ], quotes, or blobs, just like Node_bstr writes
+ * them.  Since a word at the end of a chunk could keep going in the
+ * next one, the last word of a document isn't done until the byte after
+ * it arrives, or you call StackishStream_finish at the end of the input.
+ */
+typedef struct StackishStream {
+  StackishStreamState state;
+
+  /** Build each document in its own arena, see arena.h. */
+  int use_arena;
+
+  Node *root;
+  Node *current;
+
+  /** How many groups are open, checked against NODE_LIMITS. */
+  size_t depth;
+
+  /** A token that crossed a chunk boundary so far. */
+  bstring token;
+
+  /** The blob being read and how many more bytes it needs. */
+  bstring blob;
+  size_t blob_left;
+
+  /** Total bytes consumed since the stream was created. */
+  size_t nread;
+} StackishStream;
+
+/** Biggest blob the stream will accept, since the length comes off the wire. */
+#define STACKISH_STREAM_MAX_BLOB (16 * 1024 * 1024)
+
+/**
+ * @brief Makes a stream ready for the first document.
+ * @param use_arena : Whether to build each document in a NodeArena.
+ * @return StackishStream * : The new stream.
+ */
+StackishStream *StackishStream_create(int use_arena);
+
+/**
+ * @brief Destroys the stream and any document it was in the middle of.
+ * @param stream : Stream to destroy.
+ */
+void StackishStream_destroy(StackishStream *stream);
+
+/**
+ * Parses as much of the chunk as it can.  It stops early if a document
+ * finishes, so check StackishStream_done and feed it the rest after you
+ * take the document.  Once there's an error it won't consume anything.
+ *
+ * @brief Feeds the next chunk of input to the stream.
+ * @param stream : Stream to feed.
+ * @param buf : The bytes, they don't have to stay around after.
+ * @param len : How many.
+ * @return size_t : How many bytes were used.
+ */
+size_t StackishStream_feed(StackishStream *stream, const char *buf, size_t len);
+
+/**
+ * @brief Tells the stream the input ended, which finishes any last word.
+ * @param stream : Stream that's out of input.
+ * @return int : 1 if a document is done, 0 if there wasn't a whole one, -1 for an error.
+ */
+int StackishStream_finish(StackishStream *stream);
+
+/**
+ * @brief Gives you the finished document and gets ready for the next one.
+ * @param stream : Stream with a finished document.
+ * @return Node * : The root you now own, NULL if no document is done.
+ */
+Node *StackishStream_take(StackishStream *stream);
+
+/** True when a whole document is ready to take. */
+#define StackishStream_done(S) ((S)->state == STACKISH_DONE)
+
+/** True when the input was bad, the stream is useless after this. */
+#define StackishStream_has_error(S) ((S)->state == STACKISH_ERROR)
+
+#endif
@@ -0,0 +1,237 @@
+/*
+ * Utu -- Saving The Internet With Hate
+ *
+ * Copyright (c) Zed A. Shaw 2005 (zedshaw@zedshaw.com)
+ *
+ * This file is modifiable/redistributable under the terms of the GNU
+ * General Public License.
+ *
+ * You should have recieved a copy of the GNU General Public License along
+ * with this program; see the file COPYING. If not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 0211-1307, USA.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <myriad/defend.h>
+#include "stackish/template.h"
+#include "node_algo.h"
+
+/** Same as biseqcstr(N, word) but interned names only need the pointer compare. */
+#define NodeTemplate_word_is(N, W) ((N) == (W) || ((N) != NULL && blength(N) == blength(W) \
+      && memcmp((N)->data, (W)->data, blength(W)) == 0))
+
+NodeTemplate *NodeTemplate_create(const char *format, ...)
+{
+  NodeTemplate *tmpl = NULL;
+  NodeTemplateOp *op = NULL;
+  const char *cur = NULL;
+  const char *word = NULL;
+  size_t count = 0;
+  va_list args;
+
+  assert_not(format, NULL);
+
+  for(cur = format; *cur != '\0'; cur++) {
+    check(strchr("[]nfbsG@w. \t\n", *cur), "invalid character in template format");
+    if(*cur != ' ' && *cur != '\t' && *cur != '\n') count++;
+  }
+
+  // the ops go right after the template so it's one malloc
+  tmpl = calloc(1, sizeof(NodeTemplate) + count * sizeof(NodeTemplateOp));
+  assert_mem(tmpl);
+  tmpl->ops = (NodeTemplateOp *)(tmpl + 1);
+
+  va_start(args, format);
+
+  for(cur = format, op = tmpl->ops; *cur != '\0'; cur++) {
+    if(*cur == ' ' || *cur == '\t' || *cur == '\n') continue;
+
+    op->op = *cur;
+
+    if(*cur == 'w' || *cur == '@') {
+      word = va_arg(args, const char *);
+      check_then(word != NULL && word[0] != '\0', "NULL or empty word given for template", va_end(args));
+      op->word = Node_intern(word, strlen(word));
+      if(op->word == NULL) op->word = bfromcstr(word);
+    }
+
+    tmpl->count++;
+    op++;
+  }
+
+  va_end(args);
+
+  return tmpl;
+  on_fail(if(tmpl) NodeTemplate_destroy(tmpl); return NULL);
+}
+
+void NodeTemplate_destroy(NodeTemplate *tmpl)
+{
+  size_t i = 0;
+
+  assert_not(tmpl, NULL);
+
+  // the interned ones are write protected so bdestroy leaves them alone
+  for(i = 0; i < tmpl->count; i++) {
+    if(tmpl->ops[i].word) bdestroy(tmpl->ops[i].word);
+  }
+
+  free(tmpl);
+}
+
+/** The template's name for a new node, shared if it's interned otherwise a copy. */
+static inline bstring NodeTemplate_name(Node *node, bstring word)
+{
+  return Node_is_interned(word) ? word : Node_str(node, (const char *)word->data, blength(word));
+}
+
+Node *NodeTemplate_cons(NodeTemplate *tmpl, ...)
+{
+  NodeTemplateOp *op = NULL, *end = NULL;
+  Node *root = NULL, *cur_node = NULL, *group = NULL;
+  bstring str = NULL;
+  va_list args;
+
+  assert_not(tmpl, NULL);
+
+  va_start(args, tmpl);
+
+  for(op = tmpl->ops, end = tmpl->ops + tmpl->count; op < end; op++) {
+    switch(op->op) {
+      case '[':
+        cur_node = Node_new_group(cur_node);
+        if(root == NULL) root = cur_node;
+        break;
+      case 'n':
+        Node_new_number(cur_node, va_arg(args, uint64_t));
+        break;
+      case 'f':
+        Node_new_float(cur_node, va_arg(args, double));
+        break;
+      case 'b':
+        str = va_arg(args, bstring);
+        check(str != NULL, "NULL given for blob");
+        Node_new_blob(cur_node, str);
+        break;
+      case 's':
+        str = va_arg(args, bstring);
+        check(str != NULL, "NULL given for string");
+        Node_new_string(cur_node, str);
+        break;
+      case ']':
+        if(cur_node) cur_node = cur_node->parent;
+        break;
+      case '@':
+        Node_name(cur_node->child, NodeTemplate_name(cur_node->child, op->word));
+        break;
+      case 'w':
+        Node_name(cur_node, NodeTemplate_name(cur_node, op->word));
+        cur_node = cur_node->parent;
+        break;
+      case 'G':
+        group = va_arg(args, Node *);
+        check(group != NULL, "NULL given for group to add");
+        LIST_ADD(Node, cur_node->child, group, sibling);
+        break;
+      default:
+        fail("template op can't be used to construct");
+    }
+  }
+
+  assert(cur_node == NULL);
+  va_end(args);
+
+  return root;
+  on_fail(va_end(args); return NULL);
+}
+
+#define NodeTemplate_next(N) { if((N)->sibling) (N) = (N)->sibling; }
+
+int NodeTemplate_decons(NodeTemplate *tmpl, Node *root, int copy, ...)
+{
+  NodeTemplateOp *op = NULL, *end = NULL;
+  Node *cur_node = root;
+  Node **group = NULL;
+  uint64_t *number = NULL;
+  double *floating = NULL;
+  bstring *str = NULL;
+  va_list args;
+
+  assert_not(tmpl, NULL);
+  assert_not(root, NULL);
+
+  va_start(args, copy);
+
+  for(op = tmpl->ops, end = tmpl->ops + tmpl->count; op < end; op++) {
+    check(cur_node != NULL, "deconstruct ran out of nodes before the template");
+
+    switch(op->op) {
+      case '[':
+        cur_node = cur_node->child;
+        break;
+      case 'n':
+        number = va_arg(args, uint64_t *);
+        check(number != NULL && cur_node->type == TYPE_NUMBER, "expecting a number");
+        *number = cur_node->value.number;
+        NodeTemplate_next(cur_node);
+        break;
+      case 'f':
+        floating = va_arg(args, double *);
+        check(floating != NULL && cur_node->type == TYPE_FLOAT, "expecting a float");
+        *floating = cur_node->value.floating;
+        NodeTemplate_next(cur_node);
+        break;
+      case 's': // fallthrough
+      case 'b':
+        str = va_arg(args, bstring *);
+        check(str != NULL && cur_node->type == (op->op == 's' ? TYPE_STRING : TYPE_BLOB), 
+            "expecting a string or blob");
+        *str = copy ? bstrcpy(cur_node->value.string) : cur_node->value.string;
+        NodeTemplate_next(cur_node);
+        break;
+      case ']':
+        cur_node = cur_node->parent;
+        if(cur_node) NodeTemplate_next(cur_node);
+        break;
+      case '@':
+        // just confirm but don't go to the next one
+        check(NodeTemplate_word_is(cur_node->name, op->word), "wrong attribute name");
+        break;
+      case 'w':
+        cur_node = cur_node->parent;
+        check(cur_node != NULL, "deconstruct went above the root");
+        check(NodeTemplate_word_is(cur_node->name, op->word), "wrong word name");
+        NodeTemplate_next(cur_node);
+        break;
+      case 'G':
+        group = va_arg(args, Node **);
+        check(group != NULL && *group == NULL, "group output var wasn't NULL, must be NULL.");
+        *group = cur_node;
+        NodeTemplate_next(cur_node);
+        break;
+      case '.':
+        NodeTemplate_next(cur_node);
+        break;
+      default:
+        fail("invalid template op");
+    }
+  }
+
+  va_end(args);
+  return 1;
+
+  on_fail(va_end(args); return 0);
+}
+
+NodeTemplate *NodeTemplate_install(NodeTemplate **slot, NodeTemplate *tmpl)
+{
+  assert_not(slot, NULL);
+  assert_not(tmpl, NULL);
+
+  if(!__sync_bool_compare_and_swap(slot, NULL, tmpl)) {
+    NodeTemplate_destroy(tmpl);
+  }
+
+  return *slot;
+}
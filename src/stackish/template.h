@@ -0,0 +1,97 @@
+#ifndef utu_stackish_template_h
+#define utu_stackish_template_h
+
+/*
+ * Utu -- Saving The Internet With Hate
+ *
+ * Copyright (c) Zed A. Shaw 2005 (zedshaw@zedshaw.com)
+ *
+ * This file is modifiable/redistributable under the terms of the GNU
+ * General Public License.
+ *
+ * You should have recieved a copy of the GNU General Public License along
+ * with this program; see the file COPYING. If not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 0211-1307, USA.
+ */
+
+#include <stdarg.h>
+#include "stackish/node.h"
+
+/**
+ * A Node_cons or Node_decons format that's been read once, with its
+ * words and attributes given up front and turned into names (the
+ * interned ones when they can be).  Using it skips reading the format,
+ * strlen on every word, the intern search, and biseqcstr on every name,
+ * which adds up for the formats used on every message.  A name the
+ * parser interned matches with just a pointer compare.
+ *
+ * The format characters and what they do are the same as Node_cons and
+ * Node_decons, so a template does exactly what the plain call would:
+ *
+ * <pre>
+ *   static NodeTemplate *HEADER = NULL;
+ *   Node *hdr = NodeTemplate_cons(NodeTemplate_once(HEADER, "[nw", "header"), msgid);
+ *   // same as Node_cons("[nw", msgid, "header")
+ * </pre>
+ *
+ * Templates never change once made, so one can be used by any number
+ * of threads at once.
+ */
+typedef struct NodeTemplateOp {
+  char op;
+  /** The name for 'w' and '@', NULL for the rest. */
+  bstring word;
+} NodeTemplateOp;
+
+typedef struct NodeTemplate {
+  size_t count;
+  NodeTemplateOp *ops;
+} NodeTemplate;
+
+/**
+ * @brief Reads a format into a template.
+ * @param format : Node_cons or Node_decons format.
+ * @param ... : The words and attributes (const char *) for each 'w' and '@', in order.
+ * @return NodeTemplate * : The template, NULL if the format is invalid.
+ */
+NodeTemplate *NodeTemplate_create(const char *format, ...);
+
+/**
+ * @brief Destroys a template.
+ * @param tmpl : Template to destroy.
+ */
+void NodeTemplate_destroy(NodeTemplate *tmpl);
+
+/**
+ * @brief Builds a Node tree just like Node_cons.
+ * @param tmpl : The template.
+ * @param ... : The values, like Node_cons but without the words.
+ * @return Node * : The new tree, NULL on an error.
+ */
+Node *NodeTemplate_cons(NodeTemplate *tmpl, ...);
+
+/**
+ * @brief Takes a tree apart just like Node_decons.
+ * @param tmpl : The template.
+ * @param root : Node to start deconstructing from.
+ * @param copy : Whether to copy the strings and blobs.
+ * @param ... : Pointers for the values, like Node_decons but without the words.
+ * @return int : 1 if it matched, 0 if not.
+ */
+int NodeTemplate_decons(NodeTemplate *tmpl, Node *root, int copy, ...);
+
+/**
+ * Puts tmpl in *slot if it's still NULL, otherwise destroys it since
+ * some other thread got there first.
+ *
+ * @brief Installs a shared template.
+ * @param slot : Where the shared template goes.
+ * @param tmpl : The new template.
+ * @return NodeTemplate * : Whatever is in the slot now.
+ */
+NodeTemplate *NodeTemplate_install(NodeTemplate **slot, NodeTemplate *tmpl);
+
+/** Gives the template in T, making it from the format and words the first time. */
+#define NodeTemplate_once(T, F, ...) ((T) ? (T) : NodeTemplate_install(&(T), NodeTemplate_create(F, ##__VA_ARGS__)))
+
+#endif
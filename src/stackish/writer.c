@@ -0,0 +1,272 @@
+/*
+ * Utu -- Saving The Internet With Hate
+ *
+ * Copyright (c) Zed A. Shaw 2005 (zedshaw@zedshaw.com)
+ *
+ * This file is modifiable/redistributable under the terms of the GNU
+ * General Public License.
+ *
+ * You should have recieved a copy of the GNU General Public License along
+ * with this program; see the file COPYING. If not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 0211-1307, USA.
+ */
+
+#include <stdlib.h>
+#include <myriad/defend.h>
+#include "stackish/writer.h"
+#include "stackish/number.h"
+
+/** Hands whatever's gathered to the sink. */
+static inline void StackishWriter_flush(StackishWriter *writer)
+{
+  if(writer->used > 0 && !writer->failed) {
+    writer->failed = !writer->sink.write(writer->sink.data, writer->buf, writer->used);
+    writer->written += writer->used;
+  }
+
+  writer->used = 0;
+}
+
+static void StackishWriter_put(StackishWriter *writer, const void *bytes, size_t length)
+{
+  if(writer->failed || length == 0) return;
+
+  if(writer->used + length > STACKISH_WRITER_BUF) {
+    StackishWriter_flush(writer);
+
+    // big ones (blobs mostly) go straight through rather than being copied in pieces
+    if(length > STACKISH_WRITER_BUF) {
+      if(!writer->failed) writer->failed = !writer->sink.write(writer->sink.data, bytes, length);
+      writer->written += length;
+      return;
+    }
+  }
+
+  memcpy(writer->buf + writer->used, bytes, length);
+  writer->used += length;
+}
+
+#define StackishWriter_putc(W, C) do { char c__ = (C); StackishWriter_put((W), &c__, 1); } while(0)
+
+/** Writes number in decimal with no padding, the way the parsers read it. */
+static void StackishWriter_put_number(StackishWriter *writer, uint64_t number)
+{
+  char digits[24];
+  char *p = digits + sizeof(digits);
+
+  do {
+    *--p = '0' + number % 10;
+    number /= 10;
+  } while(number > 0);
+
+  StackishWriter_put(writer, p, digits + sizeof(digits) - p);
+}
+
+void StackishWriter_start(StackishWriter *writer, StackishSink sink)
+{
+  assert_not(writer, NULL);
+  assert_not(sink.write, NULL);
+
+  writer->sink = sink;
+  writer->depth = 0;
+  writer->written = 0;
+  writer->failed = 0;
+  writer->used = 0;
+}
+
+int StackishWriter_group(StackishWriter *writer)
+{
+  writer->depth++;
+  StackishWriter_put(writer, "[ ", 2);
+
+  return !writer->failed;
+}
+
+int StackishWriter_end(StackishWriter *writer)
+{
+  if(writer->depth == 0) {
+    writer->failed = 1;
+  } else {
+    writer->depth--;
+    StackishWriter_put(writer, "] ", 2);
+  }
+
+  return !writer->failed;
+}
+
+int StackishWriter_word(StackishWriter *writer, const char *word)
+{
+  if(writer->depth == 0) {
+    writer->failed = 1;
+  } else {
+    writer->depth--;
+    StackishWriter_put(writer, word, strlen(word));
+    StackishWriter_putc(writer, ' ');
+  }
+
+  return !writer->failed;
+}
+
+int StackishWriter_attr(StackishWriter *writer, const char *attr)
+{
+  StackishWriter_put(writer, attr, strlen(attr));
+  StackishWriter_putc(writer, ' ');
+
+  return !writer->failed;
+}
+
+int StackishWriter_number(StackishWriter *writer, uint64_t number)
+{
+  StackishWriter_put_number(writer, number);
+  StackishWriter_putc(writer, ' ');
+
+  return !writer->failed;
+}
+
+int StackishWriter_float(StackishWriter *writer, double floating)
+{
+  char buf[STACKISH_FLOAT_MAX];
+
+  StackishWriter_put(writer, buf, Stackish_float_format(buf, floating));
+  StackishWriter_putc(writer, ' ');
+
+  return !writer->failed;
+}
+
+int StackishWriter_string(StackishWriter *writer, const char *data, size_t length)
+{
+  // a " would end it early and nothing could read the rest
+  if(length > 0 && memchr(data, '"', length) != NULL) {
+    writer->failed = 1;
+  } else {
+    StackishWriter_putc(writer, '"');
+    StackishWriter_put(writer, data, length);
+    StackishWriter_put(writer, "\" ", 2);
+  }
+
+  return !writer->failed;
+}
+
+int StackishWriter_blob(StackishWriter *writer, const void *data, size_t length)
+{
+  StackishWriter_putc(writer, '\'');
+  StackishWriter_put_number(writer, length);
+  StackishWriter_putc(writer, ':');
+  StackishWriter_put(writer, data, length);
+  StackishWriter_put(writer, "' ", 2);
+
+  return !writer->failed;
+}
+
+int StackishWriter_node(StackishWriter *writer, Node *d, int follow_sibs)
+{
+  int leaving = 0;
+  NodeWalk walk;
+
+  Node_walk_start(&walk, d, follow_sibs);
+
+  // the same tokens Node_write makes, so the bytes come out the same too
+  while((d = Node_walk_next(&walk, &leaving)) != NULL && !writer->failed) {
+    if(!leaving) {
+      if(d->type == TYPE_GROUP) StackishWriter_group(writer);
+      continue;
+    }
+
+    switch(d->type) {
+      case TYPE_BLOB:
+        StackishWriter_blob(writer, d->value.string->data, blength(d->value.string));
+        break;
+      case TYPE_STRING:
+        StackishWriter_string(writer, (const char *)bdata(d->value.string), Node_cstr_length(d->value.string));
+        break;
+      case TYPE_NUMBER:
+        StackishWriter_number(writer, d->value.number);
+        break;
+      case TYPE_FLOAT:
+        StackishWriter_float(writer, d->value.floating);
+        break;
+      case TYPE_GROUP:
+        if(d->name && bchar(d->name, 0) != '@') {
+          // the word is the name, so it's done here
+          StackishWriter_word(writer, (const char *)bdata(d->name));
+          continue;
+        }
+        StackishWriter_end(writer);
+        break;
+      default:
+        writer->failed = 1;
+        break;
+    }
+
+    if(d->name != NULL) StackishWriter_attr(writer, (const char *)bdata(d->name));
+  }
+
+  Node_walk_end(&walk);
+  if(walk.failed) writer->failed = 1;
+
+  return !writer->failed;
+}
+
+int StackishWriter_node_blob(StackishWriter *writer, Node *d, int follow_sibs)
+{
+  size_t depth = writer->depth;
+  size_t length = d ? Node_serialized_length(d, ' ', follow_sibs) : 0;
+
+  // a deferred group in it that doesn't parse measures as nothing
+  if(d && length == 0) writer->failed = 1;
+
+  // the \n Node_bstr adds is in the blob too
+  StackishWriter_putc(writer, '\'');
+  StackishWriter_put_number(writer, length + 1);
+  StackishWriter_putc(writer, ':');
+
+  if(d) StackishWriter_node(writer, d, follow_sibs);
+
+  StackishWriter_put(writer, "\n' ", 3);
+  writer->depth = depth;
+
+  return !writer->failed;
+}
+
+int StackishWriter_finish(StackishWriter *writer)
+{
+  if(writer->depth != 0) writer->failed = 1;
+
+  StackishWriter_putc(writer, '\n');
+  StackishWriter_flush(writer);
+
+  return !writer->failed;
+}
+
+static int StackishSink_bstr_write(void *data, const void *bytes, size_t length)
+{
+  return bcatblk((bstring)data, bytes, length) == BSTR_OK;
+}
+
+StackishSink StackishSink_bstr(bstring out)
+{
+  StackishSink sink = { StackishSink_bstr_write, NULL };
+
+  assert_not(out, NULL);
+  sink.data = out;
+
+  return sink;
+}
+
+static int StackishSink_tee_write(void *data, const void *bytes, size_t length)
+{
+  StackishTee *tee = (StackishTee *)data;
+
+  return tee->first.write(tee->first.data, bytes, length)
+    && tee->second.write(tee->second.data, bytes, length);
+}
+
+StackishSink StackishSink_tee(StackishTee *tee)
+{
+  StackishSink sink = { StackishSink_tee_write, NULL };
+
+  assert_not(tee, NULL);
+  sink.data = tee;
+
+  return sink;
+}
@@ -0,0 +1,139 @@
+#ifndef stackish_writer_h
+#define stackish_writer_h
+
+/*
+ * Utu -- Saving The Internet With Hate
+ *
+ * Copyright (c) Zed A. Shaw 2005 (zedshaw@zedshaw.com)
+ *
+ * This file is modifiable/redistributable under the terms of the GNU
+ * General Public License.
+ *
+ * You should have recieved a copy of the GNU General Public License along
+ * with this program; see the file COPYING. If not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 0211-1307, USA.
+ */
+
+#include <string.h>
+#include "stackish/node.h"
+
+/**
+ * Where a StackishWriter's bytes go.  write gets the sink's data and
+ * the next chunk of bytes, and returns 0 if it couldn't take them.
+ */
+typedef struct StackishSink {
+  int (*write)(void *data, const void *bytes, size_t length);
+  void *data;
+} StackishSink;
+
+/** Sends the same bytes to two sinks, see StackishSink_tee. */
+typedef struct StackishTee {
+  StackishSink first;
+  StackishSink second;
+} StackishTee;
+
+/** Bytes a StackishWriter gathers before it hands them to the sink. */
+#define STACKISH_WRITER_BUF 512
+
+/**
+ * Writes canonical stackish (the same bytes Node_bstr makes) one token
+ * at a time, straight to a sink, so a response or a payload to sign
+ * never has to be built as Nodes first.  You write it in the same
+ * order it's read, values before the word that closes their group:
+ *
+ * <pre>
+ *   StackishWriter_start(&out, StackishSink_bstr(body));
+ *   StackishWriter_group(&out);
+ *   StackishWriter_string(&out, "zed", 3);
+ *   StackishWriter_attr(&out, "@name");
+ *   StackishWriter_word(&out, "joined");
+ *   if(!StackishWriter_finish(&out)) ...
+ * </pre>
+ *
+ * Errors (a word with no group open, a sink that fails) stick, so you
+ * only have to check StackishWriter_finish.  Like NodeWalk it's meant
+ * to live on the stack.
+ */
+typedef struct StackishWriter {
+  StackishSink sink;
+  /** Groups open right now. */
+  size_t depth;
+  /** Bytes that went to the sink so far. */
+  size_t written;
+  int failed;
+  size_t used;
+  char buf[STACKISH_WRITER_BUF];
+} StackishWriter;
+
+/**
+ * @brief Gets a writer ready to write to sink.
+ * @param writer : The writer, usually on the stack.
+ * @param sink : Where the bytes go.
+ */
+void StackishWriter_start(StackishWriter *writer, StackishSink sink);
+
+/** @brief Opens a group, a [. */
+int StackishWriter_group(StackishWriter *writer);
+
+/** @brief Closes the open group without a name, a ]. */
+int StackishWriter_end(StackishWriter *writer);
+
+/** @brief Closes the open group with word. */
+int StackishWriter_word(StackishWriter *writer, const char *word);
+
+/** @brief Names the last thing written with an attribute, like "@to". */
+int StackishWriter_attr(StackishWriter *writer, const char *attr);
+
+/** @brief Writes a number. */
+int StackishWriter_number(StackishWriter *writer, uint64_t number);
+
+/** @brief Writes a float. */
+int StackishWriter_float(StackishWriter *writer, double floating);
+
+/** @brief Writes a string, which can't have a " in it. */
+int StackishWriter_string(StackishWriter *writer, const char *data, size_t length);
+
+/** @brief Writes a blob. */
+int StackishWriter_blob(StackishWriter *writer, const void *data, size_t length);
+
+/**
+ * @brief Writes a tree that's already built the way Node_catbstr would.
+ * @param writer : The writer.
+ * @param d : Node to write.
+ * @param follow_sibs : Whether to write the siblings of d too.
+ * @return int : 0 if the writer has failed.
+ */
+int StackishWriter_node(StackishWriter *writer, Node *d, int follow_sibs);
+
+/**
+ * Writes a blob holding Node_bstr(d, follow_sibs) without making that
+ * string, which is how the hub quotes a request back in a response.
+ *
+ * @brief Writes a tree as a blob.
+ * @param writer : The writer.
+ * @param d : Node to write.
+ * @param follow_sibs : Whether to write the siblings of d too.
+ * @return int : 0 if the writer has failed.
+ */
+int StackishWriter_node_blob(StackishWriter *writer, Node *d, int follow_sibs);
+
+/**
+ * Ends the document with the \n Node_bstr puts on, and gives the sink
+ * anything that's left.
+ *
+ * @brief Finishes writing.
+ * @param writer : The writer.
+ * @return int : 1 if everything was written and every group closed, 0 if not.
+ */
+int StackishWriter_finish(StackishWriter *writer);
+
+/** @brief A sink that appends to a bstring. */
+StackishSink StackishSink_bstr(bstring out);
+
+/** @brief A sink that writes to both of the tee's sinks, it has to live as long as the writer. */
+StackishSink StackishSink_tee(StackishTee *tee);
+
+/** Writes the C string S as a string. */
+#define StackishWriter_cstr(W, S) StackishWriter_string((W), (S), strlen(S))
+
+#endif
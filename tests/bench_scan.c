@@ -0,0 +1,133 @@
+/*
+ * Utu -- Saving The Internet With Hate
+ *
+ * Copyright (c) Zed A. Shaw 2005 (zedshaw@zedshaw.com)
+ *
+ * This file is modifiable/redistributable under the terms of the GNU
+ * General Public License.
+ *
+ * You should have recieved a copy of the GNU General Public License along
+ * with this program; see the file COPYING. If not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 0211-1307, USA.
+ */
+
+/*
+ * Times Node_parse and StackishStream over a few MB of hub-like traffic
+ * with each of the scanners in scan.h.  It's kept out of the testrunner
+ * since timing has no business failing a test run, so run scanbench by
+ * hand when changing the scanners and compare the MB/s.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "stackish/stackish.h"
+#include "stackish/stream.h"
+#include "stackish/scan.h"
+
+#define SCAN_BENCH_BYTES (4 * 1024 * 1024)
+#define SCAN_BENCH_ROUNDS 3
+
+static const char *scan_kind_names[] = { "scalar", "sse2", "avx2" };
+
+/** Something like what goes through a hub, chat lines, blobs, and the small header groups. */
+static bstring scan_bench_corpus()
+{
+  bstring corpus = bfromcstr("");
+  int i = 0;
+
+  while(blength(corpus) < SCAN_BENCH_BYTES) {
+    bformata(corpus, "[ [ \"%s %d\" @text '11:requestedme' @to [ '4:test' @room chat.speak [ %d @msgid '3:zed' @from header payload msg\n",
+        "hey did everyone see the thing about the stuff that happened to the server last night, "
+        "it was pretty bad and I think somebody should look into it before it happens again", i, i);
+    i++;
+  }
+
+  return corpus;
+}
+
+static double scan_bench_now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/** What the hub does with every frame, a whole document at a time. */
+static int scan_bench_parse(bstring corpus, double *fastest)
+{
+  Node *node = NULL;
+  size_t from = 0;
+  int round = 0, docs = 0;
+  double start = 0, took = 0;
+
+  for(round = 0; round < SCAN_BENCH_ROUNDS; round++) {
+    docs = 0;
+    start = scan_bench_now();
+
+    for(from = 0; from < (size_t)blength(corpus); docs++) {
+      node = Node_parse_seq(corpus, &from);
+      if(node == NULL) return 0;
+      Node_destroy(node);
+    }
+
+    took = scan_bench_now() - start;
+    if(*fastest == 0 || took < *fastest) *fastest = took;
+  }
+
+  return docs;
+}
+
+int main(int argc, char *argv[])
+{
+  bstring corpus = scan_bench_corpus();
+  StackishScanKind best = Stackish_scan_kind();
+  StackishStream *stream = NULL;
+  int kind = 0, round = 0, failed = 0, docs[3] = {0}, parsed[3] = {0};
+  size_t at = 0, used = 0;
+  double start = 0, fastest = 0, took = 0;
+
+  for(kind = STACKISH_SCAN_SCALAR; kind <= (int)best; kind++) {
+    Stackish_scan_use(kind);
+
+    fastest = 0;
+    parsed[kind] = scan_bench_parse(corpus, &fastest);
+    printf("Node_parse %s: %d docs at %.1f MB/s\n", scan_kind_names[kind], parsed[kind], blength(corpus) / fastest / (1024 * 1024));
+    failed += parsed[kind] == 0 || parsed[kind] != parsed[0];
+
+    fastest = 0;
+
+    for(round = 0; round < SCAN_BENCH_ROUNDS; round++) {
+      stream = StackishStream_create(1);
+      docs[kind] = 0;
+      start = scan_bench_now();
+
+      for(at = 0; at < (size_t)blength(corpus); at += used) {
+        used = StackishStream_feed(stream, (const char *)bdata(corpus) + at, blength(corpus) - at);
+        if(StackishStream_has_error(stream)) break;
+
+        if(StackishStream_done(stream)) {
+          Node_destroy(StackishStream_take(stream));
+          docs[kind]++;
+        }
+      }
+
+      took = scan_bench_now() - start;
+      failed += StackishStream_has_error(stream);
+      if(fastest == 0 || took < fastest) fastest = took;
+      StackishStream_destroy(stream);
+    }
+
+    printf("StackishStream %s: %d docs at %.1f MB/s\n", scan_kind_names[kind], docs[kind], blength(corpus) / fastest / (1024 * 1024));
+    failed += docs[kind] == 0 || docs[kind] != docs[0];
+  }
+
+  bdestroy(corpus);
+
+  if(failed) {
+    printf("scanners didn't all parse the whole corpus\n");
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,261 @@
+/*
+ * Utu -- Saving The Internet With Hate
+ *
+ * Copyright (c) Zed A. Shaw 2005 (zedshaw@zedshaw.com)
+ *
+ * This file is modifiable/redistributable under the terms of the GNU
+ * General Public License.
+ *
+ * You should have recieved a copy of the GNU General Public License along
+ * with this program; see the file COPYING. If not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 0211-1307, USA.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cut.h"
+#include "stackish/stackish.h"
+#include "stackish/binary.h"
+
+#define ARENA_TEST_DOC "[ [ \"test this\" good [ 1234 @an:integer 345.78 @a-float '5:hello' @blob test [ 1 2 3 ] doc \n"
+
+void __CUT_BRINGUP__ArenaTest( void ) {
+}
+
+void __CUT__NodeArena_alloc()
+{
+  NodeArena *arena = NodeArena_create(0);
+  char *small = NodeArena_alloc(arena, 3);
+  char *big = NodeArena_alloc(arena, NODE_ARENA_CHUNK * 3);
+  bstring str = NodeArena_bstr(arena, "hello", 5);
+
+  ASSERT(small != NULL && big != NULL, "failed to allocate");
+  ASSERT(((uintptr_t)small % 8) == 0, "not aligned");
+  ASSERT(arena->size >= NODE_ARENA_CHUNK * 4, "didn't grow for the big one");
+  memset(big, 'x', NODE_ARENA_CHUNK * 3);
+
+  ASSERT(biseqcstr(str, "hello"), "wrong string");
+  ASSERT(str->mlen <= 0, "arena strings should be write protected");
+  ASSERT(bconchar(str, 'x') != BSTR_OK, "changed a write protected string");
+  ASSERT(bdestroy(str) != BSTR_OK, "bdestroy freed an arena string");
+
+  NodeArena_destroy(arena);
+}
+
+void __CUT__Node_parse_arena()
+{
+  bstring doc = bfromcstr(ARENA_TEST_DOC);
+  Node *heap = Node_parse(doc);
+  Node *root = Node_parse_arena(doc);
+  bstring heap_out = NULL, arena_out = NULL;
+
+  ASSERT(heap != NULL && root != NULL, "failed to parse");
+  ASSERT(root->arena != NULL, "root isn't in an arena");
+  ASSERT(root->arena->root == root, "root doesn't own its arena");
+  ASSERT(root->child->arena == root->arena, "children not in the arena");
+  ASSERT(heap->arena == NULL, "Node_parse shouldn't use an arena");
+
+  heap_out = Node_bstr(heap, 1);
+  arena_out = Node_bstr(root, 1);
+  ASSERT(biseq(heap_out, arena_out), "arena tree serializes differently");
+  ASSERT(biseq(doc, arena_out), "not the same as the input");
+
+  // destroying anything but the root does nothing
+  Node_destroy(root->child);
+
+  Node_destroy(root);
+  Node_destroy(heap);
+  bdestroy(heap_out);
+  bdestroy(arena_out);
+  bdestroy(doc);
+}
+
+void __CUT__Node_parse_arena_fail()
+{
+  bstring unfinished = bfromcstr("[ 1 2 ] doc");
+  bstring broken = bfromcstr("[ [ 1 2 ] $ doc\n");
+  size_t from = 0;
+
+  // the arena has to be cleaned up whether the root was made or not
+  ASSERT(Node_parse_arena(unfinished) == NULL, "needs a trailing space");
+  ASSERT(Node_parse_seq_arena(broken, &from) == NULL, "broken doc should fail");
+
+  bdestroy(unfinished);
+  bdestroy(broken);
+}
+
+void __CUT__Node_arena_cons_decons()
+{
+  bstring doc = bfromcstr("[ \"original\" @to [ 1 2 payload msg\n");
+  Node *root = Node_parse_arena(doc);
+  Node *payload = NULL;
+  Node *wrapped = NULL;
+  bstring to = NULL, out = NULL;
+
+  ASSERT(root != NULL, "failed to parse");
+  ASSERT(Node_decons(root, 0, "[G@s", &payload, "@to", &to), "failed to deconstruct arena tree");
+  ASSERT(biseqcstr(to, "original"), "wrong @to");
+  ASSERT(payload->arena == root->arena, "payload should be in the arena");
+
+  // heap values given to arena nodes are adopted
+  Node_name(Node_new_string(root, bfromcstr("me")), bfromcstr("@me"));
+  Node_name(root->child, bfromcstr("@from"));
+  Node_add_child(root, Node_cons("[n]", (uint64_t)42));
+  Node_add_child(root, Node_cons("[n]", (uint64_t)43));
+  ASSERT(root->child->arena == NULL, "added tree should stay on the heap");
+
+  out = Node_bstr(root, 1);
+  ASSERT(biseqcstr(out, "[ \"original\" @to [ 1 2 payload \"me\" @from [ 42 ] [ 43 ] msg \n"), "wrong output after changes");
+  bdestroy(out);
+
+  // a whole arena tree can go inside a heap tree and goes with it
+  wrapped = Node_cons("[Gw", root, "wrapper");
+  out = Node_bstr(wrapped, 1);
+  ASSERT(biseqcstr(out, "[ [ \"original\" @to [ 1 2 payload \"me\" @from [ 42 ] [ 43 ] msg wrapper \n"), "wrong wrapped output");
+  bdestroy(out);
+
+  Node_destroy(wrapped);
+  bdestroy(doc);
+}
+
+void __CUT__Node_parse_view()
+{
+  bstring doc = bfromcstr("[ '11:hello world' @blob \"a string\" '0:' [ '3:abc' nested msg \n");
+  bstring out = NULL;
+  bstring blob = NULL, string = NULL, empty = NULL;
+  Node *root = Node_parse_view(doc);
+  const char *start = (const char *)bdata(doc);
+  const char *end = start + blength(doc);
+
+  ASSERT(root != NULL, "failed to parse");
+  ASSERT(root->arena->input == doc, "arena didn't keep the input");
+
+  ASSERT(Node_decons(root, 0, "[.bs@b", &empty, &string, "@blob", &blob), "failed to deconstruct");
+  ASSERT(biseqcstr(blob, "hello world"), "wrong blob");
+  ASSERT((const char *)blob->data > start && (const char *)blob->data < end, "blob was copied");
+  ASSERT(blob->mlen <= 0, "blob view isn't write protected");
+  ASSERT_EQUALS(blength(empty), 0, "empty blob isn't empty");
+
+  // strings get used as C strings so they're still copied and \0 terminated
+  ASSERT(biseqcstr(string, "a string"), "wrong string");
+  ASSERT((const char *)string->data < start || (const char *)string->data >= end, "string is a view");
+
+  out = Node_bstr(root, 1);
+  ASSERT(biseq(out, doc), "view tree serializes differently");
+  bdestroy(out);
+
+  Node_destroy(root);
+
+  // it owns the buffer even when it fails
+  ASSERT(Node_parse_view(bfromcstr("[ '3:abc' $ msg\n")) == NULL, "bad doc parsed");
+  ASSERT(Node_parse_view(bfromcstr("[ '3:abc' msg")) == NULL, "unfinished doc parsed");
+}
+
+void __CUT__Node_parse_lazy()
+{
+  const char *text = "[ [ [ '5:hello' [ 1 2 ] \"deep\" payload [ 7 ] @x 9 data msg \n";
+  bstring doc = bfromcstr(text);
+  bstring eager_doc = bfromcstr(text);
+  bstring out = NULL;
+  Node *root = Node_parse_lazy(doc, 2);
+  Node *eager = Node_parse(eager_doc);
+  Node *data = NULL, *payload = NULL, *attr = NULL, *d = NULL;
+  const unsigned char *span = NULL, *blob = NULL;
+  int span_length = 0;
+  NodeWalk walk;
+  int leaving = 0;
+
+  ASSERT(root != NULL && eager != NULL, "failed to parse");
+
+  // data is built, the groups in it aren't
+  data = root->child;
+  ASSERT(data->type == TYPE_GROUP && biseqcstr(data->name, "data"), "data wasn't built");
+  ASSERT(data->child->type == TYPE_NUMBER, "wrong first child");
+  attr = data->child->sibling;
+  payload = attr->sibling;
+  ASSERT(attr->type == TYPE_DEFERRED && biseqcstr(attr->name, "@x"), "attribute didn't name the deferred group");
+  ASSERT(payload->type == TYPE_DEFERRED && biseqcstr(payload->name, "payload"), "payload wasn't deferred");
+  ASSERT(payload->child == NULL, "deferred group has children");
+  ASSERT(payload->value.string->data > doc->data && payload->value.string->data < doc->data + blength(doc), 
+      "deferred bytes were copied");
+
+  // walks expand them as they go so they come out as if it was all parsed
+  out = Node_bstr(root, 1);
+  ASSERT(biseq(out, doc), "lazy tree serializes differently");
+  bdestroy(out);
+  out = Node_bstr(eager, 1);
+  ASSERT(biseq(out, doc), "eager tree serializes differently");
+  bdestroy(out);
+  ASSERT(payload->type == TYPE_DEFERRED, "walking changed the tree");
+
+  // stopping a walk in the middle of one still frees the copy
+  Node_walk_start(&walk, payload, 0);
+  d = Node_walk_next(&walk, &leaving);
+  ASSERT(d != payload && d->type == TYPE_GROUP && biseqcstr(d->name, "payload"), "didn't walk the copy");
+  Node_walk_end(&walk);
+
+  // expanding parses it where it is in doc, so the blob is still a view of those bytes
+  span = payload->value.string->data;
+  span_length = blength(payload->value.string);
+
+  ASSERT(Node_expand(root), "failed to expand");
+  ASSERT(payload->type == TYPE_GROUP && attr->type == TYPE_GROUP, "didn't expand");
+  ASSERT(biseqcstr(payload->name, "payload") && biseqcstr(attr->name, "@x"), "expanding lost the names");
+  ASSERT(payload->child->type == TYPE_STRING && payload->child->sibling->child->value.number == 2, "wrong children");
+  blob = payload->child->sibling->sibling->value.string->data;
+  ASSERT(blob > span && blob < span + span_length, "blob isn't a view of the deferred bytes");
+
+  out = Node_bstr(root, 1);
+  ASSERT(biseq(out, doc), "expanded tree serializes differently");
+  bdestroy(out);
+
+  Node_destroy(root);
+  Node_destroy(eager);
+  bdestroy(eager_doc);
+
+  // deferred groups are still checked
+  ASSERT(Node_parse_lazy(bfromcstr("[ [ [ 1 $ ] data msg \n"), 2) == NULL, "bad deferred group parsed");
+  ASSERT(Node_parse_lazy(bfromcstr("[ [ [ @x ] data msg \n"), 2) == NULL, "attribute with nothing to name parsed");
+  ASSERT(Node_parse_lazy(bfromcstr("[ [ [ '9:abc' ] data msg \n"), 2) == NULL, "short blob parsed");
+  ASSERT(Node_parse_lazy(bfromcstr("[ [ [ 99999999999999999999999 ] x ] msg \n"), 1) == NULL, "number too big parsed");
+
+  // 1 and 400 zeros is past the largest double
+  out = bfromcstr("[ [ [ 1");
+  for(leaving = 0; leaving < 400; leaving++) bconchar(out, '0');
+  bcatcstr(out, ".0 ] x ] msg \n");
+  ASSERT(Node_parse_lazy(out, 1) == NULL, "float too big parsed");
+
+  NODE_LIMITS.depth = 3;
+  ASSERT(Node_parse_lazy(bfromcstr("[ [ [ [ 1 ] ] ] msg \n"), 1) == NULL, "went past the depth limit");
+  NODE_LIMITS.depth = NODE_MAX_DEPTH;
+
+  NODE_LIMITS.width = 2;
+  ASSERT(Node_parse_lazy(bfromcstr("[ [ 1 2 3 ] msg \n"), 1) == NULL, "went past the width limit");
+  NODE_LIMITS.width = NODE_MAX_WIDTH;
+
+  // ones on the heap expand and free the same
+  d = Node_new_deferred(NULL, bfromcstr("[ 1 [ 2 inner stuff"));
+  Node_name(d, bfromcstr("stuff"));
+  out = Node_bstr(d, 1);
+  ASSERT(biseqcstr(out, "[ 1 [ 2 inner stuff \n"), "heap deferred group serializes wrong");
+  bdestroy(out);
+  Node_destroy(d);
+
+  d = Node_new_deferred(NULL, bfromcstr("[ 1 [ 2 inner ]"));
+  ASSERT(Node_expand(d) && d->type == TYPE_GROUP && d->name == NULL, "heap deferred group didn't expand");
+  ASSERT(d->child->child->value.number == 2, "heap deferred group expanded wrong");
+  Node_destroy(d);
+
+  // one that doesn't parse fails everything that walks it instead of aborting
+  d = Node_new_deferred(NULL, bfromcstr("[ 1 $ ]"));
+  ASSERT(Node_bstr(d, 1) == NULL, "bad deferred group serialized");
+  ASSERT(Node_serialized_length(d, ' ', 1) == 0, "bad deferred group has a length");
+  ASSERT(Node_binary(d, 1) == NULL, "bad deferred group encoded");
+  ASSERT(!Node_expand(d) && d->type == TYPE_DEFERRED, "bad deferred group expanded");
+  Node_destroy(d);
+}
+
+void __CUT_TAKEDOWN__ArenaTest( void ) {
+}
@@ -0,0 +1,177 @@
+/*
+ * Utu -- Saving The Internet With Hate
+ *
+ * Copyright (c) Zed A. Shaw 2005 (zedshaw@zedshaw.com)
+ *
+ * This file is modifiable/redistributable under the terms of the GNU
+ * General Public License.
+ *
+ * You should have recieved a copy of the GNU General Public License along
+ * with this program; see the file COPYING. If not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 0211-1307, USA.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cut.h"
+#include "stackish/stackish.h"
+#include "stackish/binary.h"
+
+static const char *binary_test_docs[] = {
+  "[ [ \"test this\" good [ 1234 @an:integer 345.78 @a-float '5:hello' @blob test [ 1 2 3 ] doc \n",
+  "[ [ [ [ [ [ [ [ one two three four five six seven eight \n",
+  "[ '0:' @empty '12:[ \"quoted\" ]' \"a string with ' and [ in it\" -1.5 msg \n",
+  "[ 18446744073709551615 [ ] ] \n",
+  "[ [ '4:test' chat.speak [ '11:requestedme' chat.speak [ '11:requestedme' chat.speak response \n",
+  "[ [ '3:zed' @from 12 @msgid header [ \"hi\" @to \"there\" @to chat.speak msg \n",
+  NULL
+};
+
+void __CUT_BRINGUP__BinaryTest( void ) {
+}
+
+void __CUT__Node_binary_round_trip()
+{
+  int i = 0, text_total = 0, bin_total = 0;
+  bstring text = NULL, bin = NULL, back = NULL;
+  Node *doc = NULL, *decoded = NULL;
+
+  for(i = 0; binary_test_docs[i] != NULL; i++) {
+    text = bfromcstr(binary_test_docs[i]);
+    doc = Node_parse(text);
+    ASSERT(doc != NULL, "test doc didn't parse");
+
+    bin = Node_binary(doc, 1);
+    ASSERT(Node_is_binary(bin), "no magic byte");
+    ASSERT(!Node_is_binary(text), "text looks binary");
+    ASSERT_EQUALS((size_t)blength(bin), Node_binary_length(doc, 1), "wrong binary length");
+    text_total += blength(text);
+    bin_total += blength(bin);
+
+    // it has to come back as exactly the canonical text
+    decoded = Node_parse_binary(bin);
+    ASSERT(decoded != NULL, "binary didn't parse");
+    back = Node_bstr(decoded, 1);
+    ASSERT(biseq(back, text), "binary didn't come back as the same text");
+
+    bdestroy(back); bdestroy(bin); bdestroy(text);
+    Node_destroy(decoded); Node_destroy(doc);
+  }
+
+  ASSERT(bin_total < text_total, "binary is bigger than text");
+}
+
+void __CUT__Node_binary_dictionary()
+{
+  bstring text = bfromcstr(binary_test_docs[4]);
+  Node *doc = Node_parse(text);
+  bstring bin = Node_binary(doc, 1);
+  struct tagbstring word = bsStatic("chat.speak");
+  int pos = 0, found = 0;
+
+  // the word is only spelled out the first time
+  for(pos = binstr(bin, 0, &word); pos != BSTR_ERR; pos = binstr(bin, pos + 1, &word)) found++;
+  ASSERT_EQUALS(found, 1, "repeated word wasn't a reference");
+
+  // interned words are never spelled out
+  Node_name(doc, Node_intern("msg", 3));
+  bdestroy(bin);
+  bin = Node_binary(doc, 1);
+  ASSERT_EQUALS(binstr(bin, 0, &NODE_INTERNED[0]), BSTR_ERR, "interned word was spelled out");
+
+  bdestroy(bin); bdestroy(text);
+  Node_destroy(doc);
+}
+
+void __CUT__Node_binary_view()
+{
+  bstring text = bfromcstr(binary_test_docs[2]);
+  Node *doc = Node_parse(text);
+  bstring bin = Node_binary(doc, 1);
+  bstring back = NULL;
+  Node *view = NULL, *blob = NULL;
+
+  // Node_parse_view takes either one, and blobs still point into the buffer
+  view = Node_parse_view(bin);
+  ASSERT(view != NULL && view->arena != NULL, "binary didn't parse into an arena");
+
+  for(blob = view->child; blob && blob->type != TYPE_BLOB; blob = blob->sibling);
+  ASSERT(blob != NULL, "no blob");
+  ASSERT((unsigned char *)blob->value.string->data > bin->data 
+      && (unsigned char *)blob->value.string->data < bin->data + blength(bin), "blob was copied");
+
+  back = Node_bstr(view, 1);
+  ASSERT(biseq(back, text), "view came back different");
+
+  bdestroy(back); bdestroy(text);
+  Node_destroy(view); Node_destroy(doc);
+}
+
+void __CUT__Node_binary_errors()
+{
+  bstring text = bfromcstr(binary_test_docs[0]);
+  Node *doc = Node_parse(text);
+  bstring bin = Node_binary(doc, 1);
+  bstring cut = NULL;
+  int i = 0, parsed = 0;
+  unsigned char bad_string[] = { NODE_BINARY_MAGIC, NODE_BIN_START, NODE_BIN_STRING, 3, 'a', '"', 'b', NODE_BIN_END };
+  unsigned char bad_name[] = { NODE_BINARY_MAGIC, NODE_BIN_START, NODE_BIN_NAME, 3, '1', 'a', 'b' };
+  unsigned char bad_ref[] = { NODE_BINARY_MAGIC, NODE_BIN_START, NODE_BIN_NAME_REF, 120 };
+  unsigned char bad_tag[] = { NODE_BINARY_MAGIC, NODE_BIN_START, 99, NODE_BIN_END };
+  unsigned char extra[] = { NODE_BINARY_MAGIC, NODE_BIN_START, NODE_BIN_END, NODE_BIN_START, NODE_BIN_END };
+  unsigned char no_group[] = { NODE_BINARY_MAGIC, NODE_BIN_NUMBER, 1 };
+  unsigned char *bad[] = { bad_string, bad_name, bad_ref, bad_tag, extra, no_group };
+  size_t bad_len[] = { sizeof(bad_string), sizeof(bad_name), sizeof(bad_ref), sizeof(bad_tag), sizeof(extra), sizeof(no_group) };
+  Node *got = NULL;
+
+  // every way of cutting it short fails cleanly
+  for(i = 1; i < blength(bin); i++) {
+    cut = blk2bstr(bin->data, i);
+    got = Node_parse_binary(cut);
+    if(got) { parsed++; Node_destroy(got); }
+    bdestroy(cut);
+  }
+  ASSERT_EQUALS(parsed, 0, "a cut off document parsed");
+
+  for(i = 0; i < (int)(sizeof(bad) / sizeof(bad[0])); i++) {
+    cut = blk2bstr(bad[i], bad_len[i]);
+    got = Node_parse_binary(cut);
+    if(got) { parsed++; Node_destroy(got); }
+    bdestroy(cut);
+  }
+  ASSERT_EQUALS(parsed, 0, "a bad document parsed");
+
+  bdestroy(bin); bdestroy(text);
+  Node_destroy(doc);
+}
+
+void __CUT__Node_binary_limits()
+{
+  NodeLimits saved = NODE_LIMITS;
+  bstring text = bfromcstr("[ [ [ 1 2 ] inner ] @attr [ 3 ] outer \n");
+  Node *doc = Node_parse(text);
+  bstring bin = Node_binary(doc, 1);
+  Node *got = NULL;
+
+  NODE_LIMITS.depth = 3;
+  NODE_LIMITS.width = 2;
+  got = Node_parse_binary(bin);
+  ASSERT(got != NULL, "failed at the limits");
+  Node_destroy(got);
+
+  NODE_LIMITS.depth = 2;
+  ASSERT(Node_parse_binary(bin) == NULL, "went past the depth limit");
+
+  NODE_LIMITS.depth = 3;
+  NODE_LIMITS.width = 1;
+  ASSERT(Node_parse_binary(bin) == NULL, "went past the width limit");
+
+  NODE_LIMITS = saved;
+  bdestroy(bin); bdestroy(text);
+  Node_destroy(doc);
+}
+
+void __CUT_TAKEDOWN__BinaryTest( void ) {
+}
@@ -0,0 +1,211 @@
+/*
+ * Utu -- Saving The Internet With Hate
+ *
+ * Copyright (c) Zed A. Shaw 2005 (zedshaw@zedshaw.com)
+ *
+ * This file is modifiable/redistributable under the terms of the GNU
+ * General Public License.
+ *
+ * You should have recieved a copy of the GNU General Public License along
+ * with this program; see the file COPYING. If not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 0211-1307, USA.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "cut.h"
+#include "hub/store.h"
+#include "protocol/crypto.h"
+
+#define CABAL_TEST_DB "test_cabal.db"
+
+Member *cabal_test_member(const char *fingerprint)
+{
+  Member *member = calloc(1, sizeof(Member));
+  member->fingerprint = bfromcstr(fingerprint);
+  member->key = bfromcstr(fingerprint);
+  member->name = bfromcstr("tester");
+  member->queue = MsgQueue_create(MEMBER_MSG_QUEUE_LENGTH);
+  member->routes = Heap_create(NULL);
+  member->cabals = Heap_create(NULL);
+  member->lag_limits = &MEMBER_LAG_DEFAULTS;
+  return member;
+}
+
+void __CUT_BRINGUP__CabalTest( void )
+{
+  CryptState_init();
+  unlink(CABAL_TEST_DB);
+  errno = 0;
+}
+
+void __CUT__Cabal_operations()
+{
+  Heap *cabals = Cabal_create_map();
+  Member *m1 = cabal_test_member("aaaa-1111");
+  Member *m2 = cabal_test_member("bbbb-2222");
+  Cabal *cabal = Cabal_create(bfromcstr("friends"), m1->fingerprint);
+  Message *msg = Message_alloc(NULL, NULL);
+  size_t count = 0;
+
+  Heap_add(cabals, cabal);
+  ASSERT(Cabal_find(cabals, cabal->name) == cabal, "failed to find the cabal");
+
+  // the owner can join, anyone else needs an invite which joining uses up
+  ASSERT(Cabal_is_owner(cabal, m1->fingerprint), "m1 should own it");
+  ASSERT(!Cabal_is_owner(cabal, m2->fingerprint), "m2 shouldn't own it");
+  ASSERT(Cabal_may_join(cabal, m1->fingerprint), "owner can't join");
+  ASSERT(!Cabal_may_join(cabal, m2->fingerprint), "m2 can join without an invite");
+  ASSERT(!Cabal_invite(cabal, m1->fingerprint), "invited the owner");
+  ASSERT(Cabal_invite(cabal, m2->fingerprint), "failed to invite m2");
+  ASSERT(!Cabal_invite(cabal, m2->fingerprint), "invited m2 twice");
+  ASSERT(Cabal_may_join(cabal, m2->fingerprint), "invite didn't let m2 join");
+
+  ASSERT(Cabal_enroll(cabal, m1->fingerprint), "failed to enroll m1");
+  ASSERT(!Cabal_enroll(cabal, m1->fingerprint), "enrolled m1 twice");
+  ASSERT(Cabal_enroll(cabal, m2->fingerprint), "failed to enroll m2");
+  ASSERT_EQUALS(Heap_count(cabal->invited), 0, "enroll didn't use up the invite");
+
+  // logging in binds them to every cabal they're enrolled in
+  Cabal_bind_member(cabals, m1);
+  Cabal_bind_member(cabals, m1);
+  ASSERT_EQUALS(Heap_count(cabal->members), 1, "wrong bound count");
+  ASSERT_EQUALS(Heap_count(m1->cabals), 1, "member doesn't know its cabal");
+
+  Cabal_bind_member(cabals, m2);
+  // ASSERT_EQUALS evaluates its arguments twice, so don't deliver inside it
+  count = Cabal_deliver(cabal, msg);
+  ASSERT_EQUALS(count, 2, "didn't deliver to both");
+  ASSERT_EQUALS(msg->ref_count, 2, "wrong ref count after delivery");
+
+  // logged out members stay on the roster
+  Cabal_unbind_all(m2);
+  ASSERT_EQUALS(Heap_count(cabal->members), 1, "unbind didn't remove m2");
+  ASSERT(Cabal_is_enrolled(cabal, m2->fingerprint), "unbind shouldn't touch the roster");
+  count = Cabal_deliver(cabal, msg);
+  ASSERT_EQUALS(count, 1, "delivered to an unbound member");
+
+  ASSERT(Cabal_expel(cabal, m1->fingerprint), "failed to expel m1");
+  ASSERT(!Cabal_expel(cabal, m1->fingerprint), "expelled m1 twice");
+  ASSERT(Cabal_expel(cabal, m2->fingerprint), "failed to expel m2");
+  ASSERT(!Cabal_may_join(cabal, m2->fingerprint), "expelled m2 can still join");
+  Cabal_unbind(cabal, m1);
+  ASSERT_EQUALS(Heap_count(m1->cabals), 0, "m1 still thinks it's in the cabal");
+
+  Cabal_destroy_map(cabals);
+  Member_destroy(m1);
+  Member_destroy(m2);
+}
+
+void cabal_test_schema()
+{
+  sqlite3 *db = NULL;
+
+  ASSERT(sqlite3_open(CABAL_TEST_DB, &db) == SQLITE_OK, "failed to make test db");
+  ASSERT(sqlite3_exec(db,
+        "DROP TABLE IF EXISTS hub; DROP TABLE IF EXISTS member;"
+        "DROP TABLE IF EXISTS cabal; DROP TABLE IF EXISTS cabal_member;"
+        "CREATE TABLE hub (name TEXT, key BLOB);"
+        "CREATE TABLE member (hub_id INTEGER, name TEXT, key BLOB, last_active DATETIME, mean_hate REAL, last_conn_state INTEGER);"
+        "CREATE TABLE cabal (hub_id INTEGER, name TEXT, owner TEXT);"
+        "CREATE TABLE cabal_member (cabal_id INTEGER, member_id INTEGER);",
+        NULL, NULL, NULL) == SQLITE_OK, "failed to make schema");
+  sqlite3_close(db);
+}
+
+void __CUT__Cabal_store()
+{
+  Heap *cabals = Cabal_create_map();
+  bstring hub_name = bfromcstr("testhub");
+  Member *m1 = cabal_test_member("aaaa-1111");
+  Cabal *cabal = Cabal_create(bfromcstr("friends"), m1->fingerprint);
+  Store *store = NULL;
+  bstring fp = NULL;
+
+  cabal_test_schema();
+
+  // nothing is written until the flush, and then all in one go
+  store = Store_open(CABAL_TEST_DB, hub_name);
+  ASSERT(store != NULL, "failed to open store");
+  Store_cabal_create(store, cabal);
+  Store_cabal_join(store, cabal, m1);
+  ASSERT_EQUALS(store->pending_count, 2, "writes weren't queued");
+  ASSERT(Store_flush(store), "failed to flush");
+  ASSERT_EQUALS(store->pending_count, 0, "flush didn't empty the queue");
+  ASSERT(store->pending == NULL && store->pending_last == NULL, "flush left writes behind");
+  Store_close(store);
+  Cabal_destroy(cabal);
+
+  store = Store_open(CABAL_TEST_DB, hub_name);
+  ASSERT(store != NULL, "failed to reopen store");
+  ASSERT(Store_load_cabals(store, cabals), "failed to load cabals");
+  ASSERT_EQUALS(Heap_count(cabals), 1, "wrong cabal count");
+
+  // the roster has the fingerprint of the stored key
+  cabal = Heap_first(cabals, Cabal *);
+  ASSERT(Cabal_is_owner(cabal, m1->fingerprint), "owner didn't come back");
+  fp = CryptState_fingerprint_bstr(bstrcpy(m1->key));
+  ASSERT(Cabal_is_enrolled(cabal, fp), "roster didn't come back");
+
+  // closing flushes whatever is still pending
+  Store_cabal_leave(store, cabal, m1);
+  Store_close(store);
+  Cabal_destroy_map(cabals);
+
+  cabals = Cabal_create_map();
+  store = Store_open(CABAL_TEST_DB, hub_name);
+  ASSERT(Store_load_cabals(store, cabals), "failed to load cabals");
+  cabal = Heap_first(cabals, Cabal *);
+  ASSERT(!Cabal_is_enrolled(cabal, fp), "leave wasn't saved");
+
+  Store_close(store);
+  Cabal_destroy_map(cabals);
+  Member_destroy(m1);
+  bdestroy(fp);
+  bdestroy(hub_name);
+}
+
+void __CUT__Cabal_store_bad_rows()
+{
+  Heap *cabals = Cabal_create_map();
+  bstring hub_name = bfromcstr("testhub");
+  Member *m1 = cabal_test_member("aaaa-1111");
+  Cabal *cabal = Cabal_create(bfromcstr("friends"), NULL);
+  Store *store = NULL;
+
+  cabal_test_schema();
+
+  store = Store_open(CABAL_TEST_DB, hub_name);
+  ASSERT(store != NULL, "failed to open store");
+  Store_cabal_create(store, cabal);
+  Store_cabal_join(store, cabal, m1);
+  ASSERT(Store_flush(store), "failed to flush");
+
+  // a nameless cabal, a second "friends", and a member of a cabal that's gone
+  ASSERT(sqlite3_exec(store->db,
+        "INSERT INTO cabal (hub_id, name) VALUES (1, NULL);"
+        "INSERT INTO cabal (hub_id, name) VALUES (1, 'friends');"
+        "INSERT INTO cabal (hub_id, name) VALUES (1, 'gone');"
+        "INSERT INTO cabal_member (cabal_id, member_id) SELECT rowid, 1 FROM cabal WHERE name = 'gone';"
+        "UPDATE cabal SET name = NULL WHERE name = 'gone';",
+        NULL, NULL, NULL) == SQLITE_OK, "failed to add bad rows");
+  errno = 0;
+
+  ASSERT(Store_load_cabals(store, cabals), "bad rows failed the load");
+  ASSERT_EQUALS(Heap_count(cabals), 1, "bad cabals weren't skipped");
+  ASSERT(Heap_first(cabals, Cabal *)->owner == NULL, "cabal without an owner got one");
+  ASSERT_EQUALS(Heap_count(Heap_first(cabals, Cabal *)->roster), 1, "good member row was lost");
+
+  Store_close(store);
+  Cabal_destroy(cabal);
+  Cabal_destroy_map(cabals);
+  Member_destroy(m1);
+  bdestroy(hub_name);
+}
+
+void __CUT_TAKEDOWN__CabalTest( void )
+{
+  unlink(CABAL_TEST_DB);
+}
@@ -93,6 +93,235 @@ void __CUT__Member_login_send_logout()
   ASSERT(global_members == NULL, "global member map not destroyed");
 }
 
+void member_detacher(void *data)
+{
+  int i = 0;
+  Peer *peer = (Peer *)data;
+  Member *m1 = NULL, *m2 = NULL;
+
+  m1 = Member_login(&global_members, peer);
+  ASSERT(m1 != NULL, "failed to login member");
+
+  for(i = 0; i < 3; i++) {
+    Message *msg = Message_alloc(NULL, NULL);
+    msg->msgid = i;
+    ASSERT(Member_send_msg(m1, msg), "Failed to send msg");
+  }
+
+  ASSERT(Member_login(&global_members, peer) == NULL, "logged in the same key twice");
+
+  Member_detach(m1);
+  ASSERT(Member_is_detached(m1), "member should be detached");
+  ASSERT(!Member_is_expired(m1, m1->detached_at), "shouldn't be expired right away");
+  ASSERT(Member_is_expired(m1, m1->detached_at + MEMBER_DETACH_GRACE + 1), "should be expired after grace");
+
+  // messages sent while they are gone still queue up
+  ASSERT(Member_send_msg(m1, Message_alloc(NULL, NULL)), "Failed to send msg to detached");
+
+  m2 = Member_login(&global_members, peer);
+  ASSERT(m2 == m1, "didn't resume the same member");
+  ASSERT(!Member_is_detached(m2), "member should be attached again");
+  ASSERT(MsgQueue_count(m2->queue) == 4, "lost queued messages on resume");
+  ASSERT(Member_first_msg(m2)->msgid == 0, "wrong first message on resume");
+
+  // evicted while they were gone, so there's nothing to come back to
+  Member_detach(m2);
+  Member_evict(m2);
+  ASSERT(Member_login(&global_members, peer) == NULL, "resumed an evicted member");
+
+  Member_logout(&global_members, m2);
+}
+
+void __CUT__Member_detach_resume()
+{
+  bstring name = bfromcstr("testname");
+  CryptState *state = CryptState_create(name, NULL);
+  state->them = state->me;
+
+  Peer *peer = Peer_create(state, 0, simple_key_confirm);
+  ASSERT(peer != NULL, "failed to make peer");
+
+  taskdispatch(member_detacher, peer, 32*1024);
+
+  memset(&state->them, 0, sizeof(state->them));
+  Peer_destroy(peer, 1);
+  bdestroy(name);
+
+  if(global_members) Member_destroy_map(&global_members);
+}
+
+void __CUT__MemberIndex_grow()
+{
+  MemberIndex *index = MemberIndex_create();
+  size_t count = MEMBER_INDEX_BUCKETS * MEMBER_INDEX_LOAD * 4;
+  Member *members = calloc(count, sizeof(Member));
+  size_t i = 0, found = 0;
+
+  for(i = 0; i < count; i++) {
+    members[i].fingerprint = bformat("%04zx-%04zx", i, i * 7);
+    MemberIndex_add(index, &members[i]);
+  }
+
+  ASSERT(index->count == count, "wrong count after adding");
+  ASSERT(index->size > MEMBER_INDEX_BUCKETS && index->count <= index->size * MEMBER_INDEX_LOAD, "didn't grow");
+
+  for(i = 0; i < count; i++) {
+    if(MemberIndex_find(index, members[i].fingerprint) == &members[i]) found++;
+  }
+  ASSERT(found == count, "lost members when it grew");
+
+  for(i = 0; i < count; i++) {
+    MemberIndex_remove(index, &members[i]);
+    bdestroy(members[i].fingerprint);
+  }
+  ASSERT(index->count == 0, "wrong count after removing");
+
+  MemberIndex_destroy(index);
+  free(members);
+}
+
+void __CUT__MemberDetachList()
+{
+  MemberDetachList list = {NULL, NULL};
+  Member m1, m2, m3;
+
+  memset(&m1, 0, sizeof(Member));
+  memset(&m2, 0, sizeof(Member));
+  memset(&m3, 0, sizeof(Member));
+
+  MemberDetachList_push(&list, &m1);
+  MemberDetachList_push(&list, &m2);
+  MemberDetachList_push(&list, &m3);
+  MemberDetachList_push(&list, &m2);
+  ASSERT(list.first == &m1 && list.last == &m3, "not in the order they detached");
+  ASSERT(m1.detached_next == &m2 && m2.detached_next == &m3, "pushing twice moved it");
+
+  MemberDetachList_remove(&list, &m2);
+  ASSERT(!MemberDetachList_has(&list, &m2), "removed member still in the list");
+  ASSERT(m1.detached_next == &m3 && m3.detached_prev == &m1, "removing from the middle broke the list");
+
+  // removing someone who isn't in it does nothing
+  MemberDetachList_remove(&list, &m2);
+  MemberDetachList_remove(&list, &m1);
+  ASSERT(list.first == &m3 && list.last == &m3, "removing the first broke the list");
+
+  MemberDetachList_remove(&list, &m3);
+  ASSERT(list.first == NULL && list.last == NULL, "list isn't empty");
+}
+
+void __CUT__Member_index()
+{
+  bstring name = bfromcstr("testname");
+  CryptState *state1 = CryptState_create(name, NULL);
+  CryptState *state2 = CryptState_create(name, NULL);
+  state1->them = state1->me;
+  state2->them = state2->me;
+
+  Peer *peer1 = Peer_create(state1, 0, simple_key_confirm);
+  Peer *peer2 = Peer_create(state2, 0, simple_key_confirm);
+  Member *m1 = Member_create(peer1);
+  Member *m2 = Member_create(peer2);
+  MemberIndex *index = MemberIndex_create();
+
+  ASSERT(bstrcmp(m1->fingerprint, m2->fingerprint) != 0, "different keys got the same fingerprint");
+
+  MemberIndex_add(index, m1);
+  MemberIndex_add(index, m2);
+  MemberIndex_add(index, m1);
+  ASSERT(index->count == 2, "adding twice should be ignored");
+
+  ASSERT(MemberIndex_find(index, m1->fingerprint) == m1, "didn't find m1");
+  ASSERT(MemberIndex_find(index, m2->fingerprint) == m2, "didn't find m2");
+
+  MemberIndex_remove(index, m1);
+  ASSERT(MemberIndex_find(index, m1->fingerprint) == NULL, "found m1 after remove");
+  ASSERT(MemberIndex_find(index, m2->fingerprint) == m2, "lost m2 after removing m1");
+  ASSERT(index->count == 1, "wrong count after remove");
+
+  MemberIndex_destroy(index);
+  Member_destroy(m1);
+  Member_destroy(m2);
+
+  memset(&state1->them, 0, sizeof(state1->them));
+  memset(&state2->them, 0, sizeof(state2->them));
+  Peer_destroy(peer1, 1);
+  Peer_destroy(peer2, 1);
+  bdestroy(name);
+}
+
+void __CUT__Member_lag()
+{
+  bstring name = bfromcstr("testname");
+  CryptState *state = CryptState_create(name, NULL);
+  MemberLagCounts before = Member_lag_counts;
+  MemberLagLimits limits = {
+    .warn_depth = 1000, .degrade_bytes = 150, .degrade_sample = 2, .evict_bytes = 1000
+  };
+  int i = 0;
+  state->them = state->me;
+
+  Peer *peer = Peer_create(state, 0, simple_key_confirm);
+  Member *member = Member_create(peer);
+  Message *small = Message_alloc(NULL, NULL);
+  Message *big = Message_alloc(NULL, NULL);
+  small->size = 60;
+  big->size = 1000;
+  member->lag_limits = &limits;
+
+  for(i = 0; i < 3; i++) {
+    ASSERT(Member_send_msg(member, small), "failed to send before degrading");
+  }
+  ASSERT(member->lag.bytes_pending == 180, "wrong bytes pending");
+
+  // over degrade_bytes so after the sweep only every other one gets through
+  ASSERT(member->lag.state == MEMBER_LAG_OK, "sends shouldn't change the lag state");
+  ASSERT(Member_lag_check(member, time(NULL)) == MEMBER_LAG_DEGRADED, "should be degraded");
+  ASSERT(Member_send_msg(member, small), "first degraded send should go");
+  ASSERT(!Member_send_msg(member, small), "second degraded send should be sampled out");
+  ASSERT(Member_send_msg(member, small), "third degraded send should go");
+  ASSERT(Member_lag_counts.degraded == before.degraded + 1, "degraded not counted");
+  ASSERT(Member_lag_counts.sampled_out == before.sampled_out + 1, "sampled out not counted");
+
+  // catching up gets them back to full delivery
+  for(i = 0; i < 4; i++) {
+    ASSERT(Member_delete_msg(member), "failed to delete");
+  }
+  ASSERT(member->lag.bytes_pending == 60, "bytes pending not reduced by delete");
+  ASSERT(Member_lag_check(member, time(NULL)) != MEMBER_LAG_DEGRADED, "still degraded after catching up");
+  ASSERT(Member_lag_counts.recovered == before.recovered + 1, "recovery not counted");
+  ASSERT(Member_send_msg(member, small), "send after catching up failed");
+
+  // over evict_bytes and they're gone for good
+  ASSERT(Member_send_msg(member, big), "big send failed");
+  ASSERT(Member_lag_check(member, time(NULL)) == MEMBER_LAG_EVICTED, "should be evicted");
+  ASSERT(!Member_send_msg(member, small), "send to an evicted member worked");
+  ASSERT(!Member_send_msg(member, small), "send to an evicted member worked");
+  ASSERT(Member_is_evicted(member), "member should be evicted");
+  ASSERT(Member_lag_counts.evicted == before.evicted + 1, "eviction not counted once");
+
+  // the sweep finds a queue that only got old, with nothing new sent to them
+  member->lag.state = MEMBER_LAG_OK;
+  limits.evict_bytes = 0;
+  limits.evict_age = 10;
+  ASSERT(Member_lag_check(member, time(NULL)) != MEMBER_LAG_EVICTED, "evicted before the queue got old");
+  ASSERT(Member_lag_check(member, time(NULL) + 10) == MEMBER_LAG_EVICTED, "old queue didn't evict");
+  ASSERT(Member_lag_counts.evicted == before.evicted + 2, "sweep eviction not counted");
+
+  // nobody reads a detached member's queue, so it only gets old once they're back
+  member->lag.state = MEMBER_LAG_OK;
+  limits.degrade_bytes = 0;
+  member->peer = NULL;
+  ASSERT(Member_lag_check(member, time(NULL) + 60) == MEMBER_LAG_OK, "detached member's lag wasn't frozen");
+  member->peer = peer;
+  member->attached_at = time(NULL);
+  ASSERT(Member_lag_check(member, member->attached_at + 5) == MEMBER_LAG_OK, "backlog aged from before they reattached");
+  ASSERT(Member_lag_check(member, member->attached_at + 10) == MEMBER_LAG_EVICTED, "reattached backlog never aged");
+
+  Member_destroy(member);
+  memset(&state->them, 0, sizeof(state->them));
+  Peer_destroy(peer, 1);
+  bdestroy(name);
+}
 
 void __CUT_TAKEDOWN__Member( void ) 
 {
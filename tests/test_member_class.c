@@ -0,0 +1,116 @@
+/*
+ * Utu -- Saving The Internet With Hate
+ *
+ * Copyright (c) Zed A. Shaw 2005 (zedshaw@zedshaw.com)
+ *
+ * This file is modifiable/redistributable under the terms of the GNU
+ * General Public License.
+ *
+ * You should have recieved a copy of the GNU General Public License along
+ * with this program; see the file COPYING. If not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 0211-1307, USA.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "cut.h"
+#include "hub/member.h"
+
+#define CLASS_TEST_FILE "test_member_class.conf"
+
+void __CUT_BRINGUP__MemberClassTest( void )
+{
+  FILE *out = fopen(CLASS_TEST_FILE, "w");
+  fputs("# test classes\n"
+      "\n"
+      "class default 10 20 1000 2000\n"
+      "class bulk 0 0 0 0\n"
+      "lag bulk 20 10 1048576 2 60 4194304\n"
+      "member bulk aaaa-1111\n", out);
+  fclose(out);
+  errno = 0;
+}
+
+void __CUT__TokenBucket_limits()
+{
+  TokenBucket bucket;
+
+  TokenBucket_init(&bucket, 10, 2, 1000);
+  ASSERT_EQUALS(TokenBucket_wait(&bucket, 1000), 0, "full bucket should not wait");
+  TokenBucket_take(&bucket, 2);
+  ASSERT_EQUALS(TokenBucket_wait(&bucket, 1000), 0, "empty but not in debt should not wait");
+
+  // big takes go into debt and make the next one wait it off at 10/sec
+  TokenBucket_take(&bucket, 5);
+  ASSERT(TokenBucket_wait(&bucket, 1000) >= 500, "debt didn't make it wait");
+  ASSERT_EQUALS(TokenBucket_wait(&bucket, 1500), 0, "didn't refill over time");
+
+  // never fills past burst
+  ASSERT_EQUALS(TokenBucket_wait(&bucket, 100000), 0, "refill failed");
+  ASSERT(bucket.tokens <= bucket.burst, "filled past burst");
+
+  // rate 0 is no limit
+  TokenBucket_init(&bucket, 0, 0, 1000);
+  TokenBucket_take(&bucket, 1000000);
+  ASSERT_EQUALS(TokenBucket_wait(&bucket, 1000), 0, "unlimited bucket made it wait");
+}
+
+void __CUT__MemberClass_load()
+{
+  Heap *classes = MemberClass_create_map();
+  struct tagbstring fp = bsStatic("aaaa-1111");
+  struct tagbstring other = bsStatic("bbbb-2222");
+  MemberClass *bulk = NULL;
+  MemberClass *def = NULL;
+
+  // nobody is limited until the class file says so
+  def = MemberClass_for(classes, &other);
+  ASSERT(def->msgs_rate == 0 && def->bytes_rate == 0, "default class has a limit before loading");
+
+  ASSERT(MemberClass_load(classes, CLASS_TEST_FILE), "failed to load classes");
+  ASSERT_EQUALS(Heap_count(classes), 2, "wrong class count");
+  ASSERT(!MemberClass_load(classes, "does_not_exist.conf"), "loaded a missing file");
+  errno = 0;
+
+  bulk = MemberClass_for(classes, &fp);
+  def = MemberClass_for(classes, &other);
+  ASSERT(biseqcstr(bulk->name, "bulk"), "member didn't get their class");
+  ASSERT(biseqcstr(def->name, MEMBER_CLASS_DEFAULT), "unlisted member didn't get default");
+  ASSERT(def->msgs_rate == 10 && def->bytes_burst == 2000, "default class not changed");
+  ASSERT(bulk->lag.degrade_sample == 2 && bulk->lag.evict_age == 60, "lag line not loaded");
+
+  MemberClass_destroy_map(classes);
+}
+
+void __CUT__Member_throttle()
+{
+  Heap *classes = MemberClass_create_map();
+  Member member;
+  MemberClass *def = NULL;
+  uint64_t wait = 0;
+
+  memset(&member, 0, sizeof(member));
+  ASSERT(MemberClass_load(classes, CLASS_TEST_FILE), "failed to load classes");
+  def = MemberClass_for(classes, NULL);
+
+  Member_set_class(&member, def);
+  ASSERT(member.lag_limits == &def->lag, "lag limits not from the class");
+
+  // burst of 20 messages goes through, then the 2000 byte burst runs out
+  wait = Member_throttle(&member, 10);
+  ASSERT_EQUALS(wait, 0, "first message throttled");
+  wait = Member_throttle(&member, 2500);
+  ASSERT_EQUALS(wait, 0, "in burst message throttled");
+  wait = Member_throttle(&member, 10);
+  ASSERT(wait > 0, "byte debt didn't throttle");
+
+  MemberClass_destroy_map(classes);
+}
+
+void __CUT_TAKEDOWN__MemberClassTest( void )
+{
+  unlink(CLASS_TEST_FILE);
+}
@@ -15,6 +15,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 #include "cut.h"
 #include "protocol/message.h"
 
@@ -38,7 +39,110 @@ void __CUT__Message_cons_decons()
   }
 }
 
+void __CUT__Message_raw()
+{
+  Node *hdr = NULL;
+  Node *data = Node_cons("[bbw", bfromcstr("data1"), bfromcstr("data2"), "chat.speak");
+  Node *body = Message_cons(&hdr, 4L, data, "msg");
+  bstring raw = Node_bstr(body, 1);
+  bstring bytes = NULL;
+
+  Message *msg = Message_decons(hdr, body);
+  Message_ref_inc(msg);
+  msg->raw = bstrcpy(raw);
+
+  // the raw bytes are the same thing as the body
+  bytes = Node_bstr(msg->body, 1);
+  ASSERT(biseq(bytes, msg->raw), "raw doesn't match the body");
+  bdestroy(bytes);
+
+  Message_changed(msg);
+  ASSERT(msg->raw == NULL, "changing didn't drop raw");
+  Message_changed(msg);
+
+  // serialized once and then cached
+  bytes = Message_bytes(msg);
+  ASSERT(bytes != NULL, "failed to serialize");
+  ASSERT(bytes == msg->raw, "serialization wasn't cached");
+  ASSERT(Message_bytes(msg) == bytes, "serialized twice");
+  ASSERT(biseq(bytes, raw), "cached bytes don't match the body");
+
+  // the binary form is made once too, and doesn't touch the text
+  bytes = Message_bytes_as(msg, NODE_CODEC_BINARY);
+  ASSERT(Node_is_binary(bytes), "binary bytes aren't binary");
+  ASSERT(bytes == msg->bin, "binary wasn't cached");
+  ASSERT(Message_bytes_as(msg, NODE_CODEC_BINARY) == bytes, "encoded binary twice");
+  ASSERT(Message_bytes_as(msg, NODE_CODEC_TEXT) == msg->raw, "binary changed the text");
+
+  Message_changed(msg);
+  ASSERT(msg->raw == NULL && msg->bin == NULL, "changing didn't drop both forms");
+
+  Message_destroy(msg);
+  bdestroy(raw);
+}
+
+void __CUT__Message_alloc_raw()
+{
+  Node *data = Node_cons("[bbw", bfromcstr("data1"), bfromcstr("data2"), "chat.speak");
+  Node *body = Node_cons("[Gw", data, "rpy");
+  bstring raw = Node_bstr(body, 1);
+  bstring bytes = NULL;
+  Node *decoded = NULL;
+  bstring text = NULL;
+
+  Message *msg = Message_alloc_raw(Message_cons_header(0), bstrcpy(raw));
+  Message_ref_inc(msg);
 
+  ASSERT(msg->body == NULL && msg->data == NULL, "raw message has a body");
+  ASSERT(Message_bytes(msg) == msg->raw, "didn't send raw as is");
+
+  // the binary form comes from raw, and decodes to the same body
+  bytes = Message_bytes_as(msg, NODE_CODEC_BINARY);
+  ASSERT(bytes != NULL && Node_is_binary(bytes), "failed to make binary from raw");
+  decoded = Node_parse_binary(bytes);
+  ASSERT(decoded != NULL, "failed to decode the binary");
+  text = Node_bstr(decoded, 1);
+  ASSERT(biseq(text, raw), "binary isn't the same body");
+
+  bdestroy(text);
+  Node_destroy(decoded);
+  Node_destroy(body);
+  Message_destroy(msg);
+  bdestroy(raw);
+}
+
+#define MESSAGE_TEST_REFS 100000
+
+void *message_ref_thread(void *data)
+{
+  Message *msg = (Message *)data;
+  int i = 0;
+
+  for(i = 0; i < MESSAGE_TEST_REFS; i++) Message_ref_inc(msg);
+  for(i = 0; i < MESSAGE_TEST_REFS; i++) Message_ref_dec(msg);
+
+  return NULL;
+}
+
+void __CUT__Message_ref_count()
+{
+  Message *msg = Message_alloc(NULL, NULL);
+  pthread_t threads[4];
+  int i = 0;
+
+  // more references than a short could hold, like a big broadcast
+  for(i = 0; i < MESSAGE_TEST_REFS; i++) Message_ref_inc(msg);
+  ASSERT_EQUALS(msg->ref_count, MESSAGE_TEST_REFS, "ref count overflowed");
+
+  // other threads sharing it don't lose counts
+  for(i = 0; i < 4; i++) pthread_create(&threads[i], NULL, message_ref_thread, msg);
+  for(i = 0; i < 4; i++) pthread_join(threads[i], NULL);
+  ASSERT_EQUALS(msg->ref_count, MESSAGE_TEST_REFS, "threads lost ref counts");
+
+  for(i = 0; i < MESSAGE_TEST_REFS - 1; i++) Message_destroy(msg);
+  ASSERT_EQUALS(msg->ref_count, 1, "destroy didn't drop refs");
+  Message_destroy(msg);
+}
 
 void __CUT_TAKEDOWN__MessageTest( void ) {
 }
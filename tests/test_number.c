@@ -0,0 +1,155 @@
+/*
+ * Utu -- Saving The Internet With Hate
+ *
+ * Copyright (c) Zed A. Shaw 2005 (zedshaw@zedshaw.com)
+ *
+ * This file is modifiable/redistributable under the terms of the GNU
+ * General Public License.
+ *
+ * You should have recieved a copy of the GNU General Public License along
+ * with this program; see the file COPYING. If not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 0211-1307, USA.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <errno.h>
+#include "cut.h"
+#include "stackish/stackish.h"
+#include "stackish/number.h"
+
+void __CUT_BRINGUP__NumberTest( void ) {
+}
+
+/** Formats floating and checks it's expect, or just its length if expect is NULL. */
+static int number_test_format(double floating, const char *expect, size_t length)
+{
+  char buf[STACKISH_FLOAT_MAX];
+  size_t got = Stackish_float_format(buf, floating);
+
+  buf[got] = '\0';
+  if(expect) return got == strlen(expect) && !strcmp(buf, expect);
+  return got == length;
+}
+
+void __CUT__Stackish_float_format()
+{
+  ASSERT(number_test_format(1e-9, "0.000000001", 0), "1e-9 lost its digits");
+  ASSERT(number_test_format(345.78, "345.78", 0), "wrong 345.78");
+  ASSERT(number_test_format(0.1, "0.1", 0), "wrong 0.1");
+  ASSERT(number_test_format(-1.5, "-1.5", 0), "wrong -1.5");
+  ASSERT(number_test_format(100.0, "100.0", 0), "wrong 100.0");
+  ASSERT(number_test_format(1e20, "100000000000000000000.0", 0), "wrong 1e20");
+  ASSERT(number_test_format(1.0 / 3.0, "0.3333333333333333", 0), "wrong 1/3");
+  ASSERT(number_test_format(0.0, "0.0", 0), "wrong 0.0");
+  ASSERT(number_test_format(-0.0, "-0.0", 0), "wrong -0.0");
+
+  // the longest ones still fit
+  ASSERT(number_test_format(DBL_MAX, NULL, 311), "wrong length for DBL_MAX");
+  ASSERT(number_test_format(-4.9406564584124654e-324, NULL, 327), "wrong length for the smallest subnormal");
+}
+
+void __CUT__Stackish_float_round_trip()
+{
+  uint64_t seed = 88172645463325252ULL, bits = 0;
+  char buf[STACKISH_FLOAT_MAX];
+  double floating = 0, back = 0;
+  size_t length = 0;
+  int i = 0, wrong = 0;
+
+  for(i = 0; i < 100000; i++) {
+    seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;
+    bits = seed;
+    memcpy(&floating, &bits, sizeof(floating));
+    // every bit pattern but the infinities and NaNs
+    if(((bits >> 52) & 0x7FF) == 0x7FF) continue;
+
+    length = Stackish_float_format(buf, floating);
+    buf[length] = '\0';
+    if(!Stackish_float_parse(buf, length, &back) || memcmp(&back, &floating, sizeof(back))) wrong++;
+    if(strtod(buf, NULL) != floating) wrong++;
+  }
+
+  ASSERT_EQUALS(wrong, 0, "floats didn't round trip");
+  // strtod sets ERANGE for the tiny ones, and that fails every check() after
+  errno = 0;
+}
+
+void __CUT__Stackish_float_parse()
+{
+  const char *good[] = { "345.78", "-1.5", "+0.25", "0.000000001", "123456789012345678901234.5",
+    "0.30000000000000004", "9007199254740993.0", "1.7976931348623157", "100000000000000000000.0", NULL };
+  const char *bad[] = { "", "1", "1.", ".5", "-.5", "1.2.3", "1.5x", "--1.5", "1e5", NULL };
+  bstring huge = bfromcstr("1");
+  double floating = 0;
+  int i = 0, parsed = 0;
+
+  for(i = 0; good[i] != NULL; i++) {
+    ASSERT(Stackish_float_parse(good[i], strlen(good[i]), &floating), "didn't parse a good float");
+    ASSERT(floating == strtod(good[i], NULL), "float isn't the same as strtod");
+  }
+
+  for(i = 0; bad[i] != NULL; i++) {
+    parsed += Stackish_float_parse(bad[i], strlen(bad[i]), &floating);
+  }
+  ASSERT_EQUALS(parsed, 0, "parsed a bad float");
+
+  // bigger than DBL_MAX, and the tiniest float written out in full
+  for(i = 0; i < 400; i++) bconchar(huge, '0');
+  bcatcstr(huge, ".0");
+  parsed = Stackish_float_parse((const char *)bdata(huge), blength(huge), &floating);
+  ASSERT_EQUALS(parsed, 0, "parsed a float that's too big");
+  btrunc(huge, 0);
+  bcatcstr(huge, "0.");
+  for(i = 0; i < 323; i++) bconchar(huge, '0');
+  bcatcstr(huge, "5");
+  ASSERT(Stackish_float_parse((const char *)bdata(huge), blength(huge), &floating) && floating == 4.9406564584124654e-324, "wrong tiniest float");
+  ASSERT_EQUALS(errno, 0, "left errno set");
+  bdestroy(huge);
+
+  // only the token's length is read, there's no \0 needed
+  ASSERT(Stackish_float_parse("2.5000", 3, &floating) && floating == 2.5, "read past the length");
+}
+
+void __CUT__Stackish_number_parse()
+{
+  uint64_t number = 0;
+  int rc = 0;
+
+  ASSERT(Stackish_number_parse("0", 1, &number) && number == 0, "wrong 0");
+  ASSERT(Stackish_number_parse("1234567890", 10, &number) && number == 1234567890ULL, "wrong 1234567890");
+  ASSERT(Stackish_number_parse("18446744073709551615", 20, &number) && number == 18446744073709551615ULL, "wrong max");
+  ASSERT(Stackish_number_parse("12345", 3, &number) && number == 123, "read past the length");
+
+  rc = Stackish_number_parse("18446744073709551616", 20, &number);
+  ASSERT_EQUALS(rc, 0, "parsed a number that wraps");
+  rc = Stackish_number_parse("", 0, &number) + Stackish_number_parse("12a", 3, &number) + Stackish_number_parse("-1", 2, &number);
+  ASSERT_EQUALS(rc, 0, "parsed a bad number");
+}
+
+void __CUT__Stackish_number_documents()
+{
+  bstring doc = bfromcstr("[ 0.000000001 345.780000 -0.0 18446744073709551615 floats \n");
+  bstring over = bfromcstr("[ 18446744073709551616 numbers \n");
+  bstring out = NULL;
+  Node *parsed = NULL;
+
+  parsed = Node_parse(doc);
+  ASSERT(parsed != NULL, "failed to parse");
+  out = Node_bstr(parsed, 1);
+  ASSERT(biseqcstr(out, "[ 0.000000001 345.78 -0.0 18446744073709551615 floats \n"), "didn't come out the same");
+  ASSERT_EQUALS(Node_serialized_length(parsed, ' ', 1) + 1, (size_t)blength(out), "wrong length");
+  Node_destroy(parsed);
+
+  ASSERT(Node_parse(over) == NULL, "parsed a number that wraps");
+
+  bdestroy(out);
+  bdestroy(over);
+  bdestroy(doc);
+}
+
+void __CUT_TAKEDOWN__NumberTest( void ) {
+}
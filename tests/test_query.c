@@ -0,0 +1,148 @@
+/*
+ * Utu -- Saving The Internet With Hate
+ *
+ * Copyright (c) Zed A. Shaw 2005 (zedshaw@zedshaw.com)
+ *
+ * This file is modifiable/redistributable under the terms of the GNU
+ * General Public License.
+ *
+ * You should have recieved a copy of the GNU General Public License along
+ * with this program; see the file COPYING. If not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 0211-1307, USA.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cut.h"
+#include "stackish/stackish.h"
+#include "stackish/query.h"
+
+static const char *query_test_doc =
+  "[ [ [ [ \"hi\" text \"bf27-3806\" @to send member [ 3 route [ 4 route msg \n";
+
+void __CUT_BRINGUP__QueryTest( void ) {
+}
+
+void __CUT__NodeQuery_compile()
+{
+  const char *bad[] = { "", "msg/", "/msg", "msg//send", "1msg", "msg/@", "msg/$", "msg/**", "msg/se nd",
+    "a/b/c/d/e/f/g/h/i/j/k/l/m/n/o/p/q", NULL };
+  NodeQuery *query = NodeQuery_compile("msg/$member/send/$@to");
+  NodeQuery *shared = NULL;
+  int i = 0, compiled = 0;
+
+  ASSERT(query != NULL, "failed to compile");
+  ASSERT_EQUALS(query->count, 4, "wrong step count");
+  ASSERT_EQUALS(query->captures, 2, "wrong capture count");
+  ASSERT(Node_is_interned(query->steps[0].word), "didn't intern msg");
+  ASSERT(biseqcstr(query->steps[3].word, "@to"), "wrong attribute step");
+  NodeQuery_destroy(query);
+
+  for(i = 0; bad[i] != NULL; i++) {
+    query = NodeQuery_compile(bad[i]);
+    if(query) { compiled++; NodeQuery_destroy(query); }
+  }
+  ASSERT_EQUALS(compiled, 0, "compiled a bad path");
+
+  query = NodeQuery_once(shared, "msg/*");
+  ASSERT(query == shared, "once didn't install the query");
+  ASSERT(NodeQuery_once(shared, "other") == query, "once compiled it again");
+  NodeQuery_destroy(shared);
+}
+
+void __CUT__NodeQuery_matching()
+{
+  bstring text = bfromcstr(query_test_doc);
+  Node *doc = Node_parse(text);
+  NodeQuery *query = NULL;
+  NodeQueryCursor cursor;
+  Node *found[8] = {NULL};
+  Node *n = NULL;
+
+  ASSERT(doc != NULL, "failed to parse the test doc");
+
+  query = NodeQuery_compile("msg/member/send/@to");
+  n = NodeQuery_first(query, doc);
+  ASSERT(n != NULL && n->type == TYPE_STRING, "didn't find @to");
+  ASSERT(biseqcstr(n->value.string, "bf27-3806"), "wrong @to");
+  NodeQuery_destroy(query);
+
+  // the route that's linked first has no send, so it has to back up and try member
+  query = NodeQuery_compile("msg/*/send/text/*");
+  n = NodeQuery_first(query, doc);
+  ASSERT(n != NULL && biseqcstr(n->value.string, "hi"), "didn't back up to find the text");
+
+  // anchored takes the first route and doesn't back up when it has no send
+  ASSERT(NodeQuery_anchored(query, doc) == NULL, "anchored backed up to member");
+  NodeQuery_destroy(query);
+
+  query = NodeQuery_compile("*/*/*");
+  n = NodeQuery_anchored(query, doc);
+  ASSERT(n != NULL && n == doc->child->child, "anchored isn't the first child's first child");
+  ASSERT(NodeQuery_anchored(query, doc->child->child) == NULL, "anchored went past a node with no children");
+  ASSERT(NodeQuery_anchored(query, NULL) == NULL, "anchored matched a NULL tree");
+  NodeQuery_destroy(query);
+
+  // it still looks past siblings that don't match, it just never comes back to them
+  query = NodeQuery_compile("msg/member/send/@to");
+  n = NodeQuery_anchored(query, doc);
+  ASSERT(n != NULL && biseqcstr(n->value.string, "bf27-3806"), "anchored didn't find @to");
+  NodeQuery_destroy(query);
+
+  // in linked order, the last one pushed comes first
+  query = NodeQuery_compile("msg/route/*");
+  ASSERT_EQUALS(NodeQuery_all(query, doc, found, 8), 2, "wrong number of route values");
+  ASSERT(found[0]->value.number == 4 && found[1]->value.number == 3, "wrong route values");
+  ASSERT_EQUALS(NodeQuery_all(query, doc, found, 1), 1, "went past max");
+  NodeQuery_destroy(query);
+
+  query = NodeQuery_compile("msg/*");
+  ASSERT_EQUALS(NodeQuery_all(query, doc, found, 8), 3, "wrong number of children");
+  NodeQuery_destroy(query);
+
+  // one step only ever matches the root once
+  query = NodeQuery_compile("msg");
+  NodeQuery_start(&cursor, query, doc);
+  ASSERT(NodeQuery_next(&cursor) == doc, "didn't match the root");
+  ASSERT(NodeQuery_next(&cursor) == NULL, "matched the root twice");
+  ASSERT(NodeQuery_next(&cursor) == NULL, "didn't stay done");
+  NodeQuery_destroy(query);
+
+  query = NodeQuery_compile("rpy/*");
+  ASSERT(NodeQuery_first(query, doc) == NULL, "matched the wrong root");
+  ASSERT(NodeQuery_first(query, NULL) == NULL, "matched a NULL tree");
+  NodeQuery_destroy(query);
+
+  query = NodeQuery_compile("msg/member/send/nothing");
+  ASSERT(NodeQuery_first(query, doc) == NULL, "found something that isn't there");
+  NodeQuery_destroy(query);
+
+  Node_destroy(doc);
+  bdestroy(text);
+}
+
+void __CUT__NodeQuery_bind()
+{
+  bstring text = bfromcstr(query_test_doc);
+  Node *doc = Node_parse(text);
+  NodeQuery *query = NodeQuery_compile("$msg/$member/send/$@to");
+  Node *msg = NULL, *member = NULL, *to = NULL;
+
+  ASSERT(NodeQuery_bind(query, doc, &msg, &member, &to), "failed to bind");
+  ASSERT(msg == doc, "wrong root");
+  ASSERT(member && biseqcstr(member->name, "member"), "wrong member");
+  ASSERT(to && biseqcstr(to->value.string, "bf27-3806"), "wrong to");
+
+  msg = member = to = NULL;
+  ASSERT(!NodeQuery_bind(query, doc->child, &msg, &member, &to), "bound the wrong tree");
+  ASSERT(msg == NULL && member == NULL && to == NULL, "set captures without a match");
+
+  NodeQuery_destroy(query);
+  Node_destroy(doc);
+  bdestroy(text);
+}
+
+void __CUT_TAKEDOWN__QueryTest( void ) {
+}
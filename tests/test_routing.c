@@ -30,6 +30,7 @@ void __CUT__Routing_operations()
   Member *member = calloc(1, sizeof(Member));
   member->routes = Heap_create(NULL);
   Node *node = NULL;
+  Node *lazy = NULL;
   int rc = 0;
 
   tests[0] = bfromcstr("[ [ \"now\" when shutdown ");
@@ -54,6 +55,11 @@ void __CUT__Routing_operations()
     ASSERT_EQUALS(Heap_count(route->members), 1, "failed to add member");
     ASSERT_EQUALS(Heap_count(member->routes), i+1, "failed to add member");
 
+    // the route groups can be left unparsed and still be found
+    lazy = Node_parse_lazy(bstrcpy(tests[i]), 1);
+    ASSERT(lazy != NULL && Route_find(routes, lazy) == route, "lazy parse found a different route");
+    Node_destroy(lazy);
+
     Node_destroy(node);
   }
 
@@ -0,0 +1,146 @@
+/*
+ * Utu -- Saving The Internet With Hate
+ *
+ * Copyright (c) Zed A. Shaw 2005 (zedshaw@zedshaw.com)
+ *
+ * This file is modifiable/redistributable under the terms of the GNU
+ * General Public License.
+ *
+ * You should have recieved a copy of the GNU General Public License along
+ * with this program; see the file COPYING. If not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 0211-1307, USA.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cut.h"
+#include "stackish/stackish.h"
+#include "stackish/scan.h"
+
+#define SCAN_TEST_BUF 200
+
+/** Mostly letters so the runs get long, with a few of every byte that ends one. */
+static void scan_test_fill(char *buf, size_t len)
+{
+  static const char ends[] = " \t\n\v\f\r[]\"'";
+  size_t i = 0;
+
+  for(i = 0; i < len; i++) {
+    switch(rand() % 40) {
+      case 0: buf[i] = ends[rand() % (sizeof(ends) - 1)]; break;
+      case 1: buf[i] = (char)(rand() % 256); break;
+      case 2: case 3: case 4: buf[i] = ' '; break;
+      default: buf[i] = 'a' + rand() % 26; break;
+    }
+  }
+}
+
+void __CUT_BRINGUP__ScanTest( void ) {
+  srand(2005);
+}
+
+void __CUT__Stackish_scan_matches_scalar()
+{
+  char buf[SCAN_TEST_BUF];
+  const char *expect[3] = {NULL};
+  int round = 0, kind = 0, wrong = 0;
+  size_t start = 0, end = 0;
+  StackishScanKind best = Stackish_scan_kind();
+
+  for(round = 0; round < 20; round++) {
+    scan_test_fill(buf, sizeof(buf));
+
+    // every start and end so the vector loops stop at every spot in a block
+    for(start = 0; start < sizeof(buf); start += 3) {
+      for(end = start; end <= sizeof(buf); end++) {
+        Stackish_scan_use(STACKISH_SCAN_SCALAR);
+        expect[0] = Stackish_scan_delimiter(buf + start, buf + end);
+        expect[1] = Stackish_scan_quote(buf + start, buf + end);
+        expect[2] = Stackish_scan_space(buf + start, buf + end);
+
+        for(kind = STACKISH_SCAN_SSE2; kind <= (int)best; kind++) {
+          Stackish_scan_use(kind);
+          wrong += Stackish_scan_delimiter(buf + start, buf + end) != expect[0];
+          wrong += Stackish_scan_quote(buf + start, buf + end) != expect[1];
+          wrong += Stackish_scan_space(buf + start, buf + end) != expect[2];
+        }
+      }
+    }
+  }
+
+  ASSERT_EQUALS(wrong, 0, "vector scans found a different end than scalar");
+  ASSERT_EQUALS(Stackish_scan_use(best), best, "couldn't go back to the best scanner");
+}
+
+/** Something like what goes through a hub, chat lines, blobs, and the small header groups. */
+void __CUT__Stackish_scan_group()
+{
+  struct { const char *doc; const char *rest; const char *word; } good[] = {
+    { "[ 1 2 ] tail", " tail", NULL },
+    { "[ [ \"a ] b\" inner ] @x 'after' ", " @x 'after' ", NULL },
+    { "[ '7:[ ] no ' 1.5 -2.25 @attr word next", " next", "word" },
+    { "[[1]x]", "]", "x" },
+    { NULL, NULL, NULL }
+  };
+  const char *bad[] = { "[ 1 2 ", "[ @x ]", "[ 1 $ ]", "[ '9:abc' ]", "[ 1. ]", "[ \"open ]", "1 ]", "[ ':' ]", NULL };
+  const char *end = NULL, *word = NULL;
+  size_t length = 0;
+  int i = 0, wrong = 0;
+
+  for(i = 0; good[i].doc != NULL; i++) {
+    end = Stackish_scan_group(good[i].doc, good[i].doc + strlen(good[i].doc), 8, 8, &word, &length);
+
+    if(end == NULL || strcmp(end, good[i].rest) != 0) wrong++;
+    else if(good[i].word ? word == NULL || strncmp(word, good[i].word, length) != 0 : word != NULL) wrong++;
+  }
+
+  ASSERT_EQUALS(wrong, 0, "valid groups scanned wrong");
+
+  for(i = 0, wrong = 0; bad[i] != NULL; i++) {
+    wrong += Stackish_scan_group(bad[i], bad[i] + strlen(bad[i]), 8, 8, &word, &length) != NULL;
+  }
+
+  ASSERT_EQUALS(wrong, 0, "invalid groups scanned");
+
+  // three deep and three wide is fine, but not four
+  end = "[ [ [ 1 2 3 ] ] ] ";
+  ASSERT(Stackish_scan_group(end, end + strlen(end), 3, 3, &word, &length) != NULL, "limits were off by one");
+  ASSERT(Stackish_scan_group(end, end + strlen(end), 2, 3, &word, &length) == NULL, "went too deep");
+  ASSERT(Stackish_scan_group(end, end + strlen(end), 3, 2, &word, &length) == NULL, "went too wide");
+}
+
+/** Node_parse skips string contents with Stackish_scan_quote, so every scanner has to land on the same closing quote. */
+void __CUT__Stackish_scan_parse_strings()
+{
+  size_t lengths[] = { 0, 1, 15, 16, 17, 31, 32, 33, 100 };
+  StackishScanKind best = Stackish_scan_kind();
+  bstring doc = NULL;
+  Node *node = NULL;
+  int kind = 0, wrong = 0;
+  size_t i = 0, j = 0;
+
+  for(kind = STACKISH_SCAN_SCALAR; kind <= (int)best; kind++) {
+    Stackish_scan_use(kind);
+
+    for(i = 0; i < sizeof(lengths) / sizeof(size_t); i++) {
+      doc = bfromcstr("[ \"");
+      // brackets and spaces in the string shouldn't end it early
+      for(j = 0; j < lengths[i]; j++) bconchar(doc, " ][a"[j % 4]);
+      bcatcstr(doc, "\" @text ] ");
+
+      node = Node_parse(doc);
+      if(node == NULL || node->child == NULL || node->child->type != TYPE_STRING 
+          || (size_t)blength(node->child->value.string) != lengths[i]) wrong++;
+      if(node) Node_destroy(node);
+      bdestroy(doc);
+    }
+  }
+
+  Stackish_scan_use(best);
+  ASSERT_EQUALS(wrong, 0, "parsed strings came out wrong with some scanner");
+}
+
+void __CUT_TAKEDOWN__ScanTest( void ) {
+}
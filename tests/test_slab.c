@@ -0,0 +1,105 @@
+/*
+ * Utu -- Saving The Internet With Hate
+ *
+ * Copyright (c) Zed A. Shaw 2005 (zedshaw@zedshaw.com)
+ *
+ * This file is modifiable/redistributable under the terms of the GNU
+ * General Public License.
+ *
+ * You should have recieved a copy of the GNU General Public License along
+ * with this program; see the file COPYING. If not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 0211-1307, USA.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cut.h"
+#include "protocol/slab.h"
+#include "protocol/message.h"
+
+static int slab_test_allocs = 0;
+
+void *slab_test_alloc(size_t size)
+{
+  slab_test_allocs++;
+  return calloc(1, size);
+}
+
+void slab_test_release(void *ptr, size_t size)
+{
+  slab_test_allocs--;
+  free(ptr);
+}
+
+void __CUT_BRINGUP__SlabTest( void )
+{
+  Slab_trim(0);
+}
+
+void __CUT__Slab_reuse()
+{
+  SlabStats before = Slab_stats();
+  SlabStats after;
+  char *block = Slab_calloc(100);
+  char *again = NULL;
+
+  ASSERT(block != NULL, "failed to allocate");
+  memset(block, 'x', 100);
+  Slab_free(block, 100);
+
+  // same size class comes back off the freelist and zeroed
+  again = Slab_calloc(90);
+  ASSERT(again == block, "didn't reuse the freed block");
+  ASSERT(again[0] == 0 && again[89] == 0, "reused block wasn't zeroed");
+  Slab_free(again, 90);
+
+  // too big just goes to malloc
+  block = Slab_calloc(SLAB_MAX_SIZE + 1);
+  ASSERT(block != NULL, "big allocation failed");
+  Slab_free(block, SLAB_MAX_SIZE + 1);
+
+  after = Slab_stats();
+  ASSERT_EQUALS(after.allocs - before.allocs, 3, "wrong alloc count");
+  ASSERT_EQUALS(after.frees - before.frees, 3, "wrong free count");
+  ASSERT_EQUALS(after.hits - before.hits, 1, "wrong hit count");
+}
+
+void __CUT__Slab_trim()
+{
+  void *blocks[SLAB_MAX_FREE + 1];
+  int i = 0;
+  SlabStats stats;
+
+  for(i = 0; i < SLAB_MAX_FREE + 1; i++) blocks[i] = Slab_calloc(SLAB_MIN_SIZE);
+  for(i = 0; i < SLAB_MAX_FREE + 1; i++) Slab_free(blocks[i], SLAB_MIN_SIZE);
+
+  // going over the max trims it back to half
+  stats = Slab_stats();
+  ASSERT(stats.free_blocks <= SLAB_MAX_FREE, "freelist wasn't trimmed");
+
+  Slab_trim(0);
+  stats = Slab_stats();
+  ASSERT_EQUALS(stats.free_blocks, 0, "trim didn't free everything");
+}
+
+void __CUT__Slab_message_allocator()
+{
+  MessageAllocator counting = { slab_test_alloc, slab_test_release };
+  Message *msg = NULL;
+
+  Message_set_allocator(&counting);
+  msg = Message_alloc(NULL, NULL);
+  Message_ref_inc(msg);
+  ASSERT_EQUALS(slab_test_allocs, 1, "message didn't use the allocator");
+  Message_destroy(msg);
+  ASSERT_EQUALS(slab_test_allocs, 0, "message wasn't released");
+
+  Message_set_allocator(NULL);
+}
+
+void __CUT_TAKEDOWN__SlabTest( void )
+{
+  Slab_trim(0);
+}
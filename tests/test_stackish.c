@@ -111,5 +111,255 @@ void __CUT__Stackish_multi_in_bstring()
   bdestroy(multi);
 }
 
+void __CUT__Stackish_interned_names()
+{
+  size_t i = 0;
+  bstring doc = bfromcstr("[ \"fred\" @to [ [ [ 1 unusual-word send member msg\n");
+  Node *parsed = Node_parse(doc);
+  Node *arena = Node_parse_arena(doc);
+  Node *built = Node_cons("[s@[[[nwwww", bfromcstr("fred"), "@to", (uint64_t)1, "unusual-word", "send", "member", "msg");
+  bstring out = NULL;
+
+  for(i = 1; i < NODE_INTERNED_COUNT; i++) {
+    ASSERT(bstrcmp(&NODE_INTERNED[i-1], &NODE_INTERNED[i]) < 0, "interned names aren't sorted");
+  }
+
+  for(i = 0; i < NODE_INTERNED_COUNT; i++) {
+    ASSERT(Node_intern((const char *)NODE_INTERNED[i].data, NODE_INTERNED[i].slen) == &NODE_INTERNED[i], "didn't find an interned name");
+  }
+
+  ASSERT(Node_intern("ms", 2) == NULL, "found a prefix");
+  ASSERT(Node_intern("msgs", 4) == NULL, "found a longer word");
+  ASSERT(Node_intern("", 0) == NULL, "found an empty word");
+
+  // the parser, arena parser and Node_cons all share the same names
+  ASSERT(parsed->name == Node_intern("msg", 3), "parser didn't intern msg");
+  ASSERT(parsed->name == arena->name, "arena parser didn't intern msg");
+  ASSERT(parsed->name == built->name, "Node_cons didn't intern msg");
+  ASSERT(parsed->child->sibling->name == built->child->sibling->name, "didn't intern the @to attribute");
+  ASSERT(Node_is_interned(parsed->child->child->name), "didn't intern send");
+  ASSERT(!Node_is_interned(parsed->child->child->child->name), "interned an uncommon word");
+  ASSERT(biseqcstr(parsed->child->child->child->name, "unusual-word"), "wrong uncommon word");
+
+  // renaming and destroying leave the shared names alone
+  Node_name(parsed, bfromcstr("other"));
+  Node_name(built, Node_name_str(built, "rpy", 3));
+  ASSERT(biseqcstr(Node_intern("msg", 3), "msg"), "interned name was changed");
+
+  out = Node_bstr(built, 1);
+  ASSERT(biseqcstr(out, "[ \"fred\" @to [ [ [ 1 unusual-word send member rpy \n"), "wrong output with interned names");
+
+  bdestroy(out);
+  Node_destroy(parsed);
+  Node_destroy(arena);
+  Node_destroy(built);
+  bdestroy(doc);
+}
+
+/** The shortest %e that reads back, written out without the exponent. */
+static void reference_float(bstring str, double floating)
+{
+  char e[40], digits[20];
+  int precision = 0, length = 0, point = 0, i = 0;
+  char *c = e;
+
+  for(precision = 0; precision < 17; precision++) {
+    sprintf(e, "%.*e", precision, floating);
+    if(strtod(e, NULL) == floating) break;
+  }
+
+  if(*c == '-') bconchar(str, *c++);
+  for(; *c != 'e'; c++) if(*c != '.') digits[length++] = *c;
+  point = atoi(c + 1) + 1;
+
+  if(floating == 0.0) {
+    bcatcstr(str, "0.0");
+  } else if(point <= 0) {
+    bcatcstr(str, "0.");
+    for(i = point; i < 0; i++) bconchar(str, '0');
+    bcatblk(str, (const unsigned char *)digits, length);
+  } else if(point < length) {
+    bcatblk(str, (const unsigned char *)digits, point);
+    bconchar(str, '.');
+    bcatblk(str, (const unsigned char *)digits + point, length - point);
+  } else {
+    bcatblk(str, (const unsigned char *)digits, length);
+    for(i = length; i < point; i++) bconchar(str, '0');
+    bcatcstr(str, ".0");
+  }
+}
+
+/** The bformata serializer Node_catbstr replaced, kept to check against. */
+static void reference_catbstr(bstring str, Node *d, char sep, int follow_sibs) 
+{
+  if(d == NULL) return;
+
+  if(d->sibling != NULL && follow_sibs) reference_catbstr(str, d->sibling, sep, follow_sibs);
+  if(d->type == TYPE_GROUP) bformata(str, "[%c", sep);
+  if(d->child != NULL) reference_catbstr(str, d->child, sep, 1);
+
+  switch(d->type) {
+    case TYPE_BLOB:
+      bformata(str, "'%zu:" , blength(d->value.string));
+      bconcat(str, d->value.string);
+      bformata(str, "\'%c", sep);
+      break;
+    case TYPE_STRING: bformata(str, "\"%s\"%c" , bdata(d->value.string), sep); break;
+    case TYPE_NUMBER: bformata(str, "%llu%c", d->value.number, sep); break;
+    case TYPE_FLOAT: reference_float(str, d->value.floating); bconchar(str, sep); break;
+    case TYPE_GROUP: if(!d->name || bchar(d->name, 0) == '@') bformata(str, "]%c", sep); break;
+    default: break;
+  }
+
+  if(d->name != NULL) bformata(str, "%s%c", bdata(d->name), sep); 
+}
+
+static uint64_t stackish_test_seed = 1;
+
+static uint64_t stackish_test_rand()
+{
+  stackish_test_seed = stackish_test_seed * 6364136223846793005ULL + 1442695040888963407ULL;
+  return stackish_test_seed >> 17;
+}
+
+static Node *stackish_test_tree(Node *parent, int depth)
+{
+  int i = 0;
+  int count = stackish_test_rand() % 6;
+  uint64_t numbers[] = {0, 9, 10, 99, 1234567890ULL, 18446744073709551615ULL};
+  double floats[] = {0.0, -1.5, 345.78, 1e20, 1e-9, 123456789.123};
+  char blob[] = "bl\0b'[]\n\"";
+  Node *group = Node_new_group(parent);
+  Node *n = NULL;
+
+  for(i = 0; i < count; i++) {
+    switch(stackish_test_rand() % 6) {
+      case 0: n = Node_new_number(group, numbers[stackish_test_rand() % 6]); break;
+      case 1: n = Node_new_float(group, floats[stackish_test_rand() % 6]); break;
+      case 2: n = Node_new_blob(group, blk2bstr(blob, stackish_test_rand() % sizeof(blob))); break;
+      case 3: n = Node_new_string(group, bfromcstr(i % 2 ? "" : "a string")); break;
+      default: n = depth > 0 ? stackish_test_tree(group, depth - 1) : Node_new_number(group, i); break;
+    }
+
+    if(stackish_test_rand() % 3 == 0) Node_name(n, bfromcstr("@attr"));
+  }
+
+  switch(stackish_test_rand() % 3) {
+    case 0: Node_name(group, bfromcstr("word")); break;
+    case 1: Node_name(group, bfromcstr("@attr-group")); break;
+    default: break;
+  }
+
+  return group;
+}
+
+void __CUT__Stackish_serialize_matches_reference()
+{
+  int i = 0;
+  bstring doc = bfromcstr("[ [ \"test this\" good [ 1234 @an:integer 345.78 @a-float '5:hello' @blob test [ 1 2 3 ] doc\n");
+  Node *trees[202] = {NULL};
+  Node *n = NULL;
+  bstring expect = NULL, got = NULL;
+
+  trees[0] = Node_parse(doc);
+  trees[1] = Node_parse_arena(doc);
+
+  for(i = 2; i < 202; i++) {
+    trees[i] = stackish_test_tree(NULL, 4);
+  }
+
+  for(i = 0; i < 202; i++) {
+    // same bytes with the usual sep, a different sep, and without siblings
+    expect = bfromcstr(""); reference_catbstr(expect, trees[i], ' ', 1); bconchar(expect, '\n');
+    got = Node_bstr(trees[i], 1);
+    ASSERT(biseq(expect, got), "Node_bstr doesn't match the reference");
+    ASSERT_EQUALS(Node_serialized_length(trees[i], ' ', 1) + 1, (size_t)blength(got), "wrong length");
+    bdestroy(expect); bdestroy(got);
+
+    for(n = trees[i]->child; n != NULL; n = n->sibling) {
+      expect = bfromcstr(">"); reference_catbstr(expect, n, '\n', 0);
+      got = bfromcstr(">"); Node_catbstr(got, n, '\n', 0);
+      ASSERT(biseq(expect, got), "Node_catbstr doesn't match the reference");
+      bdestroy(expect); bdestroy(got);
+    }
+
+    Node_destroy(trees[i]);
+  }
+
+  bdestroy(doc);
+}
+
+/** Makes a [ [ [ ... ] ] ] document nested depth deep with a 1 at the bottom. */
+static bstring stackish_test_deep(size_t depth)
+{
+  size_t i = 0;
+  bstring doc = bfromcstr("");
+
+  for(i = 0; i < depth; i++) bcatcstr(doc, "[ ");
+  bcatcstr(doc, "1 ");
+  for(i = 0; i < depth; i++) bcatcstr(doc, "] ");
+  bcatcstr(doc, "\n");
+
+  return doc;
+}
+
+void __CUT__Stackish_wide_and_deep()
+{
+  size_t i = 0;
+  NodeLimits saved = NODE_LIMITS;
+  Node *wide = Node_new_group(NULL);
+  Node *deep = Node_new_group(NULL), *n = deep;
+  Node *parsed = NULL;
+  bstring out = NULL, again = NULL, doc = NULL;
+
+  for(i = 0; i < 10000; i++) Node_new_number(wide, i);
+  Node_name(wide, bfromcstr("wide"));
+
+  out = Node_bstr(wide, 1);
+  ASSERT(!strncmp((const char *)out->data, "[ 0 1 2 ", 8), "wide list starts wrong");
+  ASSERT(!strcmp((const char *)out->data + blength(out) - 11, "9999 wide \n"), "wide list ends wrong");
+
+  parsed = Node_parse(out);
+  ASSERT(parsed != NULL, "failed to parse a 10000 wide list");
+  again = Node_bstr(parsed, 1);
+  ASSERT(biseq(out, again), "wide list didn't round trip");
+  bdestroy(again);
+  Node_destroy(parsed);
+
+  // one under the width passes, then it fails
+  NODE_LIMITS.width = 10000;
+  parsed = Node_parse(out);
+  ASSERT(parsed != NULL, "a list at the width limit failed");
+  Node_destroy(parsed);
+
+  Node_new_number(wide, 10000);
+  bdestroy(out);
+  out = Node_bstr(wide, 1);
+  ASSERT(Node_parse(out) == NULL, "a list over the width limit parsed");
+  NODE_LIMITS = saved;
+
+  // way deeper than any parser would allow, it still serializes and destroys
+  for(i = 0; i < 100000; i++) n = Node_new_group(n);
+  Node_new_number(n, 1);
+  bdestroy(out);
+  out = Node_bstr(deep, 1);
+  ASSERT_EQUALS((size_t)blength(out), 100001 * 4 + 2 + 1, "wrong length for the deep tree");
+
+  doc = stackish_test_deep(NODE_LIMITS.depth);
+  parsed = Node_parse(doc);
+  ASSERT(parsed != NULL, "failed to parse at the depth limit");
+  Node_destroy(parsed);
+  bdestroy(doc);
+
+  doc = stackish_test_deep(NODE_LIMITS.depth + 1);
+  ASSERT(Node_parse(doc) == NULL, "parsed past the depth limit");
+  ASSERT(Node_parse_arena(doc) == NULL, "parsed past the depth limit in an arena");
+
+  bdestroy(doc);
+  bdestroy(out);
+  Node_destroy(wide);
+  Node_destroy(deep);
+}
+
 void __CUT_TAKEDOWN__StackishTest( void ) {
 }
@@ -0,0 +1,175 @@
+/*
+ * Utu -- Saving The Internet With Hate
+ *
+ * Copyright (c) Zed A. Shaw 2005 (zedshaw@zedshaw.com)
+ *
+ * This file is modifiable/redistributable under the terms of the GNU
+ * General Public License.
+ *
+ * You should have recieved a copy of the GNU General Public License along
+ * with this program; see the file COPYING. If not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 0211-1307, USA.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cut.h"
+#include "stackish/stackish.h"
+#include "stackish/stream.h"
+
+static const char *stream_test_docs[] = {
+  "[ [ \"test this\" good [ 1234 @an:integer 345.78 @a-float '5:hello' @blob test [ 1 2 3 ] doc \n",
+  "[ [ [ [ [ [ [ [ one two three four five six seven eight \n",
+  "[ '0:' @empty '12:[ \"quoted\" ]' \"a string with ' and [ in it\" -1.5 msg \n",
+  "[ 18446744073709551615 [ ] ] \n",
+  NULL
+};
+
+/** Feeds the whole stream in chunks of size step, gives back the documents it got. */
+static int stream_test_feed(StackishStream *stream, bstring input, size_t step, Node **docs)
+{
+  size_t at = 0, len = 0;
+  int ndocs = 0;
+
+  while(at < (size_t)blength(input)) {
+    len = blength(input) - at < step ? blength(input) - at : step;
+
+    // a chunk can have the end of one document and the start of the next
+    while(len > 0) {
+      size_t used = StackishStream_feed(stream, (const char *)bdata(input) + at, len);
+      at += used;
+      len -= used;
+
+      if(StackishStream_done(stream)) docs[ndocs++] = StackishStream_take(stream);
+      if(StackishStream_has_error(stream)) return -1;
+    }
+  }
+
+  return ndocs;
+}
+
+void __CUT_BRINGUP__StreamTest( void ) {
+}
+
+void __CUT__StackishStream_chunks()
+{
+  int i = 0, n = 0;
+  size_t step = 0;
+  bstring input = bfromcstr("");
+  bstring expect = NULL, got = NULL;
+  Node *docs[8] = {NULL};
+  StackishStream *stream = NULL;
+
+  for(i = 0; stream_test_docs[i] != NULL; i++) {
+    bcatcstr(input, stream_test_docs[i]);
+  }
+
+  // every chunk size from byte at a time up to all at once splits tokens and blobs everywhere
+  for(step = 1; step <= (size_t)blength(input); step++) {
+    stream = StackishStream_create(step % 2);
+    n = stream_test_feed(stream, input, step, docs);
+    ASSERT_EQUALS(n, 4, "didn't get every document");
+
+    for(i = 0; i < n; i++) {
+      expect = bfromcstr(stream_test_docs[i]);
+      got = Node_bstr(docs[i], 1);
+      ASSERT(biseq(expect, got), "streamed document is different");
+      ASSERT((docs[i]->arena != NULL) == (step % 2), "wrong arena use");
+      bdestroy(expect); bdestroy(got);
+      Node_destroy(docs[i]);
+    }
+
+    ASSERT_EQUALS(stream->nread, (size_t)blength(input), "didn't read everything");
+    StackishStream_destroy(stream);
+  }
+
+  bdestroy(input);
+}
+
+void __CUT__StackishStream_finish()
+{
+  StackishStream *stream = StackishStream_create(0);
+  Node *doc = NULL;
+
+  // the last word can't be done until there's no more input
+  StackishStream_feed(stream, "[ 1 2 do", 8);
+  StackishStream_feed(stream, "c", 1);
+  ASSERT(!StackishStream_done(stream), "done before the end of the word");
+  ASSERT_EQUALS(StackishStream_finish(stream), 1, "finish didn't end the document");
+
+  doc = StackishStream_take(stream);
+  ASSERT(doc != NULL && biseqcstr(doc->name, "doc"), "wrong document");
+  ASSERT(StackishStream_take(stream) == NULL, "took the same document twice");
+  Node_destroy(doc);
+
+  // half a document isn't an error, but isn't done either
+  StackishStream_feed(stream, "[ '10:hel", 9);
+  ASSERT_EQUALS(StackishStream_finish(stream), 0, "half a document was done");
+
+  StackishStream_destroy(stream);
+}
+
+void __CUT__StackishStream_errors()
+{
+  const char *bad[] = {
+    "1 [ msg ", "] ", "[ 12ab msg ", "[ 1.2.3 msg ", "[ @attr msg ", "[ 1 @9bad msg ",
+    "[ 'x:' msg ", "[ '3:abcd' msg ", "[ '99999999999:' msg ", "[ - msg ", "[ 1. msg ",
+    NULL
+  };
+  int i = 0;
+  StackishStream *stream = NULL;
+
+  for(i = 0; bad[i] != NULL; i++) {
+    stream = StackishStream_create(i % 2);
+    StackishStream_feed(stream, bad[i], strlen(bad[i]));
+    ASSERT(StackishStream_has_error(stream), "bad input was accepted");
+    ASSERT_EQUALS(StackishStream_feed(stream, " ", 1), 0, "kept going after an error");
+    StackishStream_destroy(stream);
+  }
+}
+
+void __CUT__StackishStream_limits()
+{
+  NodeLimits saved = NODE_LIMITS;
+  StackishStream *stream = NULL;
+  const char *ok = "[ [ [ 1 2 ] ] ] ";
+  const char *deep = "[ [ [ [ 1 ] ] ] ] ";
+  const char *wide = "[ [ [ 1 2 3 ] ] ] ";
+  const char *wide_blob = "[ [ [ 1 2 '1:x' ] ] ] ";
+
+  NODE_LIMITS.depth = 3;
+  NODE_LIMITS.width = 2;
+
+  stream = StackishStream_create(0);
+  StackishStream_feed(stream, ok, strlen(ok));
+  ASSERT(StackishStream_done(stream), "failed at the limits");
+  Node_destroy(StackishStream_take(stream));
+
+  // the counts start over for the next document on the same stream
+  StackishStream_feed(stream, ok, strlen(ok));
+  ASSERT(StackishStream_done(stream), "second document failed at the limits");
+  Node_destroy(StackishStream_take(stream));
+  StackishStream_destroy(stream);
+
+  stream = StackishStream_create(1);
+  StackishStream_feed(stream, deep, strlen(deep));
+  ASSERT(StackishStream_has_error(stream), "went past the depth limit");
+  StackishStream_destroy(stream);
+
+  stream = StackishStream_create(0);
+  StackishStream_feed(stream, wide, strlen(wide));
+  ASSERT(StackishStream_has_error(stream), "went past the width limit");
+  StackishStream_destroy(stream);
+
+  stream = StackishStream_create(0);
+  StackishStream_feed(stream, wide_blob, strlen(wide_blob));
+  ASSERT(StackishStream_has_error(stream), "a blob went past the width limit");
+  StackishStream_destroy(stream);
+
+  NODE_LIMITS = saved;
+}
+
+void __CUT_TAKEDOWN__StreamTest( void ) {
+}
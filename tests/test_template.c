@@ -0,0 +1,125 @@
+/*
+ * Utu -- Saving The Internet With Hate
+ *
+ * Copyright (c) Zed A. Shaw 2005 (zedshaw@zedshaw.com)
+ *
+ * This file is modifiable/redistributable under the terms of the GNU
+ * General Public License.
+ *
+ * You should have recieved a copy of the GNU General Public License along
+ * with this program; see the file COPYING. If not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 0211-1307, USA.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cut.h"
+#include "stackish/stackish.h"
+#include "stackish/template.h"
+
+void __CUT_BRINGUP__TemplateTest( void ) {
+}
+
+void __CUT__NodeTemplate_cons_matches()
+{
+  NodeTemplate *tmpl = NodeTemplate_create("[[bbbw[bbww", "message", "identity", "signed");
+  Node *expect = NULL, *got = NULL;
+  bstring expect_str = NULL, got_str = NULL;
+
+  ASSERT(tmpl != NULL, "failed to make template");
+
+  expect = Node_cons("[[bbbw[bbww", bfromcstr("payload"), bfromcstr("hash"), bfromcstr("sig"), "message",
+      bfromcstr("zed"), bfromcstr("key"), "identity", "signed");
+  got = NodeTemplate_cons(tmpl, bfromcstr("payload"), bfromcstr("hash"), bfromcstr("sig"),
+      bfromcstr("zed"), bfromcstr("key"));
+
+  expect_str = Node_bstr(expect, 1);
+  got_str = Node_bstr(got, 1);
+  ASSERT(biseq(expect_str, got_str), "template built something different");
+
+  bdestroy(expect_str); bdestroy(got_str);
+  Node_destroy(expect); Node_destroy(got);
+  NodeTemplate_destroy(tmpl);
+
+  // every value type and attributes, with interned and plain words
+  tmpl = NodeTemplate_create("[n@f@s@b@[]w", "@to", "@a-float", "@from", "@blob", "chat.speak");
+  expect = Node_cons("[n@f@s@b@[]w", (uint64_t)12, "@to", -1.5, "@a-float", bfromcstr("hi"), "@from", 
+      bfromcstr("data"), "@blob", "chat.speak");
+  got = NodeTemplate_cons(tmpl, (uint64_t)12, -1.5, bfromcstr("hi"), bfromcstr("data"));
+
+  expect_str = Node_bstr(expect, 1);
+  got_str = Node_bstr(got, 1);
+  ASSERT(biseq(expect_str, got_str), "template built something different");
+  ASSERT(Node_is_interned(got->child->sibling->sibling->sibling->sibling->name), "@to wasn't interned");
+
+  bdestroy(expect_str); bdestroy(got_str);
+  Node_destroy(expect); Node_destroy(got);
+  NodeTemplate_destroy(tmpl);
+}
+
+void __CUT__NodeTemplate_decons_matches()
+{
+  NodeTemplate *tmpl = NodeTemplate_create("[[bbw[bbbww", "identity", "message", "signed");
+  NodeTemplate *wrong = NodeTemplate_create("[[bbw[bbbww", "identity", "message", "unsigned");
+  bstring text = bfromcstr("[ [ '7:payload' '4:hash' '3:sig' message [ '3:zed' '3:key' identity signed \n");
+  Node *doc = NULL;
+  bstring name = NULL, key = NULL, sig = NULL, hash = NULL, payload = NULL;
+  bstring e_name = NULL, e_key = NULL, e_sig = NULL, e_hash = NULL, e_payload = NULL;
+
+  doc = Node_parse(text);
+  ASSERT(doc != NULL, "test doc didn't parse");
+
+  ASSERT(Node_decons(doc, 0, "[[bbw[bbbww", &e_key, &e_name, "identity", &e_sig, &e_hash, &e_payload, "message", "signed"),
+      "plain decons failed");
+  ASSERT(NodeTemplate_decons(tmpl, doc, 0, &key, &name, &sig, &hash, &payload), "template decons failed");
+  ASSERT(key == e_key && name == e_name && sig == e_sig && hash == e_hash && payload == e_payload,
+      "template found different nodes");
+  ASSERT(biseqcstr(name, "zed") && biseqcstr(payload, "payload"), "wrong values");
+
+  ASSERT(!NodeTemplate_decons(wrong, doc, 0, &key, &name, &sig, &hash, &payload), "wrong word matched");
+
+  // copies are copies
+  ASSERT(NodeTemplate_decons(tmpl, doc, 1, &key, &name, &sig, &hash, &payload), "template copy decons failed");
+  ASSERT(key != e_key && biseq(key, e_key), "didn't copy");
+  bdestroy(key); bdestroy(name); bdestroy(sig); bdestroy(hash); bdestroy(payload);
+
+  bdestroy(text);
+  Node_destroy(doc);
+  NodeTemplate_destroy(tmpl);
+  NodeTemplate_destroy(wrong);
+}
+
+void __CUT__NodeTemplate_errors()
+{
+  static NodeTemplate *shared = NULL;
+  NodeTemplate *first = NULL, *floats = NULL, *deeper = NULL;
+  Node *doc = NULL;
+  uint64_t number = 0;
+  double floating = 0;
+
+  ASSERT(NodeTemplate_create("[nx") == NULL, "invalid format made a template");
+
+  first = NodeTemplate_once(shared, "[nw", "header");
+  ASSERT(first != NULL && NodeTemplate_once(shared, "[nw", "header") == first, "once made it twice");
+  ASSERT(NodeTemplate_install(&shared, NodeTemplate_create("[nw", "header")) == first, "install replaced it");
+
+  // wrong types and running out of nodes fail just like Node_decons
+  doc = NodeTemplate_cons(shared, (uint64_t)10);
+  ASSERT(NodeTemplate_decons(shared, doc, 0, &number) && number == 10, "didn't get the number back");
+
+  floats = NodeTemplate_create("[fw", "header");
+  ASSERT(!NodeTemplate_decons(floats, doc, 0, &floating), "read a number as a float");
+
+  deeper = NodeTemplate_create("[nwn", "header");
+  ASSERT(!NodeTemplate_decons(deeper, doc, 0, &number, &number), "read past the root");
+
+  Node_destroy(doc);
+  NodeTemplate_destroy(floats);
+  NodeTemplate_destroy(deeper);
+  NodeTemplate_destroy(shared);
+}
+
+void __CUT_TAKEDOWN__TemplateTest( void ) {
+}
@@ -0,0 +1,78 @@
+/*
+ * Utu -- Saving The Internet With Hate
+ *
+ * Copyright (c) Zed A. Shaw 2005 (zedshaw@zedshaw.com)
+ *
+ * This file is modifiable/redistributable under the terms of the GNU
+ * General Public License.
+ *
+ * You should have recieved a copy of the GNU General Public License along
+ * with this program; see the file COPYING. If not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 0211-1307, USA.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "cut.h"
+#include "protocol/trace.h"
+
+void __CUT_BRINGUP__TraceTest( void )
+{
+  Trace_reset();
+}
+
+void __CUT__Trace_clock()
+{
+  uint64_t first = Trace_now_ns();
+  uint64_t second = Trace_now_ns();
+
+  ASSERT(first > 0, "clock gave 0");
+  ASSERT(second >= first, "clock went backwards");
+}
+
+void __CUT__Trace_sample()
+{
+  int i = 0;
+  int sampled = 0;
+  unsigned int rate = Trace_sample_rate;
+
+  Trace_sample_rate = 10;
+  for(i = 0; i < 100; i++) sampled += Trace_sample();
+  ASSERT_EQUALS(sampled, 10, "wrong number sampled");
+
+  Trace_sample_rate = 0;
+  for(i = 0, sampled = 0; i < 100; i++) sampled += Trace_sample();
+  ASSERT_EQUALS(sampled, 0, "sampled with tracing off");
+
+  Trace_sample_rate = rate;
+}
+
+void __CUT__Trace_histogram()
+{
+  const TraceHistogram *hist = Trace_histogram(TRACE_QUEUE);
+  int i = 0;
+
+  for(i = 0; i < 98; i++) Trace_record(TRACE_QUEUE, 1000, 1100);
+  Trace_record(TRACE_QUEUE, 1000, 1000 + 5000);
+  Trace_record(TRACE_QUEUE, 1000, 1000 + 1000000);
+
+  // missing stamps don't count
+  Trace_record(TRACE_QUEUE, 0, 1000);
+  Trace_record(TRACE_QUEUE, 2000, 1000);
+
+  ASSERT_EQUALS(hist->count, 100, "wrong count");
+  ASSERT_EQUALS(hist->max_ns, 1000000, "wrong max");
+  ASSERT(TraceHistogram_percentile(hist, 50) >= 100, "p50 too low");
+  ASSERT(TraceHistogram_percentile(hist, 50) < 200, "p50 too high");
+  ASSERT(TraceHistogram_percentile(hist, 99) >= 5000, "p99 too low");
+  ASSERT_EQUALS(TraceHistogram_percentile(hist, 100), 1000000, "p100 isn't the max");
+  ASSERT_EQUALS(Trace_histogram(TRACE_WRITE)->count, 0, "wrong stage recorded");
+
+  Trace_reset();
+  ASSERT_EQUALS(hist->count, 0, "reset didn't clear");
+}
+
+void __CUT_TAKEDOWN__TraceTest( void )
+{
+}
@@ -0,0 +1,155 @@
+/*
+ * Utu -- Saving The Internet With Hate
+ *
+ * Copyright (c) Zed A. Shaw 2005 (zedshaw@zedshaw.com)
+ *
+ * This file is modifiable/redistributable under the terms of the GNU
+ * General Public License.
+ *
+ * You should have recieved a copy of the GNU General Public License along
+ * with this program; see the file COPYING. If not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 0211-1307, USA.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cut.h"
+#include "stackish/stackish.h"
+#include "stackish/writer.h"
+
+static const char *writer_test_doc =
+  "[ [ [ [ \"hi\" text '3:abc' 12 @id 1.5 [ \"bf27-3806\" @to ] @args send member msg \n";
+
+void __CUT_BRINGUP__WriterTest( void ) {
+}
+
+void __CUT__StackishWriter_node()
+{
+  bstring text = bfromcstr(writer_test_doc);
+  Node *doc = Node_parse(text);
+  bstring expect = NULL;
+  bstring out = bfromcstr("");
+  StackishWriter writer;
+
+  ASSERT(doc != NULL, "failed to parse the test doc");
+  expect = Node_bstr(doc, 1);
+
+  StackishWriter_start(&writer, StackishSink_bstr(out));
+  ASSERT(StackishWriter_node(&writer, doc, 1), "failed to write the doc");
+  ASSERT(StackishWriter_finish(&writer), "failed to finish");
+  ASSERT(biseq(out, expect), "didn't write what Node_bstr makes");
+  ASSERT_EQUALS(writer.written, (size_t)blength(out), "wrong written count");
+
+  // and the same thing a token at a time
+  btrunc(out, 0);
+  StackishWriter_start(&writer, StackishSink_bstr(out));
+  StackishWriter_group(&writer);
+  StackishWriter_group(&writer);
+  StackishWriter_group(&writer);
+  StackishWriter_group(&writer);
+  StackishWriter_cstr(&writer, "hi");
+  StackishWriter_word(&writer, "text");
+  StackishWriter_blob(&writer, "abc", 3);
+  StackishWriter_number(&writer, 12);
+  StackishWriter_attr(&writer, "@id");
+  StackishWriter_float(&writer, 1.5);
+  StackishWriter_group(&writer);
+  StackishWriter_cstr(&writer, "bf27-3806");
+  StackishWriter_attr(&writer, "@to");
+  StackishWriter_end(&writer);
+  StackishWriter_attr(&writer, "@args");
+  StackishWriter_word(&writer, "send");
+  StackishWriter_word(&writer, "member");
+  StackishWriter_word(&writer, "msg");
+  ASSERT(StackishWriter_finish(&writer), "failed to finish");
+  ASSERT(biseq(out, expect), "tokens didn't come out the same as Node_bstr");
+
+  Node_destroy(doc);
+  bdestroy(expect);
+  bdestroy(out);
+  bdestroy(text);
+}
+
+void __CUT__StackishWriter_node_blob()
+{
+  bstring text = bfromcstr(writer_test_doc);
+  Node *doc = Node_parse(text);
+  Node *expect = Node_cons("[b@w", Node_bstr(doc, ' '), "@path", "members");
+  bstring expect_text = Node_bstr(expect, 1);
+  bstring out = bfromcstr("");
+  StackishWriter writer;
+
+  StackishWriter_start(&writer, StackishSink_bstr(out));
+  StackishWriter_group(&writer);
+  StackishWriter_node_blob(&writer, doc, ' ');
+  StackishWriter_attr(&writer, "@path");
+  StackishWriter_word(&writer, "members");
+  ASSERT(StackishWriter_finish(&writer), "failed to finish");
+  ASSERT(biseq(out, expect_text), "blob didn't match Node_bstr in a blob");
+
+  Node_destroy(expect);
+  Node_destroy(doc);
+  bdestroy(expect_text);
+  bdestroy(out);
+  bdestroy(text);
+}
+
+void __CUT__StackishWriter_tee()
+{
+  bstring first = bfromcstr("");
+  bstring second = bfromcstr("");
+  char big[STACKISH_WRITER_BUF * 3];
+  StackishWriter writer;
+  StackishTee tee;
+  Node *blob = NULL;
+
+  memset(big, 'x', sizeof(big));
+  tee.first = StackishSink_bstr(first);
+  tee.second = StackishSink_bstr(second);
+
+  // bigger than the buffer so it goes straight through
+  StackishWriter_start(&writer, StackishSink_tee(&tee));
+  StackishWriter_group(&writer);
+  StackishWriter_cstr(&writer, "before");
+  StackishWriter_blob(&writer, big, sizeof(big));
+  StackishWriter_word(&writer, "data");
+  ASSERT(StackishWriter_finish(&writer), "failed to finish");
+  ASSERT(biseq(first, second), "tee didn't write the same to both");
+  ASSERT_EQUALS(writer.written, (size_t)blength(first), "wrong written count");
+
+  blob = Node_parse(first);
+  ASSERT(blob != NULL, "couldn't parse what was written");
+  ASSERT(blob->child && blob->child->type == TYPE_BLOB, "blob isn't last in the group");
+  ASSERT_EQUALS(blength(blob->child->value.string), (int)sizeof(big), "wrong blob length");
+
+  Node_destroy(blob);
+  bdestroy(first);
+  bdestroy(second);
+}
+
+void __CUT__StackishWriter_failures()
+{
+  bstring out = bfromcstr("");
+  StackishWriter writer;
+
+  StackishWriter_start(&writer, StackishSink_bstr(out));
+  StackishWriter_group(&writer);
+  ASSERT(!StackishWriter_cstr(&writer, "has \" in it"), "wrote a string with a quote");
+  StackishWriter_word(&writer, "data");
+  ASSERT(!StackishWriter_finish(&writer), "failure didn't stick");
+
+  btrunc(out, 0);
+  StackishWriter_start(&writer, StackishSink_bstr(out));
+  ASSERT(!StackishWriter_word(&writer, "data"), "closed a group that wasn't open");
+
+  StackishWriter_start(&writer, StackishSink_bstr(out));
+  StackishWriter_group(&writer);
+  ASSERT(!StackishWriter_finish(&writer), "finished with a group open");
+
+  bdestroy(out);
+}
+
+void __CUT_TAKEDOWN__WriterTest( void ) {
+}